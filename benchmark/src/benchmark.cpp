@@ -0,0 +1,449 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// stop quick benchmarks before they run for millions of iterations
+static constexpr uint64_t MAX_ITERATIONS = 1000000;
+
+struct BenchmarkEntry
+{
+    std::string name;
+    BenchmarkFunction function;
+};
+
+struct BenchmarkRun
+{
+    std::string name;
+
+    // mean, median or stddev, empty for a repetition
+    std::string aggregate;
+    std::string error;
+    uint32_t repetition = 0;
+    uint64_t iterations = 0;
+
+    // nanoseconds per iteration
+    double realTime = 0;
+    double cpuTime = 0;
+
+    // throughputs use the real time since most of the work is done by the thread pool
+    double bytesPerSecond = 0;
+    double itemsPerSecond = 0;
+};
+
+static BenchmarkOptions currentOptions;
+
+// benchmarks are registered during static initialization so the list must be constructed on first use
+static std::vector<BenchmarkEntry>& GetRegistry()
+{
+    static std::vector<BenchmarkEntry> registry;
+
+    return registry;
+}
+
+// only the calling thread like Google Benchmark, work done by the pool is not included
+static double GetThreadCPUTime()
+{
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    ULARGE_INTEGER kernelTime, userTime;
+
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+
+    // 100ns units
+    return static_cast<double>(kernelTime.QuadPart + userTime.QuadPart) * 1e-7;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// BenchmarkState
+//////////////////////////////////////////////////////////////////////////
+BenchmarkState::BenchmarkState(const double minTime)
+    : minTime_{ minTime }
+{
+}
+
+bool BenchmarkState::KeepRunning()
+{
+    if (!started_) {
+        started_ = true;
+        StartTimer();
+
+        return error_.empty();
+    }
+
+    // previous iteration is done
+    ++iterations_;
+
+    auto elapsed = realTime_;
+
+    if (running_)
+        elapsed += std::chrono::duration<double>(Clock::now() - realStart_).count();
+
+    if (error_.empty() && (elapsed < minTime_) && (iterations_ < MAX_ITERATIONS))
+        return true;
+
+    if (running_)
+        StopTimer();
+
+    return false;
+}
+
+void BenchmarkState::PauseTiming()
+{
+    if (running_)
+        StopTimer();
+}
+
+void BenchmarkState::ResumeTiming()
+{
+    if (!running_)
+        StartTimer();
+}
+
+void BenchmarkState::SkipWithError(const std::string_view& error)
+{
+    error_ = error;
+
+    if (running_)
+        StopTimer();
+}
+
+void BenchmarkState::StartTimer()
+{
+    running_ = true;
+    cpuStart_ = GetThreadCPUTime();
+    realStart_ = Clock::now();
+}
+
+void BenchmarkState::StopTimer()
+{
+    realTime_ += std::chrono::duration<double>(Clock::now() - realStart_).count();
+    cpuTime_ += GetThreadCPUTime() - cpuStart_;
+    running_ = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Statistics
+//////////////////////////////////////////////////////////////////////////
+static double Mean(std::vector<double> values)
+{
+    return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+static double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    auto half = values.size() / 2;
+
+    return (values.size() % 2 == 0) ? (values[half - 1] + values[half]) * 0.5 : values[half];
+}
+
+static double StdDev(std::vector<double> values)
+{
+    auto mean = Mean(values);
+    auto sum = 0.0;
+
+    for (auto value : values)
+        sum += (value - mean) * (value - mean);
+
+    return std::sqrt(sum / (values.size() - 1));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Report
+//////////////////////////////////////////////////////////////////////////
+static std::string Escape(const std::string_view& str)
+{
+    std::string res;
+
+    for (auto c : str) {
+        if ((c == '"') || (c == '\\'))
+            res += '\\';
+
+        res += c;
+    }
+
+    return res;
+}
+
+static std::string GetDate()
+{
+    auto now = std::time(nullptr);
+    tm local;
+    char buffer[32];
+
+    localtime_s(&local, &now);
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &local);
+
+    return buffer;
+}
+
+static void PrintHeader(const size_t nameWidth)
+{
+    auto width = nameWidth + 48;
+
+    std::cout << std::string(width, '-') << std::endl;
+    std::cout << std::left << std::setw(nameWidth) << "Benchmark" << std::right << std::setw(16) << "Time" << std::setw(16) << "CPU" << std::setw(16) << "Iterations" << std::endl;
+    std::cout << std::string(width, '-') << std::endl;
+}
+
+static void PrintRun(const BenchmarkRun& run, const size_t nameWidth)
+{
+    auto name = run.aggregate.empty() ? run.name : run.name + "_" + run.aggregate;
+
+    std::cout << std::left << std::setw(nameWidth) << name << std::right;
+
+    if (!run.error.empty()) {
+        std::cout << " ERROR OCCURRED: '" << run.error << "'" << std::endl;
+        return;
+    }
+
+    std::cout << std::fixed << std::setprecision(0) << std::setw(13) << run.realTime << " ns" << std::setw(13) << run.cpuTime << " ns" << std::setw(16) << run.iterations;
+
+    if (run.bytesPerSecond > 0)
+        std::cout << std::setprecision(2) << " " << run.bytesPerSecond / (1024 * 1024) << " MB/s";
+
+    if (run.itemsPerSecond > 0)
+        std::cout << std::setprecision(2) << " " << run.itemsPerSecond << " items/s";
+
+    std::cout << std::endl;
+}
+
+// same layout as Google Benchmark so its tools/compare.py can diff two runs
+static bool WriteJSON(const std::filesystem::path& path, const std::vector<BenchmarkRun>& runs, const std::string_view& executable)
+{
+    std::ofstream file{ path };
+
+    if (!file) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    file << "{" << std::endl;
+    file << "  \"context\": {" << std::endl;
+    file << "    \"date\": \"" << GetDate() << "\"," << std::endl;
+    file << "    \"executable\": \"" << Escape(executable) << "\"," << std::endl;
+    file << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+#ifdef _DEBUG
+    file << "    \"library_build_type\": \"debug\"," << std::endl;
+#else
+    file << "    \"library_build_type\": \"release\"," << std::endl;
+#endif
+    file << "    \"min_time\": " << currentOptions.minTime << "," << std::endl;
+    file << "    \"repetitions\": " << currentOptions.repetitions << std::endl;
+    file << "  }," << std::endl;
+    file << "  \"benchmarks\": [" << std::endl;
+
+    file << std::setprecision(17);
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+        auto& run = runs[i];
+        auto isAggregate = !run.aggregate.empty();
+
+        file << "    {" << std::endl;
+        file << "      \"name\": \"" << Escape(isAggregate ? run.name + "_" + run.aggregate : run.name) << "\"," << std::endl;
+        file << "      \"run_name\": \"" << Escape(run.name) << "\"," << std::endl;
+        file << "      \"run_type\": \"" << (isAggregate ? "aggregate" : "iteration") << "\"," << std::endl;
+        file << "      \"repetitions\": " << currentOptions.repetitions << "," << std::endl;
+
+        if (isAggregate)
+            file << "      \"aggregate_name\": \"" << run.aggregate << "\"," << std::endl;
+        else
+            file << "      \"repetition_index\": " << run.repetition << "," << std::endl;
+
+        if (!run.error.empty()) {
+            file << "      \"error_occurred\": true," << std::endl;
+            file << "      \"error_message\": \"" << Escape(run.error) << "\"," << std::endl;
+        }
+
+        file << "      \"iterations\": " << run.iterations << "," << std::endl;
+        file << "      \"real_time\": " << run.realTime << "," << std::endl;
+        file << "      \"cpu_time\": " << run.cpuTime << "," << std::endl;
+        file << "      \"time_unit\": \"ns\"," << std::endl;
+        file << "      \"bytes_per_second\": " << run.bytesPerSecond << "," << std::endl;
+        file << "      \"items_per_second\": " << run.itemsPerSecond << std::endl;
+        file << "    }" << ((i + 1 < runs.size()) ? "," : "") << std::endl;
+    }
+
+    file << "  ]" << std::endl;
+    file << "}" << std::endl;
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Runner
+//////////////////////////////////////////////////////////////////////////
+static BenchmarkRun CreateRun(const std::string& name, const uint32_t repetition, const BenchmarkState& state)
+{
+    BenchmarkRun res;
+
+    res.name = name;
+    res.repetition = repetition;
+    res.error = state.GetError();
+    res.iterations = state.GetIterations();
+
+    if (res.iterations > 0) {
+        res.realTime = state.GetRealTime() * 1e9 / res.iterations;
+        res.cpuTime = state.GetCPUTime() * 1e9 / res.iterations;
+    }
+
+    if (state.GetRealTime() > 0) {
+        res.bytesPerSecond = state.GetBytesProcessed() / state.GetRealTime();
+        res.itemsPerSecond = state.GetItemsProcessed() / state.GetRealTime();
+    }
+
+    return res;
+}
+
+static std::vector<BenchmarkRun> CreateAggregates(const std::vector<BenchmarkRun>& runs)
+{
+    using Statistic = double (*)(std::vector<double>);
+
+    const std::array<std::pair<const char*, Statistic>, 3> statistics = { { { "mean", Mean }, { "median", Median }, { "stddev", StdDev } } };
+    std::vector<BenchmarkRun> res;
+
+    for (auto& statistic : statistics) {
+        auto reduce = [&](double BenchmarkRun::*field)
+        {
+            std::vector<double> values;
+
+            for (auto& run : runs)
+                values.push_back(run.*field);
+
+            return statistic.second(values);
+        };
+
+        BenchmarkRun aggregate;
+
+        aggregate.name = runs.front().name;
+        aggregate.aggregate = statistic.first;
+        aggregate.iterations = runs.size();
+        aggregate.realTime = reduce(&BenchmarkRun::realTime);
+        aggregate.cpuTime = reduce(&BenchmarkRun::cpuTime);
+        aggregate.bytesPerSecond = reduce(&BenchmarkRun::bytesPerSecond);
+        aggregate.itemsPerSecond = reduce(&BenchmarkRun::itemsPerSecond);
+
+        res.emplace_back(std::move(aggregate));
+    }
+
+    return res;
+}
+
+bool RegisterBenchmark(const std::string& name, BenchmarkFunction&& function)
+{
+    GetRegistry().push_back({ name, std::move(function) });
+
+    return true;
+}
+
+std::filesystem::path GetDataPath(const std::string_view& file)
+{
+    return currentOptions.data / file;
+}
+
+std::filesystem::path GetOutputPath(const std::string_view& file)
+{
+    return std::filesystem::temp_directory_path() / "ninniku_benchmark" / file;
+}
+
+int RunBenchmarks(const BenchmarkOptions& options, const std::string_view& executable)
+{
+    currentOptions = options;
+    currentOptions.repetitions = std::max(1u, options.repetitions);
+
+    std::error_code ec;
+
+    std::filesystem::create_directories(GetOutputPath(""), ec);
+
+    std::vector<const BenchmarkEntry*> selected;
+    size_t nameWidth = 10;
+
+    for (auto& entry : GetRegistry()) {
+        if (entry.name.find(options.filter) != std::string::npos) {
+            selected.push_back(&entry);
+            nameWidth = std::max(nameWidth, entry.name.size() + 8);
+        }
+    }
+
+    if (selected.empty()) {
+        std::cerr << "No benchmark matches \"" << options.filter << "\"" << std::endl;
+        return 1;
+    }
+
+    PrintHeader(nameWidth);
+
+    std::vector<BenchmarkRun> runs;
+    auto failed = false;
+
+    for (auto entry : selected) {
+        std::vector<BenchmarkRun> repetitions;
+
+        for (uint32_t i = 0; i < currentOptions.repetitions; ++i) {
+            BenchmarkState state{ currentOptions.minTime };
+
+            entry->function(state);
+
+            auto run = CreateRun(entry->name, i, state);
+
+            PrintRun(run, nameWidth);
+            repetitions.emplace_back(std::move(run));
+        }
+
+        auto hasError = std::any_of(repetitions.begin(), repetitions.end(), [](const BenchmarkRun& run) { return !run.error.empty(); });
+
+        runs.insert(runs.end(), repetitions.begin(), repetitions.end());
+
+        if (hasError) {
+            failed = true;
+        } else if (repetitions.size() > 1) {
+            for (auto& aggregate : CreateAggregates(repetitions)) {
+                PrintRun(aggregate, nameWidth);
+                runs.emplace_back(std::move(aggregate));
+            }
+        }
+    }
+
+    if (!options.out.empty() && !WriteJSON(options.out, runs, executable))
+        return 1;
+
+    return failed ? 1 : 0;
+}
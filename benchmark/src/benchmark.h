@@ -0,0 +1,106 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Measure the body of a benchmark, the loop is the same as Google Benchmark:
+//     while (state.KeepRunning()) { ... }
+//     state.SetBytesProcessed(state.GetIterations() * size);
+class BenchmarkState
+{
+public:
+    BenchmarkState(const double minTime);
+
+    bool KeepRunning();
+
+    // exclude setup code from the timings, eg: reloading an image between iterations
+    void PauseTiming();
+    void ResumeTiming();
+
+    void SetBytesProcessed(const uint64_t bytes) { bytes_ = bytes; }
+    void SetItemsProcessed(const uint64_t items) { items_ = items; }
+
+    // stop the benchmark, it will be reported with the error instead of timings
+    void SkipWithError(const std::string_view& error);
+
+    uint64_t GetBytesProcessed() const { return bytes_; }
+    double GetCPUTime() const { return cpuTime_; }
+    const std::string& GetError() const { return error_; }
+    uint64_t GetItemsProcessed() const { return items_; }
+    uint64_t GetIterations() const { return iterations_; }
+    double GetRealTime() const { return realTime_; }
+
+private:
+    void StartTimer();
+    void StopTimer();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double minTime_;
+    uint64_t iterations_ = 0;
+    bool started_ = false;
+    bool running_ = false;
+
+    // accumulated seconds while the timer was running
+    double realTime_ = 0;
+    double cpuTime_ = 0;
+
+    Clock::time_point realStart_;
+    double cpuStart_ = 0;
+
+    uint64_t bytes_ = 0;
+    uint64_t items_ = 0;
+    std::string error_;
+};
+
+using BenchmarkFunction = std::function<void(BenchmarkState&)>;
+
+struct BenchmarkOptions
+{
+    // only run benchmarks whose name contains this string
+    std::string filter;
+
+    // json report written in addition to the console output
+    std::filesystem::path out;
+
+    // assets used by the suites, unit_test/data when run from the benchmark folder
+    std::filesystem::path data = "../unit_test/data";
+
+    double minTime = 0.5;
+    uint32_t repetitions = 1;
+};
+
+bool RegisterBenchmark(const std::string& name, BenchmarkFunction&& function);
+int RunBenchmarks(const BenchmarkOptions& options, const std::string_view& executable);
+
+// files read by the suites and files they write
+std::filesystem::path GetDataPath(const std::string_view& file);
+std::filesystem::path GetOutputPath(const std::string_view& file);
+
+#define BENCHMARK_CONCAT_IMPL(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_IMPL(a, b)
+#define BENCHMARK(function) static const bool BENCHMARK_CONCAT(benchmark_, __LINE__) = RegisterBenchmark(#function, function)
@@ -0,0 +1,91 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "benchmark.h"
+
+#include <ninniku/ninniku.h>
+
+#include <iostream>
+
+static void PrintUsage()
+{
+    std::cout << "benchmark [options]" << std::endl;
+    std::cout << "  --benchmark_filter=<str>       only run benchmarks whose name contains <str>" << std::endl;
+    std::cout << "  --benchmark_out=<file>         write the results as JSON" << std::endl;
+    std::cout << "  --benchmark_min_time=<sec>     minimum time spent in each benchmark (default 0.5)" << std::endl;
+    std::cout << "  --benchmark_repetitions=<n>    run each benchmark n times and report mean/median/stddev" << std::endl;
+    std::cout << "  --benchmark_data=<dir>         folder with the unit test assets (default ../unit_test/data)" << std::endl;
+}
+
+static bool ParseArguments(int argc, char* argv[], BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg{ argv[i] };
+
+        auto match = [&](const std::string_view& name, std::string_view& value)
+        {
+            if ((arg.size() <= name.size()) || (arg.compare(0, name.size(), name) != 0) || (arg[name.size()] != '='))
+                return false;
+
+            value = arg.substr(name.size() + 1);
+
+            return true;
+        };
+
+        std::string_view value;
+
+        if (match("--benchmark_filter", value)) {
+            options.filter = value;
+        } else if (match("--benchmark_out", value)) {
+            options.out = value;
+        } else if (match("--benchmark_min_time", value)) {
+            options.minTime = std::stod(std::string{ value });
+        } else if (match("--benchmark_repetitions", value)) {
+            options.repetitions = std::stoul(std::string{ value });
+        } else if (match("--benchmark_data", value)) {
+            options.data = value;
+        } else {
+            PrintUsage();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+
+    if (!ParseArguments(argc, argv, options))
+        return -1;
+
+    // the CPU renderer makes results comparable between machines with different GPUs
+    if (!ninniku::Initialize(ninniku::ERenderer::RENDERER_CPU, ninniku::EInitializationFlags::IF_BC7_QUICK_MODE, ninniku::ELogLevel::LL_NONE)) {
+        std::cerr << "Failed to initialize Ninniku." << std::endl;
+        return -1;
+    }
+
+    auto res = RunBenchmarks(options, argv[0]);
+
+    ninniku::Terminate();
+
+    return res;
+}
@@ -0,0 +1,380 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../benchmark.h"
+
+#include <ninniku/core/image/cmft.h>
+#include <ninniku/core/image/dds.h>
+#include <ninniku/core/image/generic.h>
+#include <ninniku/core/renderer/renderdevice.h>
+
+#include <array>
+#include <vector>
+
+// assets from unit_test/data
+static constexpr std::array<std::string_view, 6> GENERIC_FILES = {
+    "banner.png",
+    "weave_8.png",
+    "weave_16.png",
+    "Rainbow_to_alpha_gradient.png",
+    "architecture-buildings-city-1769347.jpg",
+    "whipple_creek_regional_park_01_2k.hdr"
+};
+
+static constexpr std::array<std::string_view, 3> CMFT_FILES = {
+    "Cathedral01.hdr",
+    "whipple_creek_regional_park_01_2k.hdr",
+    "park02.exr"
+};
+
+static constexpr std::string_view DDS_FILE = "Cathedral01.dds";
+
+// face size of the generated layouts
+static constexpr uint32_t LAYOUT_FACE_SIZE = 512;
+
+//////////////////////////////////////////////////////////////////////////
+// Helpers
+//////////////////////////////////////////////////////////////////////////
+template <typename T>
+static bool LoadSource(BenchmarkState& state, T& image, const std::string_view& file)
+{
+    auto path = GetDataPath(file);
+
+    if (!image.Load(path.string())) {
+        state.SkipWithError("Failed to load " + path.string());
+        return false;
+    }
+
+    return true;
+}
+
+// throughput of a benchmark processing size bytes per iteration
+static void SetProcessed(BenchmarkState& state, const uint64_t size)
+{
+    state.SetBytesProcessed(state.GetIterations() * size);
+    state.SetItemsProcessed(state.GetIterations());
+}
+
+template <typename T>
+static void Load(BenchmarkState& state, const std::string_view& file)
+{
+    auto path = GetDataPath(file);
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+
+    if (ec) {
+        state.SkipWithError("Missing " + path.string());
+        return;
+    }
+
+    while (state.KeepRunning()) {
+        T image;
+
+        if (!image.Load(path.string())) {
+            state.SkipWithError("Failed to load " + path.string());
+            return;
+        }
+    }
+
+    SetProcessed(state, size);
+}
+
+template <typename T>
+static void CreateTextureParam(BenchmarkState& state, const std::string_view& file)
+{
+    T image;
+
+    if (!LoadSource(state, image, file))
+        return;
+
+    while (state.KeepRunning()) {
+        auto param = image.CreateTextureParam(ninniku::RV_SRV);
+    }
+
+    SetProcessed(state, std::get<1>(image.GetData()));
+}
+
+// RGBA32F gradient so every layout converts the same kind of data
+// a horizontal cross is only detected when the cells around it are black
+static std::vector<float> CreateLayout(const uint32_t width, const uint32_t height, const bool isCross)
+{
+    std::vector<float> res(static_cast<size_t>(width) * height * 4);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            if (isCross && (x / LAYOUT_FACE_SIZE != 1) && (y / LAYOUT_FACE_SIZE != 1))
+                continue;
+
+            auto texel = &res[(static_cast<size_t>(y) * width + x) * 4];
+
+            texel[0] = static_cast<float>(x) / width;
+            texel[1] = static_cast<float>(y) / height;
+            texel[2] = 0.5f;
+            texel[3] = 1.f;
+        }
+    }
+
+    return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// genericImage
+//////////////////////////////////////////////////////////////////////////
+static bool RegisterGeneric()
+{
+    for (auto file : GENERIC_FILES) {
+        RegisterBenchmark("generic_Load/" + std::string{ file }, [file](BenchmarkState& state) { Load<ninniku::genericImage>(state, file); });
+        RegisterBenchmark("generic_CreateTextureParam/" + std::string{ file }, [file](BenchmarkState& state) { CreateTextureParam<ninniku::genericImage>(state, file); });
+    }
+
+    return true;
+}
+
+static const bool genericRegistered = RegisterGeneric();
+
+//////////////////////////////////////////////////////////////////////////
+// ddsImage
+//////////////////////////////////////////////////////////////////////////
+static void dds_Load(BenchmarkState& state)
+{
+    Load<ninniku::ddsImage>(state, DDS_FILE);
+}
+
+BENCHMARK(dds_Load);
+
+static void dds_LoadMapped(BenchmarkState& state)
+{
+    auto path = GetDataPath(DDS_FILE);
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+
+    if (ec) {
+        state.SkipWithError("Missing " + path.string());
+        return;
+    }
+
+    while (state.KeepRunning()) {
+        ninniku::ddsImage image;
+
+        if (!image.LoadMapped(path.string())) {
+            state.SkipWithError("Failed to map " + path.string());
+            return;
+        }
+    }
+
+    SetProcessed(state, size);
+}
+
+BENCHMARK(dds_LoadMapped);
+
+static void dds_CreateTextureParam(BenchmarkState& state)
+{
+    CreateTextureParam<ninniku::ddsImage>(state, DDS_FILE);
+}
+
+BENCHMARK(dds_CreateTextureParam);
+
+static void dds_SaveImage(BenchmarkState& state)
+{
+    ninniku::ddsImage image;
+
+    if (!LoadSource(state, image, DDS_FILE))
+        return;
+
+    auto path = GetOutputPath("dds_SaveImage.dds").string();
+
+    while (state.KeepRunning()) {
+        if (!image.SaveImage(path)) {
+            state.SkipWithError("SaveImage failed");
+            return;
+        }
+    }
+
+    SetProcessed(state, std::get<1>(image.GetData()));
+}
+
+BENCHMARK(dds_SaveImage);
+
+struct CompressedFormat
+{
+    std::string_view name;
+    DXGI_FORMAT format;
+
+    // BC6H needs a HDR source
+    std::string_view source;
+
+    // loaded as float through cmft instead of 8 bits through stb
+    bool isHDR;
+};
+
+template <typename T>
+static bool InitializeCompressSource(BenchmarkState& state, ninniku::ddsImage& image, const std::string_view& file)
+{
+    auto& dx = ninniku::GetRenderer();
+    T source;
+
+    if (!LoadSource(state, source, file))
+        return false;
+
+    auto srcTex = dx->CreateTexture(source.CreateTextureParam(ninniku::RV_SRV));
+
+    if (!image.InitializeFromTextureObject(dx, srcTex)) {
+        state.SkipWithError("InitializeFromTextureObject failed");
+        return false;
+    }
+
+    return true;
+}
+
+static void SaveCompressed(BenchmarkState& state, const CompressedFormat& format, const ninniku::CompressDesc& desc, const std::string& suffix)
+{
+    auto& dx = ninniku::GetRenderer();
+    ninniku::ddsImage image;
+
+    if (format.isHDR) {
+        if (!InitializeCompressSource<ninniku::cmftImage>(state, image, format.source))
+            return;
+    } else if (!InitializeCompressSource<ninniku::genericImage>(state, image, format.source)) {
+        return;
+    }
+
+    auto path = GetOutputPath("dds_SaveCompressedImage_" + std::string{ format.name } + suffix + ".dds").string();
+
+    while (state.KeepRunning()) {
+        if (!image.SaveCompressedImage(path, dx, format.format, desc)) {
+            state.SkipWithError("SaveCompressedImage failed");
+            return;
+        }
+    }
+
+    SetProcessed(state, std::get<1>(image.GetData()));
+}
+
+static bool RegisterCompressed()
+{
+    const std::array<CompressedFormat, 6> formats = { {
+        { "BC1_UNORM", DXGI_FORMAT_BC1_UNORM, "banner.png", false },
+        { "BC3_UNORM", DXGI_FORMAT_BC3_UNORM, "banner.png", false },
+        { "BC4_UNORM", DXGI_FORMAT_BC4_UNORM, "weave_8.png", false },
+        { "BC5_UNORM", DXGI_FORMAT_BC5_UNORM, "weave_8.png", false },
+        { "BC6H_UF16", DXGI_FORMAT_BC6H_UF16, "whipple_creek_regional_park_01_2k.hdr", true },
+        { "BC7_UNORM", DXGI_FORMAT_BC7_UNORM, "banner.png", false }
+    } };
+
+    for (auto& format : formats) {
+        auto name = "dds_SaveCompressedImage/" + std::string{ format.name };
+
+        ninniku::CompressDesc desc;
+
+        RegisterBenchmark(name, [format, desc](BenchmarkState& state) { SaveCompressed(state, format, desc, ""); });
+
+        desc.quality = ninniku::EBCQuality::BCQ_Fast;
+        RegisterBenchmark(name + "/Fast", [format, desc](BenchmarkState& state) { SaveCompressed(state, format, desc, "_Fast"); });
+
+        desc.quality = ninniku::EBCQuality::BCQ_Normal;
+        RegisterBenchmark(name + "/Normal", [format, desc](BenchmarkState& state) { SaveCompressed(state, format, desc, "_Normal"); });
+
+        if (format.format == DXGI_FORMAT_BC7_UNORM) {
+            // single subset only, then the partition search with an early out
+            desc.bc7ModeMask = 1 << 6;
+            RegisterBenchmark(name + "/Normal/Mode6", [format, desc](BenchmarkState& state) { SaveCompressed(state, format, desc, "_Normal_Mode6"); });
+
+            desc.bc7ModeMask = ninniku::BC7_ALL_MODES;
+            desc.bc7EarlyOutError = 2.f;
+            RegisterBenchmark(name + "/Normal/EarlyOut", [format, desc](BenchmarkState& state) { SaveCompressed(state, format, desc, "_Normal_EarlyOut"); });
+        }
+    }
+
+    return true;
+}
+
+static const bool compressedRegistered = RegisterCompressed();
+
+//////////////////////////////////////////////////////////////////////////
+// cmftImage
+//////////////////////////////////////////////////////////////////////////
+static bool RegisterCMFT()
+{
+    for (auto file : CMFT_FILES) {
+        RegisterBenchmark("cmft_Load/" + std::string{ file }, [file](BenchmarkState& state) { Load<ninniku::cmftImage>(state, file); });
+        RegisterBenchmark("cmft_CreateTextureParam/" + std::string{ file }, [file](BenchmarkState& state) { CreateTextureParam<ninniku::cmftImage>(state, file); });
+    }
+
+    const std::array<std::pair<std::string_view, ninniku::cmftImage::SaveType>, 4> saveTypes = { {
+        { "Cubemap", ninniku::cmftImage::SaveType::Cubemap },
+        { "Facelist", ninniku::cmftImage::SaveType::Facelist },
+        { "LatLong", ninniku::cmftImage::SaveType::LatLong },
+        { "VCross", ninniku::cmftImage::SaveType::VCross }
+    } };
+
+    for (auto& saveType : saveTypes) {
+        RegisterBenchmark("cmft_SaveImage/" + std::string{ saveType.first }, [saveType](BenchmarkState& state)
+        {
+            ninniku::cmftImage image;
+
+            if (!LoadSource(state, image, "Cathedral01.hdr"))
+                return;
+
+            auto path = GetOutputPath("cmft_SaveImage_" + std::string{ saveType.first } + ".dds").string();
+
+            while (state.KeepRunning()) {
+                if (!image.SaveImage(path, saveType.second)) {
+                    state.SkipWithError("SaveImage failed");
+                    return;
+                }
+            }
+
+            SetProcessed(state, std::get<1>(image.GetData()));
+        });
+    }
+
+    // layouts converted to a cubemap when loaded
+    const std::array<std::tuple<std::string_view, uint32_t, uint32_t, bool>, 4> layouts = { {
+        { "LatLong", LAYOUT_FACE_SIZE * 4, LAYOUT_FACE_SIZE * 2, false },
+        { "HStrip", LAYOUT_FACE_SIZE * 6, LAYOUT_FACE_SIZE, false },
+        { "VStrip", LAYOUT_FACE_SIZE, LAYOUT_FACE_SIZE * 6, false },
+        { "HCross", LAYOUT_FACE_SIZE * 4, LAYOUT_FACE_SIZE * 3, true }
+    } };
+
+    for (auto& layout : layouts) {
+        RegisterBenchmark("cmft_AssembleCubemap/" + std::string{ std::get<0>(layout) }, [layout](BenchmarkState& state)
+        {
+            auto width = std::get<1>(layout);
+            auto height = std::get<2>(layout);
+            auto data = CreateLayout(width, height, std::get<3>(layout));
+            auto size = data.size() * sizeof(float);
+
+            while (state.KeepRunning()) {
+                ninniku::cmftImage image;
+
+                if (!image.LoadRaw(data.data(), size, width, height, DXGI_FORMAT_R32G32B32A32_FLOAT)) {
+                    state.SkipWithError("LoadRaw failed");
+                    return;
+                }
+            }
+
+            SetProcessed(state, size);
+        });
+    }
+
+    return true;
+}
+
+static const bool cmftRegistered = RegisterCMFT();
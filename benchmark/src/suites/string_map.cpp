@@ -0,0 +1,143 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../benchmark.h"
+
+#include <utils/string_map.h>
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// binding names similar to what the shaders declare
+static constexpr std::array<std::string_view, 16> BINDING_NAMES = {
+    "srcTex",
+    "dstTex",
+    "srcMip",
+    "dstMip",
+    "ssPoint",
+    "ssLinear",
+    "ssBilinear",
+    "CBGlobal",
+    "CBMips",
+    "srcBuffer",
+    "dstBuffer",
+    "cubeArray",
+    "faceIndex",
+    "colorMips",
+    "resampleFaceCS",
+    "downsampleCS"
+};
+
+// number of lookups per iteration
+static constexpr uint32_t LOOKUPS = 1024;
+
+static volatile uint64_t sink;
+
+//////////////////////////////////////////////////////////////////////////
+// Helpers
+//////////////////////////////////////////////////////////////////////////
+
+// what StringMap used to do, every lookup copies the key in a std::string first
+template<typename ValueType>
+class CopyStringMap : public std::unordered_map<std::string, ValueType>
+{
+public:
+    typename std::unordered_map<std::string, ValueType>::const_iterator find(const std::string_view& str) const
+    {
+        tmp_.assign(str.data(), str.size());
+        return std::unordered_map<std::string, ValueType>::find(tmp_);
+    }
+
+private:
+    thread_local static std::string tmp_;
+};
+
+template<typename ValueType>
+thread_local std::string CopyStringMap<ValueType>::tmp_;
+
+// keys are views on separate storage like Command::shader so nothing can be shared with the map
+static std::vector<std::string_view> MakeQueries(std::vector<std::string>& storage, const uint32_t numKeys)
+{
+    storage.clear();
+    storage.reserve(numKeys * 2);
+
+    std::vector<std::string_view> res;
+
+    res.reserve(LOOKUPS);
+
+    for (uint32_t i = 0; i < numKeys; ++i) {
+        storage.emplace_back(std::string{ BINDING_NAMES[i % BINDING_NAMES.size()] } + std::to_string(i));
+        storage.emplace_back("missing" + std::to_string(i));
+    }
+
+    // one miss out of 8 like an unbound optional resource
+    for (uint32_t i = 0; i < LOOKUPS; ++i) {
+        auto key = (i * 7) % numKeys;
+
+        res.emplace_back(storage[key * 2 + ((i % 8 == 7) ? 1 : 0)]);
+    }
+
+    return res;
+}
+
+template<typename MapType>
+static void Find(BenchmarkState& state, const uint32_t numKeys)
+{
+    std::vector<std::string> storage;
+    auto queries = MakeQueries(storage, numKeys);
+    MapType map;
+
+    for (uint32_t i = 0; i < numKeys; ++i)
+        map.emplace(storage[i * 2], i);
+
+    uint64_t found = 0;
+
+    while (state.KeepRunning()) {
+        for (auto& query : queries) {
+            auto it = map.find(query);
+
+            if (it != map.end())
+                found += it->second;
+        }
+    }
+
+    sink = found;
+
+    state.SetItemsProcessed(state.GetIterations() * LOOKUPS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// StringMap
+//////////////////////////////////////////////////////////////////////////
+static bool RegisterStringMap()
+{
+    for (uint32_t numKeys : { 8u, 64u, 512u }) {
+        auto suffix = "/" + std::to_string(numKeys);
+
+        RegisterBenchmark("StringMap_Find" + suffix, [numKeys](BenchmarkState& state) { Find<ninniku::StringMap<uint32_t>>(state, numKeys); });
+        RegisterBenchmark("StringMap_FindCopy" + suffix, [numKeys](BenchmarkState& state) { Find<CopyStringMap<uint32_t>>(state, numKeys); });
+    }
+
+    return true;
+}
+
+static const bool stringMapRegistered = RegisterStringMap();
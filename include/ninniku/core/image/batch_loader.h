@@ -0,0 +1,77 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../../export.h"
+#include "../../utils.h"
+#include "image.h"
+
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace ninniku
+{
+    using ImageHandle = std::unique_ptr<Image>;
+
+    // creates the image used to decode a file, returning nullptr reports the file as failed
+    using ImageFactory = std::function<ImageHandle(const std::string_view& path)>;
+
+    // index in the path list and the decoded image, which is nullptr if the file could not be loaded
+    using BatchLoadCallback = std::function<void(const uint32_t index, ImageHandle image)>;
+
+    struct BatchLoaderDesc
+    {
+        // memory used by the file contents and the decoded images until the callback returns
+        // it is checked before reading a file so decoding can briefly go past it
+        // a single file bigger than that is still loaded, but alone
+        uint64_t maxInFlightBytes = 1ull << 30;
+
+        // by default: .dds uses ddsImage, .exr uses cmftImage and everything else uses genericImage
+        ImageFactory factory;
+    };
+
+    /// <summary>
+    /// Load a list of files, reading them one after the other on the calling thread while the thread pool decodes them
+    /// Images are handed to the callback as soon as they are ready, in no particular order and from any thread
+    /// Their memory counts toward maxInFlightBytes until the callback returns
+    /// </summary>
+    class BatchLoader final : NonCopyable
+    {
+    public:
+        NINNIKU_API BatchLoader(const BatchLoaderDesc& desc = BatchLoaderDesc{});
+
+        /// <summary>
+        /// Block until every file has been handed to the callback, returns false if any of them failed
+        /// </summary>
+        [[nodiscard]] NINNIKU_API bool Load(const std::vector<std::string>& paths, const BatchLoadCallback& callback);
+
+        /// <summary>
+        /// Same as Load but the files are read from a dedicated thread, the future is ready once every file has been handed to the callback
+        /// The loader must outlive the future
+        /// </summary>
+        [[nodiscard]] NINNIKU_API std::future<bool> LoadAsync(std::vector<std::string> paths, BatchLoadCallback callback);
+
+    private:
+        BatchLoaderDesc desc_;
+    };
+} // namespace ninniku
@@ -41,6 +41,7 @@ namespace ninniku
 
         NINNIKU_API TextureParamHandle CreateTextureParam(const EResourceViews viewFlags) const override;
         [[nodiscard]] NINNIKU_API bool Load(const std::string_view&) override;
+        [[nodiscard]] NINNIKU_API bool LoadRaw(const void* pData, const size_t size) override;
         [[nodiscard]] NINNIKU_API bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) override;
         NINNIKU_API const std::tuple<uint8_t*, uint32_t> GetData() const override;
 
@@ -62,6 +63,50 @@ namespace ninniku
 
         [[nodiscard]] NINNIKU_API bool SaveImage(const std::string_view&, SaveType type);
 
+        enum class LightingModel
+        {
+            Phong,
+            PhongBrdf,
+            Blinn,
+            BlinnBrdf
+        };
+
+        struct RadianceFilterParams
+        {
+            // 0 keeps the current face size
+            uint32_t faceSize = 0;
+
+            // 0 builds the full mip chain
+            uint8_t mipCount = 0;
+
+            // specular power of each mip is 2^(glossScale * glossiness + glossBias)
+            // where glossiness goes from 1 on the first mip to 0 on the last one
+            uint8_t glossScale = 10;
+            uint8_t glossBias = 1;
+
+            LightingModel lightingModel = LightingModel::BlinnBrdf;
+
+            // first mip is a plain downsample of the source instead of being filtered
+            bool excludeBase = false;
+
+            // warp the edges for APIs without seamless cubemap filtering
+            bool edgeFixup = false;
+
+            // 0 uses every hardware thread, cmft cannot go over 64
+            uint32_t numThreads = 0;
+        };
+
+        /// <summary>
+        /// Replace the cubemap with its specular prefiltered version, each mip being filtered for a lower glossiness
+        /// Filtering runs on the CPU and only one filter can run at a time
+        /// </summary>
+        [[nodiscard]] NINNIKU_API bool RadianceFilter(const RadianceFilterParams& params);
+
+        /// <summary>
+        /// Replace the cubemap with its irradiance computed from spherical harmonics, faceSize = 0 keeps the current size
+        /// </summary>
+        [[nodiscard]] NINNIKU_API bool IrradianceFilter(const uint32_t faceSize = 0);
+
     private:
         std::unique_ptr<cmftImageImpl> impl_;
     };
@@ -0,0 +1,36 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../../export.h"
+
+#include <cstdint>
+
+namespace ninniku
+{
+    /// <summary>
+    /// Pack interleaved RGB pixels to R11G11B10_FLOAT, results are identical to DirectX::PackedVector::XMFLOAT3PK
+    /// 8 bits channels are normalized to [0, 1], 16 bits channels are packed as is
+    /// Large images are split across the worker threads
+    /// </summary>
+    NINNIKU_API void PackR11G11B10(const uint8_t* rgb, const uint32_t numPixels, uint32_t* dst);
+    NINNIKU_API void PackR11G11B10(const uint16_t* rgb, const uint32_t numPixels, uint32_t* dst);
+} // namespace ninniku
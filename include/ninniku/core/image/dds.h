@@ -29,6 +29,41 @@ namespace ninniku
 {
     class ddsImageImpl;
 
+    enum class EBCQuality : uint8_t
+    {
+        BCQ_Fast,       // built-in encoder, endpoints from the bounding box of each block
+        BCQ_Normal,     // built-in encoder, endpoints along the principal axis refined with least squares
+        BCQ_High        // DirectXTex reference encoder
+    };
+
+    // bit n enables BC7 mode n
+    static constexpr uint8_t BC7_ALL_MODES = 0xff;
+
+    struct CompressDesc
+    {
+        // only BC1/BC3/BC4/BC5/BC7 UNORM and BC6H_UF16 have a built-in encoder, every other format always uses DirectXTex
+        EBCQuality quality = EBCQuality::BCQ_High;
+
+        // BC7 modes the encoder may pick, IF_BC7_QUICK_MODE only applies when left to BC7_ALL_MODES
+        // the built-in encoder implements modes 1 and 6, a mask with neither goes to DirectXTex with a warning
+        // since mode 1 has no alpha, strips with alpha also go to DirectXTex with a warning when mode 6 isn't allowed
+        // DirectXTex (BCQ_High) only distinguishes mode 6 alone and the 3 subsets modes 0/2
+        uint8_t bc7ModeMask = BC7_ALL_MODES;
+
+        // number of 2 subsets partitions fully encoded by the built-in encoder, the most promising ones first (1-64)
+        uint8_t bc7PartitionSearch = 16;
+
+        // stop searching BC7 modes/partitions once a block RMSE (0-255) is at or below this value, 0 to never stop early
+        float bc7EarlyOutError = 0.f;
+    };
+
+    struct CompressResult
+    {
+        // root mean square error between the source and the compressed image
+        // over the channels stored by the format, 0-1 for UNORM formats
+        float rmse;
+    };
+
     class ddsImage final : public Image
     {
         // no copy of any kind allowed
@@ -43,7 +78,15 @@ namespace ninniku
 
         NINNIKU_API TextureParamHandle CreateTextureParam(const EResourceViews viewFlags) const override;
         [[nodiscard]] NINNIKU_API bool Load(const std::string_view&) override;
-        [[nodiscard]] NINNIKU_API bool LoadRaw(const void* pData, const size_t size);
+
+        /// <summary>
+        /// Map the file in memory instead of copying it, subresources will point straight into the mapping
+        /// which stays alive as long as the image or any TextureParam created from it
+        /// Only DDS with a DX10 header can be mapped, others are loaded normally
+        /// </summary>
+        [[nodiscard]] NINNIKU_API bool LoadMapped(const std::string_view&);
+
+        [[nodiscard]] NINNIKU_API bool LoadRaw(const void* pData, const size_t size) override;
         [[nodiscard]] NINNIKU_API bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) override;
         NINNIKU_API const std::tuple<uint8_t*, uint32_t> GetData() const override;
 
@@ -53,7 +96,12 @@ namespace ninniku
         NINNIKU_API virtual const SizeFixResult IsRequiringFix() const override;
 
         [[nodiscard]] NINNIKU_API bool SaveImage(const std::string_view&);
-        [[nodiscard]] NINNIKU_API bool SaveCompressedImage(const std::string_view&, RenderDeviceHandle& dx, DXGI_FORMAT format);
+
+        /// <summary>
+        /// Compress and save to a DDS file
+        /// Computing the error requires decompressing every block so it is only done when result is not null
+        /// </summary>
+        [[nodiscard]] NINNIKU_API bool SaveCompressedImage(const std::string_view&, RenderDeviceHandle& dx, DXGI_FORMAT format, const CompressDesc& desc = CompressDesc{}, CompressResult* result = nullptr);
 
     private:
         std::unique_ptr<ddsImageImpl> impl_;
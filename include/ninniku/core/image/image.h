@@ -41,6 +41,9 @@ namespace ninniku
         virtual ~Image() = default;
 
         virtual bool Load(const std::string_view&) = 0;
+
+        // Decode the whole content of a file which is already in memory
+        virtual bool LoadRaw(const void* pData, const size_t size) = 0;
         virtual bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) = 0;
         virtual TextureParamHandle CreateTextureParam(const EResourceViews viewFlags) const = 0;
 
@@ -0,0 +1,145 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../../export.h"
+#include "../../types.h"
+#include "types.h"
+
+#include <array>
+#include <limits>
+#include <vector>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Graph compilation, independent from the renderer
+    //////////////////////////////////////////////////////////////////////////
+    enum class EGraphQueue : uint8_t
+    {
+        GQ_Compute,
+        GQ_Copy,
+        GQ_Count
+    };
+
+    // resources rest in RS_ShaderResource between graphs, a copy queue can only use the copy states
+    enum class EResourceState : uint8_t
+    {
+        RS_ShaderResource,
+        RS_UnorderedAccess,
+        RS_CopySource,
+        RS_CopyDest
+    };
+
+    struct GraphAccess
+    {
+        static constexpr uint32_t ALL_SUBRESOURCES = std::numeric_limits<uint32_t>::max();
+
+        // only used to tell resources apart
+        const void* resource;
+        uint32_t numSubresources;
+
+        // an access to all subresources only applies to the ones the same pass does not access individually
+        uint32_t subresource;
+        EResourceState state;
+    };
+
+    struct GraphPass
+    {
+        EGraphQueue queue;
+        std::vector<GraphAccess> accesses;
+    };
+
+    // UAV barrier when before and after are the same
+    struct GraphBarrier
+    {
+        const void* resource;
+        uint32_t subresource;
+        EResourceState before;
+        EResourceState after;
+    };
+
+    struct GraphStep
+    {
+        static constexpr uint32_t NO_PASS = std::numeric_limits<uint32_t>::max();
+
+        // recorded before the pass
+        std::vector<GraphBarrier> barriers;
+        uint32_t pass;
+    };
+
+    // executed as a single command list
+    struct GraphBatch
+    {
+        static constexpr uint32_t NO_WAIT = std::numeric_limits<uint32_t>::max();
+
+        EGraphQueue queue;
+
+        // last batch of each queue that must be done before this one starts
+        std::array<uint32_t, static_cast<std::underlying_type<EGraphQueue>::type>(EGraphQueue::GQ_Count)> waits;
+        std::vector<GraphStep> steps;
+    };
+
+    struct CompiledGraph
+    {
+        std::vector<GraphBatch> batches;
+        uint32_t numBarriers;
+        uint32_t numWaits;
+    };
+
+    /// <summary>
+    /// Order passes into as few batches as possible with only the barriers and cross queue waits their accesses require
+    /// Consecutive passes on the same queue share a batch, transitions a copy queue cannot do are moved to the compute queue
+    /// Every resource is back in RS_ShaderResource once the last batch is done
+    /// Returns false if a pass has conflicting accesses to the same subresource
+    /// </summary>
+    [[nodiscard]] NINNIKU_API bool CompileGraph(const std::vector<GraphPass>& passes, CompiledGraph& compiled);
+
+    //////////////////////////////////////////////////////////////////////////
+    // CommandGraph: dispatches and buffer copies submitted together with RenderDevice::Submit
+    //////////////////////////////////////////////////////////////////////////
+    class CommandGraph final : NonCopyable
+    {
+    public:
+        struct Node
+        {
+            // null for copies
+            CommandHandle cmd;
+            const BufferObject* src;
+            const BufferObject* dst;
+        };
+
+    public:
+        /// <summary>
+        /// Nodes run in the order they were added, bound resources must stay alive until the graph is done
+        /// Constant buffers are read when the graph is submitted so dispatches using the same one see the same data
+        /// </summary>
+        NINNIKU_API void AddDispatch(CommandHandle&& cmd);
+        NINNIKU_API void AddCopy(const CopyBufferSubresourceParam& params);
+        NINNIKU_API void Clear();
+
+        const std::vector<Node>& GetNodes() const { return nodes_; }
+        bool IsEmpty() const { return nodes_.empty(); }
+
+    private:
+        std::vector<Node> nodes_;
+    };
+} // namespace ninniku
@@ -0,0 +1,150 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../../types.h"
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Native kernels, only used by RENDERER_CPU
+    //////////////////////////////////////////////////////////////////////////
+
+    struct KernelSubresource
+    {
+        uint8_t* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint32_t rowPitch;
+        uint32_t depthPitch;
+    };
+
+    /// <summary>
+    /// Resource bound to a kernel slot
+    /// Textures are seen as numMips x arraySize subresources where mip 0 is the first mip of the view
+    /// Buffers are a single subresource where width is the number of elements
+    /// </summary>
+    struct KernelResource
+    {
+        const KernelSubresource& GetSubresource(uint32_t mip, uint32_t slice) const { return subresources[mip + slice * numMips]; }
+
+        template<typename T>
+        T& At(uint32_t x, uint32_t y = 0, uint32_t slice = 0, uint32_t mip = 0) const
+        {
+            auto& sub = GetSubresource(mip, slice);
+
+            return *reinterpret_cast<T*>(sub.data + static_cast<size_t>(y) * sub.rowPitch + static_cast<size_t>(x) * sizeof(T));
+        }
+
+        const KernelSubresource* subresources;
+        uint32_t numMips;
+        uint32_t arraySize;
+
+        // size of one element in bytes
+        uint32_t stride;
+
+        // TF_UNKNOWN for buffers
+        ETextureFormat format;
+    };
+
+    /// <summary>
+    /// What a kernel receives for each thread group
+    /// Bindings are in the same order as the names declared in KernelDesc, unbound slots are null
+    /// </summary>
+    struct KernelContext
+    {
+        template<typename T>
+        const T* GetCBuffer() const { return static_cast<const T*>(cbuffer); }
+
+        const KernelResource* GetSRV(uint32_t slot) const { return srvs[slot]; }
+        const KernelResource* GetUAV(uint32_t slot) const { return uavs[slot]; }
+        ESamplerState GetSampler(uint32_t slot) const { return samplers[slot]; }
+
+        /// <summary>
+        /// Call fn(x, y, z) for every SV_DispatchThreadID of the group
+        /// </summary>
+        template<typename Fn>
+        void ForEachThread(Fn&& fn) const
+        {
+            ForEachRow([&](uint32_t xBegin, uint32_t xEnd, uint32_t y, uint32_t z)
+            {
+                for (auto x = xBegin; x < xEnd; ++x) {
+                    fn(x, y, z);
+                }
+            });
+        }
+
+        /// <summary>
+        /// Call fn(xBegin, xEnd, y, z) for every row of the group so kernels can work on contiguous spans
+        /// </summary>
+        template<typename Fn>
+        void ForEachRow(Fn&& fn) const
+        {
+            auto xBegin = groupID[0] * numThreads[0];
+            auto xEnd = xBegin + numThreads[0];
+
+            for (uint32_t z = groupID[2] * numThreads[2]; z < (groupID[2] + 1) * numThreads[2]; ++z) {
+                for (uint32_t y = groupID[1] * numThreads[1]; y < (groupID[1] + 1) * numThreads[1]; ++y) {
+                    fn(xBegin, xEnd, y, z);
+                }
+            }
+        }
+
+        std::array<uint32_t, 3> groupID;
+        std::array<uint32_t, 3> numThreads;
+        const void* cbuffer;
+        const KernelResource* const* srvs;
+        const KernelResource* const* uavs;
+        const ESamplerState* samplers;
+    };
+
+    // executed once per thread group, groups are distributed over every core
+    using KernelFunction = std::function<void(const KernelContext&)>;
+
+    struct KernelDesc
+    {
+        // must match Command::shader
+        std::string name;
+        std::array<uint32_t, 3> numThreads;
+
+        // binding names as used in Command::srvBindings, uavBindings and ssBindings
+        std::vector<std::string> srvNames;
+        std::vector<std::string> uavNames;
+        std::vector<std::string> samplerNames;
+
+        // used when Command::cbufferStr is empty, can be empty if the kernel has no constant buffer
+        std::string cbufferName;
+
+        KernelFunction function;
+    };
+
+    /// <summary>
+    /// Register a native kernel that Dispatch will run when Command::shader matches its name
+    /// Requires RENDERER_CPU, registering an existing name replaces the previous kernel
+    /// </summary>
+    [[nodiscard]] NINNIKU_API bool RegisterKernel(const KernelDesc& desc);
+} // namespace ninniku
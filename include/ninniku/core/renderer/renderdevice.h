@@ -22,6 +22,7 @@
 
 #include "../../ninniku.h"
 #include "../../types.h"
+#include "command_graph.h"
 #include "types.h"
 
 #include <filesystem>
@@ -63,9 +64,26 @@ namespace ninniku
         [[nodiscard]] virtual bool LoadShader(const std::string_view& name, const void* pData, const uint32_t size) = 0;
         [[nodiscard]] virtual MappedResourceHandle Map(const BufferHandle& bObj) = 0;
         [[nodiscard]] virtual MappedResourceHandle Map(const TextureHandle& tObj, const uint32_t index) = 0;
+        [[nodiscard]] virtual ReadbackHandle ReadbackTexture(const ReadbackTextureParam& params) = 0;
         [[nodiscard]] virtual bool UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size) = 0;
 
+        /// <summary>
+        /// Same as Dispatch and CopyBufferResource but return once the work is submitted instead of waiting for it
+        /// Work runs in submission order and only starts once waitFor, which can be null, is complete
+        /// The command and constant buffers can be changed right away but the bound resources must stay alive until the fence completes
+        /// Returns null if the work could not be submitted
+        /// </summary>
+        [[nodiscard]] virtual FenceHandle DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor) = 0;
+        [[nodiscard]] virtual FenceHandle CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor) = 0;
+
+        /// <summary>
+        /// Submit every node of the graph at once with the same rules as DispatchAsync
+        /// Renderers with explicit barriers only add the ones the graph needs, see CompileGraph
+        /// </summary>
+        [[nodiscard]] virtual FenceHandle Submit(const CommandGraph& graph, const FenceHandle& waitFor) = 0;
+
         virtual const SamplerState* GetSampler(ESamplerState sampler) const = 0;
+        virtual ResourceStats GetResourceStats() const = 0;
 
     protected:
         RenderDevice() = default;
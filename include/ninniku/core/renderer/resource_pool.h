@@ -0,0 +1,121 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "../../export.h"
+#include "../../types.h"
+#include "renderdevice.h"
+
+#include <array>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace ninniku
+{
+    struct ResourcePoolDesc
+    {
+        // bytes kept by released resources waiting to be reused, 0 means no limit
+        // the least recently released ones are freed first once it is exceeded
+        uint64_t budget = 0;
+    };
+
+    struct ResourcePoolStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+
+        // released resources waiting to be reused
+        uint32_t numPooled;
+        uint64_t pooledBytes;
+    };
+
+    /// <summary>
+    /// Recycle textures and buffers that have the same description instead of creating new ones
+    /// Only uses the RenderDevice interface so it works with every renderer
+    /// Resources released to the pool must have been acquired from it or created by the same renderer
+    /// </summary>
+    class ResourcePool final : NonCopyable
+    {
+    public:
+        NINNIKU_API ResourcePool(RenderDeviceHandle& dx, const ResourcePoolDesc& desc = ResourcePoolDesc{});
+        NINNIKU_API ~ResourcePool();
+
+        /// <summary>
+        /// Return a released texture or buffer with the same description, their content is undefined
+        /// Textures with initial data are always created since the renderer has no way to update a recycled one
+        /// </summary>
+        [[nodiscard]] NINNIKU_API BufferHandle AcquireBuffer(const BufferParamHandle& params);
+        [[nodiscard]] NINNIKU_API TextureHandle AcquireTexture(const TextureParamHandle& params);
+
+        NINNIKU_API void Release(BufferHandle&& buffer);
+        NINNIKU_API void Release(TextureHandle&& texture);
+
+        /// <summary>
+        /// Free every pooled resource, needed if the renderer is terminated and initialized again
+        /// </summary>
+        NINNIKU_API void Clear();
+
+        NINNIKU_API ResourcePoolStats GetStats() const;
+
+    private:
+        // (format, width, height, depth, mips, array, viewflags) for textures, (elementSize, numElements, viewflags) for buffers
+        struct Key
+        {
+            std::array<uint32_t, 8> values;
+
+            bool operator==(const Key& other) const { return values == other.values; }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const noexcept;
+        };
+
+        struct Entry
+        {
+            Key key;
+            uint64_t size;
+            BufferHandle buffer;
+            TextureHandle texture;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        static Key MakeKey(const BufferParam& params);
+        static Key MakeKey(const TextureParam& params);
+
+        bool Pop(const Key& key, Entry& entry);
+        void Push(Entry&& entry);
+
+    private:
+        RenderDeviceHandle& dx_;
+        ResourcePoolDesc desc_;
+
+        mutable std::mutex mutex_;
+
+        // front is the most recently released
+        EntryList lru_;
+        std::unordered_multimap<Key, EntryList::iterator, KeyHash> free_;
+        ResourcePoolStats stats_;
+    };
+} // namespace ninniku
@@ -23,9 +23,12 @@
 #include "../../types.h"
 #include "../../utils.h"
 
+#include <algorithm>
 #include <array>
 #include <memory>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace ninniku
 {
@@ -70,14 +73,122 @@ namespace ninniku
     // Commands
     //////////////////////////////////////////////////////////////////////////
 
+    // Bindings of a command sorted by name, the same bindings hash the same whatever order they were inserted in
+    // up to CAPACITY bindings are stored inline so filling a command doesn't allocate, larger tables move to the heap
+    template<typename ViewType>
+    class BindingTable
+    {
+    public:
+        static constexpr uint32_t CAPACITY = 16;
+
+        using value_type = std::pair<std::string_view, const ViewType*>;
+        using const_iterator = const value_type*;
+
+        const_iterator begin() const noexcept { return heap_.empty() ? bindings_.data() : heap_.data(); }
+        const_iterator end() const noexcept { return begin() + size_; }
+
+        bool empty() const noexcept { return size_ == 0; }
+        uint32_t size() const noexcept { return size_; }
+
+        void clear() noexcept
+        {
+            heap_.clear();
+            size_ = 0;
+            hashValid_ = false;
+        }
+
+        const_iterator find(const std::string_view& name) const noexcept
+        {
+            auto found = LowerBound(name);
+
+            return ((found != end()) && (found->first == name)) ? found : end();
+        }
+
+        // like std::unordered_map, an existing binding is left untouched
+        std::pair<const_iterator, bool> insert(const value_type& binding)
+        {
+            auto index = static_cast<uint32_t>(LowerBound(binding.first) - begin());
+
+            if ((index < size_) && (begin()[index].first == binding.first))
+                return { begin() + index, false };
+
+            if ((size_ == CAPACITY) && heap_.empty())
+                heap_.assign(bindings_.begin(), bindings_.end());
+
+            if (heap_.empty()) {
+                std::move_backward(bindings_.begin() + index, bindings_.begin() + size_, bindings_.begin() + size_ + 1);
+                bindings_[index] = binding;
+            } else {
+                heap_.insert(heap_.begin() + index, binding);
+            }
+
+            ++size_;
+            hashValid_ = false;
+
+            return { begin() + index, true };
+        }
+
+        // the reference must not be kept around since it would bypass the cached hash
+        const ViewType*& operator[](const std::string_view& name)
+        {
+            auto index = static_cast<uint32_t>(insert({ name, nullptr }).first - begin());
+
+            hashValid_ = false;
+
+            return (heap_.empty() ? bindings_[index] : heap_[index]).second;
+        }
+
+        // FNV-1a of the names and views, cached until the bindings change
+        uint32_t GetHash() const noexcept
+        {
+            if (hashValid_)
+                return hash_;
+
+            uint32_t res = 2166136261u;
+
+            auto process = [&res](const void* data, const size_t size)
+            {
+                auto bytes = static_cast<const uint8_t*>(data);
+
+                for (size_t i = 0; i < size; ++i)
+                    res = (res ^ bytes[i]) * 16777619u;
+            };
+
+            for (auto& binding : *this) {
+                process(binding.first.data(), binding.first.size());
+                process(&binding.second, sizeof(binding.second));
+            }
+
+            hash_ = res;
+            hashValid_ = true;
+
+            return res;
+        }
+
+    private:
+        const_iterator LowerBound(const std::string_view& name) const noexcept
+        {
+            return std::lower_bound(begin(), end(), name, [](const value_type& binding, const std::string_view& value) { return binding.first < value; });
+        }
+
+    private:
+        std::array<value_type, CAPACITY> bindings_;
+
+        // only used once the inline storage is full
+        std::vector<value_type> heap_;
+        uint32_t size_ = 0;
+        mutable uint32_t hash_ = 0;
+        mutable bool hashValid_ = false;
+    };
+
     struct Command : NonCopyable
     {
         std::string_view shader;
         std::string_view cbufferStr;
         std::array<uint32_t, 3> dispatch;
-        std::unordered_map<std::string_view, const ShaderResourceView*> srvBindings;
-        std::unordered_map<std::string_view, const UnorderedAccessView*> uavBindings;
-        std::unordered_map<std::string_view, const SamplerState*> ssBindings;
+        BindingTable<ShaderResourceView> srvBindings;
+        BindingTable<UnorderedAccessView> uavBindings;
+        BindingTable<SamplerState> ssBindings;
     };
 
     using CommandHandle = std::unique_ptr<Command>;
@@ -92,6 +203,20 @@ namespace ninniku
 
     using DebugMarkerHandle = std::unique_ptr<const DebugMarker>;
 
+    //////////////////////////////////////////////////////////////////////////
+    // Fences: completion of work submitted with RenderDevice::DispatchAsync or CopyBufferResourceAsync
+    //////////////////////////////////////////////////////////////////////////
+    struct FenceObject : NonCopyable
+    {
+        // does not block, true once the work is done whether it succeeded or not
+        virtual bool IsComplete() const = 0;
+
+        // block until the work is done, returns false if it failed
+        virtual bool Wait() const = 0;
+    };
+
+    using FenceHandle = std::shared_ptr<const FenceObject>;
+
     //////////////////////////////////////////////////////////////////////////
     // MappedResource: GPU to CPU readback
     //////////////////////////////////////////////////////////////////////////
@@ -103,6 +228,37 @@ namespace ninniku
 
     using MappedResourceHandle = std::unique_ptr<const MappedResource>;
 
+    struct ReadbackSubresource
+    {
+        uint32_t face;
+        uint32_t mip;
+        const uint8_t* data;
+        uint32_t rowPitch;
+    };
+
+    // result of RenderDevice::ReadbackTexture, data stays valid as long as this is alive
+    struct Readback : NonCopyable
+    {
+        std::vector<ReadbackSubresource> subresources;
+        std::vector<MappedResourceHandle> mappings;
+    };
+
+    using ReadbackHandle = std::unique_ptr<const Readback>;
+
+    //////////////////////////////////////////////////////////////////////////
+    // ResourceStats: buffers and textures owned by a RenderDevice
+    //////////////////////////////////////////////////////////////////////////
+    struct ResourceStats
+    {
+        uint32_t numLiveObjects;
+
+        // exact for RENDERER_CPU and RENDERER_DX12, estimated from the description for RENDERER_DX11
+        uint64_t liveBytes;
+
+        uint64_t numCreated;
+        uint64_t numReleased;
+    };
+
     //////////////////////////////////////////////////////////////////////////
     // Textures
     //////////////////////////////////////////////////////////////////////////
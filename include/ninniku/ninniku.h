@@ -35,7 +35,8 @@ namespace ninniku
         IF_BC7_QUICK_MODE = 1 << 0,
         IF_DisableDX12DebugLayer = 1 << 1,
         IF_EnableCapture = 1 << 2,
-        IF_SafeAndSlowDX12 = 1 << 4
+        IF_SafeAndSlowDX12 = 1 << 4,
+        IF_LazyShaderLoading = 1 << 5   // shaders found in shaderPaths are only loaded by the first Dispatch using them
     };
 
     enum class ELogLevel : uint8_t
@@ -52,6 +53,7 @@ namespace ninniku
         RENDERER_WARP = 0x1,
         RENDERER_DX11 = 0x2,
         RENDERER_DX12 = 0x4,
+        RENDERER_CPU = 0x8,     // Compute is done on the host with native kernels, no GPU required
         RENDERER_WARP_DX11 = RENDERER_WARP | RENDERER_DX11,
         RENDERER_WARP_DX12 = RENDERER_WARP | RENDERER_DX12
     };
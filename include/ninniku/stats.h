@@ -0,0 +1,100 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "export.h"
+#include "core/renderer/types.h"
+
+#include <array>
+#include <cstdint>
+
+namespace ninniku
+{
+    enum EStatCounter : uint8_t
+    {
+        SC_Dispatches,
+        SC_Copies,
+        SC_BytesUploaded,       // initial data and constant buffers
+        SC_BytesReadback,
+        SC_ImagesLoaded,
+        SC_ImagesMapped,        // DDS loaded by mapping the file instead of copying it
+        SC_ShadersLoaded,
+        SC_ReflectionCacheHits, // shaders loaded without reflecting them again
+        SC_ReflectionCacheMisses,
+        SC_Count
+    };
+
+    enum EStatLatency : uint8_t
+    {
+        SL_Load,
+        SL_Dispatch,
+        SL_Flush,               // only RENDERER_DX12 has to wait for a command list to complete
+        SL_Map,
+        SL_SaveCompressedImage,
+        SL_ShaderLoad,
+        SL_Count
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // LatencyHistogram: log-linear buckets of microseconds like HdrHistogram
+    // each power of 2 is split in NUM_SUB_BUCKETS so a bucket is within 12.5% of its values
+    //////////////////////////////////////////////////////////////////////////
+    struct LatencyHistogram
+    {
+        static constexpr uint32_t SUB_BUCKET_BITS = 3;
+        static constexpr uint32_t NUM_SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+        // longer durations all land in the last bucket, 2^40us is about 12 days
+        static constexpr uint32_t MAX_BITS = 40;
+        static constexpr uint32_t NUM_BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * NUM_SUB_BUCKETS;
+
+        uint64_t count;
+        uint64_t totalUs;
+        uint64_t maxUs;
+        std::array<uint64_t, NUM_BUCKETS> buckets;
+
+        NINNIKU_API static uint32_t GetBucket(uint64_t us);
+
+        // smallest value that goes into the bucket
+        NINNIKU_API static uint64_t GetBucketLowerBound(uint32_t bucket);
+
+        /// <summary>
+        /// Upper bound of the bucket containing the given percentile (0-100), never more than maxUs
+        /// </summary>
+        NINNIKU_API uint64_t GetValueAtPercentile(double percentile) const;
+    };
+
+    struct Stats
+    {
+        std::array<uint64_t, SC_Count> counters;
+        std::array<LatencyHistogram, SL_Count> latencies;
+
+        // buffers and textures alive in the current renderer, empty without one
+        ResourceStats resources;
+    };
+
+    /// <summary>
+    /// Snapshot of everything recorded by every thread since the process started
+    /// Counters only go up, monitoring should compute the difference between two snapshots
+    /// Recording is lock free, only taking a snapshot or starting/exiting a thread takes a lock
+    /// </summary>
+    NINNIKU_API Stats GetStats();
+} // namespace ninniku
@@ -76,6 +76,14 @@ namespace ninniku
         uint32_t dstMip;
     };
 
+    // copies every mip of faces [firstFace, firstFace + numFaces) to the CPU at once
+    struct ReadbackTextureParam : NonCopyable
+    {
+        const TextureObject* src;
+        uint32_t firstFace;
+        uint32_t numFaces;
+    };
+
     struct SubresourceParam
     {
         void* data;
@@ -131,6 +139,9 @@ namespace ninniku
 
         // one per face/mip/array etc..
         std::vector<SubresourceParam> imageDatas;
+
+        // optional, keeps the memory imageDatas point to alive (eg: a memory mapped file)
+        std::shared_ptr<const void> imageDatasOwner;
     };
 
     using TextureParamHandle = std::shared_ptr<const TextureParam>;
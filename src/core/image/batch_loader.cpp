@@ -0,0 +1,210 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "ninniku/core/image/batch_loader.h"
+
+#include "ninniku/core/image/cmft.h"
+#include "ninniku/core/image/dds.h"
+#include "ninniku/core/image/generic.h"
+
+#include "../../globals.h"
+#include "../../utils/log.h"
+#include "../../utils/trace.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace ninniku
+{
+    // shared between the thread reading the files and the decoding tasks
+    struct BatchState
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        uint64_t inFlight = 0;
+        uint32_t pending = 0;
+        bool success = true;
+    };
+
+    struct BatchJob
+    {
+        uint32_t index;
+        ImageHandle image;
+        std::vector<uint8_t> data;
+    };
+
+    static ImageHandle CreateImageFromExtension(const std::string_view& path)
+    {
+        auto ext = std::filesystem::path{ path }.extension();
+
+        if (ext == ".dds")
+            return std::make_unique<ddsImage>();
+
+        if (ext == ".exr")
+            return std::make_unique<cmftImage>();
+
+        return std::make_unique<genericImage>();
+    }
+
+    static bool ReadWholeFile(const std::string& path, std::vector<uint8_t>& dst)
+    {
+        std::ifstream file{ std::filesystem::path{ path }, std::ios::binary };
+
+        if (!file)
+            return false;
+
+        file.read(reinterpret_cast<char*>(dst.data()), dst.size());
+
+        return file.gcount() == static_cast<std::streamsize>(dst.size());
+    }
+
+    BatchLoader::BatchLoader(const BatchLoaderDesc& desc)
+        : desc_{ desc }
+    {
+        if (!desc_.factory)
+            desc_.factory = CreateImageFromExtension;
+    }
+
+    bool BatchLoader::Load(const std::vector<std::string>& paths, const BatchLoadCallback& callback)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        auto pool = Globals::Instance().threadPool_.get();
+        auto maxInFlight = desc_.maxInFlightBytes;
+        BatchState state;
+
+        auto fail = [&](const uint32_t index, const char* reason)
+        {
+            LOGEF(boost::format("BatchLoader::Load, %1% \"%2%\"") % reason % paths[index]);
+
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.success = false;
+            }
+
+            callback(index, nullptr);
+        };
+
+        auto decode = [&](BatchJob& job)
+        {
+            uint64_t fileSize = job.data.size();
+            uint64_t imageSize = 0;
+            auto loaded = job.image->LoadRaw(job.data.data(), job.data.size());
+
+            std::vector<uint8_t>().swap(job.data);
+
+            if (loaded)
+                imageSize = std::get<1>(job.image->GetData());
+            else
+                job.image.reset();
+
+            // the decoded image replaces the file contents until the callback is done with it
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.inFlight = state.inFlight - fileSize + imageSize;
+            }
+
+            if (loaded)
+                callback(job.index, std::move(job.image));
+            else
+                fail(job.index, "failed to decode");
+
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.inFlight -= imageSize;
+                --state.pending;
+
+                // Load can return and destroy the state and this lambda as soon as the lock is released
+                state.cv.notify_all();
+            }
+        };
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(paths.size()); ++i) {
+            auto& path = paths[i];
+            auto job = std::make_shared<BatchJob>();
+
+            job->index = i;
+            job->image = desc_.factory(path);
+
+            if (!job->image) {
+                fail(i, "no image type for");
+                continue;
+            }
+
+            std::error_code ec;
+            uint64_t size = std::filesystem::file_size(path, ec);
+
+            if (ec) {
+                fail(i, "could not find");
+                continue;
+            }
+
+            // a file bigger than the budget can only go through once everything else is done
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+
+                HelpUntil(pool, state.cv, lock, [&state, size, maxInFlight]() { return (state.inFlight == 0) || (state.inFlight + size <= maxInFlight); });
+
+                state.inFlight += size;
+                ++state.pending;
+            }
+
+            job->data.resize(size);
+
+            if (!ReadWholeFile(path, job->data)) {
+                std::vector<uint8_t>().swap(job->data);
+
+                {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    state.inFlight -= size;
+                    --state.pending;
+                    state.cv.notify_all();
+                }
+
+                fail(i, "could not read");
+                continue;
+            }
+
+            if (pool != nullptr) {
+                pool->Submit([&decode, job]()
+                {
+                    decode(*job);
+                });
+            } else {
+                decode(*job);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+
+        HelpUntil(pool, state.cv, lock, [&state]() { return state.pending == 0; });
+
+        return state.success;
+    }
+
+    std::future<bool> BatchLoader::LoadAsync(std::vector<std::string> paths, BatchLoadCallback callback)
+    {
+        return std::async(std::launch::async, [this, paths = std::move(paths), callback = std::move(callback)]()
+        {
+            return Load(paths, callback);
+        });
+    }
+} // namespace ninniku
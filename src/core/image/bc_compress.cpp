@@ -0,0 +1,323 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "bc_compress.h"
+
+#include "../../globals.h"
+#include "../../utils/log.h"
+#include "../../utils/misc.h"
+#include "../../utils/trace.h"
+#include "bc_encoder.h"
+
+#include <cmath>
+#include <fstream>
+
+namespace ninniku
+{
+    // texels compressed by a single task, small enough for mips and cube faces to be split across every core
+    static constexpr uint32_t BC_STRIP_TEXELS = 64 * 1024;
+    static constexpr uint32_t BC_BLOCK_SIZE = 4;
+
+    struct BCStrip
+    {
+        uint32_t image;
+        uint32_t firstRow;
+        uint32_t numRows;
+    };
+
+    // shared between the thread writing the file and the compression tasks
+    struct BCPipelineState
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        // strips left to compress for each image
+        std::vector<uint32_t> remaining;
+        uint32_t pending = 0;
+        double squaredError = 0.0;
+        bool success = true;
+
+        // a strip with alpha went to DirectXTex because the BC7 modes allowed have none
+        bool alphaFallback = false;
+    };
+
+    static uint32_t GetNumBCChannels(const DXGI_FORMAT format)
+    {
+        switch (format) {
+            case DXGI_FORMAT_BC4_TYPELESS:
+            case DXGI_FORMAT_BC4_UNORM:
+            case DXGI_FORMAT_BC4_SNORM:
+                return 1;
+
+            case DXGI_FORMAT_BC5_TYPELESS:
+            case DXGI_FORMAT_BC5_UNORM:
+            case DXGI_FORMAT_BC5_SNORM:
+                return 2;
+
+            case DXGI_FORMAT_BC1_TYPELESS:
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+            case DXGI_FORMAT_BC6H_TYPELESS:
+            case DXGI_FORMAT_BC6H_UF16:
+            case DXGI_FORMAT_BC6H_SF16:
+                return 3;
+
+            default:
+                return 4;
+        }
+    }
+
+    bool AccumulateSquaredError(const DirectX::Image& src, const DirectX::Image& compressed, double& sum)
+    {
+        float mse = 0.f;
+        float mseV[4] = {};
+
+        // DirectXTex decompresses the blocks before comparing them
+        auto hr = DirectX::ComputeMSE(src, compressed, mse, mseV);
+
+        if (CheckAPIFailed(hr, "DirectX::ComputeMSE"))
+            return false;
+
+        auto numTexels = static_cast<double>(src.width) * src.height;
+
+        for (uint32_t i = 0; i < GetNumBCChannels(compressed.format); ++i)
+            sum += mseV[i] * numTexels;
+
+        return true;
+    }
+
+    float GetRMSE(const double squaredError, const DirectX::Image* images, const size_t numImages, const DXGI_FORMAT format)
+    {
+        double numTexels = 0.0;
+
+        for (size_t i = 0; i < numImages; ++i)
+            numTexels += static_cast<double>(images[i].width) * images[i].height;
+
+        if (numTexels == 0.0)
+            return 0.f;
+
+        return static_cast<float>(std::sqrt(squaredError / (numTexels * GetNumBCChannels(format))));
+    }
+
+    static bool CompressStrip(const DirectX::Image& src, const DirectX::Image& dst, const BCStrip& strip, const BCCompressParam& param, double* squaredError, bool& alphaFallback)
+    {
+        auto view = src;
+
+        view.height = strip.numRows;
+        view.slicePitch = src.rowPitch * strip.numRows;
+        view.pixels = src.pixels + strip.firstRow * src.rowPitch;
+
+        // same width so a row of blocks has the same pitch in the strip and in the whole image
+        auto dstView = dst;
+        auto numBlockRows = (strip.numRows + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+
+        dstView.height = strip.numRows;
+        dstView.slicePitch = dst.rowPitch * numBlockRows;
+        dstView.pixels = dst.pixels + (strip.firstRow / BC_BLOCK_SIZE) * dst.rowPitch;
+
+        auto builtIn = UseBuiltInBCEncoder(param.format, param.desc);
+
+        // the built-in encoder reads 8 bits per channel, or half floats for BC6H
+        const DirectX::Image* source = &view;
+        DirectX::ScratchImage converted;
+
+        if (builtIn) {
+            auto sourceFormat = GetBuiltInSourceFormat(param.format);
+
+            if ((view.format != sourceFormat) && (DirectX::MakeSRGB(view.format) != DirectX::MakeSRGB(sourceFormat))) {
+                auto hr = DirectX::Convert(view, sourceFormat, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, converted);
+
+                if (CheckAPIFailed(hr, "DirectX::Convert"))
+                    return false;
+
+                source = converted.GetImage(0, 0, 0);
+            }
+
+            alphaFallback = !CanEncodeBuiltIn(*source, param.format, param.desc);
+            builtIn = !alphaFallback;
+        }
+
+        if (builtIn) {
+            EncodeBCImage(*source, param.format, param.desc, param.threshold, dstView.pixels, dstView.rowPitch);
+        } else {
+            DirectX::ScratchImage compressed;
+
+            // each strip is compressed serially, the parallelism comes from having many strips
+            auto flags = static_cast<DirectX::TEX_COMPRESS_FLAGS>(param.flags & ~DirectX::TEX_COMPRESS_PARALLEL);
+            auto hr = DirectX::Compress(view, param.format, flags, param.threshold, compressed);
+
+            if (CheckAPIFailed(hr, "DirectX::Compress"))
+                return false;
+
+            auto res = compressed.GetImage(0, 0, 0);
+
+            assert(res->rowPitch == dstView.rowPitch);
+
+            memcpy(dstView.pixels, res->pixels, res->slicePitch);
+        }
+
+        if (squaredError != nullptr)
+            return AccumulateSquaredError(view, dstView, *squaredError);
+
+        return true;
+    }
+
+    bool CompressToDDSFile(const DirectX::Image* images, const size_t numImages, const DirectX::TexMetadata& meta, const BCCompressParam& param, const std::filesystem::path& path, float* rmse)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        auto resMeta = DirectX::TexMetadata(meta);
+
+        resMeta.format = param.format;
+
+        DirectX::ScratchImage resImage;
+
+        auto hr = resImage.Initialize(resMeta);
+
+        if (CheckAPIFailed(hr, "DirectX::ScratchImage::Initialize"))
+            return false;
+
+        TRACE_ALLOC_IMAGE(resImage.GetPixels(), resImage.GetPixelsSize());
+
+        size_t headerSize = 0;
+
+        hr = DirectX::EncodeDDSHeader(resMeta, DirectX::DDS_FLAGS_FORCE_DX10_EXT, nullptr, 0, headerSize);
+
+        if (CheckAPIFailed(hr, "DirectX::EncodeDDSHeader"))
+            return false;
+
+        std::vector<uint8_t> header(headerSize);
+
+        hr = DirectX::EncodeDDSHeader(resMeta, DirectX::DDS_FLAGS_FORCE_DX10_EXT, header.data(), header.size(), headerSize);
+
+        if (CheckAPIFailed(hr, "DirectX::EncodeDDSHeader"))
+            return false;
+
+        std::ofstream stream{ path, std::ios::binary | std::ios::trunc };
+
+        if (!stream) {
+            LOGEF(boost::format("CompressToDDSFile: could not open \"%1%\"") % path.string());
+            return false;
+        }
+
+        stream.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+        // every image is cut in strips of whole block rows, only the last one of an image can be partial
+        BCPipelineState state;
+        std::vector<BCStrip> strips;
+
+        state.remaining.resize(numImages);
+
+        for (uint32_t i = 0; i < numImages; ++i) {
+            auto& img = images[i];
+            auto blocksWide = static_cast<uint32_t>((img.width + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE);
+            auto stripRows = std::max(1u, BC_STRIP_TEXELS / (blocksWide * BC_BLOCK_SIZE * BC_BLOCK_SIZE)) * BC_BLOCK_SIZE;
+            auto height = static_cast<uint32_t>(img.height);
+
+            for (uint32_t row = 0; row < height; row += stripRows) {
+                strips.push_back({ i, row, std::min(stripRows, height - row) });
+                ++state.remaining[i];
+            }
+        }
+
+        state.pending = static_cast<uint32_t>(strips.size());
+
+        auto resImages = resImage.GetImages();
+
+        auto compress = [&](const BCStrip& strip)
+        {
+            double squaredError = 0.0;
+            auto alphaFallback = false;
+            auto success = CompressStrip(images[strip.image], resImages[strip.image], strip, param, (rmse != nullptr) ? &squaredError : nullptr, alphaFallback);
+
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+
+                if (!success)
+                    state.success = false;
+
+                state.alphaFallback |= alphaFallback;
+
+                state.squaredError += squaredError;
+
+                --state.remaining[strip.image];
+                --state.pending;
+
+                // the writer can return and destroy the state as soon as the lock is released
+                state.cv.notify_all();
+            }
+        };
+
+        // strips are submitted in file order so the first subresources are ready to be written first
+        auto pool = Globals::Instance().threadPool_.get();
+
+        for (auto& strip : strips) {
+            if (pool != nullptr) {
+                pool->Submit([&compress, strip]()
+                {
+                    compress(strip);
+                });
+            } else {
+                compress(strip);
+            }
+        }
+
+        for (uint32_t i = 0; i < numImages; ++i) {
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+
+                HelpUntil(pool, state.cv, lock, [&state, i]() { return !state.success || (state.remaining[i] == 0); });
+
+                if (!state.success)
+                    break;
+            }
+
+            TRACE_SCOPED_NAMED_IMAGE("ninniku::CompressToDDSFile Write");
+
+            stream.write(reinterpret_cast<const char*>(resImages[i].pixels), resImages[i].slicePitch);
+        }
+
+        // tasks reference the state and the images so they must all be done before leaving
+        std::unique_lock<std::mutex> lock(state.mutex);
+
+        HelpUntil(pool, state.cv, lock, [&state]() { return state.pending == 0; });
+
+        TRACE_FREE_IMAGE(resImage.GetPixels());
+
+        stream.close();
+
+        if (!state.success || stream.fail()) {
+            std::error_code ec;
+
+            std::filesystem::remove(path, ec);
+
+            return false;
+        }
+
+        if (state.alphaFallback)
+            LOGWF(boost::format("BC7 mode mask 0x%1$02x has no mode with alpha, blocks with alpha were compressed by DirectXTex") % static_cast<uint32_t>(param.desc.bc7ModeMask));
+
+        if (rmse != nullptr)
+            *rmse = GetRMSE(state.squaredError, images, numImages, param.format);
+
+        return true;
+    }
+} // namespace ninniku
@@ -0,0 +1,48 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/core/image/dds.h"
+
+#include <DirectXTex.h>
+
+#include <filesystem>
+
+namespace ninniku
+{
+    struct BCCompressParam
+    {
+        DXGI_FORMAT format;
+        DWORD flags;            // TEX_COMPRESS_FLAGS for DirectXTex
+        float threshold;
+        CompressDesc desc;
+    };
+
+    // compress every face/mip/slice in strips of block rows on the shared pool
+    // subresources are written to path in file order as soon as they are complete so writing overlaps compression
+    // rmse is only computed when not null
+    bool CompressToDDSFile(const DirectX::Image* images, const size_t numImages, const DirectX::TexMetadata& meta, const BCCompressParam& param, const std::filesystem::path& path, float* rmse);
+
+    // squared error of the channels the compressed format stores, summed over every texel
+    bool AccumulateSquaredError(const DirectX::Image& src, const DirectX::Image& compressed, double& sum);
+
+    float GetRMSE(const double squaredError, const DirectX::Image* images, const size_t numImages, const DXGI_FORMAT format);
+} // namespace ninniku
@@ -0,0 +1,1326 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "bc_encoder.h"
+
+#include <cfloat>
+#include <emmintrin.h>
+
+namespace ninniku
+{
+    static constexpr uint32_t BC_BLOCK_TEXELS = 16;
+    static constexpr uint32_t BC_MAX_CHANNELS = 4;
+
+    // one array per channel so 4 texels are processed at once
+    struct alignas(16) ColorBlock
+    {
+        float c[BC_MAX_CHANNELS][BC_BLOCK_TEXELS];
+
+        // texels with a 0 weight are ignored, eg: BC1 transparent texels or the other subset of a BC7 partition
+        float weight[BC_BLOCK_TEXELS];
+    };
+
+    struct ColorEndpoints
+    {
+        float e0[BC_MAX_CHANNELS];
+        float e1[BC_MAX_CHANNELS];
+    };
+
+    struct ColorCandidate
+    {
+        uint16_t c0;
+        uint16_t c1;
+        uint8_t indices[BC_BLOCK_TEXELS];
+        float error;
+    };
+
+    static float HorizontalSum(__m128 v)
+    {
+        auto shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        auto sums = _mm_add_ps(v, shuf);
+
+        return _mm_cvtss_f32(_mm_add_ss(sums, _mm_movehl_ps(shuf, sums)));
+    }
+
+    static float HorizontalMin(__m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        return _mm_cvtss_f32(_mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    static float HorizontalMax(__m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        return _mm_cvtss_f32(_mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    static uint8_t HorizontalMin(__m128i v)
+    {
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 1));
+
+        return static_cast<uint8_t>(_mm_cvtsi128_si32(v));
+    }
+
+    static uint8_t HorizontalMax(__m128i v)
+    {
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+
+        return static_cast<uint8_t>(_mm_cvtsi128_si32(v));
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Endpoints fitting shared by every format
+    //////////////////////////////////////////////////////////////////////////
+    static __m128 LoadWeightMask(const ColorBlock& block, const uint32_t i)
+    {
+        return _mm_cmpgt_ps(_mm_load_ps(block.weight + i), _mm_setzero_ps());
+    }
+
+    static float GetTotalWeight(const ColorBlock& block)
+    {
+        auto lo = _mm_add_ps(_mm_load_ps(block.weight), _mm_load_ps(block.weight + 4));
+        auto hi = _mm_add_ps(_mm_load_ps(block.weight + 8), _mm_load_ps(block.weight + 12));
+
+        return HorizontalSum(_mm_add_ps(lo, hi));
+    }
+
+    static void GetChannelRange(const ColorBlock& block, const uint32_t channel, float& minValue, float& maxValue)
+    {
+        auto lo = _mm_set1_ps(FLT_MAX);
+        auto hi = _mm_set1_ps(-FLT_MAX);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+            auto mask = LoadWeightMask(block, i);
+            auto v = _mm_load_ps(block.c[channel] + i);
+
+            lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, _mm_set1_ps(FLT_MAX))));
+            hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, _mm_set1_ps(-FLT_MAX))));
+        }
+
+        minValue = HorizontalMin(lo);
+        maxValue = HorizontalMax(hi);
+    }
+
+    static float GetWeightedMean(const ColorBlock& block, const uint32_t channel, const float totalWeight)
+    {
+        auto sum = _mm_setzero_ps();
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(block.c[channel] + i), _mm_load_ps(block.weight + i)));
+
+        return HorizontalSum(sum) / totalWeight;
+    }
+
+    static float GetCovariance(const ColorBlock& block, const uint32_t x, const uint32_t y, const float mean[BC_MAX_CHANNELS])
+    {
+        auto sum = _mm_setzero_ps();
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+            auto dx = _mm_sub_ps(_mm_load_ps(block.c[x] + i), _mm_set1_ps(mean[x]));
+            auto dy = _mm_sub_ps(_mm_load_ps(block.c[y] + i), _mm_set1_ps(mean[y]));
+
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(dx, dy), _mm_load_ps(block.weight + i)));
+        }
+
+        return HorizontalSum(sum);
+    }
+
+    // corners of the bounding box along the diagonal that follows how the channels vary together
+    // inset to make up for the extremes being rarely used
+    static void FitRangeEndpoints(const ColorBlock& block, const uint32_t numChannels, ColorEndpoints& res)
+    {
+        auto totalWeight = GetTotalWeight(block);
+        float minValue[BC_MAX_CHANNELS];
+        float maxValue[BC_MAX_CHANNELS];
+        float mean[BC_MAX_CHANNELS];
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            GetChannelRange(block, i, minValue[i], maxValue[i]);
+            mean[i] = GetWeightedMean(block, i, totalWeight);
+
+            auto inset = (maxValue[i] - minValue[i]) / 16.f;
+
+            minValue[i] += inset;
+            maxValue[i] -= inset;
+        }
+
+        // green carries most of the luminance so the other channels are flipped when they go against it
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            if ((i != 1) && (GetCovariance(block, i, 1, mean) < 0.f))
+                std::swap(minValue[i], maxValue[i]);
+        }
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            res.e0[i] = maxValue[i];
+            res.e1[i] = minValue[i];
+        }
+    }
+
+    // extremes of the colors projected on their principal axis, found by power iteration on the covariance
+    static void FitPrincipalAxisEndpoints(const ColorBlock& block, const uint32_t numChannels, ColorEndpoints& res)
+    {
+        auto totalWeight = GetTotalWeight(block);
+        float mean[BC_MAX_CHANNELS];
+        float axis[BC_MAX_CHANNELS];
+        float cov[BC_MAX_CHANNELS][BC_MAX_CHANNELS];
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            float minValue;
+            float maxValue;
+
+            GetChannelRange(block, i, minValue, maxValue);
+
+            mean[i] = GetWeightedMean(block, i, totalWeight);
+            axis[i] = maxValue - minValue;
+        }
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            for (uint32_t j = i; j < numChannels; ++j)
+                cov[i][j] = cov[j][i] = GetCovariance(block, i, j, mean);
+        }
+
+        // the bounding box only loses the sign of the axis, so it is a good start
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            if ((i != 1) && (cov[i][1] < 0.f))
+                axis[i] = -axis[i];
+        }
+
+        for (uint32_t iter = 0; iter < 8; ++iter) {
+            float next[BC_MAX_CHANNELS] = {};
+            float norm = 0.f;
+
+            for (uint32_t i = 0; i < numChannels; ++i) {
+                for (uint32_t j = 0; j < numChannels; ++j)
+                    next[i] += cov[i][j] * axis[j];
+
+                norm = std::max(norm, std::abs(next[i]));
+            }
+
+            // a single color, or colors with no dominant direction
+            if (norm < FLT_EPSILON)
+                break;
+
+            for (uint32_t i = 0; i < numChannels; ++i)
+                axis[i] = next[i] / norm;
+        }
+
+        float lengthSq = 0.f;
+
+        for (uint32_t i = 0; i < numChannels; ++i)
+            lengthSq += axis[i] * axis[i];
+
+        if (lengthSq < FLT_EPSILON) {
+            for (uint32_t i = 0; i < numChannels; ++i) {
+                res.e0[i] = mean[i];
+                res.e1[i] = mean[i];
+            }
+
+            return;
+        }
+
+        auto minProj = _mm_set1_ps(FLT_MAX);
+        auto maxProj = _mm_set1_ps(-FLT_MAX);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+            auto proj = _mm_setzero_ps();
+
+            for (uint32_t j = 0; j < numChannels; ++j) {
+                auto d = _mm_sub_ps(_mm_load_ps(block.c[j] + i), _mm_set1_ps(mean[j]));
+
+                proj = _mm_add_ps(proj, _mm_mul_ps(d, _mm_set1_ps(axis[j])));
+            }
+
+            auto mask = LoadWeightMask(block, i);
+
+            minProj = _mm_min_ps(minProj, _mm_or_ps(_mm_and_ps(mask, proj), _mm_andnot_ps(mask, _mm_set1_ps(FLT_MAX))));
+            maxProj = _mm_max_ps(maxProj, _mm_or_ps(_mm_and_ps(mask, proj), _mm_andnot_ps(mask, _mm_set1_ps(-FLT_MAX))));
+        }
+
+        auto tMin = HorizontalMin(minProj) / lengthSq;
+        auto tMax = HorizontalMax(maxProj) / lengthSq;
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            res.e0[i] = mean[i] + axis[i] * tMax;
+            res.e1[i] = mean[i] + axis[i] * tMin;
+        }
+    }
+
+    static void FitEndpoints(const ColorBlock& block, const uint32_t numChannels, const EBCQuality quality, ColorEndpoints& res)
+    {
+        if (quality == EBCQuality::BCQ_Fast)
+            FitRangeEndpoints(block, numChannels, res);
+        else
+            FitPrincipalAxisEndpoints(block, numChannels, res);
+    }
+
+    // least squares endpoints for the indices, e0Weights[i] is how much e0 contributes to palette entry i
+    // returns false when they can't be solved
+    static bool RefineEndpoints(const ColorBlock& block, const uint8_t indices[BC_BLOCK_TEXELS], const float* e0Weights, const uint32_t numChannels, ColorEndpoints& res)
+    {
+        float aa = 0.f;
+        float ab = 0.f;
+        float bb = 0.f;
+        float ax[BC_MAX_CHANNELS] = {};
+        float bx[BC_MAX_CHANNELS] = {};
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+            auto a = e0Weights[indices[i]];
+            auto b = 1.f - a;
+            auto w = block.weight[i];
+
+            aa += w * a * a;
+            ab += w * a * b;
+            bb += w * b * b;
+
+            for (uint32_t j = 0; j < numChannels; ++j) {
+                ax[j] += w * a * block.c[j][i];
+                bx[j] += w * b * block.c[j][i];
+            }
+        }
+
+        auto det = aa * bb - ab * ab;
+
+        if (std::abs(det) < FLT_EPSILON)
+            return false;
+
+        for (uint32_t i = 0; i < numChannels; ++i) {
+            res.e0[i] = (ax[i] * bb - bx[i] * ab) / det;
+            res.e1[i] = (bx[i] * aa - ax[i] * ab) / det;
+        }
+
+        return true;
+    }
+
+    // nearest palette entry of every texel, returns the weighted squared error
+    static float SelectIndices(const ColorBlock& block, const float palette[][BC_MAX_CHANNELS], const uint32_t numEntries, const uint32_t numChannels, uint8_t indices[BC_BLOCK_TEXELS])
+    {
+        auto total = _mm_setzero_ps();
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+            auto best = _mm_set1_ps(FLT_MAX);
+            auto bestIndex = _mm_setzero_si128();
+
+            for (uint32_t k = 0; k < numEntries; ++k) {
+                auto dist = _mm_setzero_ps();
+
+                for (uint32_t j = 0; j < numChannels; ++j) {
+                    auto d = _mm_sub_ps(_mm_load_ps(block.c[j] + i), _mm_set1_ps(palette[k][j]));
+
+                    dist = _mm_add_ps(dist, _mm_mul_ps(d, d));
+                }
+
+                auto closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+
+                best = _mm_min_ps(dist, best);
+                bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(k)));
+            }
+
+            total = _mm_add_ps(total, _mm_mul_ps(best, _mm_load_ps(block.weight + i)));
+
+            alignas(16) int32_t res[4];
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(res), bestIndex);
+
+            for (uint32_t j = 0; j < 4; ++j)
+                indices[i + j] = static_cast<uint8_t>(res[j]);
+        }
+
+        return HorizontalSum(total);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // BC1 color
+    //////////////////////////////////////////////////////////////////////////
+    static uint16_t PackRGB565(const float rgb[3])
+    {
+        auto quantize = [](float value, float scale)
+        {
+            return static_cast<uint32_t>(std::clamp(value, 0.f, 255.f) * scale / 255.f + 0.5f);
+        };
+
+        return static_cast<uint16_t>((quantize(rgb[0], 31.f) << 11) | (quantize(rgb[1], 63.f) << 5) | quantize(rgb[2], 31.f));
+    }
+
+    static void UnpackRGB565(const uint16_t color, float rgb[3])
+    {
+        auto r = (color >> 11) & 0x1f;
+        auto g = (color >> 5) & 0x3f;
+        auto b = color & 0x1f;
+
+        rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+        rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+        rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    static void EvaluateColorEndpoints(const ColorBlock& block, const ColorEndpoints& endpoints, const bool transparent, ColorCandidate& res)
+    {
+        auto c0 = PackRGB565(endpoints.e0);
+        auto c1 = PackRGB565(endpoints.e1);
+
+        // c0 > c1 selects the 4 colors mode, otherwise 3 colors and transparent black
+        if (transparent ? (c0 > c1) : (c0 < c1))
+            std::swap(c0, c1);
+
+        float palette[4][BC_MAX_CHANNELS];
+        uint32_t numColors = 3;
+
+        UnpackRGB565(c0, palette[0]);
+        UnpackRGB565(c1, palette[1]);
+
+        if (c0 > c1) {
+            for (uint32_t i = 0; i < 3; ++i) {
+                palette[2][i] = (2.f * palette[0][i] + palette[1][i]) / 3.f;
+                palette[3][i] = (palette[0][i] + 2.f * palette[1][i]) / 3.f;
+            }
+
+            numColors = 4;
+        } else {
+            for (uint32_t i = 0; i < 3; ++i)
+                palette[2][i] = (palette[0][i] + palette[1][i]) * 0.5f;
+        }
+
+        res.c0 = c0;
+        res.c1 = c1;
+        res.error = SelectIndices(block, palette, numColors, 3, res.indices);
+
+        if (transparent) {
+            for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+                if (block.weight[i] == 0.f)
+                    res.indices[i] = 3;
+            }
+        }
+    }
+
+    static void WriteColorBlock(const ColorCandidate& candidate, uint8_t* dst)
+    {
+        uint32_t bits = 0;
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            bits |= static_cast<uint32_t>(candidate.indices[i]) << (2 * i);
+
+        dst[0] = static_cast<uint8_t>(candidate.c0);
+        dst[1] = static_cast<uint8_t>(candidate.c0 >> 8);
+        dst[2] = static_cast<uint8_t>(candidate.c1);
+        dst[3] = static_cast<uint8_t>(candidate.c1 >> 8);
+
+        for (uint32_t i = 0; i < 4; ++i)
+            dst[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+
+    static void LoadColorBlock(const uint8_t rgba[BC_BLOCK_TEXELS * 4], ColorBlock& block)
+    {
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+            for (uint32_t j = 0; j < BC_MAX_CHANNELS; ++j)
+                block.c[j][i] = rgba[i * 4 + j];
+
+            block.weight[i] = 1.f;
+        }
+    }
+
+    static void EncodeColorBlock(const uint8_t rgba[BC_BLOCK_TEXELS * 4], const EBCQuality quality, const bool allowTransparent, const uint8_t alphaThreshold, uint8_t* dst)
+    {
+        ColorBlock block;
+        auto transparent = false;
+
+        LoadColorBlock(rgba, block);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+            if (allowTransparent && (rgba[i * 4 + 3] < alphaThreshold)) {
+                block.weight[i] = 0.f;
+                transparent = true;
+            }
+        }
+
+        ColorCandidate best;
+
+        if (GetTotalWeight(block) == 0.f) {
+            best.c0 = 0;
+            best.c1 = 0;
+            memset(best.indices, 3, sizeof(best.indices));
+
+            WriteColorBlock(best, dst);
+            return;
+        }
+
+        ColorEndpoints endpoints;
+
+        FitEndpoints(block, 3, quality, endpoints);
+        EvaluateColorEndpoints(block, endpoints, transparent, best);
+
+        if ((quality != EBCQuality::BCQ_Fast) && !transparent) {
+            static constexpr float e0Weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+            for (uint32_t iter = 0; (iter < 2) && (best.c0 > best.c1); ++iter) {
+                ColorCandidate candidate;
+
+                if (!RefineEndpoints(block, best.indices, e0Weights, 3, endpoints))
+                    break;
+
+                EvaluateColorEndpoints(block, endpoints, false, candidate);
+
+                if (candidate.error >= best.error)
+                    break;
+
+                best = candidate;
+            }
+        }
+
+        WriteColorBlock(best, dst);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // BC4 single channel
+    //////////////////////////////////////////////////////////////////////////
+
+    // a0 > a1 interpolates 6 values between them, otherwise 4 and adds 0 and 255
+    static void BuildAlphaPalette(const uint8_t a0, const uint8_t a1, uint8_t palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+
+        if (a0 > a1) {
+            for (uint32_t i = 1; i < 7; ++i)
+                palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1 + 3) / 7);
+        } else {
+            for (uint32_t i = 1; i < 5; ++i)
+                palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1 + 2) / 5);
+
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // nearest palette entry of every value, returns the squared error
+    static uint32_t SelectAlphaIndices(const __m128i values, const uint8_t a0, const uint8_t a1, uint8_t indices[BC_BLOCK_TEXELS])
+    {
+        uint8_t palette[8];
+
+        BuildAlphaPalette(a0, a1, palette);
+
+        auto best = _mm_set1_epi8(-1);
+        auto bestIndex = _mm_setzero_si128();
+
+        for (uint32_t k = 0; k < 8; ++k) {
+            auto entry = _mm_set1_epi8(static_cast<char>(palette[k]));
+            auto dist = _mm_or_si128(_mm_subs_epu8(values, entry), _mm_subs_epu8(entry, values));
+            auto notCloser = _mm_cmpeq_epi8(_mm_min_epu8(dist, best), best);
+
+            best = _mm_min_epu8(dist, best);
+            bestIndex = _mm_or_si128(_mm_and_si128(notCloser, bestIndex), _mm_andnot_si128(notCloser, _mm_set1_epi8(static_cast<char>(k))));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), bestIndex);
+
+        auto zero = _mm_setzero_si128();
+        auto lo = _mm_unpacklo_epi8(best, zero);
+        auto hi = _mm_unpackhi_epi8(best, zero);
+        auto sq = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+
+        sq = _mm_add_epi32(sq, _mm_srli_si128(sq, 8));
+        sq = _mm_add_epi32(sq, _mm_srli_si128(sq, 4));
+
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(sq));
+    }
+
+    static void WriteAlphaBlock(const uint8_t a0, const uint8_t a1, const uint8_t indices[BC_BLOCK_TEXELS], uint8_t* dst)
+    {
+        uint64_t bits = 0;
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            bits |= static_cast<uint64_t>(indices[i]) << (3 * i);
+
+        dst[0] = a0;
+        dst[1] = a1;
+
+        for (uint32_t i = 0; i < 6; ++i)
+            dst[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+
+    static void EncodeAlphaBlock(const uint8_t values[BC_BLOCK_TEXELS], const EBCQuality quality, uint8_t* dst)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+        auto minValue = HorizontalMin(v);
+        auto maxValue = HorizontalMax(v);
+
+        uint8_t bestA0 = maxValue;
+        uint8_t bestA1 = minValue;
+        uint8_t bestIndices[BC_BLOCK_TEXELS];
+        auto bestError = SelectAlphaIndices(v, bestA0, bestA1, bestIndices);
+
+        if ((quality == EBCQuality::BCQ_Fast) || (bestError == 0)) {
+            WriteAlphaBlock(bestA0, bestA1, bestIndices, dst);
+            return;
+        }
+
+        uint8_t indices[BC_BLOCK_TEXELS];
+
+        auto tryEndpoints = [&](uint8_t a0, uint8_t a1)
+        {
+            auto error = SelectAlphaIndices(v, a0, a1, indices);
+
+            if (error < bestError) {
+                bestError = error;
+                bestA0 = a0;
+                bestA1 = a1;
+                memcpy(bestIndices, indices, sizeof(indices));
+            }
+        };
+
+        // the interpolated values rarely land on the extremes, moving the endpoints inward often gets closer
+        auto range = maxValue - minValue;
+        auto maxInset = std::min(3, range / 4);
+
+        for (int32_t inset0 = 0; inset0 <= maxInset; ++inset0) {
+            for (int32_t inset1 = 0; inset1 <= maxInset; ++inset1) {
+                if ((inset0 | inset1) != 0)
+                    tryEndpoints(static_cast<uint8_t>(maxValue - inset0), static_cast<uint8_t>(minValue + inset1));
+            }
+        }
+
+        // the 6 values mode gets 0 and 255 for free, fit the other values in between
+        auto zero = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+        auto full = _mm_cmpeq_epi8(v, _mm_set1_epi8(-1));
+        auto extremes = _mm_or_si128(zero, full);
+
+        if (_mm_movemask_epi8(extremes) != 0) {
+            // extremes don't count toward the range of the others
+            auto innerMin = HorizontalMin(_mm_or_si128(v, extremes));
+            auto innerMax = HorizontalMax(_mm_andnot_si128(extremes, v));
+
+            if (innerMin > innerMax)
+                innerMin = innerMax = 0;
+
+            tryEndpoints(innerMin, innerMax);
+        }
+
+        WriteAlphaBlock(bestA0, bestA1, bestIndices, dst);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // BC7/BC6H shared
+    //////////////////////////////////////////////////////////////////////////
+    static constexpr uint32_t BC7_WEIGHTS3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    static constexpr uint32_t BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // bit n is set when texel n belongs to the second subset
+    static constexpr uint16_t BC7_PARTITIONS2[64] = {
+        0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+        0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+        0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+        0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+    };
+
+    // texel of the second subset whose index has an implicit 0 msb, the first subset always uses texel 0
+    static constexpr uint8_t BC7_ANCHORS2[64] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+        15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+        6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+    };
+
+    static constexpr uint32_t BC7_NUM_PARTITIONS = 64;
+
+    // modes implemented below, other masks are left to DirectXTex
+    static constexpr uint8_t BC7_BUILT_IN_MODES = (1 << 1) | (1 << 6);
+
+    // fields are packed from the lowest bit of the block
+    class BlockWriter
+    {
+    public:
+        BlockWriter(uint8_t* dst)
+            : dst_{ dst }
+            , bit_{ 0 }
+        {
+            memset(dst_, 0, 16);
+        }
+
+        void Write(const uint32_t value, const uint32_t numBits)
+        {
+            for (uint32_t i = 0; i < numBits; ++i, ++bit_) {
+                if ((value >> i) & 1)
+                    dst_[bit_ >> 3] |= static_cast<uint8_t>(1 << (bit_ & 7));
+            }
+        }
+
+    private:
+        uint8_t* dst_;
+        uint32_t bit_;
+    };
+
+    static uint32_t Interpolate(const uint32_t e0, const uint32_t e1, const uint32_t weight)
+    {
+        return (e0 * (64 - weight) + e1 * weight + 32) >> 6;
+    }
+
+    // how much e0 contributes to each palette entry
+    static void GetE0Weights(const uint32_t* weights, const uint32_t numEntries, float* res)
+    {
+        for (uint32_t i = 0; i < numEntries; ++i)
+            res[i] = 1.f - weights[i] / 64.f;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // BC7, modes 1 and 6
+    //////////////////////////////////////////////////////////////////////////
+    struct BC7Mode
+    {
+        uint32_t numChannels;
+        uint32_t bits;          // per channel, without the p-bit
+        bool sharedPBit;
+        const uint32_t* weights;
+        uint32_t numEntries;
+    };
+
+    // 2 subsets RGB 6 bits, one p-bit per subset, 3 bits indices
+    static constexpr BC7Mode BC7_MODE1 = { 3, 6, true, BC7_WEIGHTS3, 8 };
+
+    // 1 subset RGBA 7 bits, one p-bit per endpoint, 4 bits indices
+    static constexpr BC7Mode BC7_MODE6 = { 4, 7, false, BC7_WEIGHTS4, 16 };
+
+    struct BC7Endpoints
+    {
+        uint8_t q[2][BC_MAX_CHANNELS];
+        uint8_t pbits[2];
+        uint8_t indices[BC_BLOCK_TEXELS];
+        float error;
+    };
+
+    static uint32_t QuantizeBC7(const float value, const uint32_t pbit, const uint32_t bits)
+    {
+        auto maxValue = static_cast<float>((1u << (bits + 1)) - 1);
+        auto target = std::clamp(value, 0.f, 255.f) * maxValue / 255.f;
+        auto q = static_cast<int32_t>((target - pbit) * 0.5f + 0.5f);
+
+        return static_cast<uint32_t>(std::clamp(q, 0, (1 << bits) - 1));
+    }
+
+    // the p-bit becomes the lsb, then the msbs are replicated to reach 8 bits
+    static uint32_t ExpandBC7(const uint32_t q, const uint32_t pbit, const uint32_t bits)
+    {
+        auto value = (q << 1) | pbit;
+        auto numBits = bits + 1;
+
+        return (value << (8 - numBits)) | (value >> (2 * numBits - 8));
+    }
+
+    static void EvaluateBC7(const ColorBlock& block, const ColorEndpoints& endpoints, const BC7Mode& mode, const uint8_t pbit0, const uint8_t pbit1, BC7Endpoints& res)
+    {
+        float palette[16][BC_MAX_CHANNELS];
+
+        res.pbits[0] = pbit0;
+        res.pbits[1] = pbit1;
+
+        for (uint32_t i = 0; i < mode.numChannels; ++i) {
+            res.q[0][i] = static_cast<uint8_t>(QuantizeBC7(endpoints.e0[i], pbit0, mode.bits));
+            res.q[1][i] = static_cast<uint8_t>(QuantizeBC7(endpoints.e1[i], pbit1, mode.bits));
+
+            auto a = ExpandBC7(res.q[0][i], pbit0, mode.bits);
+            auto b = ExpandBC7(res.q[1][i], pbit1, mode.bits);
+
+            for (uint32_t j = 0; j < mode.numEntries; ++j)
+                palette[j][i] = static_cast<float>(Interpolate(a, b, mode.weights[j]));
+        }
+
+        res.error = SelectIndices(block, palette, mode.numEntries, mode.numChannels, res.indices);
+    }
+
+    // BCQ_Normal tries every p-bits combination, BCQ_Fast picks the one closest to each endpoint
+    static void EvaluateBC7PBits(const ColorBlock& block, const ColorEndpoints& endpoints, const BC7Mode& mode, const EBCQuality quality, BC7Endpoints& res)
+    {
+        if (mode.sharedPBit || (quality != EBCQuality::BCQ_Fast)) {
+            BC7Endpoints candidate;
+
+            res.error = FLT_MAX;
+
+            for (uint8_t combo = 0; combo < 4; ++combo) {
+                uint8_t pbit0 = combo & 1;
+                uint8_t pbit1 = combo >> 1;
+
+                if (mode.sharedPBit && (pbit0 != pbit1))
+                    continue;
+
+                EvaluateBC7(block, endpoints, mode, pbit0, pbit1, candidate);
+
+                if (candidate.error < res.error)
+                    res = candidate;
+            }
+
+            return;
+        }
+
+        auto closestPBit = [&mode](const float* value)
+        {
+            float error[2] = {};
+
+            for (uint32_t pbit = 0; pbit < 2; ++pbit) {
+                for (uint32_t i = 0; i < mode.numChannels; ++i) {
+                    auto d = static_cast<float>(ExpandBC7(QuantizeBC7(value[i], pbit, mode.bits), pbit, mode.bits)) - value[i];
+
+                    error[pbit] += d * d;
+                }
+            }
+
+            return static_cast<uint8_t>(error[1] < error[0] ? 1 : 0);
+        };
+
+        EvaluateBC7(block, endpoints, mode, closestPBit(endpoints.e0), closestPBit(endpoints.e1), res);
+    }
+
+    static void EncodeBC7Endpoints(const ColorBlock& block, const BC7Mode& mode, const EBCQuality quality, BC7Endpoints& res)
+    {
+        ColorEndpoints endpoints;
+
+        FitEndpoints(block, mode.numChannels, quality, endpoints);
+        EvaluateBC7PBits(block, endpoints, mode, quality, res);
+
+        if (quality == EBCQuality::BCQ_Fast)
+            return;
+
+        float e0Weights[16];
+
+        GetE0Weights(mode.weights, mode.numEntries, e0Weights);
+
+        for (uint32_t iter = 0; iter < 2; ++iter) {
+            BC7Endpoints candidate;
+
+            if (!RefineEndpoints(block, res.indices, e0Weights, mode.numChannels, endpoints))
+                break;
+
+            EvaluateBC7PBits(block, endpoints, mode, quality, candidate);
+
+            if (candidate.error >= res.error)
+                break;
+
+            res = candidate;
+        }
+    }
+
+    // the msb of the anchor index is implicitly 0, swapping the endpoints mirrors the indices so it is
+    static void FixBC7Anchor(BC7Endpoints& res, const BC7Mode& mode, const uint32_t anchor)
+    {
+        if (res.indices[anchor] < mode.numEntries / 2)
+            return;
+
+        for (uint32_t i = 0; i < mode.numChannels; ++i)
+            std::swap(res.q[0][i], res.q[1][i]);
+
+        std::swap(res.pbits[0], res.pbits[1]);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            res.indices[i] = static_cast<uint8_t>(mode.numEntries - 1 - res.indices[i]);
+    }
+
+    static __m128 GetSubsetMask(const uint16_t partition, const uint32_t first, const uint32_t subset)
+    {
+        auto bits = _mm_set_epi32((partition >> (first + 3)) & 1, (partition >> (first + 2)) & 1, (partition >> (first + 1)) & 1, (partition >> first) & 1);
+
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(bits, _mm_set1_epi32(subset)));
+    }
+
+    // what is left of each RGB subset once projected on its bounding box diagonal, ranks the partitions before encoding them
+    static float EstimatePartitionError(const ColorBlock& block, const uint16_t partition)
+    {
+        float error = 0.f;
+
+        for (uint32_t subset = 0; subset < 2; ++subset) {
+            __m128 sum[3];
+            __m128 lo[3];
+            __m128 hi[3];
+            auto count = _mm_setzero_ps();
+
+            for (uint32_t i = 0; i < 3; ++i) {
+                sum[i] = _mm_setzero_ps();
+                lo[i] = _mm_set1_ps(FLT_MAX);
+                hi[i] = _mm_set1_ps(-FLT_MAX);
+            }
+
+            for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+                auto mask = GetSubsetMask(partition, i, subset);
+
+                count = _mm_add_ps(count, _mm_and_ps(mask, _mm_set1_ps(1.f)));
+
+                for (uint32_t j = 0; j < 3; ++j) {
+                    auto v = _mm_load_ps(block.c[j] + i);
+
+                    sum[j] = _mm_add_ps(sum[j], _mm_and_ps(mask, v));
+                    lo[j] = _mm_min_ps(lo[j], _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, _mm_set1_ps(FLT_MAX))));
+                    hi[j] = _mm_max_ps(hi[j], _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, _mm_set1_ps(-FLT_MAX))));
+                }
+            }
+
+            auto numTexels = HorizontalSum(count);
+            float mean[3];
+            float axis[3];
+
+            for (uint32_t j = 0; j < 3; ++j) {
+                mean[j] = HorizontalSum(sum[j]) / numTexels;
+                axis[j] = HorizontalMax(hi[j]) - HorizontalMin(lo[j]);
+            }
+
+            // xx, xy, xz, yy, yz, zz
+            __m128 cov[6];
+
+            for (uint32_t j = 0; j < 6; ++j)
+                cov[j] = _mm_setzero_ps();
+
+            for (uint32_t i = 0; i < BC_BLOCK_TEXELS; i += 4) {
+                auto mask = GetSubsetMask(partition, i, subset);
+                auto dr = _mm_and_ps(mask, _mm_sub_ps(_mm_load_ps(block.c[0] + i), _mm_set1_ps(mean[0])));
+                auto dg = _mm_and_ps(mask, _mm_sub_ps(_mm_load_ps(block.c[1] + i), _mm_set1_ps(mean[1])));
+                auto db = _mm_and_ps(mask, _mm_sub_ps(_mm_load_ps(block.c[2] + i), _mm_set1_ps(mean[2])));
+
+                cov[0] = _mm_add_ps(cov[0], _mm_mul_ps(dr, dr));
+                cov[1] = _mm_add_ps(cov[1], _mm_mul_ps(dr, dg));
+                cov[2] = _mm_add_ps(cov[2], _mm_mul_ps(dr, db));
+                cov[3] = _mm_add_ps(cov[3], _mm_mul_ps(dg, dg));
+                cov[4] = _mm_add_ps(cov[4], _mm_mul_ps(dg, db));
+                cov[5] = _mm_add_ps(cov[5], _mm_mul_ps(db, db));
+            }
+
+            float c[6];
+
+            for (uint32_t j = 0; j < 6; ++j)
+                c[j] = HorizontalSum(cov[j]);
+
+            if (c[1] < 0.f)
+                axis[0] = -axis[0];
+
+            if (c[4] < 0.f)
+                axis[2] = -axis[2];
+
+            auto trace = c[0] + c[3] + c[5];
+            auto lengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+            if (lengthSq > FLT_EPSILON) {
+                auto along = axis[0] * (c[0] * axis[0] + c[1] * axis[1] + c[2] * axis[2])
+                    + axis[1] * (c[1] * axis[0] + c[3] * axis[1] + c[4] * axis[2])
+                    + axis[2] * (c[2] * axis[0] + c[4] * axis[1] + c[5] * axis[2]);
+
+                trace -= along / lengthSq;
+            }
+
+            error += trace;
+        }
+
+        return error;
+    }
+
+    static void WriteBC7Mode1(const uint32_t partition, const BC7Endpoints subsets[2], uint8_t* dst)
+    {
+        BlockWriter writer{ dst };
+        auto mask = BC7_PARTITIONS2[partition];
+        auto anchor = BC7_ANCHORS2[partition];
+
+        writer.Write(1 << 1, 2);
+        writer.Write(partition, 6);
+
+        for (uint32_t i = 0; i < 3; ++i) {
+            for (uint32_t subset = 0; subset < 2; ++subset) {
+                writer.Write(subsets[subset].q[0][i], BC7_MODE1.bits);
+                writer.Write(subsets[subset].q[1][i], BC7_MODE1.bits);
+            }
+        }
+
+        writer.Write(subsets[0].pbits[0], 1);
+        writer.Write(subsets[1].pbits[0], 1);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+            auto subset = (mask >> i) & 1;
+
+            writer.Write(subsets[subset].indices[i], ((i == 0) || (i == anchor)) ? 2 : 3);
+        }
+    }
+
+    static void WriteBC7Mode6(const BC7Endpoints& endpoints, uint8_t* dst)
+    {
+        BlockWriter writer{ dst };
+
+        writer.Write(1 << 6, 7);
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            writer.Write(endpoints.q[0][i], BC7_MODE6.bits);
+            writer.Write(endpoints.q[1][i], BC7_MODE6.bits);
+        }
+
+        writer.Write(endpoints.pbits[0], 1);
+        writer.Write(endpoints.pbits[1], 1);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            writer.Write(endpoints.indices[i], (i == 0) ? 3 : 4);
+    }
+
+    static void EncodeBC7Block(const uint8_t rgba[BC_BLOCK_TEXELS * 4], const CompressDesc& desc, uint8_t* dst)
+    {
+        ColorBlock block;
+        auto opaque = true;
+
+        LoadColorBlock(rgba, block);
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            opaque &= rgba[i * 4 + 3] == 255;
+
+        assert((desc.bc7ModeMask & BC7_BUILT_IN_MODES) != 0);
+
+        // mode 1 has no alpha, CanEncodeBuiltIn leaves blocks with alpha to DirectXTex when mode 6 isn't allowed
+        auto useMode1 = opaque && ((desc.bc7ModeMask & (1 << 1)) != 0);
+        auto useMode6 = ((desc.bc7ModeMask & (1 << 6)) != 0) || !useMode1;
+
+        assert(useMode1 || ((desc.bc7ModeMask & (1 << 6)) != 0));
+
+        auto earlyOut = desc.bc7EarlyOutError * desc.bc7EarlyOutError * BC_BLOCK_TEXELS * 4;
+
+        BC7Endpoints mode6;
+
+        mode6.error = FLT_MAX;
+
+        if (useMode6) {
+            EncodeBC7Endpoints(block, BC7_MODE6, desc.quality, mode6);
+
+            if (!useMode1 || (mode6.error <= earlyOut)) {
+                FixBC7Anchor(mode6, BC7_MODE6, 0);
+                WriteBC7Mode6(mode6, dst);
+                return;
+            }
+        }
+
+        // only the most promising partitions are fully encoded
+        float estimates[BC7_NUM_PARTITIONS];
+        uint8_t order[BC7_NUM_PARTITIONS];
+
+        for (uint32_t i = 0; i < BC7_NUM_PARTITIONS; ++i) {
+            estimates[i] = EstimatePartitionError(block, BC7_PARTITIONS2[i]);
+            order[i] = static_cast<uint8_t>(i);
+        }
+
+        auto depth = std::clamp<uint32_t>(desc.bc7PartitionSearch, 1, BC7_NUM_PARTITIONS);
+
+        std::partial_sort(order, order + depth, order + BC7_NUM_PARTITIONS, [&estimates](uint8_t lhs, uint8_t rhs) { return estimates[lhs] < estimates[rhs]; });
+
+        BC7Endpoints best[2];
+        auto bestError = FLT_MAX;
+        uint32_t bestPartition = 0;
+        auto subsetBlock = block;
+
+        for (uint32_t i = 0; (i < depth) && (bestError > earlyOut); ++i) {
+            auto mask = BC7_PARTITIONS2[order[i]];
+            BC7Endpoints subsets[2];
+
+            for (uint32_t subset = 0; subset < 2; ++subset) {
+                for (uint32_t j = 0; j < BC_BLOCK_TEXELS; ++j)
+                    subsetBlock.weight[j] = (((mask >> j) & 1) == subset) ? 1.f : 0.f;
+
+                EncodeBC7Endpoints(subsetBlock, BC7_MODE1, desc.quality, subsets[subset]);
+            }
+
+            auto error = subsets[0].error + subsets[1].error;
+
+            if (error < bestError) {
+                bestError = error;
+                bestPartition = order[i];
+                best[0] = subsets[0];
+                best[1] = subsets[1];
+            }
+        }
+
+        if (mode6.error <= bestError) {
+            FixBC7Anchor(mode6, BC7_MODE6, 0);
+            WriteBC7Mode6(mode6, dst);
+        } else {
+            FixBC7Anchor(best[0], BC7_MODE1, 0);
+            FixBC7Anchor(best[1], BC7_MODE1, BC7_ANCHORS2[bestPartition]);
+            WriteBC7Mode1(bestPartition, best, dst);
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // BC6H unsigned, mode 11 only: a single region with 10 bits endpoints
+    //////////////////////////////////////////////////////////////////////////
+    struct BC6HEndpoints
+    {
+        uint32_t q[2][3];
+        uint8_t indices[BC_BLOCK_TEXELS];
+        float error;
+    };
+
+    // half float bits to the space BC6H interpolates in, the decoder scales by 31/64 at the end
+    static float HalfToBC6H(const uint16_t half)
+    {
+        // unsigned format so negative values are clamped, infinity and NaN become the largest finite value
+        if ((half & 0x8000) != 0)
+            return 0.f;
+
+        auto value = std::min<uint32_t>(half, 0x7bff);
+
+        return static_cast<float>(std::min((value * 64 + 30) / 31, 0xffffu));
+    }
+
+    static uint32_t QuantizeBC6H(const float value)
+    {
+        return static_cast<uint32_t>(std::clamp(static_cast<int32_t>((value - 32.f) / 64.f + 0.5f), 0, 1023));
+    }
+
+    static uint32_t UnquantizeBC6H(const uint32_t q)
+    {
+        if (q == 0)
+            return 0;
+
+        if (q == 1023)
+            return 0xffff;
+
+        return ((q << 16) + 0x8000) >> 10;
+    }
+
+    static void EvaluateBC6H(const ColorBlock& block, const ColorEndpoints& endpoints, BC6HEndpoints& res)
+    {
+        float palette[16][BC_MAX_CHANNELS];
+
+        for (uint32_t i = 0; i < 3; ++i) {
+            res.q[0][i] = QuantizeBC6H(endpoints.e0[i]);
+            res.q[1][i] = QuantizeBC6H(endpoints.e1[i]);
+
+            auto a = UnquantizeBC6H(res.q[0][i]);
+            auto b = UnquantizeBC6H(res.q[1][i]);
+
+            for (uint32_t j = 0; j < 16; ++j)
+                palette[j][i] = static_cast<float>(Interpolate(a, b, BC7_WEIGHTS4[j]));
+        }
+
+        res.error = SelectIndices(block, palette, 16, 3, res.indices);
+    }
+
+    static void EncodeBC6HBlock(const uint16_t rgba[BC_BLOCK_TEXELS * 4], const EBCQuality quality, uint8_t* dst)
+    {
+        ColorBlock block;
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i) {
+            for (uint32_t j = 0; j < 3; ++j)
+                block.c[j][i] = HalfToBC6H(rgba[i * 4 + j]);
+
+            block.c[3][i] = 0.f;
+            block.weight[i] = 1.f;
+        }
+
+        ColorEndpoints endpoints;
+        BC6HEndpoints best;
+
+        FitEndpoints(block, 3, quality, endpoints);
+        EvaluateBC6H(block, endpoints, best);
+
+        if (quality != EBCQuality::BCQ_Fast) {
+            float e0Weights[16];
+
+            GetE0Weights(BC7_WEIGHTS4, 16, e0Weights);
+
+            for (uint32_t iter = 0; iter < 2; ++iter) {
+                BC6HEndpoints candidate;
+
+                if (!RefineEndpoints(block, best.indices, e0Weights, 3, endpoints))
+                    break;
+
+                EvaluateBC6H(block, endpoints, candidate);
+
+                if (candidate.error >= best.error)
+                    break;
+
+                best = candidate;
+            }
+        }
+
+        // same implicit msb on the first index as BC7
+        if (best.indices[0] >= 8) {
+            for (uint32_t i = 0; i < 3; ++i)
+                std::swap(best.q[0][i], best.q[1][i]);
+
+            for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+                best.indices[i] = static_cast<uint8_t>(15 - best.indices[i]);
+        }
+
+        BlockWriter writer{ dst };
+
+        writer.Write(0x03, 5);
+
+        for (uint32_t i = 0; i < 2; ++i) {
+            for (uint32_t j = 0; j < 3; ++j)
+                writer.Write(best.q[i][j], 10);
+        }
+
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            writer.Write(best.indices[i], (i == 0) ? 3 : 4);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Image
+    //////////////////////////////////////////////////////////////////////////
+
+    // texels past the edge of a partial block repeat the last row/column
+    static void LoadBlock(const DirectX::Image& src, const uint32_t bx, const uint32_t by, const uint32_t texelSize, uint8_t* texels)
+    {
+        auto width = static_cast<uint32_t>(src.width);
+        auto height = static_cast<uint32_t>(src.height);
+        auto x0 = bx * 4;
+
+        for (uint32_t y = 0; y < 4; ++y) {
+            auto row = src.pixels + std::min(by * 4 + y, height - 1) * src.rowPitch;
+
+            if (x0 + 4 <= width) {
+                memcpy(texels + y * 4 * texelSize, row + x0 * texelSize, 4 * texelSize);
+            } else {
+                for (uint32_t x = 0; x < 4; ++x)
+                    memcpy(texels + (y * 4 + x) * texelSize, row + std::min(x0 + x, width - 1) * texelSize, texelSize);
+            }
+        }
+    }
+
+    static void ExtractChannel(const uint8_t rgba[BC_BLOCK_TEXELS * 4], const uint32_t channel, uint8_t values[BC_BLOCK_TEXELS])
+    {
+        for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+            values[i] = rgba[i * 4 + channel];
+    }
+
+    bool IsBuiltInBCFormat(const DXGI_FORMAT format)
+    {
+        switch (format) {
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB:
+            case DXGI_FORMAT_BC4_UNORM:
+            case DXGI_FORMAT_BC5_UNORM:
+            case DXGI_FORMAT_BC6H_UF16:
+            case DXGI_FORMAT_BC7_UNORM:
+            case DXGI_FORMAT_BC7_UNORM_SRGB:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    bool UseBuiltInBCEncoder(const DXGI_FORMAT format, const CompressDesc& desc)
+    {
+        if ((desc.quality == EBCQuality::BCQ_High) || !IsBuiltInBCFormat(format))
+            return false;
+
+        if ((format == DXGI_FORMAT_BC7_UNORM) || (format == DXGI_FORMAT_BC7_UNORM_SRGB))
+            return (desc.bc7ModeMask & BC7_BUILT_IN_MODES) != 0;
+
+        return true;
+    }
+
+    DXGI_FORMAT GetBuiltInSourceFormat(const DXGI_FORMAT format)
+    {
+        return (format == DXGI_FORMAT_BC6H_UF16) ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    bool CanEncodeBuiltIn(const DirectX::Image& src, const DXGI_FORMAT format, const CompressDesc& desc)
+    {
+        if (((format != DXGI_FORMAT_BC7_UNORM) && (format != DXGI_FORMAT_BC7_UNORM_SRGB)) || ((desc.bc7ModeMask & (1 << 6)) != 0))
+            return true;
+
+        for (size_t y = 0; y < src.height; ++y) {
+            auto row = src.pixels + y * src.rowPitch;
+
+            for (size_t x = 0; x < src.width; ++x) {
+                if (row[x * 4 + 3] != 255)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    void EncodeBCImage(const DirectX::Image& src, const DXGI_FORMAT format, const CompressDesc& desc, const float alphaThreshold, uint8_t* dst, const size_t dstRowPitch)
+    {
+        assert(IsBuiltInBCFormat(format));
+
+        auto blocksWide = static_cast<uint32_t>((src.width + 3) / 4);
+        auto blocksHigh = static_cast<uint32_t>((src.height + 3) / 4);
+        auto threshold = static_cast<uint8_t>(std::clamp(alphaThreshold, 0.f, 1.f) * 255.f + 0.5f);
+        auto quality = desc.quality;
+
+        alignas(16) uint8_t rgba[BC_BLOCK_TEXELS * 4];
+        alignas(16) uint16_t half[BC_BLOCK_TEXELS * 4];
+        uint8_t values[BC_BLOCK_TEXELS];
+
+        for (uint32_t by = 0; by < blocksHigh; ++by) {
+            auto dstBlock = dst + by * dstRowPitch;
+
+            for (uint32_t bx = 0; bx < blocksWide; ++bx) {
+                if (format == DXGI_FORMAT_BC6H_UF16)
+                    LoadBlock(src, bx, by, 8, reinterpret_cast<uint8_t*>(half));
+                else
+                    LoadBlock(src, bx, by, 4, rgba);
+
+                switch (format) {
+                    case DXGI_FORMAT_BC1_UNORM:
+                    case DXGI_FORMAT_BC1_UNORM_SRGB:
+                        EncodeColorBlock(rgba, quality, true, threshold, dstBlock);
+                        dstBlock += 8;
+                        break;
+
+                    case DXGI_FORMAT_BC3_UNORM:
+                    case DXGI_FORMAT_BC3_UNORM_SRGB:
+                        ExtractChannel(rgba, 3, values);
+                        EncodeAlphaBlock(values, quality, dstBlock);
+                        EncodeColorBlock(rgba, quality, false, 0, dstBlock + 8);
+                        dstBlock += 16;
+                        break;
+
+                    case DXGI_FORMAT_BC4_UNORM:
+                        ExtractChannel(rgba, 0, values);
+                        EncodeAlphaBlock(values, quality, dstBlock);
+                        dstBlock += 8;
+                        break;
+
+                    case DXGI_FORMAT_BC5_UNORM:
+                        ExtractChannel(rgba, 0, values);
+                        EncodeAlphaBlock(values, quality, dstBlock);
+                        ExtractChannel(rgba, 1, values);
+                        EncodeAlphaBlock(values, quality, dstBlock + 8);
+                        dstBlock += 16;
+                        break;
+
+                    case DXGI_FORMAT_BC6H_UF16:
+                        EncodeBC6HBlock(half, quality, dstBlock);
+                        dstBlock += 16;
+                        break;
+
+                    case DXGI_FORMAT_BC7_UNORM:
+                    case DXGI_FORMAT_BC7_UNORM_SRGB:
+                        EncodeBC7Block(rgba, desc, dstBlock);
+                        dstBlock += 16;
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+} // namespace ninniku
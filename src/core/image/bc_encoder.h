@@ -0,0 +1,44 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/core/image/dds.h"
+
+#include <DirectXTex.h>
+
+namespace ninniku
+{
+    // formats the built-in encoder can produce, anything else has to go through DirectXTex
+    bool IsBuiltInBCFormat(const DXGI_FORMAT format);
+
+    // quality is not BCQ_High and the format, and for BC7 at least one of the allowed modes, is built-in
+    bool UseBuiltInBCEncoder(const DXGI_FORMAT format, const CompressDesc& desc);
+
+    // R16G16B16A16_FLOAT for BC6H, R8G8B8A8_UNORM for everything else
+    DXGI_FORMAT GetBuiltInSourceFormat(const DXGI_FORMAT format);
+
+    // src is in GetBuiltInSourceFormat, false when a BC7 mask without mode 6 meets texels with alpha since mode 1 has none
+    bool CanEncodeBuiltIn(const DirectX::Image& src, const DXGI_FORMAT format, const CompressDesc& desc);
+
+    // compress an image in GetBuiltInSourceFormat, block row y is written at dst + y * dstRowPitch
+    // BC1 texels with an alpha below alphaThreshold (0-1) are encoded as transparent
+    void EncodeBCImage(const DirectX::Image& src, const DXGI_FORMAT format, const CompressDesc& desc, const float alphaThreshold, uint8_t* dst, const size_t dstRowPitch);
+} // namespace ninniku
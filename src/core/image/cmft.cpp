@@ -35,6 +35,11 @@ namespace ninniku
         return impl_->Load(path);
     }
 
+    bool cmftImage::LoadRaw(const void* pData, const size_t size)
+    {
+        return impl_->LoadRaw(pData, size);
+    }
+
     bool cmftImage::LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format)
     {
         return impl_->LoadRaw(pData, size, width, height, format);
@@ -60,6 +65,16 @@ namespace ninniku
         return impl_->IsRequiringFix();
     }
 
+    bool cmftImage::IrradianceFilter(const uint32_t faceSize)
+    {
+        return impl_->IrradianceFilter(faceSize);
+    }
+
+    bool cmftImage::RadianceFilter(const RadianceFilterParams& params)
+    {
+        return impl_->RadianceFilter(params);
+    }
+
     bool cmftImage::SaveImage(const std::string_view& path, SaveType type)
     {
         return impl_->SaveImage(path, type);
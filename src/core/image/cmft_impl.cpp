@@ -25,22 +25,58 @@
 #include "ninniku/core/renderer/types.h"
 #include "ninniku/core/image/cmft.h"
 
-#include "../renderer/dx11/dx11_types.h"
-#include "../renderer/dx12/DX12.h"
 #include "../../utils/log.h"
+#include "../../utils/mapped_file.h"
 #include "../../utils/misc.h"
+#include "../../utils/trace.h"
+#include "exr_stream.h"
 
-#define TINYEXR_IMPLEMENTATION
 #include <tinyexr/tinyexr.h>
 
+#include <cmft/cubemapfilter.h>
+
 #include <array>
 #include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 namespace ninniku
 {
+    // limit of imageRadianceFilter
+    static constexpr uint32_t RADIANCE_MAX_THREADS = 64;
+
+    // imageRadianceFilter keeps its progress in globals
+    static std::mutex radianceMutex;
+
+#ifdef TRACY_ENABLE
+    // forwards to the default allocator and reports everything cmft allocates to Tracy
+    class TracedCmftAllocator final : public cmft::AllocatorI
+    {
+    public:
+        void* realloc(void* ptr, size_t size, size_t align, const char* file, size_t line) override
+        {
+            TRACE_FREE_IMAGE(ptr);
+
+            auto res = cmft::g_crtAllocator.realloc(ptr, size, align, file, line);
+
+            TRACE_ALLOC_IMAGE(res, size);
+
+            return res;
+        }
+    };
+
+    static TracedCmftAllocator tracedAllocator;
+    static std::once_flag tracedAllocatorFlag;
+#endif
+
     cmftImage::cmftImage()
         : impl_{ new cmftImageImpl() }
     {
+#ifdef TRACY_ENABLE
+        // installed before the first image so nothing allocated by the default one is freed through it
+        std::call_once(tracedAllocatorFlag, []() { cmft::setAllocator(&tracedAllocator); });
+#endif
     }
 
     cmftImage::~cmftImage() = default;
@@ -53,24 +89,13 @@ namespace ninniku
 
     void cmftImageImpl::AllocateMemory()
     {
-        // Alloc dst data.
-        const uint32_t bytesPerPixel = GetBPPFromFormat(image_.m_format);
-        uint32_t dstDataSize = 0;
-        uint32_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-
-        for (uint8_t face = 0; face < image_.m_numFaces; ++face) {
-            for (uint8_t mip = 0; mip < image_.m_numMips; ++mip) {
-                dstOffsets[face][mip] = dstDataSize;
-                uint32_t dstMipSize = std::max(UINT32_C(1), image_.m_width >> mip);
-                dstDataSize += dstMipSize * dstMipSize * bytesPerPixel;
-            }
-        }
+        UpdateLayout();
 
         if (image_.m_data != nullptr)
             imageUnload(image_);
 
-        image_.m_data = CMFT_ALLOC(cmft::g_allocator, dstDataSize);
-        image_.m_dataSize = dstDataSize;
+        image_.m_data = CMFT_ALLOC(cmft::g_allocator, layout_.dataSize);
+        image_.m_dataSize = layout_.dataSize;
     }
 
     TextureParamHandle cmftImageImpl::CreateTextureParamInternal(const EResourceViews viewFlags) const
@@ -82,7 +107,7 @@ namespace ninniku
         res->format = TF_R32G32B32A32_FLOAT;
         res->height = res->width = imageGetCubemapFaceSize(image_);
         res->imageDatas = GetInitializationData();
-        res->numMips = 1;
+        res->numMips = image_.m_numMips;
         res->viewflags = viewFlags;
 
         return std::move(res);
@@ -149,14 +174,52 @@ namespace ninniku
 
     bool cmftImageImpl::LoadEXR(const std::filesystem::path& path)
     {
+        TRACE_SCOPED_IMAGE;
+
+        // the streaming path decodes straight from the mapped pages
+        MappedFile file;
+
+        if (!file.Open(path))
+            return false;
+
+        return LoadEXR(file.GetData(), file.GetSize());
+    }
+
+    bool cmftImageImpl::LoadEXR(const void* pData, const size_t size)
+    {
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image decode (MB/s)");
+
+        switch (StreamLatLongEXR(static_cast<const uint8_t*>(pData), size, image_)) {
+            case EXRStreamResult::Success:
+                TRACE_THROUGHPUT_ADD_IMAGE(image_.m_dataSize);
+                return true;
+
+            case EXRStreamResult::Failed:
+                return false;
+
+            default:
+                LOG << "cmftImageImpl::LoadEXR, file cannot be streamed, decoding it whole";
+        }
+
         int width, height;
         float* rgba;
         const char* err;
 
-        int ret = ::LoadEXR(&rgba, &width, &height, path.string().c_str(), &err);
+        int ret = LoadEXRFromMemory(&rgba, &width, &height, static_cast<const unsigned char*>(pData), size, &err);
+
+        if (!SetEXRImage(ret, rgba, width, height, err))
+            return false;
+
+        TRACE_THROUGHPUT_ADD_IMAGE(image_.m_dataSize);
+
+        return true;
+    }
+
+    bool cmftImageImpl::SetEXRImage(const int ret, float* rgba, const int width, const int height, const char* err)
+    {
         if (ret != TINYEXR_SUCCESS) {
-            auto fmt = boost::format("cmftImageImpl::LoadEXR failed with: %1%") % err;
-            LOG << boost::str(fmt);
+            LOGF(boost::format("cmftImageImpl::LoadEXR failed with: %1%") % err);
 
             return false;
         }
@@ -169,11 +232,16 @@ namespace ninniku
         image_.m_numFaces = 1;
         image_.m_data = rgba;
 
+        // tinyexr allocated it but it will be released through cmft
+        TRACE_ALLOC_IMAGE(rgba, width * height * 4 * sizeof(float));
+
         return true;
     }
 
     bool cmftImageImpl::AssembleCubemap()
     {
+        TRACE_SCOPED_IMAGE;
+
         if (!imageIsCubemap(image_)) {
             if (imageIsCubeCross(image_)) {
                 LOG << "Converting cube cross to cubemap.";
@@ -200,13 +268,16 @@ namespace ninniku
         if (!imageIsCubemap(image_))
             return false;
 
+        UpdateLayout();
+
         return true;
     }
 
     bool cmftImageImpl::LoadInternal(const std::string_view& path)
     {
-        auto fmt = boost::format("cmftImageImpl::Load, Path=\"%1%\"") % path;
-        LOG << boost::str(fmt);
+        TRACE_SCOPED_IMAGE;
+
+        LOGF(boost::format("cmftImageImpl::Load, Path=\"%1%\"") % path);
 
         bool imageLoaded = false;
 
@@ -230,6 +301,41 @@ namespace ninniku
         return true;
     }
 
+    bool cmftImageImpl::LoadRaw(const void* pData, const size_t size)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        if (size > std::numeric_limits<uint32_t>::max()) {
+            LOGE << "cmftImageImpl::LoadRaw, cmft cannot decode more than 4GB";
+            return false;
+        }
+
+        EXRVersion version;
+        bool imageLoaded = false;
+
+        if (ParseEXRVersionFromMemory(&version, static_cast<const unsigned char*>(pData), size) == TINYEXR_SUCCESS) {
+            imageLoaded = LoadEXR(pData, size);
+        } else {
+            auto dataSize = static_cast<uint32_t>(size);
+
+            imageLoaded = imageLoad(image_, pData, dataSize, cmft::TextureFormat::RGBA32F) || imageLoadStb(image_, pData, dataSize, cmft::TextureFormat::RGBA32F);
+        }
+
+        if (!imageLoaded) {
+            LOGE << "Failed to load file";
+
+            return false;
+        }
+
+        if (!AssembleCubemap()) {
+            LOGE << "Conversion failed.";
+
+            return false;
+        }
+
+        return true;
+    }
+
     bool cmftImageImpl::LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format)
     {
         auto cmftFormat = cmft::TextureFormat::RGBA32F;
@@ -270,6 +376,8 @@ namespace ninniku
 
     bool cmftImageImpl::InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex, const uint32_t cubeIndex)
     {
+        TRACE_SCOPED_IMAGE;
+
         // we want to enforce 1:1 for now
         if (srcTex->GetDesc()->width != srcTex->GetDesc()->height) {
             LOGE << "CFMT requires textures 1:1 for width and height";
@@ -293,100 +401,119 @@ namespace ninniku
         image_.m_numFaces = CUBEMAP_NUM_FACES;
         image_.m_numMips = (uint8_t)srcTex->GetDesc()->numMips;
 
-        auto fmt = boost::format("cmftImageImpl::InitializeFromTextureObject with Width=%1%, Height=%2%, Array=%3%, Mips=%4%") % image_.m_width % image_.m_height % (int)image_.m_numFaces % (int)image_.m_numMips;
-        LOG << boost::str(fmt);
+        LOGF(boost::format("cmftImageImpl::InitializeFromTextureObject with Width=%1%, Height=%2%, Array=%3%, Mips=%4%") % image_.m_width % image_.m_height % (int)image_.m_numFaces % (int)image_.m_numMips);
 
         AllocateMemory();
 
         auto marker = dx->CreateDebugMarker("ImageFromTextureObject");
 
-        // we have to copy each mip with a read back texture or the same size for each face
-        auto srcDesc = srcTex->GetDesc();
+        return ReadbackTextureObject(dx, srcTex, cubeIndex * CUBEMAP_NUM_FACES, CUBEMAP_NUM_FACES);
+    }
 
-        if ((dx->GetType() & ERenderer::RENDERER_DX11) != 0) {
-            // dx11 can read back from a texture
-            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
-                auto param = TextureParam::Create();
+    const std::vector<SubresourceParam> cmftImageImpl::GetInitializationData() const
+    {
+        const uint32_t numMips = image_.m_numMips;
+        std::vector<SubresourceParam> res(CUBEMAP_NUM_FACES * numMips);
 
-                param->width = srcDesc->width >> mip;
-                param->height = srcDesc->height >> mip;
-                param->format = srcDesc->format;
-                param->numMips = 1;
-                param->arraySize = 1;
-                param->viewflags = EResourceViews::RV_CPU_READ;
+        for (uint32_t face = 0; face < CUBEMAP_NUM_FACES; ++face) {
+            for (uint32_t mip = 0; mip < numMips; ++mip) {
+                auto& sub = res[mip + face * numMips];
 
-                auto readBack = dx->CreateTexture(param);
+                sub.data = static_cast<void*>(static_cast<uint8_t*>(image_.m_data) + layout_.offsets[face][mip]);
+                sub.rowPitch = layout_.rowPitches[mip];
+                sub.depthPitch = 0;
+            }
+        }
 
-                CopyTextureSubresourceParam params = {};
-                params.src = srcTex.get();
-                params.srcMip = mip;
-                params.dst = readBack.get();
+        return res;
+    }
 
-                for (uint32_t face = 0; face < CUBEMAP_NUM_FACES; ++face) {
-                    params.srcFace = (cubeIndex * CUBEMAP_NUM_FACES) + face;
+    const std::tuple<uint8_t*, uint32_t> cmftImageImpl::GetData() const
+    {
+        return { static_cast<uint8_t*>(image_.m_data), image_.m_dataSize };
+    }
 
-                    auto indexes = dx->CopyTextureSubresource(params);
-                    auto mapped = dx->Map(readBack, std::get<1>(indexes));
-                    auto dx11Mapped = static_cast<const DX11MappedResource*>(mapped.get());
+    bool cmftImageImpl::IrradianceFilter(const uint32_t faceSize)
+    {
+        TRACE_SCOPED_IMAGE;
 
-                    UpdateSubImage(face, mip, static_cast<uint8_t*>(mapped->GetData()), dx11Mapped->GetRowPitch());
-                }
-            }
-        } else {
-            // dx12 needs to use an intermediate buffer
-            auto dx12 = static_cast<DX12*>(dx.get());
+        if (image_.m_data == nullptr) {
+            LOGE << "IrradianceFilter requires an image to be loaded first";
+            return false;
+        }
 
-            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
-                auto param = TextureParam::Create();
+        LOGF(boost::format("cmftImageImpl::IrradianceFilter with FaceSize=%1%") % faceSize);
 
-                param->width = srcDesc->width >> mip;
-                param->height = srcDesc->height >> mip;
-                param->format = srcDesc->format;
+        cmft::Image dst;
 
-                auto readback = dx12->CreateBuffer(param);
+        if (!cmft::imageIrradianceFilterSh(dst, faceSize, image_)) {
+            LOGE << "Irradiance filter failed";
+            return false;
+        }
 
-                CopyTextureSubresourceToBufferParam cpyParams = {};
+        cmft::imageMove(image_, dst);
+        UpdateLayout();
 
-                cpyParams.tex = srcTex.get();
-                cpyParams.texMip = mip;
-                cpyParams.buffer = readback.get();
+        return true;
+    }
 
-                for (uint32_t face = 0; face < CUBEMAP_NUM_FACES; ++face) {
-                    cpyParams.texFace = (cubeIndex * CUBEMAP_NUM_FACES) + face;
+    bool cmftImageImpl::RadianceFilter(const cmftImage::RadianceFilterParams& params)
+    {
+        TRACE_SCOPED_IMAGE;
 
-                    auto cpyRes = dx12->CopyTextureSubresourceToBuffer(cpyParams);
+        if (image_.m_data == nullptr) {
+            LOGE << "RadianceFilter requires an image to be loaded first";
+            return false;
+        }
 
-                    auto mapped = dx->Map(readback);
+        cmft::LightingModel::Enum lightingModel;
 
-                    UpdateSubImage(face, mip, static_cast<uint8_t*>(mapped->GetData()), std::get<0>(cpyRes));
-                }
-            }
+        switch (params.lightingModel) {
+            case cmftImage::LightingModel::Phong:
+                lightingModel = cmft::LightingModel::Phong;
+                break;
+            case cmftImage::LightingModel::PhongBrdf:
+                lightingModel = cmft::LightingModel::PhongBrdf;
+                break;
+            case cmftImage::LightingModel::Blinn:
+                lightingModel = cmft::LightingModel::Blinn;
+                break;
+            case cmftImage::LightingModel::BlinnBrdf:
+                lightingModel = cmft::LightingModel::BlinnBrdf;
+                break;
+            default:
+                LOGE << "Unsupported lighting model";
+                return false;
         }
 
-        return true;
-    }
+        auto numThreads = params.numThreads;
 
-    const std::vector<SubresourceParam> cmftImageImpl::GetInitializationData() const
-    {
-        std::array<uint32_t, CUBEMAP_NUM_FACES> offsets;
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        numThreads = std::min(numThreads, RADIANCE_MAX_THREADS);
+
+        // cmft clamps it to the full chain
+        uint8_t mipCount = (params.mipCount == 0) ? std::numeric_limits<uint8_t>::max() : params.mipCount;
+        auto edgeFixup = params.edgeFixup ? cmft::EdgeFixup::Warp : cmft::EdgeFixup::None;
 
-        cmft::imageGetFaceOffsets(offsets.data(), image_);
+        LOGF(boost::format("cmftImageImpl::RadianceFilter with FaceSize=%1%, Mips=%2%, GlossScale=%3%, GlossBias=%4%, Threads=%5%") % params.faceSize % (int)params.mipCount % (int)params.glossScale % (int)params.glossBias % numThreads);
 
-        const uint32_t bytesPerPixel = getImageDataInfo(image_.m_format).m_bytesPerPixel;
-        std::vector<SubresourceParam> res(CUBEMAP_NUM_FACES);
+        cmft::Image dst;
 
-        for (auto i = 0; i < CUBEMAP_NUM_FACES; ++i) {
-            res[i].data = static_cast<void*>(static_cast<uint8_t*>(image_.m_data) + offsets[i]);
-            res[i].rowPitch = image_.m_width * bytesPerPixel;
-            res[i].depthPitch = 0;
+        {
+            std::lock_guard<std::mutex> lock(radianceMutex);
+
+            if (!cmft::imageRadianceFilter(dst, params.faceSize, lightingModel, params.excludeBase, mipCount, params.glossScale, params.glossBias, image_, edgeFixup, static_cast<uint8_t>(numThreads))) {
+                LOGE << "Radiance filter failed";
+                return false;
+            }
         }
 
-        return res;
-    }
+        cmft::imageMove(image_, dst);
+        UpdateLayout();
 
-    const std::tuple<uint8_t*, uint32_t> cmftImageImpl::GetData() const
-    {
-        return { static_cast<uint8_t*>(image_.m_data), image_.m_dataSize };
+        return true;
     }
 
     bool cmftImageImpl::SaveImage(const std::filesystem::path& path, cmftImage::SaveType type)
@@ -437,31 +564,35 @@ namespace ninniku
         return cmft::imageSave(image_, pathCopy.replace_extension().string().c_str(), cmftFileType, cmftType, cmftFormat, true);
     }
 
-    void cmftImageImpl::UpdateSubImage(const uint32_t dstFace, const uint32_t dstMip, const uint8_t* newData, const uint32_t newRowPitch)
+    void cmftImageImpl::UpdateLayout()
     {
-        // get the right offset
         const uint32_t bytesPerPixel = GetBPPFromFormat(image_.m_format);
-        uint32_t size = image_.m_width;
-        uint32_t dstDataSize = 0;
-        uint32_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        uint32_t dstMipSize[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint32_t dataSize = 0;
+
+        for (uint8_t mip = 0; mip < image_.m_numMips; ++mip) {
+            layout_.mipSizes[mip] = std::max(UINT32_C(1), image_.m_width >> mip);
+            layout_.rowPitches[mip] = layout_.mipSizes[mip] * bytesPerPixel;
+        }
 
         for (uint8_t face = 0; face < image_.m_numFaces; ++face) {
             for (uint8_t mip = 0; mip < image_.m_numMips; ++mip) {
-                uint32_t mipSize = std::max(UINT32_C(1), size >> mip);
-
-                dstMipSize[face][mip] = mipSize * mipSize * bytesPerPixel;
-                dstOffsets[face][mip] = dstDataSize;
-                dstDataSize += dstMipSize[face][mip];
+                layout_.offsets[face][mip] = dataSize;
+                dataSize += layout_.rowPitches[mip] * layout_.mipSizes[mip];
             }
         }
 
-        auto offset = (uint8_t*)image_.m_data + dstOffsets[dstFace][dstMip];
+        layout_.dataSize = dataSize;
+    }
 
-        // row pitch from dx11 can be larger than for the image so we have to do each row manually
-        uint32_t mipSize = size >> dstMip;
-        auto imgPitch = mipSize * bytesPerPixel;
+    void cmftImageImpl::UpdateSubImage(const uint32_t dstFace, const uint32_t dstMip, const uint8_t* newData, const uint32_t newRowPitch)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        auto offset = static_cast<uint8_t*>(image_.m_data) + layout_.offsets[dstFace][dstMip];
+        auto mipSize = layout_.mipSizes[dstMip];
+        auto imgPitch = layout_.rowPitches[dstMip];
 
+        // row pitch from dx11 can be larger than for the image so we have to do each row manually
         if (newRowPitch != imgPitch) {
             for (uint32_t row = 0; row < mipSize; ++row) {
                 auto imgOffset = imgPitch * row;
@@ -482,8 +613,7 @@ namespace ninniku
             if (ext == validExt)
                 return true;
 
-        auto fmt = boost::format("cmftImage does not support extension: \"%1%\"") % ext;
-        LOGE << boost::str(fmt);
+        LOGEF(boost::format("cmftImage does not support extension: \"%1%\"") % ext);
 
         return false;
     }
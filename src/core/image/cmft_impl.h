@@ -45,8 +45,11 @@ namespace ninniku
         // Used when transferring data back from the GPU
         bool InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex) override;
 
+        bool LoadRaw(const void* pData, const size_t size) override;
         bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) override;
 
+        bool IrradianceFilter(const uint32_t faceSize);
+        bool RadianceFilter(const cmftImage::RadianceFilterParams& params);
         bool SaveImage(const std::filesystem::path& path, cmftImage::SaveType type);
 
         bool InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex, const uint32_t cubeIndex);
@@ -64,11 +67,24 @@ namespace ninniku
         void AllocateMemory();
         bool AssembleCubemap();
         bool LoadEXR(const std::filesystem::path& path);
+        bool LoadEXR(const void* pData, const size_t size);
         cmft::TextureFormat::Enum GetFormatFromNinnikuFormat(uint32_t format) const;
         cmft::ImageFileType::Enum GetFiletypeFromFilename(const std::filesystem::path& path);
         uint32_t GetBPPFromFormat(cmft::TextureFormat::Enum format) const;
+        bool SetEXRImage(const int ret, float* rgba, const int width, const int height, const char* err);
+        void UpdateLayout();
 
     private:
+        // where each face/mip lives in image_.m_data, rebuilt only when the image changes
+        struct SubresourceLayout
+        {
+            uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+            uint32_t mipSizes[MAX_MIP_NUM];
+            uint32_t rowPitches[MAX_MIP_NUM];
+            uint32_t dataSize;
+        };
+
         cmft::Image image_;
+        SubresourceLayout layout_ = {};
     };
 } // namespace ninniku
@@ -0,0 +1,156 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "ninniku/core/image/convert.h"
+
+#include "../../globals.h"
+#include "../../utils/trace.h"
+
+#include <DirectXPackedVector.h>
+#include <emmintrin.h>
+
+namespace ninniku
+{
+    // pixels converted per task, smaller images are not worth waking the workers
+    static constexpr uint32_t PACKR11G11B10_GRAIN = 64 * 1024;
+
+    // pixels converted per iteration, 48 channels fill 12 vectors
+    static constexpr uint32_t PACKR11G11B10_STEP = 16;
+
+    // Same rounding as XMStoreFloat3PK for what 8 and 16 bits channels can produce:
+    // positive, finite and either zero or large enough to never be a denormal 11 or 10 bits float
+    static __m128i PackFloat11Or10(__m128 v, __m128i isBlue)
+    {
+        auto i = _mm_castps_si128(v);
+
+        // rebias the exponent then round to nearest even
+        auto rebiased = _mm_add_epi32(i, _mm_set1_epi32(0xC8000000));
+        auto one = _mm_set1_epi32(1);
+        auto f11 = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rebiased, _mm_set1_epi32(0xFFFF)), _mm_and_si128(_mm_srli_epi32(rebiased, 17), one)), 17);
+        auto f10 = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rebiased, _mm_set1_epi32(0x1FFFF)), _mm_and_si128(_mm_srli_epi32(rebiased, 18), one)), 18);
+        auto res = _mm_or_si128(_mm_andnot_si128(isBlue, _mm_and_si128(f11, _mm_set1_epi32(0x7FF))), _mm_and_si128(isBlue, _mm_and_si128(f10, _mm_set1_epi32(0x3FF))));
+
+        // too large values are clamped to the largest finite value
+        auto max = _mm_or_si128(_mm_andnot_si128(isBlue, _mm_set1_epi32(0x477E0000)), _mm_and_si128(isBlue, _mm_set1_epi32(0x477C0000)));
+        auto maxCode = _mm_or_si128(_mm_andnot_si128(isBlue, _mm_set1_epi32(0x7BF)), _mm_and_si128(isBlue, _mm_set1_epi32(0x3DF)));
+        auto tooLarge = _mm_cmpgt_epi32(i, max);
+
+        res = _mm_or_si128(_mm_andnot_si128(tooLarge, res), _mm_and_si128(tooLarge, maxCode));
+
+        // zero would wrap when rebiased
+        return _mm_andnot_si128(_mm_cmpeq_epi32(i, _mm_setzero_si128()), res);
+    }
+
+    template<typename T>
+    static void PackR11G11B10Range(const T* rgb, uint32_t begin, uint32_t end, uint32_t* dst)
+    {
+        // channels are interleaved so the lanes holding blue repeat every 3 vectors
+        const std::array<__m128i, 3> isBlue = {
+            _mm_set_epi32(0, -1, 0, 0),     // R G B R
+            _mm_set_epi32(0, 0, -1, 0),     // G B R G
+            _mm_set_epi32(-1, 0, 0, -1)     // B R G B
+        };
+
+        auto zero = _mm_setzero_si128();
+        auto x = begin;
+
+        for (; x + PACKR11G11B10_STEP <= end; x += PACKR11G11B10_STEP) {
+            auto src = rgb + x * 3;
+            std::array<__m128i, 12> channels;
+
+            // widen to 32 bits
+            if constexpr (sizeof(T) == 1) {
+                for (uint32_t j = 0; j < 3; ++j) {
+                    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j * 16));
+                    auto lo = _mm_unpacklo_epi8(bytes, zero);
+                    auto hi = _mm_unpackhi_epi8(bytes, zero);
+
+                    channels[j * 4 + 0] = _mm_unpacklo_epi16(lo, zero);
+                    channels[j * 4 + 1] = _mm_unpackhi_epi16(lo, zero);
+                    channels[j * 4 + 2] = _mm_unpacklo_epi16(hi, zero);
+                    channels[j * 4 + 3] = _mm_unpackhi_epi16(hi, zero);
+                }
+            } else {
+                for (uint32_t j = 0; j < 6; ++j) {
+                    auto words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j * 8));
+
+                    channels[j * 2 + 0] = _mm_unpacklo_epi16(words, zero);
+                    channels[j * 2 + 1] = _mm_unpackhi_epi16(words, zero);
+                }
+            }
+
+            alignas(16) std::array<uint32_t, PACKR11G11B10_STEP * 3> codes;
+
+            for (uint32_t j = 0; j < 12; ++j) {
+                auto v = _mm_cvtepi32_ps(channels[j]);
+
+                // a division like the scalar version, multiplying by the reciprocal would round differently
+                if constexpr (sizeof(T) == 1)
+                    v = _mm_div_ps(v, _mm_set1_ps(255.f));
+
+                _mm_store_si128(reinterpret_cast<__m128i*>(codes.data() + j * 4), PackFloat11Or10(v, isBlue[j % 3]));
+            }
+
+            for (uint32_t p = 0; p < PACKR11G11B10_STEP; ++p)
+                dst[x + p] = codes[p * 3] | (codes[p * 3 + 1] << 11) | (codes[p * 3 + 2] << 22);
+        }
+
+        for (; x < end; ++x) {
+            float r, g, b;
+
+            if constexpr (sizeof(T) == 1) {
+                r = static_cast<float>(rgb[x * 3 + 0]) / 255.f;
+                g = static_cast<float>(rgb[x * 3 + 1]) / 255.f;
+                b = static_cast<float>(rgb[x * 3 + 2]) / 255.f;
+            } else {
+                r = static_cast<float>(rgb[x * 3 + 0]);
+                g = static_cast<float>(rgb[x * 3 + 1]);
+                b = static_cast<float>(rgb[x * 3 + 2]);
+            }
+
+            dst[x] = DirectX::PackedVector::XMFLOAT3PK(r, g, b);
+        }
+    }
+
+    template<typename T>
+    static void PackR11G11B10Parallel(const T* rgb, const uint32_t numPixels, uint32_t* dst)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        // chunks are a multiple of the SIMD width so only the last one has a scalar tail
+        auto numChunks = (numPixels + PACKR11G11B10_STEP - 1) / PACKR11G11B10_STEP;
+
+        ParallelFor(Globals::Instance().threadPool_.get(), numChunks, PACKR11G11B10_GRAIN / PACKR11G11B10_STEP, [&](uint32_t begin, uint32_t end)
+        {
+            PackR11G11B10Range(rgb, begin * PACKR11G11B10_STEP, std::min(end * PACKR11G11B10_STEP, numPixels), dst);
+        });
+    }
+
+    void PackR11G11B10(const uint8_t* rgb, const uint32_t numPixels, uint32_t* dst)
+    {
+        PackR11G11B10Parallel(rgb, numPixels, dst);
+    }
+
+    void PackR11G11B10(const uint16_t* rgb, const uint32_t numPixels, uint32_t* dst)
+    {
+        PackR11G11B10Parallel(rgb, numPixels, dst);
+    }
+} // namespace ninniku
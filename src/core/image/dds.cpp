@@ -35,6 +35,11 @@ namespace ninniku
         return impl_->Load(path);
     }
 
+    bool ddsImage::LoadMapped(const std::string_view& path)
+    {
+        return impl_->LoadMapped(path);
+    }
+
     bool ddsImage::LoadRaw(const void* pData, const size_t size)
     {
         return impl_->LoadRaw(pData, size);
@@ -65,8 +70,8 @@ namespace ninniku
         return impl_->SaveImage(path);
     }
 
-    bool ddsImage::SaveCompressedImage(const std::string_view& path, RenderDeviceHandle& dx, DXGI_FORMAT format)
+    bool ddsImage::SaveCompressedImage(const std::string_view& path, RenderDeviceHandle& dx, DXGI_FORMAT format, const CompressDesc& desc, CompressResult* result)
     {
-        return impl_->SaveCompressedImage(path, dx, format);
+        return impl_->SaveCompressedImage(path, dx, format, desc, result);
     }
 } // namespace ninniku
\ No newline at end of file
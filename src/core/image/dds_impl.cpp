@@ -26,14 +26,26 @@
 #include "../../globals.h"
 #include "../../utils/log.h"
 #include "../../utils/misc.h"
+#include "../../utils/stats.h"
+#include "../../utils/trace.h"
 #include "../renderer/dx11/DX11.h"
-#include "../renderer/dx12/DX12.h"
+#include "bc_compress.h"
+#include "bc_encoder.h"
 
 #include <d3dx12/d3dx12.h>
 #include <comdef.h>
 
 namespace ninniku
 {
+    // DirectXTex does not expose DDS.h so only what is needed to locate the pixels is declared here
+    static constexpr uint32_t DDS_MAGIC_SIZE = 4;
+    static constexpr uint32_t DDS_HEADER_SIZE = 124;
+    static constexpr uint32_t DDS_HEADER_DXT10_SIZE = 20;
+    static constexpr uint32_t DDS_PIXELFORMAT_FLAGS_OFFSET = DDS_MAGIC_SIZE + 76;
+    static constexpr uint32_t DDS_PIXELFORMAT_FOURCC_OFFSET = DDS_MAGIC_SIZE + 80;
+    static constexpr uint32_t DDS_FOURCC = 0x00000004;
+    static constexpr uint32_t DDS_FOURCC_DX10 = 0x30315844; // 'DX10'
+
     ddsImage::ddsImage()
         : impl_{ new ddsImageImpl() }
     {
@@ -41,6 +53,11 @@ namespace ninniku
 
     ddsImage::~ddsImage() = default;
 
+    ddsImageImpl::~ddsImageImpl()
+    {
+        TRACE_FREE_IMAGE(scratch_.GetPixels());
+    }
+
     TextureParamHandle ddsImageImpl::CreateTextureParamInternal(const EResourceViews viewFlags) const
     {
         auto res = TextureParam::Create();
@@ -53,15 +70,32 @@ namespace ninniku
         res->imageDatas = GetInitializationData();
         res->numMips = static_cast<uint32_t>(meta_.mipLevels);
         res->viewflags = viewFlags;
+        res->imageDatasOwner = file_;
 
         return std::move(res);
     }
 
     const std::tuple<uint8_t*, uint32_t> ddsImageImpl::GetData() const
     {
+        if (file_) {
+            auto pixels = mappedImages_.front().pixels;
+
+            return { pixels, static_cast<uint32_t>(file_->GetData() + file_->GetSize() - pixels) };
+        }
+
         return { scratch_.GetPixels(), static_cast<uint32_t>(scratch_.GetPixelsSize()) };
     }
 
+    size_t ddsImageImpl::GetImageCount() const
+    {
+        return file_ ? mappedImages_.size() : scratch_.GetImageCount();
+    }
+
+    const DirectX::Image* ddsImageImpl::GetImages() const
+    {
+        return file_ ? mappedImages_.data() : scratch_.GetImages();
+    }
+
     const std::vector<SubresourceParam> ddsImageImpl::GetInitializationData() const
     {
         if (meta_.IsVolumemap()) {
@@ -78,7 +112,7 @@ namespace ninniku
         for (size_t item = 0; item < meta_.arraySize; ++item) {
             for (size_t level = 0; level < meta_.mipLevels; ++level) {
                 auto index = meta_.ComputeIndex(level, item, 0);
-                auto& img = scratch_.GetImages()[index];
+                auto& img = GetImages()[index];
 
                 res[idx].data = img.pixels;
                 res[idx].rowPitch = static_cast<uint32_t>(img.rowPitch);
@@ -92,41 +126,145 @@ namespace ninniku
 
     bool ddsImageImpl::LoadInternal(const std::string_view& path)
     {
-        auto fmt = boost::format("ddsImageImpl::Load, Path=\"%1%\"") % path;
-        LOG << boost::str(fmt);
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image decode (MB/s)");
+
+        ResetMapping();
+
+        if (mapOnLoad_ && LoadMappedInternal(path))
+            return true;
+
+        LOGF(boost::format("ddsImageImpl::Load, Path=\"%1%\"") % path);
 
-        auto wPath = strToWStr(path);
+        TRACE_FREE_IMAGE(scratch_.GetPixels());
 
-        HRESULT hr = GetMetadataFromDDSFile(wPath.c_str(), DirectX::DDS_FLAGS_NONE, meta_);
+        // metadata are filled by the load itself so the file is only opened once
+        HRESULT hr = LoadFromDDSFile(strToWStr(path).c_str(), DirectX::DDS_FLAGS_NONE, &meta_, scratch_);
         if (FAILED(hr)) {
-            fmt = boost::format("Could not load metadata for DDS file %1%") % path;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Failed to load DDS file %1%") % path);
             return false;
         }
 
         if ((meta_.dimension == DirectX::TEX_DIMENSION_TEXTURE3D) && (meta_.arraySize > 1)) {
             LOGE << "Texture3DArray cannot be loaded";
+            scratch_.Release();
             return false;
         }
 
-        hr = LoadFromDDSFile(wPath.c_str(), DirectX::DDS_FLAGS_NONE, &meta_, scratch_);
+        TRACE_ALLOC_IMAGE(scratch_.GetPixels(), scratch_.GetPixelsSize());
+        TRACE_THROUGHPUT_ADD_IMAGE(scratch_.GetPixelsSize());
+
+        return true;
+    }
+
+    bool ddsImageImpl::LoadMapped(const std::string_view& path)
+    {
+        mapOnLoad_ = true;
+
+        auto res = Load(path);
+
+        mapOnLoad_ = false;
+
+        return res;
+    }
+
+    bool ddsImageImpl::LoadMappedInternal(const std::string_view& path)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        LOGF(boost::format("ddsImageImpl::LoadMapped, Path=\"%1%\"") % path);
+
+        auto file = std::make_shared<MappedFile>();
+
+        if (!file->Open(path))
+            return false;
+
+        auto data = file->GetData();
+        auto size = file->GetSize();
+
+        HRESULT hr = GetMetadataFromDDSMemory(data, size, DirectX::DDS_FLAGS_NONE, meta_);
         if (FAILED(hr)) {
-            fmt = boost::format("Failed to load DDS file %1%") % path;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Could not load metadata for DDS file %1%") % path);
+            return false;
+        }
+
+        // legacy headers may need a conversion (24bpp, palettes, swizzles..) which cannot be done in place
+        uint32_t pfFlags;
+        uint32_t fourCC;
+
+        memcpy(&pfFlags, data + DDS_PIXELFORMAT_FLAGS_OFFSET, sizeof(uint32_t));
+        memcpy(&fourCC, data + DDS_PIXELFORMAT_FOURCC_OFFSET, sizeof(uint32_t));
+
+        if (((pfFlags & DDS_FOURCC) == 0) || (fourCC != DDS_FOURCC_DX10)) {
+            LOGWF(boost::format("%1% has no DX10 header, falling back to a copy") % path);
+            return false;
+        }
+
+        if (meta_.dimension == DirectX::TEX_DIMENSION_TEXTURE3D) {
+            LOGW << "Texture3D cannot be mapped, falling back to a copy";
             return false;
         }
 
+        // subresources are stored item by item, each with its whole mip chain
+        auto offset = DDS_MAGIC_SIZE + DDS_HEADER_SIZE + DDS_HEADER_DXT10_SIZE;
+        std::vector<DirectX::Image> images;
+
+        images.reserve(meta_.arraySize * meta_.mipLevels);
+
+        for (size_t item = 0; item < meta_.arraySize; ++item) {
+            for (size_t level = 0; level < meta_.mipLevels; ++level) {
+                DirectX::Image img = {};
+
+                img.width = std::max<size_t>(1, meta_.width >> level);
+                img.height = std::max<size_t>(1, meta_.height >> level);
+                img.format = meta_.format;
+
+                hr = DirectX::ComputePitch(img.format, img.width, img.height, img.rowPitch, img.slicePitch);
+
+                if (CheckAPIFailed(hr, "DirectX::ComputePitch"))
+                    return false;
+
+                if (offset + img.slicePitch > size) {
+                    LOGEF(boost::format("DDS file %1% is truncated") % path);
+                    return false;
+                }
+
+                img.pixels = data + offset;
+                offset += img.slicePitch;
+
+                images.emplace_back(img);
+            }
+        }
+
+        file_ = std::move(file);
+        mappedImages_ = std::move(images);
+
+        AddStat(SC_ImagesMapped);
+
+        TRACE_FREE_IMAGE(scratch_.GetPixels());
+        scratch_.Release();
+
         return true;
     }
 
     bool ddsImageImpl::LoadRaw(const void* pData, const size_t size)
     {
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image decode (MB/s)");
+
+        ResetMapping();
+
+        TRACE_FREE_IMAGE(scratch_.GetPixels());
+
         const auto hr = LoadFromDDSMemory(pData, size, DirectX::DDS_FLAGS_NONE, &meta_, scratch_);
         if (FAILED(hr)) {
             LOGE << "Failed to load DDS file";
             return false;
         }
 
+        TRACE_ALLOC_IMAGE(scratch_.GetPixels(), scratch_.GetPixelsSize());
+        TRACE_THROUGHPUT_ADD_IMAGE(scratch_.GetPixelsSize());
+
         return true;
     }
 
@@ -137,6 +275,8 @@ namespace ninniku
 
     bool ddsImageImpl::InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex)
     {
+        TRACE_SCOPED_IMAGE;
+
         // DirectXTex
         meta_ = DirectX::TexMetadata{};
         meta_.width = srcTex->GetDesc()->width;
@@ -158,86 +298,27 @@ namespace ninniku
         if ((meta_.arraySize % CUBEMAP_NUM_FACES == 0) && (meta_.dimension == DirectX::TEX_DIMENSION_TEXTURE2D))
             meta_.miscFlags |= DirectX::TEX_MISC_TEXTURECUBE;
 
-        auto fmt = boost::format("ddsImageImpl::InitializeFromTextureObject with Width=%1%, Height=%2%, Depth=%3%, Array=%4%, Mips=%5%, IsCubemap=%6%") % meta_.width % meta_.height % meta_.depth % meta_.arraySize % meta_.mipLevels % ((meta_.miscFlags & DirectX::TEX_MISC_TEXTURECUBE) != 0);
-        LOG << boost::str(fmt);
+        LOGF(boost::format("ddsImageImpl::InitializeFromTextureObject with Width=%1%, Height=%2%, Depth=%3%, Array=%4%, Mips=%5%, IsCubemap=%6%") % meta_.width % meta_.height % meta_.depth % meta_.arraySize % meta_.mipLevels % ((meta_.miscFlags & DirectX::TEX_MISC_TEXTURECUBE) != 0));
+
+        ResetMapping();
+
+        TRACE_FREE_IMAGE(scratch_.GetPixels());
 
         auto hr = scratch_.Initialize(meta_);
 
         if (CheckAPIFailed(hr, "DirectX::ScratchImage::Initialize"))
             return false;
 
-        auto marker = dx->CreateDebugMarker("ddsFromTextureObject");
-
-        // we have to copy each mip with a read back texture of the same size for each face
-        auto srcDesc = srcTex->GetDesc();
-
-        if ((dx->GetType() & ERenderer::RENDERER_DX11) != 0) {
-            // dx11 can read back from a texture
-            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
-                auto param = TextureParam::Create();
-
-                param->width = srcDesc->width >> mip;
-                param->height = srcDesc->height >> mip;
-                param->format = srcDesc->format;
-                param->numMips = 1;
-                param->arraySize = 1;
-                param->viewflags = EResourceViews::RV_CPU_READ;
-                param->depth = 1;
-
-                auto readBack = dx->CreateTexture(param);
-
-                ninniku::CopyTextureSubresourceParam params = {};
-                params.src = srcTex.get();
-                params.srcMip = mip;
-                params.dst = readBack.get();
-
-                for (uint32_t face = 0; face < srcDesc->arraySize; ++face) {
-                    params.srcFace = face;
-
-                    auto indexes = dx->CopyTextureSubresource(params);
-                    auto mapped = dx->Map(readBack, std::get<1>(indexes));
-                    auto dx11Mapped = static_cast<const DX11MappedResource*>(mapped.get());
-
-                    UpdateSubImage(face, mip, static_cast<uint8_t*>(mapped->GetData()), dx11Mapped->GetRowPitch());
-                }
-            }
-        } else {
-            // dx12 needs to use an intermediate buffer
-            auto dx12 = static_cast<DX12*>(dx.get());
-
-            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
-                auto param = TextureParam::Create();
-
-                param->width = srcDesc->width >> mip;
-                param->height = srcDesc->height >> mip;
-                param->format = srcDesc->format;
-
-                auto readback = dx12->CreateBuffer(param);
-
-                CopyTextureSubresourceToBufferParam cpyParams = {};
-
-                cpyParams.tex = srcTex.get();
-                cpyParams.texMip = mip;
-                cpyParams.buffer = readback.get();
+        TRACE_ALLOC_IMAGE(scratch_.GetPixels(), scratch_.GetPixelsSize());
 
-                for (uint32_t face = 0; face < srcDesc->arraySize; ++face) {
-                    cpyParams.texFace = face;
-
-                    auto cpyRes = dx12->CopyTextureSubresourceToBuffer(cpyParams);
-
-                    auto mapped = dx->Map(readback);
-
-                    UpdateSubImage(face, mip, static_cast<uint8_t*>(mapped->GetData()), std::get<0>(cpyRes));
-                }
-            }
-        }
+        auto marker = dx->CreateDebugMarker("ddsFromTextureObject");
 
-        return true;
+        return ReadbackTextureObject(dx, srcTex, 0, srcTex->GetDesc()->arraySize);
     }
 
     bool ddsImageImpl::SaveImage(const std::string_view& path)
     {
-        auto hr = DirectX::SaveToDDSFile(scratch_.GetImage(0, 0, 0), scratch_.GetImageCount(), meta_, DirectX::DDS_FLAGS_FORCE_DX10_EXT, ninniku::strToWStr(path).c_str());
+        auto hr = DirectX::SaveToDDSFile(GetImages(), GetImageCount(), meta_, DirectX::DDS_FLAGS_FORCE_DX10_EXT, ninniku::strToWStr(path).c_str());
 
         if (FAILED(hr)) {
             LOGE << "Failed to save compressed DDS";
@@ -247,38 +328,40 @@ namespace ninniku
         return true;
     }
 
-    bool ddsImageImpl::SaveCompressedImage(const std::string_view& path, RenderDeviceHandle& dx, DXGI_FORMAT format)
+    bool ddsImageImpl::SaveCompressedImage(const std::string_view& path, RenderDeviceHandle& dx, DXGI_FORMAT format, const CompressDesc& desc, CompressResult* result)
     {
-        auto fmt = boost::format("Saving DDS with ddsImageImpl file \"%1%\"") % path;
-        LOG << boost::str(fmt);
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image encode (MB/s)");
+
+        ScopedLatency latency{ SL_SaveCompressedImage };
+
+        LOGF(boost::format("Saving DDS with ddsImageImpl file \"%1%\"") % path);
 
         if (!DirectX::IsCompressed(format)) {
             LOGE << "Only compressed format are supported for now";
             return false;
         }
 
-        auto img = scratch_.GetImage(0, 0, 0);
+        auto img = GetImages();
         assert(img);
-        size_t nimg = scratch_.GetImageCount();
-
-        std::unique_ptr<DirectX::ScratchImage> resImageImpl(new (std::nothrow) DirectX::ScratchImage);
-
-        if (!resImageImpl) {
-            LOGE << "\nERROR: Memory allocation failed";
-            return false;
-        }
+        size_t nimg = GetImageCount();
 
         DWORD flags = DirectX::TEX_COMPRESS_PARALLEL;
         auto bc6hbc7 = false;
+        auto compressDesc = desc;
 
-        // use best compression for BC7
+        // the global quick mode only restricts calls which didn't choose their own modes
+        if ((compressDesc.bc7ModeMask == BC7_ALL_MODES) && Globals::Instance().bc7Quick_)
+            compressDesc.bc7ModeMask = 1 << 6;
+
+        // DirectXTex only has switches for mode 6 alone and for the 3 subsets modes 0/2
         switch (format) {
             case DXGI_FORMAT_BC7_TYPELESS:
             case DXGI_FORMAT_BC7_UNORM:
             case DXGI_FORMAT_BC7_UNORM_SRGB:
-                if (Globals::Instance().bc7Quick_)
+                if (compressDesc.bc7ModeMask == (1 << 6))
                     flags |= DirectX::TEX_COMPRESS_BC7_QUICK;
-                else
+                else if ((compressDesc.bc7ModeMask & ((1 << 0) | (1 << 2))) != 0)
                     flags |= DirectX::TEX_COMPRESS_BC7_USE_3SUBSETS;
                 bc6hbc7 = true;
                 break;
@@ -290,71 +373,116 @@ namespace ninniku
                 break;
         };
 
-        if (bc6hbc7) {
+        TRACE_THROUGHPUT_ADD_IMAGE(std::get<1>(GetData()));
+
+        auto builtIn = UseBuiltInBCEncoder(format, compressDesc);
+
+        if (!builtIn && (desc.quality != EBCQuality::BCQ_High) && IsBuiltInBCFormat(format))
+            LOGWF(boost::format("BC7 mode mask 0x%1$02x has neither mode 1 nor 6, using DirectXTex instead of the built-in encoder") % static_cast<uint32_t>(compressDesc.bc7ModeMask));
+
+        // DirectXTex only support DX11, the built-in encoder always runs on the CPU
+        if (bc6hbc7 && !builtIn && (dx->GetType() & ERenderer::RENDERER_DX11)) {
+            std::unique_ptr<DirectX::ScratchImage> resImageImpl(new (std::nothrow) DirectX::ScratchImage);
+
+            if (!resImageImpl) {
+                LOGE << "\nERROR: Memory allocation failed";
+                return false;
+            }
+
             HRESULT hr;
 
-            // DirectXTex only support DX11
-            if (dx->GetType() & ERenderer::RENDERER_DX11) {
+            {
+                TRACE_SCOPED_NAMED_IMAGE("ninniku::ddsImageImpl::SaveCompressedImage Compress BC6H/BC7");
+
                 LOGD_INDENT_START << "DirectXTex GPU Compression";
                 auto subMarker = dx->CreateDebugMarker("DirectXTex Compress");
                 auto dx11 = static_cast<DX11*>(dx.get());
 
                 hr = DirectX::Compress(dx11->GetDevice(), img, nimg, meta_, format, static_cast<DirectX::TEX_COMPRESS_FLAGS>(flags), 1.f, *resImageImpl);
-            } else {
-                LOGD_INDENT_START << "DirectXTex CPU Compression";
 
-                hr = DirectX::Compress(img, nimg, meta_, format, static_cast<DirectX::TEX_COMPRESS_FLAGS>(flags), 1.f, *resImageImpl);
+                LOGD_INDENT_END;
             }
 
             if (FAILED(hr)) {
                 LOGE << "Failed to compress DDS";
-                LOGD_INDENT_END;
                 return false;
             }
 
-            LOGD_INDENT_END;
-        } else {
-            LOGD_INDENT_START << "DirectXTex CPU Compression";
+            if (result != nullptr) {
+                auto resImages = resImageImpl->GetImages();
+                double squaredError = 0.0;
+
+                for (size_t i = 0; i < nimg; ++i) {
+                    if (!AccumulateSquaredError(img[i], resImages[i], squaredError))
+                        return false;
+                }
+
+                result->rmse = GetRMSE(squaredError, img, nimg, format);
+            }
+
+            auto resMeta = DirectX::TexMetadata(meta_);
+
+            resMeta.format = format;
+
+            TRACE_ALLOC_IMAGE(resImageImpl->GetPixels(), resImageImpl->GetPixelsSize());
 
-            auto hr = DirectX::Compress(img, nimg, meta_, format, static_cast<DirectX::TEX_COMPRESS_FLAGS>(flags), DirectX::TEX_THRESHOLD_DEFAULT, *resImageImpl);
+            {
+                TRACE_SCOPED_NAMED_IMAGE("ninniku::ddsImageImpl::SaveCompressedImage Write");
+
+                hr = DirectX::SaveToDDSFile(resImageImpl->GetImage(0, 0, 0), nimg, resMeta, DirectX::DDS_FLAGS_FORCE_DX10_EXT, ninniku::strToWStr(path).c_str());
+            }
+
+            TRACE_FREE_IMAGE(resImageImpl->GetPixels());
 
             if (FAILED(hr)) {
-                LOGE << "Failed to compress DDS";
-                LOGD_INDENT_END;
+                LOGE << "Failed to save compressed DDS";
                 return false;
             }
 
-            LOGD_INDENT_END;
+            return true;
         }
 
-        auto resMeta = DirectX::TexMetadata(meta_);
+        // CPU compression is split per subresource block rows instead of relying on DirectXTex parallelism within each image
+        LOGD_INDENT_START << "CPU Compression";
 
-        resMeta.format = format;
+        BCCompressParam param;
 
-        auto hr = DirectX::SaveToDDSFile(resImageImpl->GetImage(0, 0, 0), nimg, resMeta, DirectX::DDS_FLAGS_FORCE_DX10_EXT, ninniku::strToWStr(path).c_str());
+        param.format = format;
+        param.flags = flags;
+        param.threshold = bc6hbc7 ? 1.f : DirectX::TEX_THRESHOLD_DEFAULT;
+        param.desc = compressDesc;
 
-        if (FAILED(hr)) {
-            LOGE << "Failed to save compressed DDS";
+        auto success = CompressToDDSFile(img, nimg, meta_, param, std::filesystem::path{ ninniku::strToWStr(path) }, (result != nullptr) ? &result->rmse : nullptr);
+
+        LOGD_INDENT_END;
+
+        if (!success) {
+            LOGE << "Failed to compress DDS";
             return false;
         }
 
         return true;
     }
 
+    void ddsImageImpl::ResetMapping()
+    {
+        // TextureParam created from the mapping keep their own reference
+        file_.reset();
+        mappedImages_.clear();
+    }
+
     void ddsImageImpl::UpdateSubImage(const uint32_t dstFace, const uint32_t dstMip, const uint8_t* newData, const uint32_t newRowPitch)
     {
+        TRACE_SCOPED_IMAGE;
+
         auto index = meta_.ComputeIndex(dstMip, dstFace, 0);
         auto& img = scratch_.GetImages()[index];
 
         if (newRowPitch > img.rowPitch) {
             // row pitch from dx11 can be larger than for the image so we have to do each row manually
-            std::vector<uint8_t> temp(img.height * img.rowPitch);
-
             for (size_t y = 0; y < img.height; ++y) {
-                memcpy_s(&temp[y * img.rowPitch], img.rowPitch, &newData[y * newRowPitch], img.rowPitch);
+                memcpy_s(img.pixels + y * img.rowPitch, img.rowPitch, newData + y * newRowPitch, img.rowPitch);
             }
-
-            memcpy_s(img.pixels, img.height * img.rowPitch, temp.data(), temp.size());
         } else {
             memcpy_s(img.pixels, img.height * img.rowPitch, newData, img.height * newRowPitch);
         }
@@ -365,8 +493,7 @@ namespace ninniku
         if (ext == ".dds")
             return true;
 
-        auto fmt = boost::format("ddsImage does not support extension: \"%1%\"") % ext;
-        LOGE << boost::str(fmt);
+        LOGEF(boost::format("ddsImage does not support extension: \"%1%\"") % ext);
 
         return false;
     }
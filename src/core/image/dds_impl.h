@@ -22,6 +22,10 @@
 
 #include "image_Impl.h"
 
+#include "ninniku/core/image/dds.h"
+
+#include "../../utils/mapped_file.h"
+
 #include <DirectXTex.h>
 
 namespace ninniku
@@ -36,17 +40,19 @@ namespace ninniku
 
     public:
         ddsImageImpl() = default;
+        ~ddsImageImpl();
 
         const std::tuple<uint8_t*, uint32_t> GetData() const override;
 
         // Used when transferring data back from the GPU
         bool InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex) override;
 
-        bool LoadRaw(const void* pData, const size_t size);
+        bool LoadMapped(const std::string_view& path);
+        bool LoadRaw(const void* pData, const size_t size) override;
         bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) override;
 
         bool SaveImage(const std::string_view&);
-        bool SaveCompressedImage(const std::string_view&, RenderDeviceHandle& dx, DXGI_FORMAT format);
+        bool SaveCompressedImage(const std::string_view&, RenderDeviceHandle& dx, DXGI_FORMAT format, const CompressDesc& desc, CompressResult* result);
 
     protected:
         TextureParamHandle CreateTextureParamInternal(const EResourceViews viewFlags) const override;
@@ -57,8 +63,19 @@ namespace ninniku
         void UpdateSubImage(const uint32_t dstFace, const uint32_t dstMip, const uint8_t* newData, const uint32_t newRowPitch) override;
         bool ValidateExtension(const std::string_view& ext) const override;
 
+    private:
+        size_t GetImageCount() const;
+        const DirectX::Image* GetImages() const;
+        bool LoadMappedInternal(const std::string_view& path);
+        void ResetMapping();
+
     private:
         DirectX::TexMetadata meta_;
         DirectX::ScratchImage scratch_;
+
+        // when loaded with LoadMapped, images point into the file instead of scratch_
+        std::shared_ptr<MappedFile> file_;
+        std::vector<DirectX::Image> mappedImages_;
+        bool mapOnLoad_ = false;
     };
 } // namespace ninniku
\ No newline at end of file
@@ -0,0 +1,508 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "exr_stream.h"
+
+#include "../../globals.h"
+#include "../../utils/log.h"
+#include "../../utils/thread_pool.h"
+#include "../../utils/trace.h"
+
+#define TINYEXR_IMPLEMENTATION
+#include <tinyexr/tinyexr.h>
+
+#include <cmft/allocator.h>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace ninniku
+{
+    // preferred number of source rows decoded at once, rounded up to whole blocks
+    static constexpr uint32_t EXR_STREAM_BAND_ROWS = 64;
+
+    // upper bound for the decoded band window, wide images get fewer rows per band instead of more memory
+    static constexpr size_t EXR_STREAM_BAND_BYTES = 32 * 1024 * 1024;
+
+    // same constants and face orientation as cmft so both paths build the same cubemap
+    static constexpr float EXR_STREAM_PI = 3.14159265358979323846f;
+    static constexpr float EXR_STREAM_RPI = 0.31830988618379067153f;
+
+    static constexpr float EXR_STREAM_FACE_UV[CUBE_FACE_NUM][3][3] = {
+        { { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }
+    };
+
+    // FreeEXRHeader only releases what the header points to
+    struct EXRHeaderHolder : NonCopyable
+    {
+        EXRHeaderHolder() { InitEXRHeader(&header); }
+        ~EXRHeaderHolder() override { FreeEXRHeader(&header); }
+
+        EXRHeader header;
+    };
+
+    struct EXRStreamContext
+    {
+        const uint8_t* data;
+        size_t size;
+        const EXRHeader* header;
+        std::vector<tinyexr::tinyexr_uint64> offsets;
+        std::vector<size_t> channelOffsets;
+        size_t pixelDataSize;
+
+        // channel written to R, G, B and A, -1 means 1.0
+        std::array<int32_t, 4> channelMap;
+
+        uint32_t width;
+        uint32_t height;
+        uint32_t blockRows;
+        uint32_t numBlocksX;
+    };
+
+    // consecutive texels of a face row that all sample the same band
+    struct EXRStreamRun
+    {
+        uint32_t face;
+        uint32_t y;
+        uint32_t xBegin;
+        uint32_t xEnd;
+    };
+
+    struct EXRStreamSample
+    {
+        uint32_t x0;
+        uint32_t x1;
+        uint32_t y0;
+        uint32_t y1;
+        float tx;
+        float ty;
+    };
+
+    // bilinear taps of a cubemap texel in the lat-long image, this follows imageCubemapFromLatLong step by step
+    // the taps are clamped so a degenerate direction cannot read outside of the source
+    static EXRStreamSample GetLatLongSample(const uint32_t face, const uint32_t x, const uint32_t y, const float invFaceSize, const uint32_t width, const uint32_t height)
+    {
+        const float u = 2.0f * x * invFaceSize - 1.0f;
+        const float v = 2.0f * y * invFaceSize - 1.0f;
+        const auto& faceUV = EXR_STREAM_FACE_UV[face];
+
+        float vec[3];
+
+        for (uint32_t i = 0; i < 3; ++i)
+            vec[i] = faceUV[0][i] * u + faceUV[1][i] * v + faceUV[2][i];
+
+        const float invLen = 1.0f / sqrtf(vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2]);
+
+        for (uint32_t i = 0; i < 3; ++i)
+            vec[i] *= invLen;
+
+        const float phi = atan2f(vec[0], vec[2]);
+        const float theta = acosf(vec[1]);
+
+        float xSrc = (EXR_STREAM_PI + phi) * (0.5f / EXR_STREAM_PI);
+        float ySrc = theta * EXR_STREAM_RPI;
+
+        xSrc *= static_cast<float>(static_cast<int32_t>(width - 1));
+        ySrc *= static_cast<float>(static_cast<int32_t>(height - 1));
+
+        EXRStreamSample res;
+
+        res.x0 = std::min(static_cast<uint32_t>(static_cast<int32_t>(xSrc)), width - 1);
+        res.y0 = std::min(static_cast<uint32_t>(static_cast<int32_t>(ySrc)), height - 1);
+        res.x1 = std::min(res.x0 + 1, width - 1);
+        res.y1 = std::min(res.y0 + 1, height - 1);
+        res.tx = xSrc - static_cast<float>(static_cast<int32_t>(res.x0));
+        res.ty = ySrc - static_cast<float>(static_cast<int32_t>(res.y0));
+
+        return res;
+    }
+
+    // decode one scanline block or tile into the band window, row 0 of the window is the last row of the previous band
+    static bool DecodeBlock(const EXRStreamContext& ctx, const uint32_t block, const uint32_t bandStart, float* window)
+    {
+        const auto& header = *ctx.header;
+        const auto offset = ctx.offsets[block];
+
+        // tile coordinates or line number, followed by the data length
+        const size_t chunkHeaderSize = header.tiled ? 20 : 8;
+
+        if (offset + chunkHeaderSize > ctx.size)
+            return false;
+
+        auto ptr = ctx.data + offset;
+        int32_t dataLen;
+
+        memcpy(&dataLen, ptr + chunkHeaderSize - sizeof(int32_t), sizeof(int32_t));
+        tinyexr::swap4(reinterpret_cast<unsigned int*>(&dataLen));
+
+        if ((dataLen <= 0) || (static_cast<size_t>(dataLen) > ctx.size - offset - chunkHeaderSize))
+            return false;
+
+        uint32_t x0 = 0;
+        uint32_t y0;
+        uint32_t width = ctx.width;
+        uint32_t rows;
+
+        if (header.tiled) {
+            int32_t coords[4];
+
+            memcpy(coords, ptr, sizeof(coords));
+
+            for (auto& coord : coords)
+                tinyexr::swap4(reinterpret_cast<unsigned int*>(&coord));
+
+            auto tileX = block % ctx.numBlocksX;
+            auto tileY = block / ctx.numBlocksX;
+
+            if ((coords[0] != static_cast<int32_t>(tileX)) || (coords[1] != static_cast<int32_t>(tileY)) || (coords[2] != 0) || (coords[3] != 0))
+                return false;
+
+            x0 = tileX * header.tile_size_x;
+            y0 = tileY * header.tile_size_y;
+            width = std::min(static_cast<uint32_t>(header.tile_size_x), ctx.width - x0);
+            rows = std::min(static_cast<uint32_t>(header.tile_size_y), ctx.height - y0);
+        } else {
+            int32_t lineNo;
+
+            memcpy(&lineNo, ptr, sizeof(int32_t));
+            tinyexr::swap4(reinterpret_cast<unsigned int*>(&lineNo));
+
+            y0 = block * ctx.blockRows;
+
+            if (static_cast<int64_t>(lineNo) - header.data_window[1] != static_cast<int64_t>(y0))
+                return false;
+
+            rows = std::min(ctx.blockRows, ctx.height - y0);
+        }
+
+        // tinyexr decodes each channel in its own plane
+        const size_t planeSize = static_cast<size_t>(width) * rows;
+        const size_t numChannels = static_cast<size_t>(header.num_channels);
+        std::vector<float> planes(planeSize * numChannels);
+        std::vector<uint8_t*> planePtrs(numChannels);
+
+        for (size_t c = 0; c < numChannels; ++c)
+            planePtrs[c] = reinterpret_cast<uint8_t*>(planes.data() + c * planeSize);
+
+        auto decoded = tinyexr::DecodePixelData(planePtrs.data(), header.requested_pixel_types, ptr + chunkHeaderSize, static_cast<size_t>(dataLen),
+                                                header.compression_type, header.line_order, width, rows, width, 0, 0, rows, ctx.pixelDataSize,
+                                                static_cast<size_t>(header.num_custom_attributes), header.custom_attributes, numChannels, header.channels, ctx.channelOffsets);
+
+        if (!decoded)
+            return false;
+
+        for (uint32_t row = 0; row < rows; ++row) {
+            auto dst = window + (static_cast<size_t>(y0 + row - bandStart + 1) * ctx.width + x0) * 4;
+            auto src = static_cast<size_t>(row) * width;
+
+            for (uint32_t x = 0; x < width; ++x, ++src, dst += 4) {
+                for (uint32_t i = 0; i < 4; ++i) {
+                    auto c = ctx.channelMap[i];
+
+                    dst[i] = (c < 0) ? 1.0f : planes[c * planeSize + src];
+                }
+            }
+        }
+
+        return true;
+    }
+
+    EXRStreamResult StreamLatLongEXR(const uint8_t* data, const size_t size, cmft::Image& dst)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        EXRVersion version;
+
+        if (ParseEXRVersionFromMemory(&version, data, size) != TINYEXR_SUCCESS)
+            return EXRStreamResult::Failed;
+
+        if (version.multipart || version.non_image)
+            return EXRStreamResult::Unsupported;
+
+        EXRHeaderHolder holder;
+        auto& header = holder.header;
+        const char* err = nullptr;
+
+        if (ParseEXRHeaderFromMemory(&header, &version, data, size, &err) != TINYEXR_SUCCESS) {
+            LOGEF(boost::format("StreamLatLongEXR failed with: %1%") % err);
+            FreeEXRErrorMessage(err);
+
+            return EXRStreamResult::Failed;
+        }
+
+        const int64_t width = static_cast<int64_t>(header.data_window[2]) - header.data_window[0] + 1;
+        const int64_t height = static_cast<int64_t>(header.data_window[3]) - header.data_window[1] + 1;
+
+        if ((width <= 0) || (height <= 0) || (width > std::numeric_limits<int32_t>::max()) || (height > std::numeric_limits<int32_t>::max()))
+            return EXRStreamResult::Failed;
+
+        // anything else is converted differently by AssembleCubemap
+        const float aspect = static_cast<float>(width) / static_cast<float>(height);
+
+        if (fabsf(aspect - 2.0f) >= 0.00001f)
+            return EXRStreamResult::Unsupported;
+
+        // decreasing y and mip/rip levels are rare enough to leave them to the full decoder
+        if ((header.line_order != 0) || (header.tiled && (header.tile_level_mode != TINYEXR_TILE_ONE_LEVEL)))
+            return EXRStreamResult::Unsupported;
+
+        EXRStreamContext ctx;
+
+        ctx.data = data;
+        ctx.size = size;
+        ctx.header = &header;
+        ctx.channelMap = { -1, -1, -1, -1 };
+        ctx.width = static_cast<uint32_t>(width);
+        ctx.height = static_cast<uint32_t>(height);
+
+        for (int32_t c = 0; c < header.num_channels; ++c) {
+            if (header.pixel_types[c] == TINYEXR_PIXELTYPE_UINT)
+                return EXRStreamResult::Unsupported;
+
+            header.requested_pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
+
+            constexpr std::array<const char*, 4> names = { "R", "G", "B", "A" };
+
+            for (uint32_t i = 0; i < 4; ++i) {
+                if (strcmp(header.channels[c].name, names[i]) == 0)
+                    ctx.channelMap[i] = c;
+            }
+        }
+
+        // grayscale is replicated to every component like LoadEXR does
+        if (header.num_channels == 1) {
+            ctx.channelMap = { 0, 0, 0, 0 };
+        } else if ((ctx.channelMap[0] < 0) || (ctx.channelMap[1] < 0) || (ctx.channelMap[2] < 0)) {
+            LOGE << "StreamLatLongEXR: R, G or B channel not found";
+
+            return EXRStreamResult::Failed;
+        }
+
+        int pixelDataSize;
+        size_t channelOffset;
+
+        // unknown pixel types leave the offsets undefined, the full decoder reports them
+        if (!tinyexr::ComputeChannelLayout(&ctx.channelOffsets, &pixelDataSize, &channelOffset, header.num_channels, header.channels))
+            return EXRStreamResult::Unsupported;
+
+        ctx.pixelDataSize = static_cast<size_t>(pixelDataSize);
+
+        uint32_t numBlocksY;
+
+        if (header.tiled) {
+            if ((header.tile_size_x <= 0) || (header.tile_size_y <= 0))
+                return EXRStreamResult::Failed;
+
+            ctx.blockRows = header.tile_size_y;
+            ctx.numBlocksX = (ctx.width + header.tile_size_x - 1) / header.tile_size_x;
+        } else {
+            switch (header.compression_type) {
+                case TINYEXR_COMPRESSIONTYPE_ZIP:
+                case TINYEXR_COMPRESSIONTYPE_ZFP:
+                    ctx.blockRows = 16;
+                    break;
+
+                case TINYEXR_COMPRESSIONTYPE_PIZ:
+                    ctx.blockRows = 32;
+                    break;
+
+                default:
+                    ctx.blockRows = 1;
+            }
+
+            ctx.numBlocksX = 1;
+        }
+
+        numBlocksY = (ctx.height + ctx.blockRows - 1) / ctx.blockRows;
+
+        const size_t numBlocks = static_cast<size_t>(ctx.numBlocksX) * numBlocksY;
+
+        if ((header.chunk_count > 0) && (static_cast<size_t>(header.chunk_count) != numBlocks))
+            return EXRStreamResult::Unsupported;
+
+        // offset table follows the magic number, the version and the header
+        const size_t tableOffset = static_cast<size_t>(header.header_len) + 8;
+
+        if ((tableOffset > size) || (numBlocks > (size - tableOffset) / sizeof(tinyexr::tinyexr_uint64)))
+            return EXRStreamResult::Failed;
+
+        ctx.offsets.resize(numBlocks);
+        memcpy(ctx.offsets.data(), data + tableOffset, numBlocks * sizeof(tinyexr::tinyexr_uint64));
+
+        for (auto& offset : ctx.offsets) {
+            tinyexr::swap8(&offset);
+
+            // incomplete files need their table rebuilt by scanning the whole file
+            if ((offset == 0) || (offset >= size))
+                return EXRStreamResult::Unsupported;
+        }
+
+        auto pool = Globals::Instance().threadPool_.get();
+        const uint32_t numThreads = (pool != nullptr) ? pool->GetNumThreads() : 1;
+
+        // a band is a row of tiles or enough scanline blocks to keep every worker busy, within the window budget
+        uint32_t blocksPerBand = 1;
+
+        if (!header.tiled) {
+            const size_t blockBytes = static_cast<size_t>(ctx.blockRows) * ctx.width * 4 * sizeof(float);
+            const size_t maxBlocks = std::max<size_t>(1, EXR_STREAM_BAND_BYTES / blockBytes);
+
+            blocksPerBand = std::max(std::max(1u, EXR_STREAM_BAND_ROWS / ctx.blockRows), numThreads);
+            blocksPerBand = static_cast<uint32_t>(std::min<size_t>(blocksPerBand, maxBlocks));
+        }
+
+        const uint32_t bandRows = ctx.blockRows * blocksPerBand;
+        const uint32_t numBands = (ctx.height + bandRows - 1) / bandRows;
+
+        const uint32_t faceSize = (ctx.height + 1) / 2;
+        const size_t facePitch = static_cast<size_t>(faceSize) * 4;
+        const size_t faceDataSize = facePitch * faceSize;
+        const size_t dstDataSize = faceDataSize * CUBE_FACE_NUM * sizeof(float);
+
+        if (dstDataSize > std::numeric_limits<uint32_t>::max())
+            return EXRStreamResult::Unsupported;
+
+        const float invFaceSize = 1.0f / static_cast<float>(faceSize);
+
+        // each texel is resampled with the band holding its bottom taps, the top ones are in the same band or in the carried row
+        std::vector<std::vector<EXRStreamRun>> bandRuns(numBands);
+        std::mutex runsMutex;
+
+        ParallelFor(pool, faceSize * CUBE_FACE_NUM, 16, [&](uint32_t begin, uint32_t end)
+        {
+            std::vector<std::pair<uint32_t, EXRStreamRun>> runs;
+
+            for (uint32_t i = begin; i < end; ++i) {
+                EXRStreamRun run = { i / faceSize, i % faceSize, 0, 0 };
+                uint32_t runBand = 0;
+
+                for (uint32_t x = 0; x < faceSize; ++x) {
+                    auto band = GetLatLongSample(run.face, x, run.y, invFaceSize, ctx.width, ctx.height).y1 / bandRows;
+
+                    if ((x > 0) && (band != runBand)) {
+                        run.xEnd = x;
+                        runs.emplace_back(runBand, run);
+                        run.xBegin = x;
+                    }
+
+                    runBand = band;
+                }
+
+                run.xEnd = faceSize;
+                runs.emplace_back(runBand, run);
+            }
+
+            std::lock_guard<std::mutex> lock(runsMutex);
+
+            for (auto& run : runs)
+                bandRuns[run.first].push_back(run.second);
+        });
+
+        auto dstData = static_cast<float*>(CMFT_ALLOC(cmft::g_allocator, dstDataSize));
+
+        if (dstData == nullptr) {
+            LOGE << "StreamLatLongEXR: could not allocate the cubemap";
+
+            return EXRStreamResult::Failed;
+        }
+
+        std::vector<float> window(static_cast<size_t>(bandRows + 1) * ctx.width * 4);
+
+        for (uint32_t band = 0; band < numBands; ++band) {
+            const uint32_t bandStart = band * bandRows;
+            const uint32_t bandEnd = std::min(ctx.height, bandStart + bandRows);
+            const uint32_t firstBlock = header.tiled ? band * ctx.numBlocksX : band * blocksPerBand;
+            const uint32_t numBandBlocks = header.tiled ? ctx.numBlocksX : std::min(blocksPerBand, numBlocksY - firstBlock);
+            std::atomic<bool> failed{ false };
+
+            ParallelFor(pool, numBandBlocks, 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; ++i) {
+                    if (!DecodeBlock(ctx, firstBlock + i, bandStart, window.data()))
+                        failed = true;
+                }
+            });
+
+            if (failed) {
+                LOGEF(boost::format("StreamLatLongEXR: could not decode rows %1% to %2%") % bandStart % bandEnd);
+                CMFT_FREE(cmft::g_allocator, dstData);
+
+                return EXRStreamResult::Failed;
+            }
+
+            auto& runs = bandRuns[band];
+
+            ParallelFor(pool, static_cast<uint32_t>(runs.size()), 16, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; ++i) {
+                    auto& run = runs[i];
+                    auto dstTexel = dstData + run.face * faceDataSize + run.y * facePitch + run.xBegin * 4;
+
+                    for (uint32_t x = run.xBegin; x < run.xEnd; ++x, dstTexel += 4) {
+                        auto sample = GetLatLongSample(run.face, x, run.y, invFaceSize, ctx.width, ctx.height);
+                        auto row0 = window.data() + static_cast<size_t>(sample.y0 + 1 - bandStart) * ctx.width * 4;
+                        auto row1 = window.data() + static_cast<size_t>(sample.y1 + 1 - bandStart) * ctx.width * 4;
+                        auto src0 = row0 + sample.x0 * 4;
+                        auto src1 = row0 + sample.x1 * 4;
+                        auto src2 = row1 + sample.x0 * 4;
+                        auto src3 = row1 + sample.x1 * 4;
+
+                        const float invTx = 1.0f - sample.tx;
+                        const float invTy = 1.0f - sample.ty;
+                        const float w0 = invTx * invTy;
+                        const float w1 = sample.tx * invTy;
+                        const float w2 = invTx * sample.ty;
+                        const float w3 = sample.tx * sample.ty;
+
+                        for (uint32_t c = 0; c < 4; ++c)
+                            dstTexel[c] = src0[c] * w0 + src1[c] * w1 + src2[c] * w2 + src3[c] * w3;
+                    }
+                }
+            });
+
+            // release the runs early and keep the last row for the next band
+            std::vector<EXRStreamRun>().swap(runs);
+            memcpy(window.data(), window.data() + static_cast<size_t>(bandEnd - bandStart) * ctx.width * 4, ctx.width * 4 * sizeof(float));
+        }
+
+        cmft::Image image;
+
+        image.m_data = dstData;
+        image.m_width = faceSize;
+        image.m_height = faceSize;
+        image.m_dataSize = static_cast<uint32_t>(dstDataSize);
+        image.m_format = cmft::TextureFormat::RGBA32F;
+        image.m_numMips = 1;
+        image.m_numFaces = CUBE_FACE_NUM;
+
+        cmft::imageMove(dst, image);
+
+        return EXRStreamResult::Success;
+    }
+} // namespace ninniku
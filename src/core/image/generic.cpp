@@ -35,6 +35,11 @@ namespace ninniku
         return impl_->Load(path);
     }
 
+    bool genericImage::LoadRaw(const void* pData, const size_t size)
+    {
+        return impl_->LoadRaw(pData, size);
+    }
+
     bool genericImage::LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format)
     {
         return impl_->LoadRaw(pData, size, width, height, format);
@@ -21,16 +21,18 @@
 #include "pch.h"
 #include "generic_impl.h"
 
+#include "ninniku/core/image/convert.h"
 #include "ninniku/core/image/generic.h"
 
 #include "../../utils/log.h"
+#include "../../utils/trace.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
 #include <array>
 #include <filesystem>
-#include <DirectXPackedVector.h>
+#include <limits>
 
 namespace ninniku
 {
@@ -52,23 +54,10 @@ namespace ninniku
 
         convertedData_.resize(size);
 
-        for (uint32_t i = 0; i < size; ++i) {
-            float r, g, b;
-
-            if (data16_ != nullptr) {
-                r = static_cast<float>(data16_[i * 3 + 0]);
-                g = static_cast<float>(data16_[i * 3 + 1]);
-                b = static_cast<float>(data16_[i * 3 + 2]);
-            } else {
-                r = static_cast<float>(data8_[i * 3 + 0]) / 255.f;
-                g = static_cast<float>(data8_[i * 3 + 1]) / 255.f;
-                b = static_cast<float>(data8_[i * 3 + 2]) / 255.f;
-            }
-
-            auto r11b11g10 = DirectX::PackedVector::XMFLOAT3PK(r, g, b);
-
-            convertedData_[i] = r11b11g10;
-        }
+        if (data16_ != nullptr)
+            PackR11G11B10(data16_, size, convertedData_.data());
+        else
+            PackR11G11B10(data8_, size, convertedData_.data());
     }
 
     TextureParamHandle genericImageImpl::CreateTextureParamInternal(const EResourceViews viewFlags) const
@@ -134,8 +123,10 @@ namespace ninniku
 
     bool genericImageImpl::LoadInternal(const std::string_view& path)
     {
-        auto fmt = boost::format("genericImageImpl::Load, Path=\"%1%\"") % path;
-        LOG << boost::str(fmt);
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image decode (MB/s)");
+
+        LOGF(boost::format("genericImageImpl::Load, Path=\"%1%\"") % path);
 
         Reset();
 
@@ -144,6 +135,10 @@ namespace ninniku
         else
             data8_ = stbi_load(path.data(), (int*)&width_, (int*)&height_, (int*)&bpp_, 0);
 
+        TRACE_ALLOC_IMAGE(data8_, std::get<1>(GetData()));
+        TRACE_ALLOC_IMAGE(data16_, std::get<1>(GetData()));
+        TRACE_THROUGHPUT_ADD_IMAGE(std::get<1>(GetData()));
+
         if (bpp_ == 3) {
             // we must convert from RGB to R11G11B10 since there is no R8G8B8 formats
             // a bit overkill but better than having an unused alpha
@@ -153,6 +148,42 @@ namespace ninniku
         return true;
     }
 
+    bool genericImageImpl::LoadRaw(const void* pData, const size_t size)
+    {
+        TRACE_SCOPED_IMAGE;
+        TRACE_THROUGHPUT_IMAGE("Image decode (MB/s)");
+
+        Reset();
+
+        if (size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+            LOGE << "genericImageImpl::LoadRaw, stb cannot decode more than 2GB";
+            return false;
+        }
+
+        auto buffer = static_cast<const stbi_uc*>(pData);
+        auto len = static_cast<int>(size);
+
+        if (stbi_is_16_bit_from_memory(buffer, len))
+            data16_ = stbi_load_16_from_memory(buffer, len, (int*)&width_, (int*)&height_, (int*)&bpp_, 0);
+        else
+            data8_ = stbi_load_from_memory(buffer, len, (int*)&width_, (int*)&height_, (int*)&bpp_, 0);
+
+        if ((data8_ == nullptr) && (data16_ == nullptr)) {
+            LOGEF(boost::format("genericImageImpl::LoadRaw failed with: %1%") % stbi_failure_reason());
+
+            return false;
+        }
+
+        TRACE_ALLOC_IMAGE(data8_, std::get<1>(GetData()));
+        TRACE_ALLOC_IMAGE(data16_, std::get<1>(GetData()));
+        TRACE_THROUGHPUT_ADD_IMAGE(std::get<1>(GetData()));
+
+        if (bpp_ == 3)
+            ConvertToR11G11B10();
+
+        return true;
+    }
+
     bool genericImageImpl::LoadRaw([[maybe_unused]] const void* pData, [[maybe_unused]] const size_t size, [[maybe_unused]] const uint32_t width, [[maybe_unused]] const uint32_t height, [[maybe_unused]] const int32_t format)
     {
         throw std::exception("not implemented");
@@ -200,11 +231,13 @@ namespace ninniku
         width_ = height_ = bpp_ = 0;
 
         if (data8_ != nullptr) {
+            TRACE_FREE_IMAGE(data8_);
             stbi_image_free(data8_);
             data8_ = nullptr;
         }
 
         if (data16_ != nullptr) {
+            TRACE_FREE_IMAGE(data16_);
             stbi_image_free(data16_);
             data16_ = nullptr;
         }
@@ -223,8 +256,7 @@ namespace ninniku
             if (ext == validExt)
                 return true;
 
-        auto fmt = boost::format("genericImage does not support extension: \"%1%\"") % ext;
-        LOGE << boost::str(fmt);
+        LOGEF(boost::format("genericImage does not support extension: \"%1%\"") % ext);
 
         return false;
     }
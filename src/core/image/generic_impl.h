@@ -41,6 +41,7 @@ namespace ninniku
         // Used when transferring data back from the GPU
         bool InitializeFromTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex) override;
 
+        bool LoadRaw(const void* pData, const size_t size) override;
         bool LoadRaw(const void* pData, const size_t size, const uint32_t width, const uint32_t height, const int32_t format) override;
 
         // Save Image as DDS R32G32B32A32_FLOAT
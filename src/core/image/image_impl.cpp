@@ -21,8 +21,11 @@
 #include "pch.h"
 #include "image_impl.h"
 
+#include "../../globals.h"
 #include "../../utils/mathUtils.h"
 #include "../../utils/log.h"
+#include "../../utils/stats.h"
+#include "../../utils/trace.h"
 
 namespace ninniku
 {
@@ -43,16 +46,14 @@ namespace ninniku
         auto res = false;
 
         if (!IsPow2(tx)) {
-            auto fmt = boost::format("Width %1% is not a power of 2") % tx;
-            LOGW << boost::str(fmt);
+            LOGWF(boost::format("Width %1% is not a power of 2") % tx);
 
             tx = NearestPow2Floor(tx);
             res = true;
         }
 
         if (!IsPow2(ty)) {
-            auto fmt = boost::format("Height %1% is not a power of 2") % ty;
-            LOGW << boost::str(fmt);
+            LOGWF(boost::format("Height %1% is not a power of 2") % ty);
 
             ty = NearestPow2Floor(ty);
             res = true;
@@ -63,11 +64,12 @@ namespace ninniku
 
     bool ImageImpl::Load(const std::string_view& path)
     {
+        ScopedLatency latency{ SL_Load };
+
         auto validPath = std::filesystem::path{ path };
 
         if (!std::filesystem::exists(validPath)) {
-            auto fmt = boost::format("Could not find file \"%1%\"") % path;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Could not find file \"%1%\"") % path);
 
             return false;
         }
@@ -75,6 +77,43 @@ namespace ninniku
         if (!ValidateExtension(validPath.extension().string()))
             return false;
 
-        return LoadInternal(path);
+        if (!LoadInternal(path))
+            return false;
+
+        AddStat(SC_ImagesLoaded);
+
+        return true;
+    }
+
+    bool ImageImpl::ReadbackTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex, const uint32_t firstFace, const uint32_t numFaces)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        ReadbackTextureParam params = {};
+
+        params.src = srcTex.get();
+        params.firstFace = firstFace;
+        params.numFaces = numFaces;
+
+        auto readback = dx->ReadbackTexture(params);
+
+        if (!readback) {
+            LOGE << "ReadbackTexture failed";
+            return false;
+        }
+
+        auto& subresources = readback->subresources;
+
+        // every subresource goes to a different part of the image
+        ParallelFor(Globals::Instance().threadPool_.get(), static_cast<uint32_t>(subresources.size()), 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i) {
+                auto& sub = subresources[i];
+
+                UpdateSubImage(sub.face - firstFace, sub.mip, sub.data, sub.rowPitch);
+            }
+        });
+
+        return true;
     }
 } // namespace ninniku
\ No newline at end of file
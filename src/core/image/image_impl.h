@@ -50,6 +50,10 @@ namespace ninniku
         virtual const std::vector<SubresourceParam> GetInitializationData() const = 0;
         virtual uint32_t GetWidth() const = 0;
         virtual bool LoadInternal(const std::string_view& path) = 0;
+
+        // copies every mip of faces [firstFace, firstFace + numFaces) through UpdateSubImage, in parallel
+        bool ReadbackTextureObject(RenderDeviceHandle& dx, const TextureHandle& srcTex, const uint32_t firstFace, const uint32_t numFaces);
+
         virtual void UpdateSubImage(const uint32_t dstFace, const uint32_t dstMip, const uint8_t* newData, const uint32_t newRowPitch) = 0;
         virtual bool ValidateExtension(const std::string_view& ext) const = 0;
     };
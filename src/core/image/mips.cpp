@@ -0,0 +1,382 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "ninniku/core/image/mips.h"
+
+#include "../../globals.h"
+#include "../../utils/log.h"
+#include "../../utils/trace.h"
+
+#include <DirectXPackedVector.h>
+#include <emmintrin.h>
+
+namespace ninniku
+{
+    // bytes of mip 0 processed at once per slice, the levels built from it then stay in L2
+    static constexpr uint32_t GENERATEMIPS_BAND_SIZE = 256 * 1024;
+
+    // src0 and src1 are the 2 source rows, each must hold at least dstWidth * 2 pixels
+    using DownsampleRowFn = void(*)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth);
+
+    struct MipLevel
+    {
+        uint8_t* data;
+        uint32_t rowPitch;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // Row filters
+    //////////////////////////////////////////////////////////////////////////
+    template<typename T, uint32_t NumChannels>
+    void DownsampleRowScalar(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t begin, uint32_t end)
+    {
+        auto s0 = reinterpret_cast<const T*>(src0);
+        auto s1 = reinterpret_cast<const T*>(src1);
+        auto d = reinterpret_cast<T*>(dst);
+
+        for (auto x = begin; x < end; ++x) {
+            for (uint32_t c = 0; c < NumChannels; ++c) {
+                auto i = x * 2 * NumChannels + c;
+
+                if constexpr (std::is_floating_point_v<T>)
+                    d[x * NumChannels + c] = (s0[i] + s0[i + NumChannels] + s1[i] + s1[i + NumChannels]) * 0.25f;
+                else
+                    d[x * NumChannels + c] = static_cast<T>((s0[i] + s0[i + NumChannels] + s1[i] + s1[i + NumChannels] + 2) >> 2);
+            }
+        }
+    }
+
+    // v holds 8 16 bits channels, the sums of horizontal pixel pairs are returned in the low 4 lanes
+    template<uint32_t NumChannels>
+    __m128i SumPixelPairs16(__m128i v)
+    {
+        if constexpr (NumChannels == 1) {
+            return _mm_packs_epi32(_mm_madd_epi16(v, _mm_set1_epi16(1)), _mm_setzero_si128());
+        } else if constexpr (NumChannels == 2) {
+            return _mm_add_epi16(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 0, 3, 1)));
+        } else {
+            return _mm_add_epi16(v, _mm_srli_si128(v, 8));
+        }
+    }
+
+    // lo and hi hold 4 32 bits channels each, returns the 4 sums of horizontal pixel pairs
+    template<uint32_t NumChannels>
+    __m128i SumPixelPairs32(__m128i lo, __m128i hi)
+    {
+        auto fLo = _mm_castsi128_ps(lo);
+        auto fHi = _mm_castsi128_ps(hi);
+
+        if constexpr (NumChannels == 1) {
+            return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fLo, fHi, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(fLo, fHi, _MM_SHUFFLE(3, 1, 3, 1))));
+        } else if constexpr (NumChannels == 2) {
+            return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fLo, fHi, _MM_SHUFFLE(1, 0, 1, 0))), _mm_castps_si128(_mm_shuffle_ps(fLo, fHi, _MM_SHUFFLE(3, 2, 3, 2))));
+        } else {
+            return _mm_add_epi32(lo, hi);
+        }
+    }
+
+    template<uint32_t NumChannels>
+    void DownsampleRowUNorm8(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth)
+    {
+        // 16 bytes are read from each row and 8 bytes are written per iteration
+        constexpr uint32_t step = 8 / NumChannels;
+
+        auto zero = _mm_setzero_si128();
+        auto round = _mm_set1_epi16(2);
+        uint32_t x = 0;
+
+        for (; x + step <= dstWidth; x += step) {
+            auto offset = x * NumChannels * 2;
+            auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + offset));
+            auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + offset));
+
+            auto lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero));
+            auto hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+            auto sum = _mm_unpacklo_epi64(SumPixelPairs16<NumChannels>(lo), SumPixelPairs16<NumChannels>(hi));
+            auto avg = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * NumChannels), _mm_packus_epi16(avg, avg));
+        }
+
+        DownsampleRowScalar<uint8_t, NumChannels>(src0, src1, dst, x, dstWidth);
+    }
+
+    template<uint32_t NumChannels>
+    void DownsampleRowUNorm16(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth)
+    {
+        // 16 bytes are read from each row and 8 bytes are written per iteration
+        constexpr uint32_t step = 4 / NumChannels;
+
+        auto zero = _mm_setzero_si128();
+        auto round = _mm_set1_epi32(2);
+        auto bias32 = _mm_set1_epi32(0x8000);
+        auto bias16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+        uint32_t x = 0;
+
+        for (; x + step <= dstWidth; x += step) {
+            auto offset = x * NumChannels * 4;
+            auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + offset));
+            auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + offset));
+
+            auto lo = _mm_add_epi32(_mm_unpacklo_epi16(r0, zero), _mm_unpacklo_epi16(r1, zero));
+            auto hi = _mm_add_epi32(_mm_unpackhi_epi16(r0, zero), _mm_unpackhi_epi16(r1, zero));
+            auto avg = _mm_srli_epi32(_mm_add_epi32(SumPixelPairs32<NumChannels>(lo, hi), round), 2);
+
+            // SSE2 has no unsigned 32 to 16 bits pack so go through the signed range and back
+            auto biased = _mm_sub_epi32(avg, bias32);
+            auto packed = _mm_xor_si128(_mm_packs_epi32(biased, biased), bias16);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * NumChannels * 2), packed);
+        }
+
+        DownsampleRowScalar<uint16_t, NumChannels>(src0, src1, dst, x, dstWidth);
+    }
+
+    template<uint32_t NumChannels>
+    void DownsampleRowFloat(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth)
+    {
+        static_assert((NumChannels == 1) || (NumChannels == 4));
+
+        auto s0 = reinterpret_cast<const float*>(src0);
+        auto s1 = reinterpret_cast<const float*>(src1);
+        auto d = reinterpret_cast<float*>(dst);
+        auto quarter = _mm_set1_ps(0.25f);
+
+        if constexpr (NumChannels == 1) {
+            // 32 bytes are read from each row and 16 bytes are written per iteration
+            uint32_t x = 0;
+
+            for (; x + 4 <= dstWidth; x += 4) {
+                auto v0 = _mm_add_ps(_mm_loadu_ps(s0 + x * 2), _mm_loadu_ps(s1 + x * 2));
+                auto v1 = _mm_add_ps(_mm_loadu_ps(s0 + x * 2 + 4), _mm_loadu_ps(s1 + x * 2 + 4));
+                auto sum = _mm_add_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+                _mm_storeu_ps(d + x, _mm_mul_ps(sum, quarter));
+            }
+
+            DownsampleRowScalar<float, 1>(src0, src1, dst, x, dstWidth);
+        } else {
+            for (uint32_t x = 0; x < dstWidth; ++x) {
+                auto offset = x * 8;
+                auto sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(s0 + offset), _mm_loadu_ps(s0 + offset + 4)), _mm_add_ps(_mm_loadu_ps(s1 + offset), _mm_loadu_ps(s1 + offset + 4)));
+
+                _mm_storeu_ps(d + x * 4, _mm_mul_ps(sum, quarter));
+            }
+        }
+    }
+
+    void DownsampleRowHalf4(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth)
+    {
+        using namespace DirectX::PackedVector;
+
+        // widen both rows, filter them as RGBA32F and narrow the result back
+        thread_local std::vector<float> scratch;
+
+        auto srcCount = dstWidth * 2 * 4;
+        auto dstCount = dstWidth * 4;
+
+        scratch.resize(srcCount * 2 + dstCount);
+
+        auto f0 = scratch.data();
+        auto f1 = f0 + srcCount;
+        auto fDst = f1 + srcCount;
+
+        XMConvertHalfToFloatStream(f0, sizeof(float), reinterpret_cast<const HALF*>(src0), sizeof(HALF), srcCount);
+        XMConvertHalfToFloatStream(f1, sizeof(float), reinterpret_cast<const HALF*>(src1), sizeof(HALF), srcCount);
+
+        DownsampleRowFloat<4>(reinterpret_cast<const uint8_t*>(f0), reinterpret_cast<const uint8_t*>(f1), reinterpret_cast<uint8_t*>(fDst), dstWidth);
+
+        XMConvertFloatToHalfStream(reinterpret_cast<HALF*>(dst), sizeof(HALF), fDst, sizeof(float), dstCount);
+    }
+
+    void DownsampleRowR11G11B10(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, uint32_t dstWidth)
+    {
+        using namespace DirectX;
+        using namespace DirectX::PackedVector;
+
+        auto s0 = reinterpret_cast<const XMFLOAT3PK*>(src0);
+        auto s1 = reinterpret_cast<const XMFLOAT3PK*>(src1);
+        auto d = reinterpret_cast<XMFLOAT3PK*>(dst);
+
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            auto top = XMVectorAdd(XMLoadFloat3PK(&s0[x * 2]), XMLoadFloat3PK(&s0[x * 2 + 1]));
+            auto bottom = XMVectorAdd(XMLoadFloat3PK(&s1[x * 2]), XMLoadFloat3PK(&s1[x * 2 + 1]));
+
+            XMStoreFloat3PK(&d[x], XMVectorScale(XMVectorAdd(top, bottom), 0.25f));
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // GenerateMips
+    //////////////////////////////////////////////////////////////////////////
+    std::tuple<uint32_t, DownsampleRowFn> GetDownsampleRowFn(const uint32_t format)
+    {
+        switch (format) {
+            case TF_R8_UNORM:
+                return { 1, &DownsampleRowUNorm8<1> };
+            case TF_R8G8_UNORM:
+                return { 2, &DownsampleRowUNorm8<2> };
+            case TF_R8G8B8A8_UNORM:
+                return { 4, &DownsampleRowUNorm8<4> };
+            case TF_R11G11B10_FLOAT:
+                return { 4, &DownsampleRowR11G11B10 };
+            case TF_R16_UNORM:
+                return { 2, &DownsampleRowUNorm16<1> };
+            case TF_R16G16_UNORM:
+                return { 4, &DownsampleRowUNorm16<2> };
+            case TF_R16G16B16A16_FLOAT:
+                return { 8, &DownsampleRowHalf4 };
+            case TF_R16G16B16A16_UNORM:
+                return { 8, &DownsampleRowUNorm16<4> };
+            case TF_R32_FLOAT:
+                return { 4, &DownsampleRowFloat<1> };
+            case TF_R32G32B32A32_FLOAT:
+                return { 16, &DownsampleRowFloat<4> };
+        }
+
+        return { 0, nullptr };
+    }
+
+    void DownsampleRows(const MipLevel& src, const MipLevel& dst, uint32_t begin, uint32_t end, uint32_t bpp, DownsampleRowFn fn)
+    {
+        for (auto y = begin; y < end; ++y) {
+            auto src0 = src.data + 2 * y * src.rowPitch;
+            auto src1 = src.data + std::min(2 * y + 1, src.height - 1) * src.rowPitch;
+            auto dstRow = dst.data + y * dst.rowPitch;
+
+            if (src.width > 1) {
+                fn(src0, src1, dstRow, dst.width);
+            } else {
+                // single column, duplicate the pixel so the row filters always have a pair to read
+                std::array<uint8_t, 32> pair0;
+                std::array<uint8_t, 32> pair1;
+
+                memcpy(pair0.data(), src0, bpp);
+                memcpy(pair0.data() + bpp, src0, bpp);
+                memcpy(pair1.data(), src1, bpp);
+                memcpy(pair1.data() + bpp, src1, bpp);
+
+                fn(pair0.data(), pair1.data(), dstRow, 1);
+            }
+        }
+    }
+
+    bool GenerateMips(TextureParam& param)
+    {
+        TRACE_SCOPED_IMAGE;
+
+        if (param.depth > 1) {
+            LOGE << "GenerateMips: Texture3D are not supported";
+            return false;
+        }
+
+        if ((param.width == 0) || (param.height == 0) || (param.numMips == 0) || (param.arraySize == 0)) {
+            LOGE << "GenerateMips: invalid texture dimensions";
+            return false;
+        }
+
+        if ((param.numMips > 32) || ((std::max(param.width, param.height) >> (param.numMips - 1)) == 0)) {
+            LOGEF(boost::format("GenerateMips: %1% mips is too many for a %2%x%3% texture") % param.numMips % param.width % param.height);
+            return false;
+        }
+
+        if (param.imageDatas.size() != param.arraySize * param.numMips) {
+            LOGEF(boost::format("GenerateMips: expected %1% subresources but got %2%") % (param.arraySize * param.numMips) % param.imageDatas.size());
+            return false;
+        }
+
+        auto [bpp, fn] = GetDownsampleRowFn(param.format);
+
+        if (fn == nullptr) {
+            LOGEF(boost::format("GenerateMips: unsupported format %1%") % param.format);
+            return false;
+        }
+
+        auto getLevel = [&](uint32_t slice, uint32_t mip)
+        {
+            auto& sub = param.imageDatas[mip + slice * param.numMips];
+
+            return MipLevel{ static_cast<uint8_t*>(sub.data), sub.rowPitch, std::max(1u, param.width >> mip), std::max(1u, param.height >> mip) };
+        };
+
+        for (uint32_t slice = 0; slice < param.arraySize; ++slice) {
+            for (uint32_t mip = 0; mip < param.numMips; ++mip) {
+                auto level = getLevel(slice, mip);
+
+                if ((level.data == nullptr) || (level.rowPitch < level.width * bpp)) {
+                    LOGEF(boost::format("GenerateMips: invalid subresource for slice %1% mip %2%") % slice % mip);
+                    return false;
+                }
+            }
+        }
+
+        if (param.numMips == 1)
+            return true;
+
+        auto pool = Globals::Instance().threadPool_.get();
+
+        // mip 0 is cut in bands of 2^bandLevels rows, the first bandLevels levels of a band only depend
+        // on its own rows so they are built right away while the source is still in cache
+        auto bandRows = std::max(2u, GENERATEMIPS_BAND_SIZE / (param.width * bpp));
+        uint32_t bandLevels = 0;
+
+        while ((bandLevels + 1 < param.numMips) && ((2u << bandLevels) <= std::min(bandRows, param.height)))
+            ++bandLevels;
+
+        if (bandLevels > 0) {
+            auto numBands = (param.height + (1u << bandLevels) - 1) >> bandLevels;
+
+            ParallelFor(pool, param.arraySize * numBands, 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto i = begin; i < end; ++i) {
+                    auto slice = i / numBands;
+                    auto band = i % numBands;
+
+                    for (uint32_t mip = 1; mip <= bandLevels; ++mip) {
+                        auto dst = getLevel(slice, mip);
+                        auto rows = 1u << (bandLevels - mip);
+                        auto first = std::min(band * rows, dst.height);
+
+                        DownsampleRows(getLevel(slice, mip - 1), dst, first, std::min(first + rows, dst.height), bpp, fn);
+                    }
+                }
+            });
+        }
+
+        // remaining levels are small, one task per slice
+        if (bandLevels + 1 < param.numMips) {
+            ParallelFor(pool, param.arraySize, 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto slice = begin; slice < end; ++slice) {
+                    for (auto mip = bandLevels + 1; mip < param.numMips; ++mip) {
+                        auto dst = getLevel(slice, mip);
+
+                        DownsampleRows(getLevel(slice, mip - 1), dst, 0, dst.height, bpp, fn);
+                    }
+                }
+            });
+        }
+
+        return true;
+    }
+} // namespace ninniku
@@ -0,0 +1,402 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "ninniku/core/renderer/command_graph.h"
+
+#include "../../utils/log.h"
+#include "../../utils/trace.h"
+
+namespace ninniku
+{
+    static constexpr uint32_t QUEUE_COUNT = static_cast<std::underlying_type<EGraphQueue>::type>(EGraphQueue::GQ_Count);
+
+    // state of a resource as the passes are walked in order
+    struct GraphResource
+    {
+        const void* resource;
+        std::vector<EResourceState> states;
+
+        // batches that accessed the resource since it was last written or transitioned
+        uint32_t lastWrite;
+        std::array<uint32_t, QUEUE_COUNT> lastReads;
+
+        // last pass accessing it as a UAV without a transition since
+        uint32_t lastUAVPass;
+    };
+
+    // what a single pass needs from a resource, one state per subresource
+    struct GraphRequirement
+    {
+        uint32_t tracked;
+        std::vector<EResourceState> states;
+        std::vector<uint8_t> accessed;
+    };
+
+    static constexpr uint8_t ACCESS_NONE = 0;
+    static constexpr uint8_t ACCESS_ALL = 1;
+    static constexpr uint8_t ACCESS_SUBRESOURCE = 2;
+
+    static uint32_t QueueIndex(EGraphQueue queue)
+    {
+        return static_cast<std::underlying_type<EGraphQueue>::type>(queue);
+    }
+
+    static bool IsCopyState(EResourceState state)
+    {
+        return (state == EResourceState::RS_CopySource) || (state == EResourceState::RS_CopyDest);
+    }
+
+    static bool IsWriteState(EResourceState state)
+    {
+        return (state == EResourceState::RS_UnorderedAccess) || (state == EResourceState::RS_CopyDest);
+    }
+
+    static GraphStep& BarrierStep(GraphBatch& batch)
+    {
+        // merge with the previous barriers if no pass was recorded since
+        if (batch.steps.empty() || (batch.steps.back().pass != GraphStep::NO_PASS))
+            batch.steps.push_back(GraphStep{ {}, GraphStep::NO_PASS });
+
+        return batch.steps.back();
+    }
+
+    static uint32_t OpenBatch(CompiledGraph& compiled, EGraphQueue queue)
+    {
+        // consecutive work on the same queue goes in the same command list
+        if (!compiled.batches.empty() && (compiled.batches.back().queue == queue))
+            return static_cast<uint32_t>(compiled.batches.size() - 1);
+
+        GraphBatch batch;
+
+        batch.queue = queue;
+        batch.waits.fill(GraphBatch::NO_WAIT);
+
+        compiled.batches.emplace_back(std::move(batch));
+
+        return static_cast<uint32_t>(compiled.batches.size() - 1);
+    }
+
+    static void AddWait(CompiledGraph& compiled, uint32_t batchIndex, uint32_t dependency)
+    {
+        if (dependency == GraphBatch::NO_WAIT)
+            return;
+
+        auto& batch = compiled.batches[batchIndex];
+        auto queue = QueueIndex(compiled.batches[dependency].queue);
+
+        // a queue executes in order so the same queue or an earlier batch already waited on is free
+        if ((queue == QueueIndex(batch.queue)) || ((batch.waits[queue] != GraphBatch::NO_WAIT) && (batch.waits[queue] >= dependency)))
+            return;
+
+        if (batch.waits[queue] == GraphBatch::NO_WAIT)
+            ++compiled.numWaits;
+
+        batch.waits[queue] = dependency;
+    }
+
+    static void AddTransitions(CompiledGraph& compiled, std::vector<GraphBarrier>& barriers, GraphResource& tracked, const std::vector<EResourceState>& states, const std::vector<uint8_t>& accessed)
+    {
+        auto numSubresources = static_cast<uint32_t>(tracked.states.size());
+        auto whole = true;
+
+        for (uint32_t i = 0; i < numSubresources; ++i) {
+            if ((accessed[i] == ACCESS_NONE) || (tracked.states[i] != tracked.states[0]) || (states[i] != states[0])) {
+                whole = false;
+                break;
+            }
+        }
+
+        // a single barrier when every subresource goes from and to the same state
+        if (whole) {
+            if (tracked.states[0] != states[0]) {
+                barriers.push_back(GraphBarrier{ tracked.resource, GraphAccess::ALL_SUBRESOURCES, tracked.states[0], states[0] });
+                ++compiled.numBarriers;
+            }
+
+            return;
+        }
+
+        for (uint32_t i = 0; i < numSubresources; ++i) {
+            if ((accessed[i] != ACCESS_NONE) && (tracked.states[i] != states[i])) {
+                barriers.push_back(GraphBarrier{ tracked.resource, i, tracked.states[i], states[i] });
+                ++compiled.numBarriers;
+            }
+        }
+    }
+
+    static bool GatherRequirements(const GraphPass& pass, uint32_t passIndex, std::vector<GraphResource>& resources, std::vector<GraphRequirement>& requirements)
+    {
+        requirements.clear();
+
+        // whole resource accesses first so the ones to single subresources can override them
+        for (auto individual : { false, true }) {
+            for (auto& access : pass.accesses) {
+                if ((access.subresource != GraphAccess::ALL_SUBRESOURCES) != individual)
+                    continue;
+
+                if ((access.numSubresources == 0) || (individual && (access.subresource >= access.numSubresources))) {
+                    LOGEF(boost::format("CompileGraph error: pass %1% accesses subresource %2% out of %3%") % passIndex % access.subresource % access.numSubresources);
+                    return false;
+                }
+
+                auto found = std::find_if(resources.begin(), resources.end(), [&access](const GraphResource& r) { return r.resource == access.resource; });
+
+                if (found == resources.end()) {
+                    GraphResource tracked;
+
+                    tracked.resource = access.resource;
+                    tracked.states.resize(access.numSubresources, EResourceState::RS_ShaderResource);
+                    tracked.lastWrite = GraphBatch::NO_WAIT;
+                    tracked.lastReads.fill(GraphBatch::NO_WAIT);
+                    tracked.lastUAVPass = GraphStep::NO_PASS;
+
+                    resources.emplace_back(std::move(tracked));
+                    found = resources.end() - 1;
+                } else if (found->states.size() != access.numSubresources) {
+                    LOGEF(boost::format("CompileGraph error: pass %1% gives a different number of subresources for the same resource") % passIndex);
+                    return false;
+                }
+
+                auto trackedIndex = static_cast<uint32_t>(found - resources.begin());
+                auto req = std::find_if(requirements.begin(), requirements.end(), [trackedIndex](const GraphRequirement& r) { return r.tracked == trackedIndex; });
+
+                if (req == requirements.end()) {
+                    requirements.push_back(GraphRequirement{ trackedIndex, std::vector<EResourceState>(access.numSubresources), std::vector<uint8_t>(access.numSubresources, ACCESS_NONE) });
+                    req = requirements.end() - 1;
+                }
+
+                auto first = individual ? access.subresource : 0;
+                auto last = individual ? access.subresource + 1 : access.numSubresources;
+                auto kind = individual ? ACCESS_SUBRESOURCE : ACCESS_ALL;
+
+                for (auto i = first; i < last; ++i) {
+                    // a subresource can be read several times but only one way
+                    if ((req->accessed[i] == kind) && (req->states[i] != access.state)) {
+                        LOGEF(boost::format("CompileGraph error: pass %1% accesses subresource %2% in different states") % passIndex % i);
+                        return false;
+                    }
+
+                    req->states[i] = access.state;
+                    req->accessed[i] = kind;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool CompileGraph(const std::vector<GraphPass>& passes, CompiledGraph& compiled)
+    {
+        TRACE_SCOPED_UTILS;
+
+        compiled.batches.clear();
+        compiled.numBarriers = 0;
+        compiled.numWaits = 0;
+
+        auto lastCompute = GraphBatch::NO_WAIT;
+
+        std::vector<GraphResource> resources;
+        std::vector<GraphRequirement> requirements;
+        std::vector<GraphBarrier> barriers;
+        std::vector<GraphBarrier> computeBarriers;
+        std::vector<uint32_t> dependencies;
+
+        for (uint32_t passIndex = 0; passIndex < static_cast<uint32_t>(passes.size()); ++passIndex) {
+            auto& pass = passes[passIndex];
+
+            if (!GatherRequirements(pass, passIndex, resources, requirements))
+                return false;
+
+            auto onCopy = (pass.queue == EGraphQueue::GQ_Copy);
+
+            barriers.clear();
+            computeBarriers.clear();
+            dependencies.clear();
+
+            // transitions the copy queue cannot do go at the end of the last compute batch, which exists before the pass batch
+            for (auto& req : requirements) {
+                auto& tracked = resources[req.tracked];
+                auto numSubresources = static_cast<uint32_t>(tracked.states.size());
+                auto needsCompute = false;
+
+                for (uint32_t i = 0; i < numSubresources; ++i) {
+                    if ((req.accessed[i] != ACCESS_NONE) && (tracked.states[i] != req.states[i]) && onCopy && !(IsCopyState(tracked.states[i]) && IsCopyState(req.states[i])))
+                        needsCompute = true;
+                }
+
+                if (needsCompute) {
+                    if (lastCompute == GraphBatch::NO_WAIT)
+                        lastCompute = OpenBatch(compiled, EGraphQueue::GQ_Compute);
+
+                    // only the subresources a copy queue cannot transition
+                    std::vector<uint8_t> accessed = req.accessed;
+
+                    for (uint32_t i = 0; i < numSubresources; ++i) {
+                        if (IsCopyState(tracked.states[i]) && IsCopyState(req.states[i]))
+                            accessed[i] = ACCESS_NONE;
+                    }
+
+                    AddTransitions(compiled, computeBarriers, tracked, req.states, accessed);
+
+                    for (uint32_t i = 0; i < numSubresources; ++i) {
+                        if (accessed[i] != ACCESS_NONE)
+                            tracked.states[i] = req.states[i];
+                    }
+
+                    // the pass now depends on the transition
+                    tracked.lastWrite = lastCompute;
+                    tracked.lastReads.fill(GraphBatch::NO_WAIT);
+                    tracked.lastUAVPass = GraphStep::NO_PASS;
+                }
+            }
+
+            if (!computeBarriers.empty()) {
+                auto& step = BarrierStep(compiled.batches[lastCompute]);
+
+                step.barriers.insert(step.barriers.end(), computeBarriers.begin(), computeBarriers.end());
+            }
+
+            auto batchIndex = OpenBatch(compiled, pass.queue);
+
+            if (pass.queue == EGraphQueue::GQ_Compute)
+                lastCompute = batchIndex;
+
+            for (auto& req : requirements) {
+                auto& tracked = resources[req.tracked];
+                auto numSubresources = static_cast<uint32_t>(tracked.states.size());
+                auto changes = false;
+                auto uavBarrier = false;
+
+                for (uint32_t i = 0; i < numSubresources; ++i) {
+                    if (req.accessed[i] == ACCESS_NONE)
+                        continue;
+
+                    if ((tracked.states[i] != req.states[i]) || IsWriteState(req.states[i]))
+                        changes = true;
+
+                    // UAV accesses from different passes without a transition in between
+                    if ((tracked.states[i] == EResourceState::RS_UnorderedAccess) && (req.states[i] == EResourceState::RS_UnorderedAccess) && (tracked.lastUAVPass != GraphStep::NO_PASS))
+                        uavBarrier = true;
+                }
+
+                // read after write, and write after read when the resource changes
+                dependencies.push_back(tracked.lastWrite);
+
+                if (changes) {
+                    dependencies.insert(dependencies.end(), tracked.lastReads.begin(), tracked.lastReads.end());
+                }
+
+                auto numBarriers = barriers.size();
+
+                AddTransitions(compiled, barriers, tracked, req.states, req.accessed);
+
+                if (uavBarrier) {
+                    barriers.push_back(GraphBarrier{ tracked.resource, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_UnorderedAccess, EResourceState::RS_UnorderedAccess });
+                    ++compiled.numBarriers;
+                }
+
+                auto usesUAV = false;
+
+                for (uint32_t i = 0; i < numSubresources; ++i) {
+                    if (req.accessed[i] == ACCESS_NONE)
+                        continue;
+
+                    tracked.states[i] = req.states[i];
+
+                    if (req.states[i] == EResourceState::RS_UnorderedAccess)
+                        usesUAV = true;
+                }
+
+                if (changes) {
+                    tracked.lastWrite = batchIndex;
+                    tracked.lastReads.fill(GraphBatch::NO_WAIT);
+                } else {
+                    tracked.lastReads[QueueIndex(pass.queue)] = batchIndex;
+                }
+
+                if (usesUAV) {
+                    tracked.lastUAVPass = passIndex;
+                } else if (barriers.size() != numBarriers) {
+                    tracked.lastUAVPass = GraphStep::NO_PASS;
+                }
+            }
+
+            for (auto dependency : dependencies) {
+                AddWait(compiled, batchIndex, dependency);
+            }
+
+            compiled.batches[batchIndex].steps.push_back(GraphStep{ std::move(barriers), passIndex });
+            barriers = std::vector<GraphBarrier>{};
+        }
+
+        // back to the resting state, only the compute queue can do it
+        std::vector<uint8_t> accessed;
+        std::vector<EResourceState> resting;
+
+        barriers.clear();
+        dependencies.clear();
+
+        for (auto& tracked : resources) {
+            accessed.assign(tracked.states.size(), ACCESS_ALL);
+            resting.assign(tracked.states.size(), EResourceState::RS_ShaderResource);
+
+            auto numBarriers = barriers.size();
+
+            AddTransitions(compiled, barriers, tracked, resting, accessed);
+
+            if (barriers.size() != numBarriers) {
+                dependencies.push_back(tracked.lastWrite);
+                dependencies.insert(dependencies.end(), tracked.lastReads.begin(), tracked.lastReads.end());
+            }
+        }
+
+        if (!barriers.empty()) {
+            auto batchIndex = OpenBatch(compiled, EGraphQueue::GQ_Compute);
+            auto& step = BarrierStep(compiled.batches[batchIndex]);
+
+            step.barriers.insert(step.barriers.end(), barriers.begin(), barriers.end());
+
+            for (auto dependency : dependencies) {
+                AddWait(compiled, batchIndex, dependency);
+            }
+        }
+
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CommandGraph
+    //////////////////////////////////////////////////////////////////////////
+    void CommandGraph::AddDispatch(CommandHandle&& cmd)
+    {
+        nodes_.push_back(Node{ std::move(cmd), nullptr, nullptr });
+    }
+
+    void CommandGraph::AddCopy(const CopyBufferSubresourceParam& params)
+    {
+        nodes_.push_back(Node{ CommandHandle(), params.src, params.dst });
+    }
+
+    void CommandGraph::Clear()
+    {
+        nodes_.clear();
+    }
+} // namespace ninniku
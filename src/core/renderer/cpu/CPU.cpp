@@ -0,0 +1,771 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "CPU.h"
+
+#include "../../../globals.h"
+#include "../../../utils/log.h"
+#include "../../../utils/misc.h"
+#include "../../../utils/stats.h"
+
+namespace ninniku
+{
+    bool CPU::CheckFeatureSupport(uint32_t features)
+    {
+        // kernels are plain C++ so there are no shader model features
+        if ((features & EDeviceFeature::DF_SM6_WAVE_INTRINSICS) != 0) {
+            LOGW << "DF_SM6_WAVE_INTRINSICS is not supported by RENDERER_CPU";
+            return false;
+        }
+
+        return true;
+    }
+
+    // runs on the calling thread for Dispatch and on the queue for DispatchAsync
+    static void ExecuteDispatch(const CPUDispatch& dispatch)
+    {
+        auto& groups = dispatch.groups;
+        auto numGroups = groups[0] * groups[1] * groups[2];
+
+        ParallelFor(Globals::Instance().threadPool_.get(), numGroups, 1, [&](uint32_t begin, uint32_t end)
+        {
+            KernelContext ctx = {};
+
+            ctx.numThreads = dispatch.numThreads;
+            ctx.cbuffer = dispatch.cbuffer.empty() ? nullptr : dispatch.cbuffer.data();
+            ctx.srvs = dispatch.srvs.data();
+            ctx.uavs = dispatch.uavs.data();
+            ctx.samplers = dispatch.samplers.data();
+
+            for (auto i = begin; i < end; ++i) {
+                ctx.groupID[0] = i % groups[0];
+                ctx.groupID[1] = (i / groups[0]) % groups[1];
+                ctx.groupID[2] = i / (groups[0] * groups[1]);
+
+                dispatch.function(ctx);
+            }
+        });
+    }
+
+    bool CPU::CopyBufferResource(const CopyBufferSubresourceParam& params)
+    {
+        TRACE_SCOPED_CPU;
+
+        std::shared_ptr<CPUBufferInternal> srcInternal;
+        std::shared_ptr<CPUBufferInternal> dstInternal;
+
+        if (!ResolveBufferCopy(params, srcInternal, dstInternal))
+            return false;
+
+        AddStat(SC_Copies);
+
+        queue_.WaitIdle();
+
+        std::copy(srcInternal->data_.begin(), srcInternal->data_.end(), dstInternal->data_.begin());
+
+        return true;
+    }
+
+    FenceHandle CPU::CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_CPU;
+
+        std::shared_ptr<CPUBufferInternal> srcInternal;
+        std::shared_ptr<CPUBufferInternal> dstInternal;
+
+        if (!ResolveBufferCopy(params, srcInternal, dstInternal))
+            return FenceHandle();
+
+        AddStat(SC_Copies);
+
+        return queue_.Submit([srcInternal, dstInternal, waitFor]()
+        {
+            if (waitFor && !waitFor->Wait())
+                return false;
+
+            std::copy(srcInternal->data_.begin(), srcInternal->data_.end(), dstInternal->data_.begin());
+
+            return true;
+        });
+    }
+
+    std::tuple<uint32_t, uint32_t> CPU::CopyTextureSubresource(const CopyTextureSubresourceParam& params)
+    {
+        TRACE_SCOPED_CPU;
+
+        queue_.WaitIdle();
+
+        auto srcImpl = static_cast<const CPUTextureImpl*>(params.src);
+
+        if (CheckWeakExpired(srcImpl->impl_))
+            return std::tuple<uint32_t, uint32_t>();
+
+        auto srcInternal = srcImpl->impl_.lock();
+
+        auto dstImpl = static_cast<const CPUTextureImpl*>(params.dst);
+
+        if (CheckWeakExpired(dstImpl->impl_))
+            return std::tuple<uint32_t, uint32_t>();
+
+        auto dstInternal = dstImpl->impl_.lock();
+
+        auto isValid = [](const CPUTextureInternal& texture, uint32_t mip, uint32_t face, const std::string_view& name)
+        {
+            if ((mip < texture.desc_->numMips) && (face < texture.desc_->arraySize))
+                return true;
+
+            LOGEF(boost::format("CopyTextureSubresource invalid %1% mip %2% face %3%, texture has %4% mips and %5% slices") % name % mip % face % texture.desc_->numMips % texture.desc_->arraySize);
+            return false;
+        };
+
+        if (!isValid(*srcInternal, params.srcMip, params.srcFace, "source") || !isValid(*dstInternal, params.dstMip, params.dstFace, "destination"))
+            return std::tuple<uint32_t, uint32_t>();
+
+        auto srcSub = srcInternal->GetSubresourceIndex(params.srcMip, params.srcFace);
+        auto dstSub = dstInternal->GetSubresourceIndex(params.dstMip, params.dstFace);
+        auto& srcLayout = srcInternal->subresources_[srcSub];
+        auto& dstLayout = dstInternal->subresources_[dstSub];
+
+        if ((srcInternal->bpp_ != dstInternal->bpp_) || (srcLayout.width != dstLayout.width) || (srcLayout.height != dstLayout.height) || (srcLayout.depth != dstLayout.depth)) {
+            LOGEF(boost::format("CopyTextureSubresource mismatch between source subresource %1% and destination subresource %2%") % srcSub % dstSub);
+            return std::tuple<uint32_t, uint32_t>();
+        }
+
+        // both sides are tightly packed so the whole subresource can be copied at once
+        memcpy(dstInternal->GetSubresourceData(dstSub), srcInternal->GetSubresourceData(srcSub), static_cast<size_t>(srcLayout.depthPitch) * srcLayout.depth);
+
+        AddStat(SC_Copies);
+
+        return { srcSub, dstSub };
+    }
+
+    BufferHandle CPU::CreateBuffer(const BufferParamHandle& params)
+    {
+        TRACE_SCOPED_NAMED_CPU("ninniku::CPU::CreateBuffer (BufferParamHandle)");
+
+        LOGDF(boost::format("Creating Buffer: ElementSize=%1%, NumElements=%2%") % params->elementSize % params->numElements);
+
+        // we need to pad to 4 bytes because Buffer data is an array of uint32_t
+        if (params->elementSize % 4 != 0) {
+            LOGE << "ElementSize must be a multiple of 4";
+            return BufferHandle();
+        }
+
+        auto impl = std::make_shared<CPUBufferInternal>();
+
+        impl->desc_ = params;
+        impl->data_.resize(params->numElements * (params->elementSize / 4));
+
+        if ((params->viewflags & EResourceViews::RV_SRV) != 0) {
+            auto srv = new CPUShaderResourceView();
+
+            srv->Initialize(impl);
+            impl->srv_.reset(srv);
+        }
+
+        if ((params->viewflags & EResourceViews::RV_UAV) != 0) {
+            auto uav = new CPUUnorderedAccessView();
+
+            uav->Initialize(impl);
+            impl->uav_.reset(uav);
+        }
+
+        auto res = std::make_unique<CPUBufferImpl>(impl);
+
+        res->tracked_ = tracker_.RegisterObject(impl, impl->data_.size() * sizeof(uint32_t));
+
+        return res;
+    }
+
+    BufferHandle CPU::CreateBuffer(const BufferHandle& src)
+    {
+        TRACE_SCOPED_NAMED_CPU("ninniku::CPU::CreateBuffer (BufferHandle)");
+
+        auto implSrc = static_cast<const CPUBufferImpl*>(src.get());
+
+        if (CheckWeakExpired(implSrc->impl_))
+            return BufferHandle();
+
+        auto internalSrc = implSrc->impl_.lock();
+
+        auto dst = CreateBuffer(internalSrc->desc_);
+
+        if (!dst)
+            return BufferHandle();
+
+        CopyBufferSubresourceParam copyParams = {};
+
+        copyParams.src = src.get();
+        copyParams.dst = dst.get();
+
+        if (!CopyBufferResource(copyParams))
+            return BufferHandle();
+
+        return dst;
+    }
+
+    TextureHandle CPU::CreateTexture(const TextureParamHandle& params)
+    {
+        TRACE_SCOPED_CPU;
+
+        LOGDF(boost::format("Creating Texture: Size=%1%x%2%, Mips=%3%") % params->width % params->height % params->numMips);
+
+        auto impl = std::make_shared<CPUTextureInternal>();
+
+        impl->desc_ = params;
+        impl->bpp_ = DXGIFormatToNumBytes(NinnikuTFToDXGIFormat(params->format));
+
+        // compute the layout of every subresource in a single allocation
+        auto numSubresources = params->numMips * params->arraySize;
+        size_t size = 0;
+
+        impl->subresources_.resize(numSubresources);
+
+        for (uint32_t slice = 0; slice < params->arraySize; ++slice) {
+            for (uint32_t mip = 0; mip < params->numMips; ++mip) {
+                auto& sub = impl->subresources_[impl->GetSubresourceIndex(mip, slice)];
+
+                sub.offset = size;
+                sub.width = std::max(1u, params->width >> mip);
+                sub.height = std::max(1u, params->height >> mip);
+                sub.depth = std::max(1u, params->depth >> mip);
+                sub.rowPitch = sub.width * impl->bpp_;
+                sub.depthPitch = sub.rowPitch * sub.height;
+
+                size += static_cast<size_t>(sub.depthPitch) * sub.depth;
+            }
+        }
+
+        // zero initialized like a freshly created GPU resource
+        impl->data_.resize(size);
+
+        // initial data, source pitches can be larger than ours
+        auto numImageDatas = std::min(static_cast<uint32_t>(params->imageDatas.size()), numSubresources);
+        uint64_t uploaded = 0;
+
+        for (uint32_t i = 0; i < numImageDatas; ++i) {
+            auto& subParam = params->imageDatas[i];
+            auto& sub = impl->subresources_[i];
+
+            if (subParam.data == nullptr)
+                continue;
+
+            uploaded += static_cast<uint64_t>(sub.depthPitch) * sub.depth;
+
+            auto dst = impl->GetSubresourceData(i);
+            auto src = static_cast<const uint8_t*>(subParam.data);
+
+            for (uint32_t z = 0; z < sub.depth; ++z) {
+                auto srcSlice = src + static_cast<size_t>(z) * subParam.depthPitch;
+                auto dstSlice = dst + static_cast<size_t>(z) * sub.depthPitch;
+
+                if (subParam.rowPitch == sub.rowPitch) {
+                    memcpy(dstSlice, srcSlice, sub.depthPitch);
+                } else {
+                    for (uint32_t y = 0; y < sub.height; ++y) {
+                        memcpy(dstSlice + y * sub.rowPitch, srcSlice + y * subParam.rowPitch, sub.rowPitch);
+                    }
+                }
+            }
+        }
+
+        AddStat(SC_BytesUploaded, uploaded);
+
+        MakeTextureViews(impl);
+
+        auto res = std::make_unique<CPUTextureImpl>(impl);
+
+        res->tracked_ = tracker_.RegisterObject(impl, size);
+
+        return res;
+    }
+
+    bool CPU::Dispatch(const CommandHandle& cmd)
+    {
+        TRACE_SCOPED_CPU;
+
+        ScopedLatency latency{ SL_Dispatch };
+        CPUDispatch dispatch;
+
+        if (!PrepareDispatch(cmd, dispatch))
+            return false;
+
+        AddStat(SC_Dispatches);
+
+        queue_.WaitIdle();
+
+        ExecuteDispatch(dispatch);
+
+        return true;
+    }
+
+    FenceHandle CPU::DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_CPU;
+
+        CPUDispatch dispatch;
+
+        if (!PrepareDispatch(cmd, dispatch))
+            return FenceHandle();
+
+        AddStat(SC_Dispatches);
+
+        return queue_.Submit([dispatch = std::move(dispatch), waitFor]()
+        {
+            if (waitFor && !waitFor->Wait())
+                return false;
+
+            ExecuteDispatch(dispatch);
+
+            return true;
+        });
+    }
+
+    void CPU::Finalize()
+    {
+        TRACE_SCOPED_CPU;
+
+        queue_.WaitIdle();
+
+        tracker_.ReleaseObjects();
+    }
+
+    bool CPU::Initialize()
+    {
+        TRACE_SCOPED_CPU;
+
+        LOGDF(boost::format("Using RENDERER_CPU with %1% worker threads") % Globals::Instance().threadPool_->GetNumThreads());
+
+        auto sampler = new CPUSamplerState();
+
+        sampler->filter_ = ESamplerState::SS_Point;
+        samplers_[static_cast<std::underlying_type<ESamplerState>::type>(ESamplerState::SS_Point)].reset(sampler);
+
+        sampler = new CPUSamplerState();
+
+        sampler->filter_ = ESamplerState::SS_Linear;
+        samplers_[static_cast<std::underlying_type<ESamplerState>::type>(ESamplerState::SS_Linear)].reset(sampler);
+
+        return true;
+    }
+
+    bool CPU::LoadShader(const std::filesystem::path& path)
+    {
+        TRACE_SCOPED_NAMED_CPU("ninniku::CPU::LoadShader (path)");
+
+        ScopedLatency latency{ SL_ShaderLoad };
+
+        // nothing to load from a directory, kernels are registered natively
+        if (std::filesystem::is_directory(path))
+            return true;
+
+        auto name = path.stem().string();
+
+        if (kernels_.find(name) == kernels_.end()) {
+            LOGEF(boost::format("LoadShader error: no kernel was registered for \"%1%\"") % name);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CPU::LoadShader(const std::string_view& name, const void*, const uint32_t)
+    {
+        LOGEF(boost::format("Cannot load \"%1%\" from memory, RENDERER_CPU only runs registered kernels") % name);
+
+        return false;
+    }
+
+    void CPU::MakeTextureViews(const std::shared_ptr<CPUTextureInternal>& internal)
+    {
+        TRACE_SCOPED_CPU;
+
+        auto& params = internal->desc_;
+        auto is3d = params->depth > 1;
+        auto is2d = (!is3d) && (params->height > 1);
+        auto isCube = is2d && (params->arraySize == CUBEMAP_NUM_FACES);
+        auto isCubeArray = is2d && (params->arraySize > CUBEMAP_NUM_FACES) && ((params->arraySize % CUBEMAP_NUM_FACES) == 0);
+
+        auto makeSRV = [&](uint32_t firstMip, uint32_t numMips)
+        {
+            auto srv = new CPUShaderResourceView();
+
+            srv->Initialize(internal, firstMip, numMips);
+
+            return SRVHandle{ srv };
+        };
+
+        if ((params->viewflags & EResourceViews::RV_SRV) != 0) {
+            // same set of views as the other renderers
+            if (isCubeArray)
+                internal->srvCubeArray_ = makeSRV(0, params->numMips);
+
+            if (isCube) {
+                internal->srvCube_ = makeSRV(0, params->numMips);
+                internal->srvArrayWithMips_ = makeSRV(0, params->numMips);
+            }
+
+            if (isCube || (params->arraySize > 1)) {
+                internal->srvArray_.resize(params->numMips);
+
+                for (uint32_t i = 0; i < params->numMips; ++i) {
+                    internal->srvArray_[i] = makeSRV(i, 1);
+                }
+            } else {
+                internal->srvDefault_ = makeSRV(0, params->numMips);
+            }
+        }
+
+        if ((params->viewflags & EResourceViews::RV_UAV) != 0) {
+            internal->uav_.resize(params->numMips);
+
+            for (uint32_t i = 0; i < params->numMips; ++i) {
+                auto uav = new CPUUnorderedAccessView();
+
+                uav->Initialize(internal, i, 1);
+                internal->uav_[i].reset(uav);
+            }
+        }
+    }
+
+    MappedResourceHandle CPU::Map(const BufferHandle& bObj)
+    {
+        TRACE_SCOPED_NAMED_CPU("ninniku::CPU::Map (BufferHandle)");
+
+        ScopedLatency latency{ SL_Map };
+
+        queue_.WaitIdle();
+
+        auto impl = static_cast<const CPUBufferImpl*>(bObj.get());
+
+        if (CheckWeakExpired(impl->impl_))
+            return MappedResourceHandle();
+
+        auto internal = impl->impl_.lock();
+        auto size = static_cast<uint32_t>(internal->data_.size() * sizeof(uint32_t));
+
+        return std::make_unique<CPUMappedResource>(internal->data_.data(), size);
+    }
+
+    MappedResourceHandle CPU::Map(const TextureHandle& tObj, const uint32_t index)
+    {
+        TRACE_SCOPED_NAMED_CPU("ninniku::CPU::Map (TextureHandle, uint32_t)");
+
+        ScopedLatency latency{ SL_Map };
+
+        queue_.WaitIdle();
+
+        auto impl = static_cast<const CPUTextureImpl*>(tObj.get());
+
+        if (CheckWeakExpired(impl->impl_))
+            return MappedResourceHandle();
+
+        auto internal = impl->impl_.lock();
+
+        if (index >= internal->subresources_.size()) {
+            LOGEF(boost::format("Map error: invalid subresource index %1%") % index);
+            return MappedResourceHandle();
+        }
+
+        return std::make_unique<CPUMappedResource>(internal->GetSubresourceData(index), internal->subresources_[index].rowPitch);
+    }
+
+    bool CPU::PrepareDispatch(const CommandHandle& cmd, CPUDispatch& dispatch)
+    {
+        auto found = kernels_.find(cmd->shader);
+
+        if (found == kernels_.end()) {
+            LOGEF(boost::format("Dispatch error: could not find kernel \"%1%\"") % cmd->shader);
+            return false;
+        }
+
+        auto& kernel = found->second;
+
+        // resolve bindings to the slots declared by the kernel
+        auto& srvs = dispatch.srvs;
+        auto& uavs = dispatch.uavs;
+        auto& samplers = dispatch.samplers;
+
+        srvs.assign(kernel.desc_.srvNames.size(), nullptr);
+        uavs.assign(kernel.desc_.uavNames.size(), nullptr);
+        samplers.assign(kernel.desc_.samplerNames.size(), ESamplerState::SS_Point);
+
+        auto lambda = [&](auto& kvp, auto& slots, auto castFn)
+        {
+            auto f = slots.find(kvp.first);
+
+            if (f == slots.end()) {
+                LOGEF(boost::format("Dispatch error: could not find binding \"%1%\" in kernel \"%2%\"") % kvp.first % cmd->shader);
+                return false;
+            }
+
+            castFn(f->second, kvp.second);
+
+            return true;
+        };
+
+        auto& owners = dispatch.owners;
+
+        owners.clear();
+
+        auto addOwner = [&](const CPUView& view)
+        {
+            auto owner = view.owner_.lock();
+
+            if (owner)
+                owners.push_back(std::move(owner));
+
+            return &view.kernelResource_;
+        };
+
+        for (auto& kvp : cmd->srvBindings) {
+            auto castFn = [&](uint32_t slot, const ShaderResourceView* view)
+            {
+                srvs[slot] = (view != nullptr) ? addOwner(*static_cast<const CPUShaderResourceView*>(view)) : nullptr;
+            };
+
+            if (!lambda(kvp, kernel.srvSlots_, castFn))
+                return false;
+        }
+
+        for (auto& kvp : cmd->uavBindings) {
+            auto castFn = [&](uint32_t slot, const UnorderedAccessView* view)
+            {
+                uavs[slot] = (view != nullptr) ? addOwner(*static_cast<const CPUUnorderedAccessView*>(view)) : nullptr;
+            };
+
+            if (!lambda(kvp, kernel.uavSlots_, castFn))
+                return false;
+        }
+
+        for (auto& kvp : cmd->ssBindings) {
+            auto castFn = [&](uint32_t slot, const SamplerState* ss)
+            {
+                if (ss != nullptr)
+                    samplers[slot] = static_cast<const CPUSamplerState*>(ss)->filter_;
+            };
+
+            if (!lambda(kvp, kernel.ssSlots_, castFn))
+                return false;
+        }
+
+        // constant buffer, fallback on the one declared by the kernel
+        auto cbufferStr = cmd->cbufferStr.empty() ? std::string_view{ kernel.desc_.cbufferName } : cmd->cbufferStr;
+
+        if (!cbufferStr.empty()) {
+            auto foundCB = cBuffers_.find(cbufferStr);
+
+            if (foundCB == cBuffers_.end()) {
+                LOGEF(boost::format("Dispatch error: constant buffer \"%1%\" was never updated") % cbufferStr);
+                return false;
+            }
+
+            dispatch.cbuffer = foundCB->second;
+        }
+
+        dispatch.function = kernel.desc_.function;
+        dispatch.numThreads = kernel.desc_.numThreads;
+        dispatch.groups = cmd->dispatch;
+
+        return true;
+    }
+
+    ReadbackHandle CPU::ReadbackTexture(const ReadbackTextureParam& params)
+    {
+        TRACE_SCOPED_CPU;
+
+        queue_.WaitIdle();
+
+        auto impl = static_cast<const CPUTextureImpl*>(params.src);
+
+        if (CheckWeakExpired(impl->impl_))
+            return ReadbackHandle();
+
+        auto internal = impl->impl_.lock();
+        auto desc = internal->desc_;
+
+        if ((params.numFaces == 0) || (params.firstFace + params.numFaces > desc->arraySize)) {
+            LOGEF(boost::format("ReadbackTexture error: faces [%1%, %2%) are out of range for an array of %3%") % params.firstFace % (params.firstFace + params.numFaces) % desc->arraySize);
+            return ReadbackHandle();
+        }
+
+        // textures already live in host memory so there is nothing to copy or wait for
+        auto res = std::make_unique<Readback>();
+
+        res->subresources.reserve(params.numFaces * desc->numMips);
+
+        for (uint32_t face = params.firstFace; face < params.firstFace + params.numFaces; ++face) {
+            for (uint32_t mip = 0; mip < desc->numMips; ++mip) {
+                auto index = internal->GetSubresourceIndex(mip, face);
+                auto& sub = internal->subresources_[index];
+
+                res->subresources.push_back({ face, mip, internal->GetSubresourceData(index), sub.rowPitch });
+
+                AddStat(SC_BytesReadback, static_cast<uint64_t>(sub.depthPitch) * sub.depth);
+            }
+        }
+
+        return res;
+    }
+
+    bool CPU::ResolveBufferCopy(const CopyBufferSubresourceParam& params, std::shared_ptr<CPUBufferInternal>& src, std::shared_ptr<CPUBufferInternal>& dst)
+    {
+        auto srcImpl = static_cast<const CPUBufferImpl*>(params.src);
+
+        if (CheckWeakExpired(srcImpl->impl_))
+            return false;
+
+        auto dstImpl = static_cast<const CPUBufferImpl*>(params.dst);
+
+        if (CheckWeakExpired(dstImpl->impl_))
+            return false;
+
+        src = srcImpl->impl_.lock();
+        dst = dstImpl->impl_.lock();
+
+        if (src->data_.size() != dst->data_.size()) {
+            LOGE << "CopyBufferResource requires buffers of the same size";
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CPU::RegisterKernel(const KernelDesc& desc)
+    {
+        TRACE_SCOPED_CPU;
+
+        if (!desc.function) {
+            LOGEF(boost::format("RegisterKernel error: \"%1%\" has no function") % desc.name);
+            return false;
+        }
+
+        if ((desc.numThreads[0] == 0) || (desc.numThreads[1] == 0) || (desc.numThreads[2] == 0)) {
+            LOGEF(boost::format("RegisterKernel error: \"%1%\" has an invalid number of threads") % desc.name);
+            return false;
+        }
+
+        CPUKernel kernel;
+
+        kernel.desc_ = desc;
+
+        auto fillSlots = [](const std::vector<std::string>& names, StringMap<uint32_t>& slots)
+        {
+            for (uint32_t i = 0; i < names.size(); ++i) {
+                slots.emplace(names[i], i);
+            }
+        };
+
+        fillSlots(desc.srvNames, kernel.srvSlots_);
+        fillSlots(desc.uavNames, kernel.uavSlots_);
+        fillSlots(desc.samplerNames, kernel.ssSlots_);
+
+        LOGDF(boost::format("Adding kernel: \"%1%\" to library") % desc.name);
+
+        kernels_[desc.name] = std::move(kernel);
+
+        AddStat(SC_ShadersLoaded);
+
+        return true;
+    }
+
+    FenceHandle CPU::Submit(const CommandGraph& graph, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_CPU;
+
+        // resolved now so errors are reported when submitting, nodes have no hazards since they run in order
+        std::vector<std::function<void()>> nodes;
+
+        nodes.reserve(graph.GetNodes().size());
+
+        for (auto& node : graph.GetNodes()) {
+            if (node.cmd) {
+                CPUDispatch dispatch;
+
+                if (!PrepareDispatch(node.cmd, dispatch))
+                    return FenceHandle();
+
+                AddStat(SC_Dispatches);
+
+                nodes.emplace_back([dispatch = std::move(dispatch)]()
+                {
+                    ExecuteDispatch(dispatch);
+                });
+            } else {
+                CopyBufferSubresourceParam copyParams = {};
+
+                copyParams.src = node.src;
+                copyParams.dst = node.dst;
+
+                std::shared_ptr<CPUBufferInternal> srcInternal;
+                std::shared_ptr<CPUBufferInternal> dstInternal;
+
+                if (!ResolveBufferCopy(copyParams, srcInternal, dstInternal))
+                    return FenceHandle();
+
+                AddStat(SC_Copies);
+
+                nodes.emplace_back([srcInternal, dstInternal]()
+                {
+                    std::copy(srcInternal->data_.begin(), srcInternal->data_.end(), dstInternal->data_.begin());
+                });
+            }
+        }
+
+        return queue_.Submit([nodes = std::move(nodes), waitFor]()
+        {
+            if (waitFor && !waitFor->Wait())
+                return false;
+
+            for (auto& node : nodes) {
+                node();
+            }
+
+            return true;
+        });
+    }
+
+    bool CPU::UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size)
+    {
+        TRACE_SCOPED_CPU;
+
+        // there is no reflection so constant buffers are created on first update
+        auto src = static_cast<const uint8_t*>(data);
+
+        cBuffers_[name].assign(src, src + size);
+
+        AddStat(SC_BytesUploaded, size);
+
+        return true;
+    }
+
+    bool RegisterKernel(const KernelDesc& desc)
+    {
+        auto& dx = GetRenderer();
+
+        if ((!dx) || (dx->GetType() != ERenderer::RENDERER_CPU)) {
+            LOGE << "RegisterKernel requires RENDERER_CPU";
+            return false;
+        }
+
+        return static_cast<CPU*>(dx.get())->RegisterKernel(desc);
+    }
+} // namespace ninniku
@@ -0,0 +1,87 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/core/renderer/renderdevice.h"
+
+#include "../../../utils/string_map.h"
+#include "../../../utils/trace.h"
+
+#include "cpu_types.h"
+
+namespace ninniku
+{
+    class CPU final : public RenderDevice
+    {
+    public:
+        CPU() = default;
+
+        // RenderDevice
+        ERenderer GetType() const override { return ERenderer::RENDERER_CPU; }
+        const std::string_view& GetShaderExtension() const override { return ShaderExt; }
+
+        bool CheckFeatureSupport(uint32_t features) override;
+        bool CopyBufferResource(const CopyBufferSubresourceParam& params) override;
+        FenceHandle CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor) override;
+        std::tuple<uint32_t, uint32_t> CopyTextureSubresource(const CopyTextureSubresourceParam& params) override;
+        BufferHandle CreateBuffer(const BufferParamHandle& params) override;
+        BufferHandle CreateBuffer(const BufferHandle& src) override;
+        CommandHandle CreateCommand() const override { return std::make_unique<Command>(); }
+        DebugMarkerHandle CreateDebugMarker(const std::string_view&) const override { return std::make_unique<DebugMarker>(); }
+        TextureHandle CreateTexture(const TextureParamHandle& params) override;
+        bool Dispatch(const CommandHandle& cmd) override;
+        FenceHandle DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor) override;
+        void Finalize() override;
+        bool Initialize() override;
+        bool LoadShader(const std::filesystem::path& path) override;
+        bool LoadShader(const std::string_view& name, const void* pData, const uint32_t size) override;
+        MappedResourceHandle Map(const BufferHandle& bObj) override;
+        MappedResourceHandle Map(const TextureHandle& tObj, const uint32_t index) override;
+        ReadbackHandle ReadbackTexture(const ReadbackTextureParam& params) override;
+        FenceHandle Submit(const CommandGraph& graph, const FenceHandle& waitFor) override;
+        bool UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size) override;
+
+        const SamplerState* GetSampler(ESamplerState sampler) const override { return samplers_[static_cast<std::underlying_type<ESamplerState>::type>(sampler)].get(); }
+        ResourceStats GetResourceStats() const override { return tracker_.GetStats(); }
+
+        // Not from RenderDevice
+        bool RegisterKernel(const KernelDesc& desc);
+
+    private:
+        void MakeTextureViews(const std::shared_ptr<CPUTextureInternal>& internal);
+        bool PrepareDispatch(const CommandHandle& cmd, CPUDispatch& dispatch);
+        bool ResolveBufferCopy(const CopyBufferSubresourceParam& params, std::shared_ptr<CPUBufferInternal>& src, std::shared_ptr<CPUBufferInternal>& dst);
+
+    private:
+        // kernels are not loaded from files but LoadShader still validates names against the registry
+        static constexpr std::string_view ShaderExt = "";
+
+        StringMap<CPUKernel> kernels_;
+        StringMap<std::vector<uint8_t>> cBuffers_;
+        std::array<SSHandle, static_cast<std::underlying_type<ESamplerState>::type>(ESamplerState::SS_Count)> samplers_;
+
+        // tracks allocated resources
+        ObjectTracker tracker_;
+
+        // last so pending work is done before anything else is destroyed
+        CPUQueue queue_;
+    };
+} // namespace ninniku
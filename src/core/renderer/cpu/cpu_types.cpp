@@ -0,0 +1,289 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "cpu_types.h"
+
+#include "../../../utils/misc.h"
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // CPUBufferImpl
+    //////////////////////////////////////////////////////////////////////////
+    CPUBufferImpl::CPUBufferImpl(const std::shared_ptr<CPUBufferInternal>& impl) noexcept
+        : impl_{ impl }
+    {
+    }
+
+    const std::tuple<uint8_t*, uint32_t> CPUBufferImpl::GetData() const
+    {
+        if (CheckWeakExpired(impl_))
+            return std::tuple<uint8_t*, uint32_t>();
+
+        auto& data = impl_.lock()->data_;
+
+        return { reinterpret_cast<uint8_t*>(data.data()), static_cast<uint32_t>(data.size() * sizeof(uint32_t)) };
+    }
+
+    const BufferParam* CPUBufferImpl::GetDesc() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->desc_.get();
+    }
+
+    const ShaderResourceView* CPUBufferImpl::GetSRV() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srv_.get();
+    }
+
+    const UnorderedAccessView* CPUBufferImpl::GetUAV() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->uav_.get();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUFenceImpl
+    //////////////////////////////////////////////////////////////////////////
+    CPUFenceImpl::CPUFenceImpl(std::shared_future<bool>&& future) noexcept
+        : future_{ std::move(future) }
+    {
+    }
+
+    bool CPUFenceImpl::IsComplete() const
+    {
+        return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    bool CPUFenceImpl::Wait() const
+    {
+        return future_.get();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUMappedResource
+    //////////////////////////////////////////////////////////////////////////
+    CPUMappedResource::CPUMappedResource(void* data, const uint32_t rowPitch)
+        : data_{ data }
+        , rowPitch_{ rowPitch }
+    {
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUView
+    //////////////////////////////////////////////////////////////////////////
+    void CPUView::Initialize(const std::shared_ptr<CPUTextureInternal>& texture, uint32_t firstMip, uint32_t numMips)
+    {
+        auto& desc = texture->desc_;
+
+        owner_ = texture;
+
+        subresources_.resize(numMips * desc->arraySize);
+
+        for (uint32_t slice = 0; slice < desc->arraySize; ++slice) {
+            for (uint32_t mip = 0; mip < numMips; ++mip) {
+                auto index = texture->GetSubresourceIndex(firstMip + mip, slice);
+                auto& src = texture->subresources_[index];
+                auto& dst = subresources_[mip + slice * numMips];
+
+                dst.data = texture->GetSubresourceData(index);
+                dst.width = src.width;
+                dst.height = src.height;
+                dst.depth = src.depth;
+                dst.rowPitch = src.rowPitch;
+                dst.depthPitch = src.depthPitch;
+            }
+        }
+
+        kernelResource_.subresources = subresources_.data();
+        kernelResource_.numMips = numMips;
+        kernelResource_.arraySize = desc->arraySize;
+        kernelResource_.stride = texture->bpp_;
+        kernelResource_.format = static_cast<ETextureFormat>(desc->format);
+    }
+
+    void CPUView::Initialize(const std::shared_ptr<CPUBufferInternal>& buffer)
+    {
+        auto size = static_cast<uint32_t>(buffer->data_.size() * sizeof(uint32_t));
+
+        owner_ = buffer;
+
+        subresources_.resize(1);
+
+        auto& dst = subresources_.front();
+
+        dst.data = reinterpret_cast<uint8_t*>(buffer->data_.data());
+        dst.width = buffer->desc_->numElements;
+        dst.height = 1;
+        dst.depth = 1;
+        dst.rowPitch = size;
+        dst.depthPitch = size;
+
+        kernelResource_.subresources = subresources_.data();
+        kernelResource_.numMips = 1;
+        kernelResource_.arraySize = 1;
+        kernelResource_.stride = buffer->desc_->elementSize;
+        kernelResource_.format = ETextureFormat::TF_UNKNOWN;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUQueue
+    //////////////////////////////////////////////////////////////////////////
+    CPUQueue::~CPUQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+
+        cv_.notify_all();
+
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    FenceHandle CPUQueue::Submit(std::function<bool()>&& work)
+    {
+        std::packaged_task<bool()> task{ std::move(work) };
+        auto fence = std::make_shared<CPUFenceImpl>(task.get_future().share());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // most users never submit asynchronous work so only start the thread when needed
+            if (!worker_.joinable())
+                worker_ = std::thread(&CPUQueue::WorkerMain, this);
+
+            tasks_.emplace_back(std::move(task));
+            ++pending_;
+        }
+
+        cv_.notify_all();
+
+        return fence;
+    }
+
+    void CPUQueue::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        cv_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+    void CPUQueue::WorkerMain()
+    {
+        for (;;) {
+            std::packaged_task<bool()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+
+                cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+
+                if (tasks_.empty())
+                    return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --pending_;
+            }
+
+            cv_.notify_all();
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUTextureImpl
+    //////////////////////////////////////////////////////////////////////////
+    CPUTextureImpl::CPUTextureImpl(const std::shared_ptr<CPUTextureInternal>& impl) noexcept
+        : impl_{ impl }
+    {
+    }
+
+    const TextureParam* CPUTextureImpl::GetDesc() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->desc_.get();
+    }
+
+    const ShaderResourceView* CPUTextureImpl::GetSRVDefault() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srvDefault_.get();
+    }
+
+    const ShaderResourceView* CPUTextureImpl::GetSRVCube() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srvCube_.get();
+    }
+
+    const ShaderResourceView* CPUTextureImpl::GetSRVCubeArray() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srvCubeArray_.get();
+    }
+
+    const ShaderResourceView* CPUTextureImpl::GetSRVArray(uint32_t index) const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srvArray_[index].get();
+    }
+
+    const ShaderResourceView* CPUTextureImpl::GetSRVArrayWithMips() const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->srvArrayWithMips_.get();
+    }
+
+    const UnorderedAccessView* CPUTextureImpl::GetUAV(uint32_t index) const
+    {
+        if (CheckWeakExpired(impl_))
+            return nullptr;
+
+        return impl_.lock()->uav_[index].get();
+    }
+} // namespace ninniku
@@ -0,0 +1,245 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/core/renderer/kernel.h"
+#include "ninniku/core/renderer/types.h"
+
+#include "../../../utils/object_tracker.h"
+#include "../../../utils/string_map.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // CPUBufferInternal
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUBufferInternal final : TrackedObject
+    {
+        SRVHandle srv_;
+        UAVHandle uav_;
+
+        // the buffer lives in host memory so this is the resource itself
+        std::vector<uint32_t> data_;
+
+        // Initial desc that was used to create the resource
+        std::shared_ptr<const BufferParam> desc_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUBufferImpl
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUBufferImpl : public BufferObject
+    {
+        CPUBufferImpl(const std::shared_ptr<CPUBufferInternal>& impl) noexcept;
+
+        const std::tuple<uint8_t*, uint32_t> GetData() const override;
+        const BufferParam* GetDesc() const override;
+        const ShaderResourceView* GetSRV() const override;
+        const UnorderedAccessView* GetUAV() const override;
+
+        std::weak_ptr<CPUBufferInternal> impl_;
+        TrackedRef tracked_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUDispatch: everything a dispatch needs, resolved when it is submitted
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUDispatch
+    {
+        KernelFunction function;
+        std::array<uint32_t, 3> numThreads;
+        std::array<uint32_t, 3> groups;
+        std::vector<const KernelResource*> srvs;
+        std::vector<const KernelResource*> uavs;
+        std::vector<ESamplerState> samplers;
+
+        // the bound resources can't be freed before an asynchronous dispatch runs even if the user drops their handles
+        std::vector<std::shared_ptr<TrackedObject>> owners;
+
+        // copied so the constant buffer can be updated again before an asynchronous dispatch runs
+        std::vector<uint8_t> cbuffer;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUFenceImpl
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUFenceImpl final : public FenceObject
+    {
+        CPUFenceImpl(std::shared_future<bool>&& future) noexcept;
+
+        bool IsComplete() const override;
+        bool Wait() const override;
+
+        std::shared_future<bool> future_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUKernel
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUKernel
+    {
+        KernelDesc desc_;
+
+        // binding name to slot index in desc_
+        StringMap<uint32_t> srvSlots_;
+        StringMap<uint32_t> uavSlots_;
+        StringMap<uint32_t> ssSlots_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUMappedResource
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUMappedResource final : public MappedResource
+    {
+    public:
+        CPUMappedResource(void* data, const uint32_t rowPitch);
+
+        // MappedResource
+        void* GetData() const override { return data_; }
+
+        uint32_t GetRowPitch() const { return rowPitch_; }
+
+    private:
+        void* data_;
+        const uint32_t rowPitch_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUQueue: runs asynchronous work on its own thread in submission order, like a GPU queue
+    //////////////////////////////////////////////////////////////////////////
+    class CPUQueue : NonCopyable
+    {
+    public:
+        CPUQueue() = default;
+        ~CPUQueue();
+
+        FenceHandle Submit(std::function<bool()>&& work);
+
+        // block until everything submitted so far has run
+        void WaitIdle();
+
+    private:
+        void WorkerMain();
+
+    private:
+        std::thread worker_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<std::packaged_task<bool()>> tasks_;
+        uint32_t pending_ = 0;
+        bool stop_ = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPU Shader Resources
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUView
+    {
+        void Initialize(const std::shared_ptr<struct CPUTextureInternal>& texture, uint32_t firstMip, uint32_t numMips);
+        void Initialize(const std::shared_ptr<CPUBufferInternal>& buffer);
+
+        // what kernels see through this view, only covers the mips visible to the view
+        std::vector<KernelSubresource> subresources_;
+        KernelResource kernelResource_;
+
+        // the resource owns its views so queued work locks it to keep kernelResource_ alive
+        std::weak_ptr<TrackedObject> owner_;
+    };
+
+    struct CPUShaderResourceView final : public ShaderResourceView, public CPUView
+    {
+    };
+
+    struct CPUUnorderedAccessView final : public UnorderedAccessView, public CPUView
+    {
+    };
+
+    struct CPUSamplerState final : public SamplerState
+    {
+    public:
+        ESamplerState filter_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUTextureInternal
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUSubresource
+    {
+        size_t offset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint32_t rowPitch;
+        uint32_t depthPitch;
+    };
+
+    struct CPUTextureInternal final : TrackedObject
+    {
+        // same ordering as D3D11CalcSubresource
+        uint32_t GetSubresourceIndex(uint32_t mip, uint32_t slice) const { return mip + slice * desc_->numMips; }
+        uint8_t* GetSubresourceData(uint32_t index) { return data_.data() + subresources_[index].offset; }
+
+        std::vector<uint8_t> data_;
+        std::vector<CPUSubresource> subresources_;
+        uint32_t bpp_;
+
+        SRVHandle srvDefault_;
+        SRVHandle srvCube_;
+        SRVHandle srvCubeArray_;
+
+        // one per mip level
+        std::vector<SRVHandle> srvArray_;
+
+        SRVHandle srvArrayWithMips_;
+
+        // one per mip level
+        std::vector<UAVHandle> uav_;
+
+        // Initial desc that was used to create the resource
+        std::shared_ptr<const TextureParam> desc_;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // CPUTextureImpl
+    //////////////////////////////////////////////////////////////////////////
+    struct CPUTextureImpl final : public TextureObject
+    {
+        CPUTextureImpl(const std::shared_ptr<CPUTextureInternal>& impl) noexcept;
+
+        const TextureParam* GetDesc() const override;
+        const ShaderResourceView* GetSRVDefault() const override;
+        const ShaderResourceView* GetSRVCube() const override;
+        const ShaderResourceView* GetSRVCubeArray() const override;
+        const ShaderResourceView* GetSRVArray(uint32_t index) const override;
+        const ShaderResourceView* GetSRVArrayWithMips() const override;
+        const UnorderedAccessView* GetUAV(uint32_t index) const override;
+
+        std::weak_ptr<CPUTextureInternal> impl_;
+        TrackedRef tracked_;
+    };
+} // namespace ninniku
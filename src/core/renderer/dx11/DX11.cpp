@@ -27,15 +27,36 @@
 #include "../../../utils/log.h"
 #include "../../../utils/misc.h"
 #include "../../../utils/object_tracker.h"
+#include "../../../utils/stats.h"
 #include "../../../utils/vector_set.h"
 #include "../dx_common.h"
 
 #include <comdef.h>
 #include <d3d11shader.h>
 #include <d3dcompiler.h>
+#include <DirectXTex.h>
 
 namespace ninniku
 {
+    // D3D11 cannot tell how much memory a resource takes so estimate it from the description
+    static uint64_t EstimateTextureSize(const TextureParam& params)
+    {
+        auto format = static_cast<DXGI_FORMAT>(NinnikuTFToDXGIFormat(params.format));
+        uint64_t size = 0;
+
+        for (uint32_t mip = 0; mip < params.numMips; ++mip) {
+            size_t rowPitch, slicePitch;
+            auto hr = DirectX::ComputePitch(format, std::max(1u, params.width >> mip), std::max(1u, params.height >> mip), rowPitch, slicePitch);
+
+            if (FAILED(hr))
+                return 0;
+
+            size += static_cast<uint64_t>(slicePitch) * std::max(1u, params.depth >> mip);
+        }
+
+        return size * params.arraySize;
+    }
+
     DX11::DX11(ERenderer type)
         : type_{ type }
     {
@@ -68,9 +89,24 @@ namespace ninniku
 
         context_->CopyResource(dstInternal->buffer_.Get(), srcInternal->buffer_.Get());
 
+        AddStat(SC_Copies);
+
         return true;
     }
 
+    FenceHandle DX11::CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX11;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        if (!CopyBufferResource(params))
+            return FenceHandle();
+
+        return SignalFence();
+    }
+
     std::tuple<uint32_t, uint32_t> DX11::CopyTextureSubresource(const CopyTextureSubresourceParam& params)
     {
         TRACE_SCOPED_DX11;
@@ -94,6 +130,8 @@ namespace ninniku
 
         context_->CopySubresourceRegion(dstInternal->GetResource(), dstSub, 0, 0, 0, srcInternal->GetResource(), srcSub, nullptr);
 
+        AddStat(SC_Copies);
+
         return { srcSub, dstSub };
     }
 
@@ -120,9 +158,7 @@ namespace ninniku
         D3D11_USAGE usage = isCPURead ? D3D11_USAGE_STAGING : D3D11_USAGE_DEFAULT;
         std::string_view usageStr = isCPURead ? "D3D11_USAGE_STAGING" : "D3D11_USAGE_DEFAULT";
 
-        auto fmt = boost::format("Creating Buffer: ElementSize=%1%, NumElements=%2%, Usage=%3%") % params->elementSize % params->numElements % usageStr;
-
-        LOGD << boost::str(fmt);
+        LOGDF(boost::format("Creating Buffer: ElementSize=%1%, NumElements=%2%, Usage=%3%") % params->elementSize % params->numElements % usageStr);
 
         uint32_t cpuFlags = 0;
         uint32_t bindFlags = 0;
@@ -156,8 +192,6 @@ namespace ninniku
 
         auto impl = std::make_shared<DX11BufferInternal>();
 
-        tracker_.RegisterObject(impl);
-
         impl->desc_ = params;
 
         // do not support initial data for now
@@ -200,7 +234,11 @@ namespace ninniku
             }
         }
 
-        return std::make_unique<DX11BufferImpl>(impl);
+        auto res = std::make_unique<DX11BufferImpl>(impl);
+
+        res->tracked_ = tracker_.RegisterObject(impl, desc.ByteWidth);
+
+        return res;
     }
 
     BufferHandle DX11::CreateBuffer(const BufferHandle& src)
@@ -265,6 +303,24 @@ namespace ninniku
         return dst;
     }
 
+    StringMap<uint32_t> DX11::CreateBindSlots(const ShaderReflection& reflection)
+    {
+        StringMap<uint32_t> res;
+
+        res.reserve(reflection.bindings.size());
+
+        for (auto& binding : reflection.bindings) {
+            // if the texture is a constant buffer, we want to create it a slot for it in the map
+            if (binding.type == D3D_SIT_CBUFFER) {
+                cBuffers_.emplace(binding.name, DX11Buffer{});
+            }
+
+            res.emplace(binding.name, binding.bindPoint);
+        }
+
+        return res;
+    }
+
     bool DX11::CreateDevice(int adapter, _Outptr_ ID3D11Device** pDevice)
     {
         TRACE_SCOPED_DX11;
@@ -296,8 +352,7 @@ namespace ninniku
 
             if (DXCommon::GetDXGIFactory<IDXGIFactory1>(dxgiFactory.GetAddressOf())) {
                 if (FAILED(dxgiFactory->EnumAdapters(adapter, pAdapter.GetAddressOf()))) {
-                    auto fmt = boost::format("Invalid GPU adapter index (%1%)!") % adapter;
-                    LOGE << boost::str(fmt);
+                    LOGEF(boost::format("Invalid GPU adapter index (%1%)!") % adapter);
                     return false;
                 }
             }
@@ -376,9 +431,7 @@ namespace ninniku
             usageStr = "D3D11_USAGE_DEFAULT";
         }
 
-        auto fmt = boost::format("Creating Texture: Size=%1%x%2%, Mips=%3%, Usage=%4%") % params->width % params->height % params->numMips % usageStr;
-
-        LOGD << boost::str(fmt);
+        LOGDF(boost::format("Creating Texture: Size=%1%x%2%, Mips=%3%, Usage=%4%") % params->width % params->height % params->numMips % usageStr);
 
         uint32_t miscFlags = 0;
 
@@ -412,8 +465,6 @@ namespace ninniku
         // we want to use unique_ptr here so that the object is properly destroyed in case it fails before we return
         auto impl = std::make_shared<DX11TextureInternal>();
 
-        tracker_.RegisterObject(impl);
-
         impl->desc_ = params;
 
         auto res = std::make_unique<DX11TextureImpl>(impl);
@@ -519,6 +570,13 @@ namespace ninniku
             }
         }
 
+        auto size = EstimateTextureSize(*params);
+
+        if (numImageImpls > 0)
+            AddStat(SC_BytesUploaded, size);
+
+        res->tracked_ = tracker_.RegisterObject(impl, size);
+
         return res;
     }
 
@@ -566,11 +624,15 @@ namespace ninniku
     {
         TRACE_SCOPED_DX11;
 
+        ScopedLatency latency{ SL_Dispatch };
+
+        if (!LoadLazyShader(cmd->shader))
+            return false;
+
         auto found = shaders_.find(cmd->shader);
 
         if (found == shaders_.end()) {
-            auto fmt = boost::format("Dispatch error: could not find shader \"%1%\"") % cmd->shader;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Dispatch error: could not find shader \"%1%\"") % cmd->shader);
             return false;
         }
 
@@ -598,8 +660,7 @@ namespace ninniku
             if (f != cs.bindSlots_.end()) {
                 container.insert(f->second, castFn(kvp.second));
             } else {
-                auto fmt = boost::format("Dispatch error: could not find bindSlots \"%1%\"") % kvp.first;
-                LOGE << boost::str(fmt);
+                LOGEF(boost::format("Dispatch error: could not find bindSlots \"%1%\"") % kvp.first);
                 return false;
             }
 
@@ -658,9 +719,26 @@ namespace ninniku
         context_->CSSetUnorderedAccessViews(0, vmUAV.size(), vmUAV.data(), nullptr);
         context_->CSSetShaderResources(0, vmSRV.size(), vmSRV.data());
         context_->Dispatch(cmd->dispatch[0], cmd->dispatch[1], cmd->dispatch[2]);
+
+        AddStat(SC_Dispatches);
+
         return true;
     }
 
+    FenceHandle DX11::DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX11;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        // Dispatch only records into the immediate context which is in order
+        if (!Dispatch(cmd))
+            return FenceHandle();
+
+        return SignalFence();
+    }
+
     void DX11::Finalize()
     {
         TRACE_SCOPED_DX11;
@@ -668,6 +746,43 @@ namespace ninniku
         tracker_.ReleaseObjects();
     }
 
+    bool DX11::GetShaderReflection(const std::filesystem::path& path, ID3DBlob* pBlob, ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_DX11;
+
+        auto key = ReflectionCache::GetKey(pBlob->GetBufferPointer(), pBlob->GetBufferSize());
+
+        if (reflectionCache_.Find(key, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), reflection)) {
+            LOGD << "Found reflection in cache";
+            return true;
+        }
+
+        Microsoft::WRL::ComPtr<ID3D11ShaderReflection> reflect;
+        D3D11_SHADER_DESC desc;
+
+        auto hr = D3DReflect(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), IID_PPV_ARGS(reflect.GetAddressOf()));
+        if (FAILED(hr)) {
+            LOGEF(boost::format("Failed to call D3DReflect on shader: %1% with:") % path);
+            _com_error err(hr);
+            LOGE << err.ErrorMessage();
+            return false;
+        }
+
+        hr = reflect->GetDesc(&desc);
+        if (FAILED(hr)) {
+            LOGEF(boost::format("Failed to GetDesc from shader reflection on shader: %1% with:") % path);
+            _com_error err(hr);
+            LOGE << err.ErrorMessage();
+            return false;
+        }
+
+        // keep what was parsed on failure but don't cache an incomplete result
+        if (ParseShaderResources(desc.BoundResources, reflect.Get(), reflection))
+            reflectionCache_.Add(key, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), reflection);
+
+        return true;
+    }
+
     bool DX11::Initialize()
     {
         TRACE_SCOPED_DX11;
@@ -727,26 +842,21 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX11("ninniku::DX11::LoadShader (path)");
 
+        ScopedLatency latency{ SL_ShaderLoad };
+
         if (std::filesystem::is_directory(path)) {
             return LoadShaders(path);
         } else if (path.extension() == ShaderExt) {
-            auto fmt = boost::format("Loading %1%..") % path;
-
-            LOG_INDENT_START << boost::str(fmt);
+            LOG_INDENT_START << boost::format("Loading %1%..") % path;
 
-            ID3DBlob* blob = nullptr;
-            auto hr = D3DReadFileToBlob(ninniku::strToWStr(path.string()).c_str(), &blob);
+            Microsoft::WRL::ComPtr<ID3DBlob> blob;
 
-            if (FAILED(hr)) {
-                fmt = boost::format("Failed to D3DReadFileToBlob: %1% with:") % path;
-                LOGE << boost::str(fmt);
-                _com_error err(hr);
-                LOGE << err.ErrorMessage();
+            if (!ReadShaderBlob(path, blob.GetAddressOf())) {
                 LOG_INDENT_END;
                 return false;
             }
 
-            if (!LoadShader(path, blob)) {
+            if (!LoadShader(path, blob.Get())) {
                 LOG_INDENT_END;
                 return false;
             }
@@ -761,9 +871,9 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX11("ninniku::DX11::LoadShader (string, void*, uint32_t)");
 
-        auto fmt = boost::format("Loading %1% directly from memory..") % name;
+        ScopedLatency latency{ SL_ShaderLoad };
 
-        LOG_INDENT_START << boost::str(fmt);
+        LOG_INDENT_START << boost::format("Loading %1% directly from memory..") % name;
 
         ID3DBlob* pBlob = nullptr;
         auto hr = D3DCreateBlob(size, &pBlob);
@@ -784,45 +894,28 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX12("ninniku::DX12::LoadShader (path, IDxID3DBlobBlobEncoding)");
 
-        // reflection
-        ID3D11ShaderReflection* reflect = nullptr;
-        D3D11_SHADER_DESC desc;
+        ShaderReflection reflection;
 
-        auto hr = D3DReflect(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), IID_PPV_ARGS(&reflect));
-        if (FAILED(hr)) {
-            auto fmt = boost::format("Failed to call D3DReflect on shader: %1% with:") % path;
-            LOGE << boost::str(fmt);
-            _com_error err(hr);
-            LOGE << err.ErrorMessage();
+        if (!GetShaderReflection(path, pBlob, reflection))
             return false;
-        }
 
-        hr = reflect->GetDesc(&desc);
-        if (FAILED(hr)) {
-            auto fmt = boost::format("Failed to GetDesc from shader reflection on shader: %1% with:") % path;
-            LOGE << boost::str(fmt);
-            _com_error err(hr);
-            LOGE << err.ErrorMessage();
-            return false;
-        }
-
-        auto bindings = ParseShaderResources(desc.BoundResources, reflect);
+        return RegisterShader(path, pBlob, reflection);
+    }
 
-        // create shader
-        DX11CS shader;
+    bool DX11::LoadLazyShader(const std::string_view& name)
+    {
+        if (lazyShaders_.empty() || (shaders_.find(name) != shaders_.end()))
+            return true;
 
-        hr = device_->CreateComputeShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), nullptr, shader.GetAddressOf());
+        auto found = lazyShaders_.find(name);
 
-        if (CheckAPIFailed(hr, "CreateComputeShader")) {
-            return false;
-        } else {
-            auto name = path.stem().string();
-            LOGDF(boost::format("Adding CS: \"%1%\" to library") % name);
+        // let the caller report unknown shaders
+        if (found == lazyShaders_.end())
+            return true;
 
-            shaders_.emplace(name, DX11ComputeShader{ shader, bindings });
-        }
+        LOGDF(boost::format("Lazy loading shader \"%1%\"") % name);
 
-        return true;
+        return LoadShader(found->second);
     }
 
     /// <summary>
@@ -834,29 +927,59 @@ namespace ninniku
 
         // check if directory is valid
         if (!std::filesystem::is_directory(shaderPath)) {
-            auto fmt = boost::format("Failed to open directory: %1%") % shaderPath;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Failed to open directory: %1%") % shaderPath);
 
             return false;
         }
 
-        // Count the number of .cso found
-        std::filesystem::directory_iterator begin(shaderPath), end;
+        // the iterator already goes through sub folders
+        std::vector<std::filesystem::path> paths;
+
+        for (auto& iter : std::filesystem::recursive_directory_iterator(shaderPath)) {
+            if (!iter.is_directory() && (iter.path().extension() == ShaderExt))
+                paths.emplace_back(iter.path());
+        }
+
+        LOGDF(boost::format("Found %1% compiled shaders in /%2%") % paths.size() % shaderPath);
+
+        if (Globals::Instance().lazyShaderLoading_) {
+            for (auto& path : paths) {
+                lazyShaders_.emplace(path.stem().string(), path);
+            }
+
+            return true;
+        }
+
+        auto cachePath = shaderPath / ReflectionCache::FileName;
 
-        auto fileCounter = [&](const std::filesystem::directory_entry& d)
+        reflectionCache_.Load(cachePath);
+
+        struct LoadedShader
         {
-            return (!is_directory(d.path()) && (d.path().extension() == ShaderExt));
+            Microsoft::WRL::ComPtr<ID3DBlob> blob;
+            ShaderReflection reflection;
+            bool valid;
         };
 
-        auto numFiles = std::count_if(begin, end, fileCounter);
-        auto fmt = boost::format("Found %1% compiled shaders in /%2%") % numFiles % shaderPath;
+        std::vector<LoadedShader> loaded(paths.size());
 
-        LOGD << boost::str(fmt);
+        // reading and reflecting doesn't touch the device or the maps so each shader can go wide
+        ParallelFor(Globals::Instance().threadPool_.get(), static_cast<uint32_t>(paths.size()), 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (auto i = begin; i < end; ++i) {
+                auto& shader = loaded[i];
 
-        for (auto& iter : std::filesystem::recursive_directory_iterator(shaderPath)) {
-            LoadShader(iter.path());
+                shader.valid = ReadShaderBlob(paths[i], shader.blob.GetAddressOf()) && GetShaderReflection(paths[i], shader.blob.Get(), shader.reflection);
+            }
+        });
+
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (loaded[i].valid)
+                RegisterShader(paths[i], loaded[i].blob.Get(), loaded[i].reflection);
         }
 
+        reflectionCache_.Save(cachePath);
+
         return true;
     }
 
@@ -981,6 +1104,8 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX11("ninniku::DX11::Map (BufferHandle)");
 
+        ScopedLatency latency{ SL_Map };
+
         auto res = std::make_unique<DX11MappedResource>(context_, bObj);
         auto impl = static_cast<const DX11BufferImpl*>(bObj.get());
 
@@ -1001,6 +1126,8 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX11("ninniku::DX11::Map (TextureHandle, uint32_t)");
 
+        ScopedLatency latency{ SL_Map };
+
         auto res = std::make_unique<DX11MappedResource>(context_, tObj, index);
         auto impl = static_cast<const DX11TextureImpl*>(tObj.get());
 
@@ -1017,20 +1144,90 @@ namespace ninniku
         return res;
     }
 
-    StringMap<uint32_t> DX11::ParseShaderResources(uint32_t numBoundResources, ID3D11ShaderReflection* reflection)
+    ReadbackHandle DX11::ReadbackTexture(const ReadbackTextureParam& params)
     {
         TRACE_SCOPED_DX11;
 
-        StringMap<uint32_t> res;
+        auto srcImpl = static_cast<const DX11TextureImpl*>(params.src);
+
+        if (CheckWeakExpired(srcImpl->impl_))
+            return ReadbackHandle();
+
+        auto srcInternal = srcImpl->impl_.lock();
+        auto srcDesc = params.src->GetDesc();
+
+        if ((params.numFaces == 0) || (params.firstFace + params.numFaces > srcDesc->arraySize)) {
+            LOGEF(boost::format("ReadbackTexture error: faces [%1%, %2%) are out of range for an array of %3%") % params.firstFace % (params.firstFace + params.numFaces) % srcDesc->arraySize);
+            return ReadbackHandle();
+        }
+
+        // a single staging texture receives every copy so only the first Map has to wait
+        auto param = TextureParam::Create();
+
+        param->width = srcDesc->width;
+        param->height = srcDesc->height;
+        param->depth = srcDesc->depth;
+        param->format = srcDesc->format;
+        param->numMips = srcDesc->numMips;
+        param->arraySize = params.numFaces;
+        param->viewflags = EResourceViews::RV_CPU_READ;
+
+        auto staging = CreateTexture(param);
+        auto stagingImpl = static_cast<const DX11TextureImpl*>(staging.get());
+
+        if (CheckWeakExpired(stagingImpl->impl_))
+            return ReadbackHandle();
+
+        auto stagingInternal = stagingImpl->impl_.lock();
+
+        for (uint32_t face = 0; face < params.numFaces; ++face) {
+            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
+                uint32_t dstSub = D3D11CalcSubresource(mip, face, srcDesc->numMips);
+                uint32_t srcSub = D3D11CalcSubresource(mip, params.firstFace + face, srcDesc->numMips);
+
+                context_->CopySubresourceRegion(stagingInternal->GetResource(), dstSub, 0, 0, 0, srcInternal->GetResource(), srcSub, nullptr);
+            }
+        }
+
+        auto res = std::make_unique<Readback>();
+        auto numSubresources = params.numFaces * srcDesc->numMips;
+
+        res->subresources.reserve(numSubresources);
+        res->mappings.reserve(numSubresources);
+
+        for (uint32_t face = 0; face < params.numFaces; ++face) {
+            for (uint32_t mip = 0; mip < srcDesc->numMips; ++mip) {
+                auto mapped = Map(staging, D3D11CalcSubresource(mip, face, srcDesc->numMips));
+
+                if (!mapped)
+                    return ReadbackHandle();
+
+                auto dx11Mapped = static_cast<const DX11MappedResource*>(mapped.get());
+
+                res->subresources.push_back({ params.firstFace + face, mip, static_cast<const uint8_t*>(mapped->GetData()), dx11Mapped->GetRowPitch() });
+                res->mappings.emplace_back(std::move(mapped));
+            }
+        }
+
+        AddStat(SC_BytesReadback, EstimateTextureSize(*param));
+
+        return res;
+    }
+
+    bool DX11::ParseShaderResources(uint32_t numBoundResources, ID3D11ShaderReflection* pReflection, ShaderReflection& res)
+    {
+        TRACE_SCOPED_DX11;
+
+        res.bindings.reserve(numBoundResources);
 
         // parse parameter bind slots
         for (uint32_t i = 0; i < numBoundResources; ++i) {
             D3D11_SHADER_INPUT_BIND_DESC bindDesc;
 
-            auto hr = reflection->GetResourceBindingDesc(i, &bindDesc);
+            auto hr = pReflection->GetResourceBindingDesc(i, &bindDesc);
 
             if (CheckAPIFailed(hr, "ID3D11ShaderReflection::GetResourceBindingDesc"))
-                return res;
+                return false;
 
             std::string_view restypeStr;
 
@@ -1061,22 +1258,109 @@ namespace ninniku
 
                 default:
                     LOG << "DX11::ParseShaderResources unsupported type";
-                    return res;
+                    return false;
             }
 
-            auto fmt = boost::format("Resource: Name=\"%1%\", Type=%2%, Slot=%3%") % bindDesc.Name % restypeStr % bindDesc.BindPoint;
+            LOGDF(boost::format("Resource: Name=\"%1%\", Type=%2%, Slot=%3%") % bindDesc.Name % restypeStr % bindDesc.BindPoint);
 
-            LOGD << boost::str(fmt);
+            ShaderBinding binding = {};
 
-            // if the texture is a constant buffer, we want to create it a slot for it in the map
-            if (bindDesc.Type == D3D_SIT_CBUFFER) {
-                cBuffers_.emplace(bindDesc.Name, DX11Buffer{});
-            }
+            binding.name = bindDesc.Name;
+            binding.type = bindDesc.Type;
+            binding.bindPoint = bindDesc.BindPoint;
+            binding.bindCount = bindDesc.BindCount;
+            binding.flags = bindDesc.uFlags;
+            binding.returnType = bindDesc.ReturnType;
+            binding.dimension = bindDesc.Dimension;
+            binding.numSamples = bindDesc.NumSamples;
 
-            res.emplace(bindDesc.Name, bindDesc.BindPoint);
+            res.bindings.emplace_back(std::move(binding));
         }
 
-        return res;
+        return true;
+    }
+
+    bool DX11::ReadShaderBlob(const std::filesystem::path& path, ID3DBlob** ppBlob)
+    {
+        TRACE_SCOPED_DX11;
+
+        auto hr = D3DReadFileToBlob(ninniku::strToWStr(path.string()).c_str(), ppBlob);
+
+        if (FAILED(hr)) {
+            LOGEF(boost::format("Failed to D3DReadFileToBlob: %1% with:") % path);
+            _com_error err(hr);
+            LOGE << err.ErrorMessage();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool DX11::RegisterShader(const std::filesystem::path& path, ID3DBlob* pBlob, const ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_DX11;
+
+        auto bindings = CreateBindSlots(reflection);
+
+        // create shader
+        DX11CS shader;
+
+        auto hr = device_->CreateComputeShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), nullptr, shader.GetAddressOf());
+
+        if (CheckAPIFailed(hr, "CreateComputeShader")) {
+            return false;
+        } else {
+            auto name = path.stem().string();
+            LOGDF(boost::format("Adding CS: \"%1%\" to library") % name);
+
+            shaders_.emplace(name, DX11ComputeShader{ shader, bindings });
+            AddStat(SC_ShadersLoaded);
+        }
+
+        return true;
+    }
+
+    FenceHandle DX11::SignalFence()
+    {
+        D3D11_QUERY_DESC desc = {};
+
+        desc.Query = D3D11_QUERY_EVENT;
+
+        DX11Query query;
+        auto hr = device_->CreateQuery(&desc, query.GetAddressOf());
+
+        if (CheckAPIFailed(hr, "ID3D11Device::CreateQuery"))
+            return FenceHandle();
+
+        context_->End(query.Get());
+
+        return std::make_shared<DX11FenceImpl>(context_, query);
+    }
+
+    FenceHandle DX11::Submit(const CommandGraph& graph, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX11;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        // the runtime tracks hazards itself so the nodes are recorded in order
+        for (auto& node : graph.GetNodes()) {
+            if (node.cmd) {
+                if (!Dispatch(node.cmd))
+                    return FenceHandle();
+            } else {
+                CopyBufferSubresourceParam copyParams = {};
+
+                copyParams.src = node.src;
+                copyParams.dst = node.dst;
+
+                if (!CopyBufferResource(copyParams))
+                    return FenceHandle();
+            }
+        }
+
+        return SignalFence();
     }
 
     bool DX11::UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size)
@@ -1085,6 +1369,14 @@ namespace ninniku
 
         auto found = cBuffers_.find(name);
 
+        // the shader declaring it might not have been loaded yet, load the pending ones until it shows up
+        for (auto iter = lazyShaders_.begin(); (found == cBuffers_.end()) && (iter != lazyShaders_.end()); ++iter) {
+            if (!LoadLazyShader(iter->first))
+                return false;
+
+            found = cBuffers_.find(name);
+        }
+
         if (found == cBuffers_.end()) {
             LOGEF(boost::format("Constant buffer \"%1%\" was not found in any of the shaders parsed") % name);
 
@@ -1119,6 +1411,25 @@ namespace ninniku
             context_->Unmap(src, 0);
         }
 
+        AddStat(SC_BytesUploaded, size);
+
         return true;
     }
+
+    bool DX11::WaitForFence(const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX11;
+
+        if (!waitFor)
+            return true;
+
+        // the immediate context executes in submission order so its own fences are already ahead of anything recorded now
+        auto dxFence = dynamic_cast<const DX11FenceImpl*>(waitFor.get());
+
+        if ((dxFence != nullptr) && (dxFence->GetContext() == context_.Get()))
+            return true;
+
+        // fences of other renderers are waited on the CPU
+        return waitFor->Wait();
+    }
 } // namespace ninniku
\ No newline at end of file
@@ -24,6 +24,7 @@
 
 #include "../../../utils/string_map.h"
 #include "../../../utils/trace.h"
+#include "../reflection_cache.h"
 
 #include "dx11_types.h"
 
@@ -42,6 +43,7 @@ namespace ninniku
 
         bool CheckFeatureSupport(uint32_t features) override;
         bool CopyBufferResource(const CopyBufferSubresourceParam& params) override;
+        FenceHandle CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor) override;
         std::tuple<uint32_t, uint32_t> CopyTextureSubresource(const CopyTextureSubresourceParam& params) override;
         BufferHandle CreateBuffer(const BufferParamHandle& params) override;
         BufferHandle CreateBuffer(const BufferHandle& src) override;
@@ -49,26 +51,37 @@ namespace ninniku
         DebugMarkerHandle CreateDebugMarker(const std::string_view& name) const override;
         TextureHandle CreateTexture(const TextureParamHandle& params) override;
         bool Dispatch(const CommandHandle& cmd) override;
+        FenceHandle DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor) override;
         void Finalize() override;
         bool Initialize() override;
         bool LoadShader(const std::filesystem::path& path) override;
         bool LoadShader(const std::string_view& name, const void* pData, const uint32_t size) override;
         MappedResourceHandle Map(const BufferHandle& bObj) override;
         MappedResourceHandle Map(const TextureHandle& tObj, const uint32_t index) override;
+        ReadbackHandle ReadbackTexture(const ReadbackTextureParam& params) override;
+        FenceHandle Submit(const CommandGraph& graph, const FenceHandle& waitFor) override;
         bool UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size) override;
 
         const SamplerState* GetSampler(ESamplerState sampler) const override { return samplers_[static_cast<std::underlying_type<ESamplerState>::type>(sampler)].get(); }
+        ResourceStats GetResourceStats() const override { return tracker_.GetStats(); }
 
         // Not from RenderDevice
         inline ID3D11Device* GetDevice() const { return device_.Get(); }
 
     private:
+        StringMap<uint32_t> CreateBindSlots(const ShaderReflection& reflection);
         bool CreateDevice(int adapter, ID3D11Device** pDevice);
         std::string_view DxSRVDimensionToString(D3D_SRV_DIMENSION dimension);
+        bool GetShaderReflection(const std::filesystem::path& path, ID3DBlob* pBlob, ShaderReflection& reflection);
+        bool LoadLazyShader(const std::string_view& name);
         bool LoadShader(const std::filesystem::path& path, ID3DBlob* pBlob);
         bool LoadShaders(const std::filesystem::path& shaderPath);
         bool MakeTextureSRV(const TextureSRVParams& params);
-        StringMap<uint32_t> ParseShaderResources(uint32_t numBoundResources, ID3D11ShaderReflection* reflection);
+        bool ParseShaderResources(uint32_t numBoundResources, ID3D11ShaderReflection* pReflection, ShaderReflection& res);
+        bool ReadShaderBlob(const std::filesystem::path& path, ID3DBlob** ppBlob);
+        bool RegisterShader(const std::filesystem::path& path, ID3DBlob* pBlob, const ShaderReflection& reflection);
+        FenceHandle SignalFence();
+        bool WaitForFence(const FenceHandle& waitFor);
 
         // Helper to cast into the correct shader resource type
         template<typename SourceType, typename DestType, typename ReturnType>
@@ -91,6 +104,12 @@ namespace ninniku
         StringMap<DX11Buffer> cBuffers_;
         std::array<SSHandle, static_cast<std::underlying_type<ESamplerState>::type>(ESamplerState::SS_Count)> samplers_;
 
+        // IF_LazyShaderLoading only, shaders are loaded by the first Dispatch using them
+        StringMap<std::filesystem::path> lazyShaders_;
+
+        // only loaded while LoadShaders is going through a folder
+        ReflectionCache reflectionCache_;
+
         // tracks allocated resources
         ObjectTracker tracker_;
     };
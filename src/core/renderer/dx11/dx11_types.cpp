@@ -22,7 +22,11 @@
 #include "dx11_types.h"
 
 #include "../../../globals.h"
+#include "../../../utils/log.h"
 #include "../../../utils/misc.h"
+#include "../../../utils/trace.h"
+
+#include <thread>
 
 namespace ninniku
 {
@@ -86,6 +90,40 @@ namespace ninniku
         }
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    // DX11FenceImpl
+    //////////////////////////////////////////////////////////////////////////
+    DX11FenceImpl::DX11FenceImpl(const DX11Context& context, const DX11Query& query) noexcept
+        : context_{ context }
+        , query_{ query }
+    {
+    }
+
+    bool DX11FenceImpl::IsComplete() const
+    {
+        return context_->GetData(query_.Get(), nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+    }
+
+    bool DX11FenceImpl::Wait() const
+    {
+        TRACE_SCOPED_DX11;
+
+        // without DONOTFLUSH the command buffer is submitted so the query is guaranteed to complete
+        for (;;) {
+            auto hr = context_->GetData(query_.Get(), nullptr, 0, 0);
+
+            if (hr == S_OK)
+                return true;
+
+            if (FAILED(hr)) {
+                LOGE << "ID3D11DeviceContext::GetData failed while waiting on a fence";
+                return false;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
     //////////////////////////////////////////////////////////////////////////
     // DX11MappedResource
     //////////////////////////////////////////////////////////////////////////
@@ -99,9 +137,7 @@ namespace ninniku
         if (CheckWeakExpired(impl->impl_))
             throw new std::exception("DX11MappedResource ctor");
 
-        auto internal = impl->impl_.lock();
-
-        resource_ = static_cast<const DX11TextureInternal*>(internal.get());
+        resource_ = std::shared_ptr<const DX11TextureInternal>(impl->impl_.lock());
     }
 
     DX11MappedResource::DX11MappedResource(const DX11Context& context, const BufferHandle& bufObj)
@@ -114,19 +150,17 @@ namespace ninniku
         if (CheckWeakExpired(impl->impl_))
             throw new std::exception("DX11MappedResource ctor");
 
-        auto internal = impl->impl_.lock();
-
-        resource_ = static_cast<const DX11BufferInternal*>(internal.get());
+        resource_ = std::shared_ptr<const DX11BufferInternal>(impl->impl_.lock());
     }
 
     DX11MappedResource::~DX11MappedResource()
     {
-        if (std::holds_alternative<const DX11BufferInternal*>(resource_)) {
-            auto obj = std::get<const DX11BufferInternal*>(resource_);
+        if (std::holds_alternative<std::shared_ptr<const DX11BufferInternal>>(resource_)) {
+            auto& obj = std::get<std::shared_ptr<const DX11BufferInternal>>(resource_);
 
             context_->Unmap(obj->buffer_.Get(), 0);
         } else {
-            auto obj = std::get<const DX11TextureInternal*>(resource_);
+            auto& obj = std::get<std::shared_ptr<const DX11TextureInternal>>(resource_);
 
             context_->Unmap(obj->GetResource(), index_);
         }
@@ -37,6 +37,7 @@ namespace ninniku
     using DX11CS = Microsoft::WRL::ComPtr<ID3D11ComputeShader>;
     using DX11Device = Microsoft::WRL::ComPtr<ID3D11Device>;
     using DX11Marker = Microsoft::WRL::ComPtr<ID3DUserDefinedAnnotation>;
+    using DX11Query = Microsoft::WRL::ComPtr<ID3D11Query>;
     using DX11Tex1D = Microsoft::WRL::ComPtr<ID3D11Texture1D>;
     using DX11Tex2D = Microsoft::WRL::ComPtr<ID3D11Texture2D>;
     using DX11Tex3D = Microsoft::WRL::ComPtr<ID3D11Texture3D>;
@@ -73,6 +74,7 @@ namespace ninniku
         const UnorderedAccessView* GetUAV() const override;
 
         std::weak_ptr<DX11BufferInternal> impl_;
+        TrackedRef tracked_;
     };
 
     //////////////////////////////////////////////////////////////////////////
@@ -104,6 +106,24 @@ namespace ninniku
         DX11Marker marker_;
     };
 
+    //////////////////////////////////////////////////////////////////////////
+    // DX11FenceImpl: event query, like the context it must only be used from the device thread
+    //////////////////////////////////////////////////////////////////////////
+    struct DX11FenceImpl final : public FenceObject
+    {
+    public:
+        DX11FenceImpl(const DX11Context& context, const DX11Query& query) noexcept;
+
+        bool IsComplete() const override;
+        bool Wait() const override;
+
+        ID3D11DeviceContext* GetContext() const { return context_.Get(); }
+
+    private:
+        DX11Context context_;
+        DX11Query query_;
+    };
+
     //////////////////////////////////////////////////////////////////////////
     // DX11MappedResource
     //////////////////////////////////////////////////////////////////////////
@@ -121,7 +141,8 @@ namespace ninniku
         uint32_t GetRowPitch() const { return mapped_.RowPitch; }
 
     private:
-        std::variant<const struct DX11TextureInternal*, const DX11BufferInternal*> resource_;
+        // keeps the resource alive even if the user drops its handle before unmapping
+        std::variant<std::shared_ptr<const struct DX11TextureInternal>, std::shared_ptr<const DX11BufferInternal>> resource_;
         const DX11Context& context_;
         const uint32_t index_;
         D3D11_MAPPED_SUBRESOURCE mapped_;
@@ -192,6 +213,7 @@ namespace ninniku
         const UnorderedAccessView* GetUAV(uint32_t index) const override;
 
         std::weak_ptr<DX11TextureInternal> impl_;
+        TrackedRef tracked_;
     };
 
     //////////////////////////////////////////////////////////////////////////
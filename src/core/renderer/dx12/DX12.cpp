@@ -30,6 +30,7 @@
 #include "../../../utils/log.h"
 #include "../../../utils/misc.h"
 #include "../../../utils/object_tracker.h"
+#include "../../../utils/stats.h"
 #include "../dx_common.h"
 #include "dxc_utils.h"
 
@@ -44,11 +45,13 @@
 #include <dxcapi.h>
 #include <d3dx12/d3dx12.h>
 #include <boost/crc.hpp>
+#include <unordered_set>
 
 namespace ninniku
 {
     DX12::DX12(ERenderer type)
         : type_{ type }
+        , tracker_{ true }
         , _commands{}
     {
         _commands.reserve(MAX_COMMAND_QUEUE);
@@ -141,9 +144,24 @@ namespace ninniku
 
         ExecuteCommand(cmdList);
 
+        AddStat(SC_Copies);
+
         return true;
     }
 
+    FenceHandle DX12::CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        if (!CopyBufferResource(params))
+            return FenceHandle();
+
+        return SubmitAsync();
+    }
+
     std::tuple<uint32_t, uint32_t> DX12::CopyTextureSubresource(const CopyTextureSubresourceParam& params)
     {
         TRACE_SCOPED_DX12;
@@ -217,6 +235,8 @@ namespace ninniku
 
         ExecuteCommand(cmdList);
 
+        AddStat(SC_Copies);
+
         return { srcSub, dstSub };
     }
 
@@ -315,8 +335,6 @@ namespace ninniku
 
         auto impl = std::make_shared<DX12BufferInternal>();
 
-        tracker_.RegisterObject(impl);
-
         impl->_desc = params;
 
         D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE;
@@ -360,7 +378,11 @@ namespace ninniku
             impl->_uav.reset(uav);
         }
 
-        return std::make_unique<DX12BufferImpl>(impl);
+        auto res = std::make_unique<DX12BufferImpl>(impl);
+
+        res->_tracked = tracker_.RegisterObject(impl, bufferSize);
+
+        return res;
     }
 
     BufferHandle DX12::CreateBuffer(const TextureParamHandle& params)
@@ -377,8 +399,6 @@ namespace ninniku
 
         auto impl = std::make_shared<DX12BufferInternal>();
 
-        tracker_.RegisterObject(impl);
-
         auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
         auto desc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_NONE);
 
@@ -393,7 +413,11 @@ namespace ninniku
         if (CheckAPIFailed(hr, "ID3D12Device::CreateCommittedResource"))
             return BufferHandle();
 
-        return std::make_unique<DX12BufferImpl>(impl);
+        auto res = std::make_unique<DX12BufferImpl>(impl);
+
+        res->_tracked = tracker_.RegisterObject(impl, bufferSize);
+
+        return res;
     }
 
     BufferHandle DX12::CreateBuffer(const BufferHandle& src)
@@ -462,6 +486,40 @@ namespace ninniku
         return dst;
     }
 
+    std::pair<uint64_t, DX12Resource>* DX12::AcquireConstantBufferUpload(DX12ConstantBuffer& cbuffer, const std::string_view& name)
+    {
+        TRACE_SCOPED_DX12;
+
+        // reuse one the GPU is done with so updating a constant buffer never waits for work in flight
+        auto completed = fence_->GetCompletedValue();
+        auto found = std::find_if(cbuffer.uploads_.begin(), cbuffer.uploads_.end(), [completed](const auto& upload) { return upload.first <= completed; });
+
+        if (found != cbuffer.uploads_.end())
+            return &(*found);
+
+        auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+        auto desc = CD3DX12_RESOURCE_DESC::Buffer(cbuffer.size_);
+        DX12Resource upload;
+
+        auto hr = device_->CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &desc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(upload.GetAddressOf()));
+
+        if (CheckAPIFailed(hr, "ID3D12Device::CreateCommittedResource (upload)"))
+            return nullptr;
+
+        auto fmt = boost::format("Constant Buffer \"%1%\" Upload %2%") % name % cbuffer.uploads_.size();
+        upload->SetName(strToWStr(boost::str(fmt)).c_str());
+
+        cbuffer.uploads_.emplace_back(0, std::move(upload));
+
+        return &cbuffer.uploads_.back();
+    }
+
     DX12::CommandList* DX12::CreateCommandList(EQueueType type)
     {
         TRACE_SCOPED_DX12;
@@ -495,6 +553,10 @@ namespace ninniku
 
             res.process_bytes(kvp.first.c_str(), kvp.first.size());
 
+            // already created by a previous load
+            if (commandContexts_.find(res.checksum()) != commandContexts_.end())
+                continue;
+
             auto context = std::make_shared<DX12CommandInternal>(res.checksum());
 
             // find the shader bytecode
@@ -577,21 +639,11 @@ namespace ninniku
         auto fmt = boost::format("Constant Buffer \"%1%\"") % name;
         cbuffer.resource_->SetName(strToWStr(boost::str(fmt)).c_str());
 
-        heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-        hr = device_->CreateCommittedResource(
-            &heapProperties,
-            D3D12_HEAP_FLAG_NONE,
-            &desc,
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(cbuffer.upload_.GetAddressOf()));
+        auto upload = AcquireConstantBufferUpload(cbuffer, name);
 
-        if (CheckAPIFailed(hr, "ID3D12Device::CreateCommittedResource (upload)"))
+        if (upload == nullptr)
             return false;
 
-        fmt = boost::format("Constant Buffer \"%1%\" Upload") % name;
-        cbuffer.upload_->SetName(strToWStr(boost::str(fmt)).c_str());
-
         D3D12_SUBRESOURCE_DATA subdata = {};
         subdata.pData = data;
         subdata.RowPitch = cbuffer.size_;
@@ -607,7 +659,7 @@ namespace ninniku
         auto transition = CD3DX12_RESOURCE_BARRIER::Transition(cbuffer.resource_.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
 
         cmdList->gfxCmdList->ResourceBarrier(1, &transition);
-        UpdateSubresources(cmdList->gfxCmdList.Get(), cbuffer.resource_.Get(), cbuffer.upload_.Get(), 0, 0, 1, &subdata);
+        UpdateSubresources(cmdList->gfxCmdList.Get(), cbuffer.resource_.Get(), upload->second.Get(), 0, 0, 1, &subdata);
 
         ExecuteCommand(cmdList);
 
@@ -624,6 +676,12 @@ namespace ninniku
 
         ExecuteCommand(cmdList);
 
+        // submitted now so the fence value of the copy is known
+        if (!Flush(false))
+            return false;
+
+        upload->first = fenceValue_;
+
         return true;
     }
 
@@ -787,6 +845,38 @@ namespace ninniku
         return true;
     }
 
+    void DX12::CreateShaderBindings(const std::string_view& name, const ShaderReflection& reflection)
+    {
+        MapNameSlot bindings;
+
+        bindings.reserve(reflection.bindings.size());
+
+        for (auto& binding : reflection.bindings) {
+            D3D12_SHADER_INPUT_BIND_DESC bindDesc = {};
+
+            // bindings are looked up by key, the reflection which owned the name is gone anyway
+            bindDesc.Name = nullptr;
+            bindDesc.Type = static_cast<D3D_SHADER_INPUT_TYPE>(binding.type);
+            bindDesc.BindPoint = binding.bindPoint;
+            bindDesc.BindCount = binding.bindCount;
+            bindDesc.uFlags = binding.flags;
+            bindDesc.ReturnType = static_cast<D3D_RESOURCE_RETURN_TYPE>(binding.returnType);
+            bindDesc.Dimension = static_cast<D3D_SRV_DIMENSION>(binding.dimension);
+            bindDesc.NumSamples = binding.numSamples;
+            bindDesc.Space = binding.space;
+            bindDesc.uID = binding.id;
+
+            // if the texture is a constant buffer, we want to create it a slot for it in the map
+            if (bindDesc.Type == D3D_SIT_CBUFFER) {
+                cBuffers_.emplace(binding.name, DX12ConstantBuffer{});
+            }
+
+            bindings.emplace(binding.name, bindDesc);
+        }
+
+        resourceBindings_.emplace(name, std::move(bindings));
+    }
+
     TextureHandle DX12::CreateTexture(const TextureParamHandle& params)
     {
         TRACE_SCOPED_DX12;
@@ -805,13 +895,10 @@ namespace ninniku
         auto isCubeArray = is2d && (params->arraySize > CUBEMAP_NUM_FACES) && ((params->arraySize % CUBEMAP_NUM_FACES) == 0);
         auto haveData = !params->imageDatas.empty();
 
-        auto fmt = boost::format("Creating Texture: Size=%1%x%2%, Mips=%3% InitialData=%4%") % params->width % params->height % params->numMips % params->imageDatas.size();
-        LOGD << boost::str(fmt);
+        LOGDF(boost::format("Creating Texture: Size=%1%x%2%, Mips=%3% InitialData=%4%") % params->width % params->height % params->numMips % params->imageDatas.size());
 
         auto impl = std::make_shared<DX12TextureInternal>();
 
-        tracker_.RegisterObject(impl);
-
         impl->desc_ = params;
 
         D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE;
@@ -869,6 +956,8 @@ namespace ninniku
         if (CheckAPIFailed(hr, "ID3D12Device::CreateCommittedResource"))
             return TextureHandle();
 
+        auto allocSize = device_->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+
         if (haveData) {
             DX12Resource upload;
 
@@ -932,6 +1021,8 @@ namespace ninniku
 
             if (!Flush())
                 return TextureHandle();
+
+            AddStat(SC_BytesUploaded, reqSize);
         }
 
         if (isSRV) {
@@ -983,13 +1074,45 @@ namespace ninniku
             }
         }
 
-        return std::make_unique<DX12TextureImpl>(impl);
+        auto res = std::make_unique<DX12TextureImpl>(impl);
+
+        res->tracked_ = tracker_.RegisterObject(impl, allocSize);
+
+        return res;
     }
 
     bool DX12::Dispatch(const CommandHandle& cmd)
     {
         TRACE_SCOPED_DX12;
 
+        ScopedLatency latency{ SL_Dispatch };
+
+        if (!RecordDispatch(cmd))
+            return false;
+
+        return Flush();
+    }
+
+    FenceHandle DX12::DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        if (!RecordDispatch(cmd))
+            return FenceHandle();
+
+        return SubmitAsync();
+    }
+
+    bool DX12::RecordDispatch(const CommandHandle& cmd, ID3D12GraphicsCommandList* graphCmdList)
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!LoadLazyShader(cmd->shader))
+            return false;
+
         DX12Command* dxCmd = static_cast<DX12Command*>(cmd.get());
 
         auto shaderHash = dxCmd->GetHashShader();
@@ -1004,8 +1127,7 @@ namespace ninniku
             auto foundContext = commandContexts_.find(shaderHash);
 
             if (foundContext == commandContexts_.end()) {
-                auto fmt = boost::format("Dispatch error: could not find command context for shader \"%1%\". Did you forget to load the shader ?") % cmd->shader;
-                LOGE << boost::str(fmt);
+                LOGEF(boost::format("Dispatch error: could not find command context for shader \"%1%\". Did you forget to load the shader ?") % cmd->shader);
                 return false;
             }
 
@@ -1069,6 +1191,28 @@ namespace ninniku
             }
         }
 
+        auto recordDispatch = [&](ID3D12GraphicsCommandList* gfxCmdList)
+        {
+            gfxCmdList->SetPipelineState(context->pipelineState_.Get());
+            gfxCmdList->SetComputeRootSignature(context->rootSignature_.Get());
+
+            gfxCmdList->SetDescriptorHeaps(descriptorHeapCount, descriptorHeaps.data());
+
+            for (auto i = 0u; i < descriptorHeapCount; ++i) {
+                gfxCmdList->SetComputeRootDescriptorTable(i, descriptorHeaps[i]->GetGPUDescriptorHandleForHeapStart());
+            }
+
+            gfxCmdList->Dispatch(cmd->dispatch[0], cmd->dispatch[1], cmd->dispatch[2]);
+
+            AddStat(SC_Dispatches);
+        };
+
+        // a graph already took care of the transitions
+        if (graphCmdList != nullptr) {
+            recordDispatch(graphCmdList);
+            return true;
+        }
+
         // resources view are bound in the descriptor heap but we still need to transition their states before we create the views
         bool uavWholeResAll = false;
         bool srvAllNull = true;
@@ -1159,8 +1303,7 @@ namespace ninniku
                 auto found = bindings.find(kvp.first);
 
                 if (found == bindings.end()) {
-                    auto fmt = boost::format("Dispatch error: could not find resource bindings for \"%1%\" in \"%2%\"") % kvp.first % cmd->shader;
-                    LOGE << boost::str(fmt);
+                    LOGEF(boost::format("Dispatch error: could not find resource bindings for \"%1%\" in \"%2%\"") % kvp.first % cmd->shader);
                     return false;
                 }
 
@@ -1220,16 +1363,7 @@ namespace ninniku
             return false;
         }
 
-        cmdList->gfxCmdList->SetPipelineState(context->pipelineState_.Get());
-        cmdList->gfxCmdList->SetComputeRootSignature(context->rootSignature_.Get());
-
-        cmdList->gfxCmdList->SetDescriptorHeaps(descriptorHeapCount, descriptorHeaps.data());
-
-        for (auto i = 0u; i < descriptorHeapCount; ++i) {
-            cmdList->gfxCmdList->SetComputeRootDescriptorTable(i, descriptorHeaps[i]->GetGPUDescriptorHandleForHeapStart());
-        }
-
-        cmdList->gfxCmdList->Dispatch(cmd->dispatch[0], cmd->dispatch[1], cmd->dispatch[2]);
+        recordDispatch(cmdList->gfxCmdList.Get());
 
         ExecuteCommand(cmdList);
 
@@ -1289,9 +1423,6 @@ namespace ninniku
             ExecuteCommand(cmdListUAV);
         }
 
-        if (!Flush())
-            return false;
-
         return true;
     }
 
@@ -1333,7 +1464,7 @@ namespace ninniku
     {
         TRACE_SCOPED_DX12;
 
-        if (!_commands.empty()) {
+        if (!_commands.empty() || !inFlight_.empty()) {
             if (!Flush())
                 throw std::exception("Finalize flush failed");
         }
@@ -1343,16 +1474,21 @@ namespace ninniku
         tracker_.ReleaseObjects();
     }
 
-    bool DX12::Flush()
+    bool DX12::Flush(bool wait)
     {
         TRACE_SCOPED_DX12;
 
+        ScopedLatency latency{ SL_Flush };
+
         if (Globals::Instance().safeAndSlowDX12) {
+            // ExecuteCommand already waited so nothing can be in flight
+            ReleaseDeferred();
             return true;
         }
 
-        if (_commands.empty()) {
+        if (_commands.empty() && inFlight_.empty()) {
             LOGW << "Flush() was called but the command list was empty";
+            ReleaseDeferred();
             return true;
         }
 
@@ -1402,21 +1538,100 @@ namespace ninniku
                 break;
             }
 
-            iter->~CommandList();
-            poolCmd_.free(iter);
+            // the GPU may still be using it
+            inFlight_.emplace_back(fenceValue, iter);
         }
 
-        if (fenceValue != std::numeric_limits<uint64_t>::max()) {
-            // we still need to wait for commands to finish running
-            auto hr = fence_->SetEventOnCompletion(fenceValue, fenceEvent_);
+        _commands.clear();
 
-            if (CheckAPIFailed(hr, "ID3D12Fence::SetEventOnCompletion"))
-                return false;
+        if (!wait) {
+            RetireCommands();
+            return true;
+        }
 
-            WaitForSingleObject(fenceEvent_, INFINITE);
+        // we still need to wait for commands to finish running
+        return WaitForInFlight();
+    }
+
+    bool DX12::GetGraphAccesses(const CommandHandle& cmd, std::vector<GraphAccess>& accesses)
+    {
+        accesses.clear();
+
+        for (auto& kvp : cmd->srvBindings) {
+            auto dxSRV = static_cast<const DX12ShaderResourceView*>(kvp.second);
+
+            // null SRV are allowed to mimic DX11
+            if (dxSRV == nullptr)
+                continue;
+
+            if (std::holds_alternative<std::weak_ptr<DX12BufferInternal>>(dxSRV->resource_)) {
+                auto weak = std::get<std::weak_ptr<DX12BufferInternal>>(dxSRV->resource_);
+
+                if (CheckWeakExpired(weak))
+                    return false;
+
+                accesses.push_back(GraphAccess{ weak.lock()->_buffer.Get(), 1, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_ShaderResource });
+            } else {
+                auto weak = std::get<std::weak_ptr<DX12TextureInternal>>(dxSRV->resource_);
+
+                if (CheckWeakExpired(weak))
+                    return false;
+
+                auto locked = weak.lock();
+
+                accesses.push_back(GraphAccess{ locked->texture_.Get(), locked->desc_->numMips * locked->desc_->arraySize, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_ShaderResource });
+            }
         }
 
-        _commands.clear();
+        for (auto& kvp : cmd->uavBindings) {
+            auto dxUAV = static_cast<const DX12UnorderedAccessView*>(kvp.second);
+
+            if (std::holds_alternative<std::weak_ptr<DX12BufferInternal>>(dxUAV->resource_)) {
+                auto weak = std::get<std::weak_ptr<DX12BufferInternal>>(dxUAV->resource_);
+
+                if (CheckWeakExpired(weak))
+                    return false;
+
+                accesses.push_back(GraphAccess{ weak.lock()->_buffer.Get(), 1, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_UnorderedAccess });
+            } else {
+                auto weak = std::get<std::weak_ptr<DX12TextureInternal>>(dxUAV->resource_);
+
+                if (CheckWeakExpired(weak))
+                    return false;
+
+                auto locked = weak.lock();
+                auto numMips = locked->desc_->numMips;
+                auto numSubresources = numMips * locked->desc_->arraySize;
+
+                if (dxUAV->index_ == std::numeric_limits<uint32_t>::max()) {
+                    accesses.push_back(GraphAccess{ locked->texture_.Get(), numSubresources, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_UnorderedAccess });
+                } else {
+                    // the mip of every slice
+                    for (auto i = 0u; i < locked->desc_->arraySize; ++i) {
+                        accesses.push_back(GraphAccess{ locked->texture_.Get(), numSubresources, numMips * i + dxUAV->index_, EResourceState::RS_UnorderedAccess });
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool DX12::GetShaderReflection(IDxcBlobEncoding* pBlob, ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_DX12;
+
+        auto key = ReflectionCache::GetKey(pBlob->GetBufferPointer(), pBlob->GetBufferSize());
+
+        if (reflectionCache_.Find(key, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), reflection)) {
+            LOGD << "Found reflection in cache";
+            return true;
+        }
+
+        if (!ReflectShader(pBlob, reflection))
+            return false;
+
+        reflectionCache_.Add(key, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), reflection);
 
         return true;
     }
@@ -1472,6 +1687,12 @@ namespace ninniku
 
                 if (CheckAPIFailed(hr, "ID3D12Device::CreateCommandList"))
                     return false;
+            } else {
+                // graph batches run concurrently on the different queues so each signals its own fence
+                hr = device_->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&queues_[iter].graphFence));
+
+                if (CheckAPIFailed(hr, "ID3D12Device::CreateFence"))
+                    return false;
             }
         }
 
@@ -1498,12 +1719,12 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX12("ninniku::DX12::LoadShader (path)");
 
+        ScopedLatency latency{ SL_ShaderLoad };
+
         if (std::filesystem::is_directory(path)) {
             return LoadShaders(path);
         } else if (path.extension() == ShaderExt) {
-            auto fmt = boost::format("Loading %1%..") % path;
-
-            LOG_INDENT_START << boost::str(fmt);
+            LOG_INDENT_START << boost::format("Loading %1%..") % path;
 
             IDxcLibrary* pLibrary = GetDXCLibrary();
 
@@ -1514,14 +1735,7 @@ namespace ninniku
 
             Microsoft::WRL::ComPtr<IDxcBlobEncoding> pBlob = nullptr;
 
-            auto hr = pLibrary->CreateBlobFromFile(ninniku::strToWStr(path.string()).c_str(), nullptr, &pBlob);
-
-            if (CheckAPIFailed(hr, "IDxcLibrary::CreateBlobFromFile")) {
-                LOG_INDENT_END;
-                return false;
-            }
-
-            if (!ValidateDXCBlob(pBlob.Get(), pLibrary)) {
+            if (!ReadShaderBlob(path, pLibrary, pBlob.GetAddressOf())) {
                 LOG_INDENT_END;
                 return false;
             }
@@ -1541,9 +1755,9 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX12("ninniku::DX12::LoadShader (string, void*, uint32_t)");
 
-        auto fmt = boost::format("Loading %1% directly from memory..") % name;
+        ScopedLatency latency{ SL_ShaderLoad };
 
-        LOG_INDENT_START << boost::str(fmt);
+        LOG_INDENT_START << boost::format("Loading %1% directly from memory..") % name;
 
         IDxcLibrary* pLibrary = GetDXCLibrary();
 
@@ -1580,77 +1794,35 @@ namespace ninniku
     {
         TRACE_SCOPED_NAMED_DX12("ninniku::DX12::LoadShader (path, IDxcBlobEncoding)");
 
-        auto name = path.stem().string();
-        Microsoft::WRL::ComPtr<IDxcContainerReflection> pContainerReflection;
-
-        auto hr = DxcCreateInstance(CLSID_DxcContainerReflection, __uuidof(IDxcContainerReflection), (void**)&pContainerReflection);
+        ShaderReflection reflection;
 
-        if (CheckAPIFailed(hr, "DxcCreateInstance for CLSID_DxcContainerReflection"))
+        if (!GetShaderReflection(pBlob, reflection))
             return false;
 
-        hr = pContainerReflection->Load(pBlob);
-
-        if (CheckAPIFailed(hr, "IDxcContainerReflection::Load"))
+        if (!RegisterShader(path.stem().string(), pBlob, reflection))
             return false;
 
-        uint32_t partCount;
-
-        hr = pContainerReflection->GetPartCount(&partCount);
-
-        if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartCount"))
+        // Create command contexts for all the shaders we just found
+        if (!CreateCommandContexts())
             return false;
 
-        for (uint32_t i = 0; i < partCount; ++i) {
-            uint32_t partKind;
-
-            hr = pContainerReflection->GetPartKind(i, &partKind);
-
-            if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartKind"))
-                return false;
-
-            if (partKind == static_cast<uint32_t>(hlsl::DxilFourCC::DFCC_DXIL)) {
-                IDxcBlob* pShaderBlob;
-                hr = pContainerReflection->GetPartContent(i, &pShaderBlob);
-
-                if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartContent"))
-                    return false;
-
-                Microsoft::WRL::ComPtr<ID3D12ShaderReflection> pShaderReflection;
-
-                hr = pContainerReflection->GetPartReflection(i, IID_PPV_ARGS(&pShaderReflection));
-
-                if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartReflection"))
-                    return false;
-
-                D3D12_SHADER_DESC pShaderDesc;
-                hr = pShaderReflection->GetDesc(&pShaderDesc);
-
-                if (CheckAPIFailed(hr, "ID3D12ShaderReflection::GetDesc"))
-                    return false;
-
-                if (!ParseShaderResources(name, pShaderDesc.BoundResources, pShaderReflection.Get()))
-                    return false;
-            } else if (partKind == static_cast<uint32_t>(hlsl::DxilFourCC::DFCC_RootSignature)) {
-                Microsoft::WRL::ComPtr<IDxcBlob> pRSBlob;
-                hr = pContainerReflection->GetPartContent(i, &pRSBlob);
+        return true;
+    }
 
-                if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartContent"))
-                    return false;
+    bool DX12::LoadLazyShader(const std::string_view& name)
+    {
+        if (lazyShaders_.empty() || (shaders_.find(name) != shaders_.end()))
+            return true;
 
-                if (!ParseRootSignature(name, pBlob))
-                    return false;
-            }
-        }
+        auto found = lazyShaders_.find(name);
 
-        // store shader
-        LOGDF(boost::format("Adding CS: \"%1%\" to library") % name);
-        shaders_.emplace(name, CD3DX12_SHADER_BYTECODE(pBlob->GetBufferPointer(), pBlob->GetBufferSize()));
+        // let the caller report unknown shaders
+        if (found == lazyShaders_.end())
+            return true;
 
-        // Create command contexts for all the shaders we just found
-        if (!CreateCommandContexts())
-            return false;
+        LOGDF(boost::format("Lazy loading shader \"%1%\"") % name);
 
-        return true;
+        return LoadShader(found->second);
     }
 
     /// <summary>
@@ -1662,36 +1834,75 @@ namespace ninniku
 
         // check if directory is valid
         if (!std::filesystem::is_directory(shaderPath)) {
-            auto fmt = boost::format("Failed to open directory: %1%") % shaderPath;
-            LOGE << boost::str(fmt);
+            LOGEF(boost::format("Failed to open directory: %1%") % shaderPath);
 
             return false;
         }
 
-        // Count the number of .dxco found
-        std::filesystem::directory_iterator begin(shaderPath), end;
+        // the iterator already goes through sub folders
+        std::vector<std::filesystem::path> paths;
+
+        for (auto& iter : std::filesystem::recursive_directory_iterator(shaderPath)) {
+            if (!iter.is_directory() && (iter.path().extension() == ShaderExt))
+                paths.emplace_back(iter.path());
+        }
+
+        LOGDF(boost::format("Found %1% compiled shaders in %2%") % paths.size() % shaderPath);
 
-        auto fileCounter = [&](const std::filesystem::directory_entry& d)
+        if (Globals::Instance().lazyShaderLoading_) {
+            for (auto& path : paths) {
+                lazyShaders_.emplace(path.stem().string(), path);
+            }
+
+            return true;
+        }
+
+        auto cachePath = shaderPath / ReflectionCache::FileName;
+
+        reflectionCache_.Load(cachePath);
+
+        struct LoadedShader
         {
-            return (!is_directory(d.path()) && (d.path().extension() == ShaderExt));
+            Microsoft::WRL::ComPtr<IDxcBlobEncoding> blob;
+            ShaderReflection reflection;
+            bool valid;
         };
 
-        auto numFiles = std::count_if(begin, end, fileCounter);
-        auto fmt = boost::format("Found %1% compiled shaders in %2%") % numFiles % shaderPath;
+        std::vector<LoadedShader> loaded(paths.size());
+
+        // reading, validating and reflecting doesn't touch the device or the maps so each shader can go wide
+        ParallelFor(Globals::Instance().threadPool_.get(), static_cast<uint32_t>(paths.size()), 1, [&](uint32_t begin, uint32_t end)
+        {
+            // DXC doesn't document its objects as thread safe so each worker gets its own library
+            Microsoft::WRL::ComPtr<IDxcLibrary> pLibrary;
 
-        LOGD << boost::str(fmt);
+            if (!CreateDXCLibrary(pLibrary.GetAddressOf()))
+                return;
 
-        for (auto& iter : std::filesystem::recursive_directory_iterator(shaderPath)) {
-            LoadShader(iter.path());
+            for (auto i = begin; i < end; ++i) {
+                auto& shader = loaded[i];
+
+                shader.valid = ReadShaderBlob(paths[i], pLibrary.Get(), shader.blob.GetAddressOf()) && GetShaderReflection(shader.blob.Get(), shader.reflection);
+            }
+        });
+
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (loaded[i].valid)
+                RegisterShader(paths[i].stem().string(), loaded[i].blob.Get(), loaded[i].reflection);
         }
 
-        return true;
+        reflectionCache_.Save(cachePath);
+
+        // the pipeline states must be created while the blobs are still alive
+        return CreateCommandContexts();
     }
 
     MappedResourceHandle DX12::Map(const BufferHandle& bObj)
     {
         TRACE_SCOPED_DX12;
 
+        ScopedLatency latency{ SL_Map };
+
         auto impl = static_cast<const DX12BufferImpl*>(bObj.get());
 
         if (CheckWeakExpired(impl->_impl))
@@ -1713,37 +1924,151 @@ namespace ninniku
         throw std::exception("not implemented");
     }
 
-    bool DX12::ParseRootSignature(const std::string_view& name, IDxcBlobEncoding* pBlob)
+    ReadbackHandle DX12::ReadbackTexture(const ReadbackTextureParam& params)
     {
         TRACE_SCOPED_DX12;
 
-        DX12RootSignature rootSignature;
+        auto texImpl = static_cast<const DX12TextureImpl*>(params.src);
 
-        auto hr = device_->CreateRootSignature(0, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+        if (CheckWeakExpired(texImpl->impl_))
+            return ReadbackHandle();
 
-        if (CheckAPIFailed(hr, "ID3D12Device::CreateRootSignature"))
-            return false;
+        auto texInternal = texImpl->impl_.lock();
+        auto texDesc = params.src->GetDesc();
 
-        LOGD << "Found a root signature";
+        if ((params.numFaces == 0) || (params.firstFace + params.numFaces > texDesc->arraySize)) {
+            LOGEF(boost::format("ReadbackTexture error: faces [%1%, %2%) are out of range for an array of %3%") % params.firstFace % (params.firstFace + params.numFaces) % texDesc->arraySize);
+            return ReadbackHandle();
+        }
 
-        rootSignature->SetName(strToWStr(name).c_str());
+        // every subresource is placed in the same readback buffer
+        auto numSubresources = params.numFaces * texDesc->numMips;
+        auto firstSubresource = D3D12CalcSubresource(0, params.firstFace, 0, texDesc->numMips, texDesc->arraySize);
+        auto resourceDesc = texInternal->texture_->GetDesc();
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(numSubresources);
+        uint64_t bufferSize = 0;
 
-        // for now create a root signature per shader
-        rootSignatures_.emplace(name, std::move(rootSignature));
+        device_->GetCopyableFootprints(&resourceDesc, firstSubresource, numSubresources, 0, footprints.data(), nullptr, nullptr, &bufferSize);
 
-        return true;
-    }
+        LOGDF(boost::format("Creating readback buffer: Subresources=%1%, Size=%2%") % numSubresources % bufferSize);
 
-    bool DX12::ParseShaderResources(const std::string_view& name, uint32_t numBoundResources, ID3D12ShaderReflection* pReflection)
-    {
-        TRACE_SCOPED_DX12;
+        DX12Resource readback;
+        auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+        auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_NONE);
+
+        auto hr = device_->CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &bufferDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(readback.GetAddressOf()));
+
+        if (CheckAPIFailed(hr, "ID3D12Device::CreateCommittedResource"))
+            return ReadbackHandle();
+
+        // transition
+        auto cmdList = CreateCommandList(QT_TRANSITION);
+
+        if (cmdList == nullptr)
+            return ReadbackHandle();
+
+        auto srv2common = CD3DX12_RESOURCE_BARRIER::Transition(texInternal->texture_.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON);
+
+        cmdList->gfxCmdList->ResourceBarrier(1, &srv2common);
+        ExecuteCommand(cmdList);
+
+        // record all the copies in one list
+        cmdList = CreateCommandList(QT_COPY);
+
+        if (cmdList == nullptr)
+            return ReadbackHandle();
+
+        auto common2src = CD3DX12_RESOURCE_BARRIER::Transition(texInternal->texture_.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+        cmdList->gfxCmdList->ResourceBarrier(1, &common2src);
+
+        for (uint32_t i = 0; i < numSubresources; ++i) {
+            auto texLoc = CD3DX12_TEXTURE_COPY_LOCATION(texInternal->texture_.Get(), firstSubresource + i);
+            auto bufferLoc = CD3DX12_TEXTURE_COPY_LOCATION{ readback.Get(), footprints[i] };
+
+            cmdList->gfxCmdList->CopyTextureRegion(&bufferLoc, 0, 0, 0, &texLoc, nullptr);
+        }
+
+        ExecuteCommand(cmdList);
+
+        // transition
+        cmdList = CreateCommandList(QT_TRANSITION);
+
+        if (cmdList == nullptr)
+            return ReadbackHandle();
+
+        auto src2srv = CD3DX12_RESOURCE_BARRIER::Transition(texInternal->texture_.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+        cmdList->gfxCmdList->ResourceBarrier(1, &src2srv);
+        ExecuteCommand(cmdList);
+
+        // single wait for everything
+        if (!Flush())
+            return ReadbackHandle();
+
+        void* data = nullptr;
+
+        hr = readback->Map(0, nullptr, &data);
+
+        if (CheckAPIFailed(hr, "ID3D12Resource::Map"))
+            return ReadbackHandle();
+
+        auto res = std::make_unique<Readback>();
+
+        res->subresources.reserve(numSubresources);
+
+        for (uint32_t face = 0; face < params.numFaces; ++face) {
+            for (uint32_t mip = 0; mip < texDesc->numMips; ++mip) {
+                auto& footprint = footprints[mip + face * texDesc->numMips];
+
+                res->subresources.push_back({ params.firstFace + face, mip, static_cast<const uint8_t*>(data) + footprint.Offset, footprint.Footprint.RowPitch });
+            }
+        }
+
+        // also keeps the readback buffer alive
+        res->mappings.emplace_back(std::make_unique<DX12MappedResource>(readback, nullptr, 0, data));
+
+        AddStat(SC_BytesReadback, bufferSize);
+
+        return res;
+    }
+
+    bool DX12::ParseRootSignature(const std::string_view& name, IDxcBlobEncoding* pBlob)
+    {
+        TRACE_SCOPED_DX12;
+
+        DX12RootSignature rootSignature;
+
+        auto hr = device_->CreateRootSignature(0, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+
+        if (CheckAPIFailed(hr, "ID3D12Device::CreateRootSignature"))
+            return false;
+
+        LOGD << "Found a root signature";
+
+        rootSignature->SetName(strToWStr(name).c_str());
+
+        // for now create a root signature per shader
+        rootSignatures_.emplace(name, std::move(rootSignature));
+
+        return true;
+    }
+
+    bool DX12::ParseShaderResources(uint32_t numBoundResources, ID3D12ShaderReflection* pReflection, ShaderReflection& res)
+    {
+        TRACE_SCOPED_DX12;
 
         // parse parameter bind slots
-        auto fmt = boost::format("Found %1% resources") % numBoundResources;
 
-        LOGD_INDENT_START << boost::str(fmt);
+        LOGD_INDENT_START << boost::format("Found %1% resources") % numBoundResources;
 
-        StringMap<D3D12_SHADER_INPUT_BIND_DESC> bindings;
+        res.bindings.reserve(numBoundResources);
 
         for (uint32_t i = 0; i < numBoundResources; ++i) {
             D3D12_SHADER_INPUT_BIND_DESC bindDesc;
@@ -1788,20 +2113,24 @@ namespace ninniku
                     return false;
             }
 
-            fmt = boost::format("Resource: Name=\"%1%\", Type=%2%, Slot=%3%") % bindDesc.Name % restypeStr % bindDesc.BindPoint;
+            LOGDF(boost::format("Resource: Name=\"%1%\", Type=%2%, Slot=%3%") % bindDesc.Name % restypeStr % bindDesc.BindPoint);
 
-            LOGD << boost::str(fmt);
+            ShaderBinding binding;
 
-            // if the texture is a constant buffer, we want to create it a slot for it in the map
-            if (bindDesc.Type == D3D_SIT_CBUFFER) {
-                cBuffers_.emplace(bindDesc.Name, DX12ConstantBuffer{});
-            }
+            binding.name = bindDesc.Name;
+            binding.type = bindDesc.Type;
+            binding.bindPoint = bindDesc.BindPoint;
+            binding.bindCount = bindDesc.BindCount;
+            binding.flags = bindDesc.uFlags;
+            binding.returnType = bindDesc.ReturnType;
+            binding.dimension = bindDesc.Dimension;
+            binding.numSamples = bindDesc.NumSamples;
+            binding.space = bindDesc.Space;
+            binding.id = bindDesc.uID;
 
-            bindings.emplace(bindDesc.Name, bindDesc);
+            res.bindings.emplace_back(std::move(binding));
         }
 
-        resourceBindings_.emplace(name, std::move(bindings));
-
         LOGD_INDENT_END;
 
         return true;
@@ -1827,12 +2156,384 @@ namespace ninniku
         }
     }
 
+    bool DX12::ReflectShader(IDxcBlobEncoding* pBlob, ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_DX12;
+
+        Microsoft::WRL::ComPtr<IDxcContainerReflection> pContainerReflection;
+
+        auto hr = DxcCreateInstance(CLSID_DxcContainerReflection, __uuidof(IDxcContainerReflection), (void**)&pContainerReflection);
+
+        if (CheckAPIFailed(hr, "DxcCreateInstance for CLSID_DxcContainerReflection"))
+            return false;
+
+        hr = pContainerReflection->Load(pBlob);
+
+        if (CheckAPIFailed(hr, "IDxcContainerReflection::Load"))
+            return false;
+
+        uint32_t partCount;
+
+        hr = pContainerReflection->GetPartCount(&partCount);
+
+        if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartCount"))
+            return false;
+
+        for (uint32_t i = 0; i < partCount; ++i) {
+            uint32_t partKind;
+
+            hr = pContainerReflection->GetPartKind(i, &partKind);
+
+            if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartKind"))
+                return false;
+
+            if (partKind == static_cast<uint32_t>(hlsl::DxilFourCC::DFCC_DXIL)) {
+                Microsoft::WRL::ComPtr<ID3D12ShaderReflection> pShaderReflection;
+
+                hr = pContainerReflection->GetPartReflection(i, IID_PPV_ARGS(&pShaderReflection));
+
+                if (CheckAPIFailed(hr, "IDxcContainerReflection::GetPartReflection"))
+                    return false;
+
+                D3D12_SHADER_DESC pShaderDesc;
+                hr = pShaderReflection->GetDesc(&pShaderDesc);
+
+                if (CheckAPIFailed(hr, "ID3D12ShaderReflection::GetDesc"))
+                    return false;
+
+                if (!ParseShaderResources(pShaderDesc.BoundResources, pShaderReflection.Get(), reflection))
+                    return false;
+            } else if (partKind == static_cast<uint32_t>(hlsl::DxilFourCC::DFCC_RootSignature)) {
+                reflection.hasRootSignature = true;
+            }
+        }
+
+        return true;
+    }
+
+    bool DX12::ReadShaderBlob(const std::filesystem::path& path, IDxcLibrary* pLibrary, IDxcBlobEncoding** ppBlob)
+    {
+        TRACE_SCOPED_DX12;
+
+        auto hr = pLibrary->CreateBlobFromFile(ninniku::strToWStr(path.string()).c_str(), nullptr, ppBlob);
+
+        if (CheckAPIFailed(hr, "IDxcLibrary::CreateBlobFromFile"))
+            return false;
+
+        return ValidateDXCBlob(*ppBlob, pLibrary);
+    }
+
+    bool DX12::RegisterShader(const std::string_view& name, IDxcBlobEncoding* pBlob, const ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_DX12;
+
+        CreateShaderBindings(name, reflection);
+
+        // the root signature is embedded in the container
+        if (reflection.hasRootSignature && !ParseRootSignature(name, pBlob))
+            return false;
+
+        // store shader
+        LOGDF(boost::format("Adding CS: \"%1%\" to library") % name);
+        shaders_.emplace(name, CD3DX12_SHADER_BYTECODE(pBlob->GetBufferPointer(), pBlob->GetBufferSize()));
+
+        AddStat(SC_ShadersLoaded);
+
+        return true;
+    }
+
+    void DX12::ReleaseDeferred()
+    {
+        TRACE_SCOPED_DX12;
+
+        std::unordered_set<const void*> views;
+
+        tracker_.ReleaseDeferred([&views](const TrackedObject& obj)
+        {
+            if (auto texture = dynamic_cast<const DX12TextureInternal*>(&obj)) {
+                views.insert({ texture->srvDefault_.get(), texture->srvCube_.get(), texture->srvCubeArray_.get(), texture->srvArrayWithMips_.get() });
+
+                for (auto& srv : texture->srvArray_) {
+                    views.insert(srv.get());
+                }
+
+                for (auto& uav : texture->uav_) {
+                    views.insert(uav.get());
+                }
+            } else if (auto buffer = dynamic_cast<const DX12BufferInternal*>(&obj)) {
+                views.insert({ buffer->_srv.get(), buffer->_uav.get() });
+            }
+        });
+
+        views.erase(nullptr);
+
+        if (views.empty())
+            return;
+
+        // subcontexts are looked up by view addresses which the next views created can reuse
+        for (auto& iter : commandContexts_) {
+            auto& subContexts = iter.second->subContexts_;
+
+            for (auto sub = subContexts.begin(); sub != subContexts.end();) {
+                auto& subViews = sub->second.views_;
+                auto stale = std::any_of(subViews.begin(), subViews.end(), [&views](const void* view) { return views.find(view) != views.end(); });
+
+                if (!stale) {
+                    ++sub;
+                    continue;
+                }
+
+                // work submitted so far could still be using the heap
+                retiredHeaps_.emplace_back(fenceValue_, std::move(sub->second._descriptorHeap));
+                sub = subContexts.erase(sub);
+            }
+        }
+    }
+
+    void DX12::RetireCommands()
+    {
+        auto completed = fence_->GetCompletedValue();
+        auto iter = inFlight_.begin();
+
+        // fence values are increasing
+        for (; (iter != inFlight_.end()) && (iter->first <= completed); ++iter) {
+            iter->second->~CommandList();
+            poolCmd_.free(iter->second);
+        }
+
+        inFlight_.erase(inFlight_.begin(), iter);
+
+        // retired in fence order as well
+        auto heap = std::find_if(retiredHeaps_.begin(), retiredHeaps_.end(), [completed](const auto& retired) { return retired.first > completed; });
+
+        retiredHeaps_.erase(retiredHeaps_.begin(), heap);
+
+        // resources released by the user while they were still used by the GPU can go now
+        if (inFlight_.empty())
+            ReleaseDeferred();
+    }
+
+    static D3D12_RESOURCE_STATES GraphStateToDX12(EResourceState state)
+    {
+        switch (state) {
+            case EResourceState::RS_ShaderResource:
+                return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+            case EResourceState::RS_UnorderedAccess:
+                return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+            case EResourceState::RS_CopySource:
+                return D3D12_RESOURCE_STATE_COPY_SOURCE;
+
+            case EResourceState::RS_CopyDest:
+                return D3D12_RESOURCE_STATE_COPY_DEST;
+
+            default:
+                throw std::exception("Invalid EResourceState");
+        }
+    }
+
+    FenceHandle DX12::Submit(const CommandGraph& graph, const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!WaitForFence(waitFor))
+            return FenceHandle();
+
+        auto& nodes = graph.GetNodes();
+
+        // each queue only has a single command list so submit the nodes one by one
+        if (Globals::Instance().safeAndSlowDX12) {
+            for (auto& node : nodes) {
+                if (node.cmd) {
+                    if (!RecordDispatch(node.cmd))
+                        return FenceHandle();
+                } else {
+                    CopyBufferSubresourceParam copyParams = {};
+
+                    copyParams.src = node.src;
+                    copyParams.dst = node.dst;
+
+                    if (!CopyBufferResource(copyParams))
+                        return FenceHandle();
+                }
+            }
+
+            return SubmitAsync();
+        }
+
+        std::vector<GraphPass> passes(nodes.size());
+
+        // resources used by copies, indexed by pass
+        std::vector<std::tuple<ID3D12Resource*, ID3D12Resource*>> copies(nodes.size());
+
+        for (auto i = 0u; i < nodes.size(); ++i) {
+            auto& node = nodes[i];
+            auto& pass = passes[i];
+
+            if (node.cmd) {
+                pass.queue = EGraphQueue::GQ_Compute;
+
+                if (!GetGraphAccesses(node.cmd, pass.accesses))
+                    return FenceHandle();
+            } else {
+                pass.queue = EGraphQueue::GQ_Copy;
+
+                auto srcImpl = static_cast<const DX12BufferImpl*>(node.src);
+                auto dstImpl = static_cast<const DX12BufferImpl*>(node.dst);
+
+                if (CheckWeakExpired(srcImpl->_impl) || CheckWeakExpired(dstImpl->_impl))
+                    return FenceHandle();
+
+                auto src = srcImpl->_impl.lock()->_buffer.Get();
+                auto dst = dstImpl->_impl.lock()->_buffer.Get();
+
+                copies[i] = { src, dst };
+
+                pass.accesses.push_back(GraphAccess{ src, 1, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_CopySource });
+
+                // readback buffers are always D3D12_RESOURCE_STATE_COPY_DEST
+                if ((dstImpl->GetDesc()->viewflags & EResourceViews::RV_CPU_READ) == 0)
+                    pass.accesses.push_back(GraphAccess{ dst, 1, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_CopyDest });
+            }
+        }
+
+        CompiledGraph compiled;
+
+        if (!CompileGraph(passes, compiled))
+            return FenceHandle();
+
+        // work queued before the graph goes first and every batch waits for it
+        if (!_commands.empty() && !Flush(false))
+            return FenceHandle();
+
+        auto startValue = fenceValue_;
+        std::vector<uint64_t> batchValues(compiled.batches.size());
+        std::vector<CommandList*> cmdLists;
+        std::vector<D3D12_RESOURCE_BARRIER> barriers;
+        std::array<bool, QT_COUNT> used = {};
+
+        auto toQueueType = [](EGraphQueue queue)
+        {
+            return (queue == EGraphQueue::GQ_Copy) ? QT_COPY : QT_COMPUTE;
+        };
+
+        for (auto i = 0u; i < compiled.batches.size(); ++i) {
+            auto& batch = compiled.batches[i];
+            auto type = toQueueType(batch.queue);
+            auto cmdList = CreateCommandList(type);
+
+            if (cmdList == nullptr)
+                return FenceHandle();
+
+            cmdLists.push_back(cmdList);
+
+            for (auto& step : batch.steps) {
+                if (!step.barriers.empty()) {
+                    barriers.clear();
+
+                    for (auto& barrier : step.barriers) {
+                        auto resource = static_cast<ID3D12Resource*>(const_cast<void*>(barrier.resource));
+
+                        if (barrier.before == barrier.after) {
+                            barriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+                        } else {
+                            barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, GraphStateToDX12(barrier.before), GraphStateToDX12(barrier.after), barrier.subresource));
+                        }
+                    }
+
+                    cmdList->gfxCmdList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+                }
+
+                if (step.pass == GraphStep::NO_PASS)
+                    continue;
+
+                auto& node = nodes[step.pass];
+
+                if (node.cmd) {
+                    if (!RecordDispatch(node.cmd, cmdList->gfxCmdList.Get()))
+                        return FenceHandle();
+                } else {
+                    cmdList->gfxCmdList->CopyResource(std::get<1>(copies[step.pass]), std::get<0>(copies[step.pass]));
+                    AddStat(SC_Copies);
+                }
+            }
+
+            cmdList->gfxCmdList->Close();
+
+            auto& queue = queues_[type];
+
+            if (!used[type]) {
+                queue.cmdQueue->Wait(fence_.Get(), startValue);
+                used[type] = true;
+            }
+
+            for (auto dependency : batch.waits) {
+                if (dependency != GraphBatch::NO_WAIT)
+                    queue.cmdQueue->Wait(queues_[toQueueType(compiled.batches[dependency].queue)].graphFence.Get(), batchValues[dependency]);
+            }
+
+            std::array<ID3D12CommandList*, 1> pCommandLists = { cmdList->gfxCmdList.Get() };
+
+            queue.cmdQueue->ExecuteCommandLists(1, pCommandLists.data());
+
+            batchValues[i] = ++queue.graphFenceValue;
+
+            auto hr = queue.cmdQueue->Signal(queue.graphFence.Get(), batchValues[i]);
+
+            if (CheckAPIFailed(hr, "ID3D12CommandQueue::Signal"))
+                return FenceHandle();
+        }
+
+        // join everything on the main fence so the graph is ordered with the work submitted after it
+        auto& joinQueue = queues_[QT_COMPUTE];
+
+        if (used[QT_COPY])
+            joinQueue.cmdQueue->Wait(queues_[QT_COPY].graphFence.Get(), queues_[QT_COPY].graphFenceValue);
+
+        uint64_t fenceValue = InterlockedIncrement(&fenceValue_);
+        auto hr = joinQueue.cmdQueue->Signal(fence_.Get(), fenceValue);
+
+        if (CheckAPIFailed(hr, "ID3D12CommandQueue::Signal"))
+            return FenceHandle();
+
+        // Flush only waits on values signaled before it so the other queues must not run ahead of the join
+        for (auto i = 0u; i < QT_COUNT; ++i) {
+            if (i != QT_COMPUTE)
+                queues_[i].cmdQueue->Wait(fence_.Get(), fenceValue);
+        }
+
+        for (auto cmdList : cmdLists) {
+            inFlight_.emplace_back(fenceValue, cmdList);
+        }
+
+        RetireCommands();
+
+        return std::make_shared<DX12FenceImpl>(fence_, fenceValue);
+    }
+
+    FenceHandle DX12::SubmitAsync()
+    {
+        if (!Flush(false))
+            return FenceHandle();
+
+        return std::make_shared<DX12FenceImpl>(fence_, fenceValue_);
+    }
+
     bool DX12::UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size)
     {
         TRACE_SCOPED_DX12;
 
         auto found = cBuffers_.find(name);
 
+        // the shader declaring it might not have been loaded yet, load the pending ones until it shows up
+        for (auto iter = lazyShaders_.begin(); (found == cBuffers_.end()) && (iter != lazyShaders_.end()); ++iter) {
+            if (!LoadLazyShader(iter->first))
+                return false;
+
+            found = cBuffers_.find(name);
+        }
+
         if (found == cBuffers_.end()) {
             LOGEF(boost::format("Constant buffer \"%1%\" was not found in any of the shaders parsed") % name);
 
@@ -1843,7 +2544,11 @@ namespace ninniku
             if (!CreateConstantBuffer(found->second, name, data, size))
                 return false;
         } else {
-            // constant buffer already exists so just update it
+            // constant buffer already exists so just update it, the copy is ordered after the work in flight reading the previous contents
+            auto upload = AcquireConstantBufferUpload(found->second, name);
+
+            if (upload == nullptr)
+                return false;
 
             D3D12_SUBRESOURCE_DATA subdata = {};
             subdata.pData = data;
@@ -1873,7 +2578,7 @@ namespace ninniku
             transition = CD3DX12_RESOURCE_BARRIER::Transition(found->second.resource_.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
 
             cmdList->gfxCmdList->ResourceBarrier(1, &transition);
-            UpdateSubresources(cmdList->gfxCmdList.Get(), found->second.resource_.Get(), found->second.upload_.Get(), 0, 0, 1, &subdata);
+            UpdateSubresources(cmdList->gfxCmdList.Get(), found->second.resource_.Get(), upload->second.Get(), 0, 0, 1, &subdata);
 
             ExecuteCommand(cmdList);
 
@@ -1889,8 +2594,67 @@ namespace ninniku
             cmdList->gfxCmdList->ResourceBarrier(1, &transition);
 
             ExecuteCommand(cmdList);
+
+            // submitted now so the fence value of the copy is known
+            if (!Flush(false))
+                return false;
+
+            upload->first = fenceValue_;
         }
 
+        AddStat(SC_BytesUploaded, size);
+
+        return true;
+    }
+
+    bool DX12::WaitForFence(const FenceHandle& waitFor)
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!waitFor)
+            return true;
+
+        auto dxFence = dynamic_cast<const DX12FenceImpl*>(waitFor.get());
+
+        if ((dxFence != nullptr) && !Globals::Instance().safeAndSlowDX12) {
+            Microsoft::WRL::ComPtr<ID3D12Device> device;
+
+            // a queue can only wait on a fence of its own device
+            if (SUCCEEDED(dxFence->GetFence()->GetDevice(IID_PPV_ARGS(device.GetAddressOf()))) && (device.Get() == device_.Get())) {
+                // work recorded before this call must not wait
+                if (!_commands.empty() && !Flush(false))
+                    return false;
+
+                for (auto& queue : queues_) {
+                    auto hr = queue.cmdQueue->Wait(dxFence->GetFence(), dxFence->GetValue());
+
+                    if (CheckAPIFailed(hr, "ID3D12CommandQueue::Wait"))
+                        return false;
+                }
+
+                return true;
+            }
+        }
+
+        // fences of other renderers are waited on the CPU
+        return waitFor->Wait();
+    }
+
+    bool DX12::WaitForInFlight()
+    {
+        TRACE_SCOPED_DX12;
+
+        if (!inFlight_.empty()) {
+            auto hr = fence_->SetEventOnCompletion(inFlight_.back().first, fenceEvent_);
+
+            if (CheckAPIFailed(hr, "ID3D12Fence::SetEventOnCompletion"))
+                return false;
+
+            WaitForSingleObject(fenceEvent_, INFINITE);
+        }
+
+        RetireCommands();
+
         return true;
     }
 } // namespace ninniku
\ No newline at end of file
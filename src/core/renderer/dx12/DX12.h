@@ -24,11 +24,13 @@
 
 #include "../../../utils/string_map.h"
 #include "../../../utils/trace.h"
+#include "../reflection_cache.h"
 #include "dx12_types.h"
 
 #include <boost/pool/object_pool.hpp>
 
 struct IDxcBlobEncoding;
+struct IDxcLibrary;
 struct ID3D12ShaderReflection;
 
 namespace ninniku
@@ -57,6 +59,10 @@ namespace ninniku
 
             // IF_SafeAndSlowDX12 only
             DX12GraphicsCommandList cmdList;
+
+            // signaled by CommandGraph batches only
+            DX12Fence graphFence;
+            uint64_t graphFenceValue = 0;
         };
 
     public:
@@ -67,6 +73,7 @@ namespace ninniku
 
         bool CheckFeatureSupport(uint32_t features) override;
         bool CopyBufferResource(const CopyBufferSubresourceParam& params) override;
+        FenceHandle CopyBufferResourceAsync(const CopyBufferSubresourceParam& params, const FenceHandle& waitFor) override;
         std::tuple<uint32_t, uint32_t> CopyTextureSubresource(const CopyTextureSubresourceParam& params) override;
         BufferHandle CreateBuffer(const BufferParamHandle& params) override;
         BufferHandle CreateBuffer(const BufferHandle& src) override;
@@ -74,15 +81,19 @@ namespace ninniku
         DebugMarkerHandle CreateDebugMarker(const std::string_view& name) const override;
         TextureHandle CreateTexture(const TextureParamHandle& params) override;
         bool Dispatch(const CommandHandle& cmd) override;
+        FenceHandle DispatchAsync(const CommandHandle& cmd, const FenceHandle& waitFor) override;
         void Finalize() override;
         bool Initialize() override;
         bool LoadShader(const std::filesystem::path& path) override;
         bool LoadShader(const std::string_view& name, const void* pData, const uint32_t size) override;
         MappedResourceHandle Map(const BufferHandle& bObj) override;
         MappedResourceHandle Map(const TextureHandle& tObj, const uint32_t index) override;
+        ReadbackHandle ReadbackTexture(const ReadbackTextureParam& params) override;
+        FenceHandle Submit(const CommandGraph& graph, const FenceHandle& waitFor) override;
         bool UpdateConstantBuffer(const std::string_view& name, void* data, const uint32_t size) override;
 
         const SamplerState* GetSampler(ESamplerState sampler) const override { return samplers_[static_cast<std::underlying_type<ESamplerState>::type>(sampler)].get(); }
+        ResourceStats GetResourceStats() const override { return tracker_.GetStats(); }
 
         // Not from RenderDevice
         std::tuple<uint32_t, uint32_t> CopyTextureSubresourceToBuffer(const CopyTextureSubresourceToBufferParam& params);
@@ -90,18 +101,32 @@ namespace ninniku
         inline ID3D12Device* GetDevice() const { return device_.Get(); }
 
     private:
+        std::pair<uint64_t, DX12Resource>* AcquireConstantBufferUpload(DX12ConstantBuffer& cbuffer, const std::string_view& name);
         CommandList* CreateCommandList(EQueueType type);
         bool CreateCommandContexts();
         bool CreateConstantBuffer(DX12ConstantBuffer& cbuffer, const std::string_view& name, void* data, const uint32_t size);
         bool CreateDevice(int adapter);
         bool CreateSamplers();
+        void CreateShaderBindings(const std::string_view& name, const ShaderReflection& reflection);
         D3D12_COMMAND_LIST_TYPE QueueTypeToDX12ComandListType(EQueueType type) const;
         bool ExecuteCommand(CommandList* cmdList);
-        bool Flush();
+        bool Flush(bool wait = true);
+        bool GetGraphAccesses(const CommandHandle& cmd, std::vector<GraphAccess>& accesses);
+        bool GetShaderReflection(IDxcBlobEncoding* pBlob, ShaderReflection& reflection);
+        bool LoadLazyShader(const std::string_view& name);
         bool LoadShader(const std::filesystem::path& path, IDxcBlobEncoding* pBlob);
         bool LoadShaders(const std::filesystem::path& path);
         bool ParseRootSignature(const std::string_view& name, IDxcBlobEncoding* pBlob);
-        bool ParseShaderResources(const std::string_view& name, uint32_t numBoundResources, ID3D12ShaderReflection* pReflection);
+        bool ParseShaderResources(uint32_t numBoundResources, ID3D12ShaderReflection* pReflection, ShaderReflection& res);
+        bool RecordDispatch(const CommandHandle& cmd, ID3D12GraphicsCommandList* graphCmdList = nullptr);
+        bool ReadShaderBlob(const std::filesystem::path& path, IDxcLibrary* pLibrary, IDxcBlobEncoding** ppBlob);
+        bool ReflectShader(IDxcBlobEncoding* pBlob, ShaderReflection& reflection);
+        bool RegisterShader(const std::string_view& name, IDxcBlobEncoding* pBlob, const ShaderReflection& reflection);
+        void ReleaseDeferred();
+        void RetireCommands();
+        FenceHandle SubmitAsync();
+        bool WaitForFence(const FenceHandle& waitFor);
+        bool WaitForInFlight();
 
     private:
         static constexpr std::string_view ShaderExt = ".dxco";
@@ -129,6 +154,12 @@ namespace ninniku
 
         StringMap<MapNameSlot> resourceBindings_;
 
+        // IF_LazyShaderLoading only, shaders are loaded by the first Dispatch using them
+        StringMap<std::filesystem::path> lazyShaders_;
+
+        // only loaded while LoadShaders is going through a folder
+        ReflectionCache reflectionCache_;
+
         std::unordered_map<uint32_t, std::shared_ptr<DX12CommandInternal>> commandContexts_;
 
         // heap
@@ -137,10 +168,16 @@ namespace ninniku
         // tracks allocated resources
         ObjectTracker tracker_;
 
+        // descriptor heaps of dropped subcontexts with the fence value of the last work that could use them
+        std::vector<std::pair<uint64_t, DX12DescriptorHeap>> retiredHeaps_;
+
         // Object pools
         boost::object_pool<CommandList> poolCmd_;
 
         //boost::circular_buffer<const CommandList*> _commands;
         std::vector<CommandList*> _commands;
+
+        // submitted without waiting, with the fence value signaled once they are done
+        std::vector<std::pair<uint64_t, CommandList*>> inFlight_;
     };
 } // namespace ninniku
@@ -125,6 +125,18 @@ namespace ninniku
             _heapIncrementSizes[D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER] = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
         }
 
+        views_.clear();
+
+        for (auto& srv : cmd->srvBindings) {
+            if (srv.second != nullptr)
+                views_.push_back(srv.second);
+        }
+
+        for (auto& uav : cmd->uavBindings) {
+            if (uav.second != nullptr)
+                views_.push_back(uav.second);
+        }
+
         CD3DX12_CPU_DESCRIPTOR_HANDLE heapHandle{ _descriptorHeap->GetCPUDescriptorHandleForHeapStart() };
 
         // create constant buffer view, just one supported at the moment
@@ -392,20 +404,10 @@ namespace ninniku
         res.process_bytes(cbufferStr.data(), cbufferStr.size());
         res.process_bytes(&dispatch.front(), dispatch.size() * sizeof(uint32_t));
 
-        for (auto& srv : srvBindings) {
-            res.process_bytes(srv.first.data(), srv.first.size());
-            res.process_bytes(&srv.second, sizeof(ShaderResourceView*));
-        }
+        // each table caches its own hash so unchanged bindings are not walked again
+        std::array<uint32_t, 3> bindingHashes = { srvBindings.GetHash(), uavBindings.GetHash(), ssBindings.GetHash() };
 
-        for (auto& uav : uavBindings) {
-            res.process_bytes(uav.first.data(), uav.first.size());
-            res.process_bytes(&uav.second, sizeof(UnorderedAccessView*));
-        }
-
-        for (auto& ss : ssBindings) {
-            res.process_bytes(ss.first.data(), ss.first.size());
-            res.process_bytes(&ss.second, sizeof(SamplerState*));
-        }
+        res.process_bytes(bindingHashes.data(), bindingHashes.size() * sizeof(uint32_t));
 
         return res.checksum();
     }
@@ -431,6 +433,38 @@ namespace ninniku
         }
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    // DX12FenceImpl
+    //////////////////////////////////////////////////////////////////////////
+    DX12FenceImpl::DX12FenceImpl(const DX12Fence& fence, const uint64_t value) noexcept
+        : fence_{ fence }
+        , value_{ value }
+    {
+    }
+
+    bool DX12FenceImpl::IsComplete() const
+    {
+        return fence_->GetCompletedValue() >= value_;
+    }
+
+    bool DX12FenceImpl::Wait() const
+    {
+        TRACE_SCOPED_DX12;
+
+        if (IsComplete())
+            return true;
+
+        // a null event blocks until the fence reaches the value
+        auto hr = fence_->SetEventOnCompletion(value_, nullptr);
+
+        if (FAILED(hr)) {
+            LOGE << "ID3D12Fence::SetEventOnCompletion failed while waiting on a fence";
+            return false;
+        }
+
+        return true;
+    }
+
     //////////////////////////////////////////////////////////////////////////
     // DX12MappedResource
     //////////////////////////////////////////////////////////////////////////
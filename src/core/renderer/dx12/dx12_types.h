@@ -71,6 +71,7 @@ namespace ninniku
         const UnorderedAccessView* GetUAV() const override;
 
         std::weak_ptr<DX12BufferInternal> _impl;
+        TrackedRef _tracked;
     };
 
     //////////////////////////////////////////////////////////////////////////
@@ -82,6 +83,9 @@ namespace ninniku
 
         DX12DescriptorHeap _descriptorHeap;
 
+        // views written in the heap, it is stale once one of them is freed
+        std::vector<const void*> views_;
+
         static inline std::array<uint32_t, 2> _heapIncrementSizes;
     };
 
@@ -114,7 +118,9 @@ namespace ninniku
     struct DX12ConstantBuffer
     {
         DX12Resource resource_;
-        DX12Resource upload_;
+
+        // with the fence value of the copy reading it, an upload buffer is only written again once it has passed
+        std::vector<std::pair<uint64_t, DX12Resource>> uploads_;
         uint32_t size_ = 0;
     };
 
@@ -131,6 +137,26 @@ namespace ninniku
         static inline std::atomic<uint8_t> colorIdx_;
     };
 
+    //////////////////////////////////////////////////////////////////////////
+    // DX12FenceImpl
+    //////////////////////////////////////////////////////////////////////////
+    struct DX12FenceImpl final : public FenceObject
+    {
+    public:
+        DX12FenceImpl(const DX12Fence& fence, const uint64_t value) noexcept;
+
+        bool IsComplete() const override;
+        bool Wait() const override;
+
+        // so queues of the same device can wait on the GPU
+        ID3D12Fence* GetFence() const { return fence_.Get(); }
+        uint64_t GetValue() const { return value_; }
+
+    private:
+        DX12Fence fence_;
+        uint64_t value_;
+    };
+
     //////////////////////////////////////////////////////////////////////////
     // DX12MappedResource
     //////////////////////////////////////////////////////////////////////////
@@ -225,6 +251,7 @@ namespace ninniku
         const UnorderedAccessView* GetUAV(uint32_t index) const override;
 
         std::weak_ptr<DX12TextureInternal> impl_;
+        TrackedRef tracked_;
     };
 
     //////////////////////////////////////////////////////////////////////////
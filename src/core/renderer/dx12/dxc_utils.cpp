@@ -28,16 +28,19 @@
 
 namespace ninniku
 {
+    bool CreateDXCLibrary(IDxcLibrary** ppLibrary)
+    {
+        auto hr = DxcCreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), (void**)ppLibrary);
+
+        return !CheckAPIFailed(hr, "DxcCreateInstance for CLSID_DxcLibrary");
+    }
+
     IDxcLibrary* GetDXCLibrary()
     {
         static IDxcLibrary* pLibrary = nullptr;
 
-        if (pLibrary == nullptr) {
-            auto hr = DxcCreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), (void**)&pLibrary);
-
-            if (CheckAPIFailed(hr, "DxcCreateInstance for CLSID_DxcLibrary"))
-                return nullptr;
-        }
+        if ((pLibrary == nullptr) && !CreateDXCLibrary(&pLibrary))
+            return nullptr;
 
         return pLibrary;
     }
@@ -51,6 +51,9 @@ namespace hlsl
 
 namespace ninniku
 {
+    [[nodiscard]] bool CreateDXCLibrary(IDxcLibrary** ppLibrary);
+
+    // shared by everything running on the calling thread, threads loading shaders in parallel create their own
     [[nodiscard]] IDxcLibrary* GetDXCLibrary();
     [[nodiscard]] bool ValidateDXCBlob(IDxcBlobEncoding* pBlob, IDxcLibrary* pLibrary);
 } // namespace ninniku
\ No newline at end of file
@@ -42,13 +42,18 @@ namespace ninniku
         DebugMarkerHandle CreateDebugMarker(const std::string_view&) const override { throw std::exception("Invalid for RENDERER_NULL"); }
         TextureHandle CreateTexture(const TextureParamHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
         bool Dispatch(const CommandHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
+        FenceHandle DispatchAsync(const CommandHandle&, const FenceHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
+        FenceHandle CopyBufferResourceAsync(const CopyBufferSubresourceParam&, const FenceHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
         void Finalize() override {}
         bool Initialize() override { return true; }
         bool LoadShader(const std::filesystem::path&) override { throw std::exception("Invalid for RENDERER_NULL"); }
         bool LoadShader(const std::string_view&, const void*, const uint32_t) override { throw std::exception("Invalid for RENDERER_NULL"); }
         MappedResourceHandle Map(const BufferHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
         MappedResourceHandle Map(const TextureHandle&, const uint32_t) override { throw std::exception("Invalid for RENDERER_NULL"); }
+        ReadbackHandle ReadbackTexture(const ReadbackTextureParam&) override { throw std::exception("Invalid for RENDERER_NULL"); }
+        FenceHandle Submit(const CommandGraph&, const FenceHandle&) override { throw std::exception("Invalid for RENDERER_NULL"); }
         bool UpdateConstantBuffer(const std::string_view&, void*, const uint32_t) override { throw std::exception("Invalid for RENDERER_NULL"); }
         const SamplerState* GetSampler(ESamplerState) const override { throw std::exception("Invalid for RENDERER_NULL"); }
+        ResourceStats GetResourceStats() const override { return ResourceStats{}; }
     };
 } // namespace ninniku
@@ -0,0 +1,394 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "reflection_cache.h"
+
+#include "../../utils/log.h"
+#include "../../utils/mapped_file.h"
+#include "../../utils/misc.h"
+#include "../../utils/stats.h"
+#include "../../utils/trace.h"
+
+#include <array>
+#include <fstream>
+
+namespace ninniku
+{
+    ReflectionCache::ReflectionCache()
+        : numEntries_{ 0 }
+        , generation_{ 0 }
+    {
+    }
+
+    ReflectionCache::~ReflectionCache() = default;
+
+    void ReflectionCache::Add(uint64_t key, const void* data, size_t size, const ShaderReflection& reflection)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto bytes = static_cast<const uint8_t*>(data);
+
+        added_.push_back({ key, std::vector<uint8_t>{ bytes, bytes + size }, reflection });
+    }
+
+    void ReflectionCache::Clear()
+    {
+        file_.reset();
+        numEntries_ = 0;
+        generation_ = 0;
+        states_.clear();
+        added_.clear();
+    }
+
+    bool ReflectionCache::Deserialize(const Entry& entry, ShaderReflection& reflection) const
+    {
+        auto payload = GetPayload(entry);
+
+        if (payload == nullptr)
+            return false;
+
+        auto data = payload + Align(entry.blobSize, 4);
+        auto end = payload + entry.size;
+
+        if (data > end)
+            return false;
+
+        reflection.bindings.clear();
+        reflection.bindings.reserve(entry.numBindings);
+        reflection.hasRootSignature = (entry.flags & EF_ROOT_SIGNATURE) != 0;
+
+        for (uint32_t i = 0; i < entry.numBindings; ++i) {
+            BindingRecord record;
+
+            if (static_cast<size_t>(end - data) < sizeof(BindingRecord))
+                return false;
+
+            memcpy(&record, data, sizeof(BindingRecord));
+            data += sizeof(BindingRecord);
+
+            auto paddedLength = Align(record.nameLength, 4);
+
+            if (static_cast<size_t>(end - data) < paddedLength)
+                return false;
+
+            ShaderBinding binding;
+
+            binding.name.assign(reinterpret_cast<const char*>(data), record.nameLength);
+            binding.type = record.type;
+            binding.bindPoint = record.bindPoint;
+            binding.bindCount = record.bindCount;
+            binding.flags = record.flags;
+            binding.returnType = record.returnType;
+            binding.dimension = record.dimension;
+            binding.numSamples = record.numSamples;
+            binding.space = record.space;
+            binding.id = record.id;
+
+            reflection.bindings.emplace_back(std::move(binding));
+            data += paddedLength;
+        }
+
+        return true;
+    }
+
+    bool ReflectionCache::Find(uint64_t key, const void* data, size_t size, ShaderReflection& reflection)
+    {
+        TRACE_SCOPED_UTILS;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (numEntries_ > 0) {
+            auto entries = GetEntries();
+            auto last = entries + numEntries_;
+            auto found = std::lower_bound(entries, last, key, [](const Entry& entry, uint64_t value) { return entry.key < value; });
+
+            // a different blob with the same key is a collision, keep looking
+            for (; (found != last) && (found->key == key); ++found) {
+                auto index = found - entries;
+
+                if (states_[index] == ES_Corrupted)
+                    continue;
+
+                auto payload = GetPayload(*found);
+
+                if ((payload != nullptr) && ((found->blobSize != size) || (memcmp(payload, data, size) != 0)))
+                    continue;
+
+                if ((payload != nullptr) && Deserialize(*found, reflection)) {
+                    states_[index] = ES_Used;
+                    AddStat(SC_ReflectionCacheHits);
+                    return true;
+                }
+
+                states_[index] = ES_Corrupted;
+                LOGW << "ReflectionCache: corrupted entry, falling back to reflection";
+            }
+        }
+
+        // the same blob can be loaded under different names
+        for (auto& added : added_) {
+            if ((added.key == key) && (added.blob.size() == size) && (memcmp(added.blob.data(), data, size) == 0)) {
+                reflection = added.reflection;
+                AddStat(SC_ReflectionCacheHits);
+                return true;
+            }
+        }
+
+        AddStat(SC_ReflectionCacheMisses);
+
+        return false;
+    }
+
+    const ReflectionCache::Entry* ReflectionCache::GetEntries() const
+    {
+        return reinterpret_cast<const Entry*>(file_->GetData() + sizeof(Header));
+    }
+
+    uint64_t ReflectionCache::GetKey(const void* data, size_t size)
+    {
+        TRACE_SCOPED_UTILS;
+
+        auto bytes = static_cast<const uint8_t*>(data);
+
+        // DXBC and DXIL containers start with "DXBC" and a 128 bits digest of the rest of the container
+        constexpr uint32_t DXBC_FOURCC = 0x43425844;
+
+        if (size >= sizeof(uint32_t) * 5) {
+            uint32_t fourCC;
+            std::array<uint64_t, 2> digest;
+
+            memcpy(&fourCC, bytes, sizeof(uint32_t));
+            memcpy(digest.data(), bytes + sizeof(uint32_t), sizeof(digest));
+
+            // the digest is left to 0 when the validator didn't sign the container
+            if ((fourCC == DXBC_FOURCC) && ((digest[0] | digest[1]) != 0))
+                return digest[0] ^ digest[1];
+        }
+
+        // 64-bit FNV-1a
+        uint64_t res = 14695981039346656037ull;
+
+        for (size_t i = 0; i < size; ++i) {
+            res ^= bytes[i];
+            res *= 1099511628211ull;
+        }
+
+        return res;
+    }
+
+    const uint8_t* ReflectionCache::GetPayload(const Entry& entry) const
+    {
+        auto fileSize = file_->GetSize();
+
+        if ((entry.offset > fileSize) || (entry.size > fileSize - entry.offset) || (entry.blobSize > entry.size))
+            return nullptr;
+
+        return file_->GetData() + entry.offset;
+    }
+
+    bool ReflectionCache::Load(const std::filesystem::path& path)
+    {
+        TRACE_SCOPED_UTILS;
+
+        Clear();
+
+        // a missing cache is expected on the first run
+        if (!std::filesystem::exists(path))
+            return false;
+
+        auto file = std::make_unique<MappedFile>();
+
+        if (!file->Open(path))
+            return false;
+
+        Header header;
+
+        if (file->GetSize() < sizeof(Header)) {
+            LOGW << "ReflectionCache: ignoring truncated cache";
+            return false;
+        }
+
+        memcpy(&header, file->GetData(), sizeof(Header));
+
+        if ((header.magic != MAGIC) || (header.version != VERSION)) {
+            LOGW << "ReflectionCache: ignoring cache from another version";
+            return false;
+        }
+
+        if ((file->GetSize() - sizeof(Header)) / sizeof(Entry) < header.numEntries) {
+            LOGW << "ReflectionCache: ignoring truncated cache";
+            return false;
+        }
+
+        file_ = std::move(file);
+        numEntries_ = header.numEntries;
+        generation_ = header.generation;
+        states_.assign(numEntries_, ES_Unused);
+
+        LOGDF(boost::format("ReflectionCache: %1% entries loaded from %2%") % numEntries_ % path);
+
+        return true;
+    }
+
+    bool ReflectionCache::Save(const std::filesystem::path& path)
+    {
+        TRACE_SCOPED_UTILS;
+
+        // hits alone don't justify rewriting the file unless they would otherwise age out or a corrupted entry must go
+        auto needsRefresh = false;
+
+        for (uint32_t i = 0; (i < numEntries_) && !needsRefresh; ++i) {
+            needsRefresh = (states_[i] == ES_Corrupted) || ((states_[i] == ES_Used) && (GetEntries()[i].generation != generation_));
+        }
+
+        if (added_.empty() && !needsRefresh) {
+            Clear();
+            return true;
+        }
+
+        auto generation = generation_ + 1;
+
+        std::vector<std::pair<Entry, std::vector<uint8_t>>> entries;
+
+        entries.reserve(numEntries_ + added_.size());
+
+        // keep what the other renderers sharing this folder wrote
+        for (uint32_t i = 0; i < numEntries_; ++i) {
+            auto entry = GetEntries()[i];
+
+            if (states_[i] == ES_Corrupted)
+                continue;
+
+            if (states_[i] == ES_Used)
+                entry.generation = generation;
+            else if (generation - entry.generation > MAX_STALE_SAVES)
+                continue;
+
+            auto payload = GetPayload(entry);
+
+            if (payload != nullptr)
+                entries.emplace_back(entry, std::vector<uint8_t>{ payload, payload + entry.size });
+        }
+
+        for (auto& added : added_) {
+            Entry entry = {};
+
+            entry.key = added.key;
+            entry.blobSize = static_cast<uint32_t>(added.blob.size());
+            entry.numBindings = static_cast<uint32_t>(added.reflection.bindings.size());
+            entry.flags = added.reflection.hasRootSignature ? EF_ROOT_SIGNATURE : EF_NONE;
+            entry.generation = generation;
+
+            std::vector<uint8_t> payload;
+            Serialize(added.blob.data(), added.blob.size(), added.reflection, payload);
+
+            entries.emplace_back(entry, std::move(payload));
+        }
+
+        // the file must be unmapped before it can be replaced
+        Clear();
+
+        // the payload starts with the blob so equal payloads are the same shader
+        std::sort(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) { return (lhs.first.key < rhs.first.key) || ((lhs.first.key == rhs.first.key) && (lhs.second < rhs.second)); });
+
+        auto newEnd = std::unique(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) { return (lhs.first.key == rhs.first.key) && (lhs.second == rhs.second); });
+
+        entries.erase(newEnd, entries.end());
+
+        Header header = {};
+
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.numEntries = static_cast<uint32_t>(entries.size());
+        header.generation = generation;
+
+        auto offset = static_cast<uint32_t>(sizeof(Header) + sizeof(Entry) * entries.size());
+
+        for (auto& kvp : entries) {
+            kvp.first.offset = offset;
+            kvp.first.size = static_cast<uint32_t>(kvp.second.size());
+            offset += kvp.first.size;
+        }
+        // write next to it first so an interrupted save cannot leave a broken cache behind
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream stream{ tmpPath, std::ios::binary | std::ios::trunc };
+
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+            for (auto& kvp : entries) {
+                stream.write(reinterpret_cast<const char*>(&kvp.first), sizeof(Entry));
+            }
+
+            for (auto& kvp : entries) {
+                stream.write(reinterpret_cast<const char*>(kvp.second.data()), kvp.second.size());
+            }
+
+            if (!stream) {
+                LOGWF(boost::format("ReflectionCache: failed to write %1%") % tmpPath);
+                return false;
+            }
+        }
+
+        std::error_code err;
+
+        std::filesystem::rename(tmpPath, path, err);
+
+        if (err) {
+            LOGWF(boost::format("ReflectionCache: failed to replace %1% with: %2%") % path % err.message());
+            std::filesystem::remove(tmpPath, err);
+            return false;
+        }
+
+        LOGDF(boost::format("ReflectionCache: %1% entries saved to %2%") % header.numEntries % path);
+
+        return true;
+    }
+
+    void ReflectionCache::Serialize(const void* data, size_t size, const ShaderReflection& reflection, std::vector<uint8_t>& payload)
+    {
+        payload.resize(Align(static_cast<uint32_t>(size), 4), 0);
+        memcpy(payload.data(), data, size);
+
+        for (auto& binding : reflection.bindings) {
+            BindingRecord record;
+
+            record.type = binding.type;
+            record.bindPoint = binding.bindPoint;
+            record.bindCount = binding.bindCount;
+            record.flags = binding.flags;
+            record.returnType = binding.returnType;
+            record.dimension = binding.dimension;
+            record.numSamples = binding.numSamples;
+            record.space = binding.space;
+            record.id = binding.id;
+            record.nameLength = static_cast<uint32_t>(binding.name.size());
+
+            auto start = payload.size();
+
+            payload.resize(start + sizeof(BindingRecord) + Align(record.nameLength, 4), 0);
+            memcpy(payload.data() + start, &record, sizeof(BindingRecord));
+            memcpy(payload.data() + start + sizeof(BindingRecord), binding.name.data(), record.nameLength);
+        }
+    }
+} // namespace ninniku
@@ -0,0 +1,166 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/utils.h"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ninniku
+{
+    class MappedFile;
+
+    //////////////////////////////////////////////////////////////////////////
+    // ShaderReflection: what the renderers need from reflection, independent from the D3D version
+    //////////////////////////////////////////////////////////////////////////
+    struct ShaderBinding
+    {
+        std::string name;
+
+        // D3D_SHADER_INPUT_TYPE
+        uint32_t type;
+        uint32_t bindPoint;
+        uint32_t bindCount;
+        uint32_t flags;
+
+        // D3D_RESOURCE_RETURN_TYPE
+        uint32_t returnType;
+
+        // D3D_SRV_DIMENSION
+        uint32_t dimension;
+        uint32_t numSamples;
+        uint32_t space;
+        uint32_t id;
+    };
+
+    struct ShaderReflection
+    {
+        // in reflection order
+        std::vector<ShaderBinding> bindings;
+        bool hasRootSignature = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // ReflectionCache: reflected shaders saved to disk so a warm start can skip reflection
+    // Entries are keyed by a hash of the blob and keep the blob itself, a hit must match it byte for byte
+    // Renderers sharing a folder merge their entries, one not hit for MAX_STALE_SAVES saves is dropped
+    // Add and Find can be called from several threads, Load and Save cannot
+    //////////////////////////////////////////////////////////////////////////
+    class ReflectionCache : NonCopyable
+    {
+    public:
+        ReflectionCache();
+        ~ReflectionCache() override;
+
+        static uint64_t GetKey(const void* data, size_t size);
+
+        void Add(uint64_t key, const void* data, size_t size, const ShaderReflection& reflection);
+        bool Find(uint64_t key, const void* data, size_t size, ShaderReflection& reflection);
+        bool Load(const std::filesystem::path& path);
+        bool Save(const std::filesystem::path& path);
+
+    public:
+        static constexpr std::string_view FileName = "ninniku_reflection.cache";
+
+    private:
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t numEntries;
+
+            // incremented by each save
+            uint32_t generation;
+        };
+
+        // sorted by key so lookups can be done in the mapped file directly
+        struct Entry
+        {
+            uint64_t key;
+            uint32_t offset;
+            uint32_t size;
+            uint32_t blobSize;
+            uint32_t numBindings;
+            uint32_t flags;
+
+            // last save that had a hit on it
+            uint32_t generation;
+        };
+
+        // followed by the name, padded to 4 bytes
+        struct BindingRecord
+        {
+            uint32_t type;
+            uint32_t bindPoint;
+            uint32_t bindCount;
+            uint32_t flags;
+            uint32_t returnType;
+            uint32_t dimension;
+            uint32_t numSamples;
+            uint32_t space;
+            uint32_t id;
+            uint32_t nameLength;
+        };
+
+        struct AddedEntry
+        {
+            uint64_t key;
+            std::vector<uint8_t> blob;
+            ShaderReflection reflection;
+        };
+
+        enum EEntryFlags : uint32_t
+        {
+            EF_NONE = 0,
+            EF_ROOT_SIGNATURE = 1 << 0
+        };
+
+        enum EEntryState : uint8_t
+        {
+            ES_Unused,
+            ES_Used,
+            ES_Corrupted
+        };
+
+        void Clear();
+        const Entry* GetEntries() const;
+        const uint8_t* GetPayload(const Entry& entry) const;
+        static void Serialize(const void* data, size_t size, const ShaderReflection& reflection, std::vector<uint8_t>& payload);
+        bool Deserialize(const Entry& entry, ShaderReflection& reflection) const;
+
+    private:
+        static constexpr uint32_t MAGIC = 0x4352494e; // NIRC
+        static constexpr uint32_t VERSION = 2;
+        static constexpr uint32_t MAX_STALE_SAVES = 8;
+
+        std::unique_ptr<MappedFile> file_;
+        uint32_t numEntries_;
+        uint32_t generation_;
+
+        std::mutex mutex_;
+        std::vector<EEntryState> states_;
+        std::vector<AddedEntry> added_;
+    };
+} // namespace ninniku
@@ -0,0 +1,226 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "ninniku/core/renderer/resource_pool.h"
+
+#include "../../utils/log.h"
+#include "../../utils/misc.h"
+
+namespace ninniku
+{
+    // what the first value of a key is set to so a buffer and a texture never match
+    enum EPooledResource : uint32_t
+    {
+        PR_Buffer,
+        PR_Texture
+    };
+
+    ResourcePool::ResourcePool(RenderDeviceHandle& dx, const ResourcePoolDesc& desc)
+        : dx_{ dx }
+        , desc_{ desc }
+        , stats_{}
+    {
+    }
+
+    ResourcePool::~ResourcePool()
+    {
+        Clear();
+    }
+
+    BufferHandle ResourcePool::AcquireBuffer(const BufferParamHandle& params)
+    {
+        Entry entry;
+
+        if (Pop(MakeKey(*params), entry))
+            return std::move(entry.buffer);
+
+        return dx_->CreateBuffer(params);
+    }
+
+    TextureHandle ResourcePool::AcquireTexture(const TextureParamHandle& params)
+    {
+        Entry entry;
+
+        if (params->imageDatas.empty() && Pop(MakeKey(*params), entry))
+            return std::move(entry.texture);
+
+        return dx_->CreateTexture(params);
+    }
+
+    void ResourcePool::Clear()
+    {
+        EntryList released;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            released.swap(lru_);
+            free_.clear();
+
+            stats_.numPooled = 0;
+            stats_.pooledBytes = 0;
+        }
+
+        // the renderer frees them as the handles are destroyed, do it outside of the lock
+        released.clear();
+    }
+
+    ResourcePoolStats ResourcePool::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        return stats_;
+    }
+
+    size_t ResourcePool::KeyHash::operator()(const Key& key) const noexcept
+    {
+        // FNV-1a
+        size_t hash = 14695981039346656037ull;
+
+        for (auto value : key.values) {
+            hash = (hash ^ value) * 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    ResourcePool::Key ResourcePool::MakeKey(const BufferParam& params)
+    {
+        return { { PR_Buffer, params.elementSize, params.numElements, params.viewflags, 0, 0, 0, 0 } };
+    }
+
+    ResourcePool::Key ResourcePool::MakeKey(const TextureParam& params)
+    {
+        return { { PR_Texture, params.format, params.width, params.height, params.depth, params.numMips, params.arraySize, params.viewflags } };
+    }
+
+    bool ResourcePool::Pop(const Key& key, Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto found = free_.find(key);
+
+        if (found == free_.end()) {
+            ++stats_.misses;
+            return false;
+        }
+
+        auto iter = found->second;
+
+        entry = std::move(*iter);
+        lru_.erase(iter);
+        free_.erase(found);
+
+        --stats_.numPooled;
+        stats_.pooledBytes -= entry.size;
+        ++stats_.hits;
+
+        return true;
+    }
+
+    void ResourcePool::Push(Entry&& entry)
+    {
+        EntryList evicted;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            ++stats_.numPooled;
+            stats_.pooledBytes += entry.size;
+
+            auto key = entry.key;
+
+            lru_.emplace_front(std::move(entry));
+            free_.emplace(key, lru_.begin());
+
+            while ((desc_.budget > 0) && (stats_.pooledBytes > desc_.budget)) {
+                auto last = std::prev(lru_.end());
+                auto range = free_.equal_range(last->key);
+
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (iter->second == last) {
+                        free_.erase(iter);
+                        break;
+                    }
+                }
+
+                --stats_.numPooled;
+                stats_.pooledBytes -= last->size;
+                ++stats_.evictions;
+
+                evicted.splice(evicted.end(), lru_, last);
+            }
+        }
+
+        // the renderer frees them as the handles are destroyed, do it outside of the lock
+        evicted.clear();
+    }
+
+    void ResourcePool::Release(BufferHandle&& buffer)
+    {
+        if (!buffer)
+            return;
+
+        auto desc = buffer->GetDesc();
+
+        if (desc == nullptr) {
+            LOGE << "ResourcePool::Release: the buffer is no longer valid";
+            return;
+        }
+
+        Entry entry;
+
+        entry.key = MakeKey(*desc);
+        entry.size = static_cast<uint64_t>(desc->numElements) * desc->elementSize;
+        entry.buffer = std::move(buffer);
+
+        Push(std::move(entry));
+    }
+
+    void ResourcePool::Release(TextureHandle&& texture)
+    {
+        if (!texture)
+            return;
+
+        auto desc = texture->GetDesc();
+
+        if (desc == nullptr) {
+            LOGE << "ResourcePool::Release: the texture is no longer valid";
+            return;
+        }
+
+        // same estimate for every renderer, the budget only has to be consistent
+        auto bpp = DXGIFormatToNumBytes(NinnikuTFToDXGIFormat(desc->format));
+        uint64_t size = 0;
+
+        for (uint32_t mip = 0; mip < desc->numMips; ++mip) {
+            size += static_cast<uint64_t>(std::max(1u, desc->width >> mip)) * std::max(1u, desc->height >> mip) * std::max(1u, desc->depth >> mip) * bpp;
+        }
+
+        Entry entry;
+
+        entry.key = MakeKey(*desc);
+        entry.size = size * desc->arraySize;
+        entry.texture = std::move(texture);
+
+        Push(std::move(entry));
+    }
+} // namespace ninniku
@@ -22,6 +22,7 @@
 
 #include "ninniku/utils.h"
 #include "ninniku/core/renderer/renderdevice.h"
+#include "utils/thread_pool.h"
 
 #include <renderdoc/renderdoc_app.h>
 
@@ -36,11 +37,15 @@ namespace ninniku
         RENDERDOC_API_1_4_1* renderDocApi_ = nullptr;
         RenderDeviceHandle renderer_;
 
+        // shared by the CPU renderer and the image processing functions
+        std::unique_ptr<ThreadPool> threadPool_;
+
         bool bc7Quick_ : 1;
         bool doCapture_ : 1;
         bool useDebugLayer_ : 1;
         bool safeAndSlowDX12 : 1;
-        bool padding_ : 4;
+        bool lazyShaderLoading_ : 1;
+        bool padding_ : 3;
 
     private:
         static Globals instance_;
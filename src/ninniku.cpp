@@ -22,6 +22,7 @@
 #include "ninniku/ninniku.h"
 
 #include "ninniku/core/renderer/renderdevice.h"
+#include "core/renderer/cpu/CPU.h"
 #include "core/renderer/dx11/DX11.h"
 #include "core/renderer/dx12/DX12.h"
 #include "core/renderer/null.h"
@@ -106,6 +107,12 @@ namespace ninniku
             }
             break;
 
+            case ERenderer::RENDERER_CPU:
+            {
+                dx.reset(new CPU());
+            }
+            break;
+
             case ERenderer::RENDERER_DX11:
             case ERenderer::RENDERER_WARP_DX11:
             {
@@ -125,6 +132,8 @@ namespace ninniku
                 return false;
         }
 
+        Log::SetRendererType(renderer);
+
         if (!dx->Initialize()) {
             LOGE << "RenderDevice::Initialize failed";
             return false;
@@ -148,6 +157,8 @@ namespace ninniku
         Globals::Instance().useDebugLayer_ = (flags & EInitializationFlags::IF_DisableDX12DebugLayer) == 0;
         Globals::Instance().bc7Quick_ = (flags & EInitializationFlags::IF_BC7_QUICK_MODE) != 0;
         Globals::Instance().safeAndSlowDX12 = (flags & EInitializationFlags::IF_SafeAndSlowDX12) != 0;
+        Globals::Instance().lazyShaderLoading_ = (flags & EInitializationFlags::IF_LazyShaderLoading) != 0;
+        Globals::Instance().threadPool_ = std::make_unique<ThreadPool>();
     }
 
     void InitializeLog(const ELogLevel logLevel)
@@ -168,6 +179,12 @@ namespace ninniku
 
         if (renderer == ERenderer::RENDERER_NULL)
             flags = 0;
+
+        if (renderer == ERenderer::RENDERER_CPU) {
+            // no capture or debug layer without a GPU, only keep what affects image processing
+            flags &= EInitializationFlags::IF_BC7_QUICK_MODE;
+            flags |= EInitializationFlags::IF_DisableDX12DebugLayer;
+        }
     }
 
     bool Initialize(const ERenderer renderer, const std::vector<std::filesystem::path>& shaderPaths, uint32_t flags, const ELogLevel logLevel)
@@ -227,6 +244,8 @@ namespace ninniku
         renderer->Finalize();
         renderer.reset();
 
+        Globals::Instance().threadPool_.reset();
+
         if (!isNull && Globals::Instance().useDebugLayer_) {
             Microsoft::WRL::ComPtr<IDXGIDebug1> dxgiDebug;
             if (!CheckAPIFailed(DXGIGetDebugInterface1(0, IID_PPV_ARGS(&dxgiDebug)), "DXGIGetDebugInterface1")) {
@@ -236,5 +255,8 @@ namespace ninniku
         }
 
         LOG << "Shutdown complete";
+
+        // make sure the queued records reach the console before the application exits
+        Log::Terminate();
     }
 }
\ No newline at end of file
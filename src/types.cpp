@@ -57,6 +57,7 @@ namespace ninniku
         res->width = width;
         res->imageDatas.reserve(imageDatas.size());
         res->imageDatas.assign(imageDatas.begin(), imageDatas.end());
+        res->imageDatasOwner = imageDatasOwner;
 
         return res;
     }
@@ -22,11 +22,13 @@
 #include "log.h"
 
 #include "ninniku/ninniku.h"
-#include "ninniku/core/renderer/renderdevice.h"
 
 #include <boost/date_time.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
 #include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
 #include <boost/log/sinks/debug_output_backend.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/utility/setup/console.hpp>
@@ -64,9 +66,13 @@ namespace ninniku
             uint32_t isNew;
         };
 
-        static LogContext sLogContext;
+        // indents are per thread since shaders are loaded from the pool workers
+        static thread_local LogContext sLogContext;
         static bool sLogInitizalized;
 
+        // records are formatted on the sink thread, long after the renderer could have been destroyed
+        static std::atomic<ERenderer> sRendererType{ ERenderer::RENDERER_NULL };
+
         //////////////////////////////////////////////////////////////////////////
         /// Color console
         //////////////////////////////////////////////////////////////////////////
@@ -115,6 +121,16 @@ namespace ninniku
             }
         };
 
+        // the console is slow so records are queued and written by a dedicated thread, callers only block when the ring is full
+        static constexpr size_t MAX_QUEUED_RECORDS = 4096;
+
+        using AsyncColorConsoleSink = sinks::asynchronous_sink<ColorConsoleSink, sinks::bounded_fifo_queue<MAX_QUEUED_RECORDS, sinks::block_on_overflow>>;
+
+        using DebugOutputSink = sinks::synchronous_sink<sinks::debug_output_backend>;
+
+        static boost::shared_ptr<AsyncColorConsoleSink> sColorSink;
+        static boost::shared_ptr<DebugOutputSink> sDebugSink;
+
         //////////////////////////////////////////////////////////////////////////
 
         std::ostream& operator<<(std::ostream& strm, BoostLogLevel level)
@@ -129,10 +145,12 @@ namespace ninniku
             if (static_cast<std::size_t>(level) < (sizeof(strings) / sizeof(*strings))) {
                 // output version of dx
                 if (level == Log_DX) {
-                    auto& renderer = GetRenderer();
+                    auto type = sRendererType.load(std::memory_order_relaxed);
 
-                    if ((renderer->GetType() & ERenderer::RENDERER_DX12) != 0)
+                    if ((type & ERenderer::RENDERER_DX12) != 0)
                         strm << "dx12";
+                    else if (type == ERenderer::RENDERER_CPU)
+                        strm << "cpu";
                     else
                         strm << "dx11";
                 } else {
@@ -152,7 +170,7 @@ namespace ninniku
 
             logging::add_common_attributes();
 
-            auto colorSink = boost::make_shared<sinks::synchronous_sink<ColorConsoleSink>>();
+            auto colorSink = boost::make_shared<AsyncColorConsoleSink>();
 
             colorSink->set_formatter(expr::format("%1%: [%2%] %3%")
                                      % expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%H:%M:%S")
@@ -160,7 +178,7 @@ namespace ninniku
                                      % expr::message);
 
             // debug sink (VS output)
-            auto debugSink = boost::make_shared <sinks::synchronous_sink<sinks::debug_output_backend>>();
+            auto debugSink = boost::make_shared<DebugOutputSink>();
 
             debugSink->set_filter(expr::is_debugger_present());
             debugSink->set_formatter(expr::format("%1%: [%2%] %3%\n")
@@ -174,25 +192,60 @@ namespace ninniku
                 case ELogLevel::LL_NONE:
                     colorSink->set_filter(severity > Log_Error);
                     debugSink->set_filter(severity > Log_Error);
+                    sMinLevel = Log_Level_Count;
                     break;
 
                 case ELogLevel::LL_NORMAL:
                     colorSink->set_filter(severity > Log_DX);
                     debugSink->set_filter(severity > Log_DX);
+                    sMinLevel = Log_Core;
                     break;
 
                 case ELogLevel::LL_WARN_ERROR:
                     colorSink->set_filter(severity > Log_Core);
                     debugSink->set_filter(severity > Log_Core);
+                    sMinLevel = Log_Warning;
+                    break;
+
+                case ELogLevel::LL_FULL:
+                    sMinLevel = Log_DX;
                     break;
             }
 
             core->add_sink(colorSink);
             core->add_sink(debugSink);
 
+            sColorSink = colorSink;
+            sDebugSink = debugSink;
+
             sLogInitizalized = true;
         }
 
+        void Terminate()
+        {
+            if (!sLogInitizalized)
+                return;
+
+            auto core = logging::core::get();
+
+            // the console thread has to be joined here, leaving it to static destruction would happen during the DLL unload
+            core->remove_sink(sColorSink);
+            sColorSink->stop();
+            sColorSink->flush();
+            sColorSink.reset();
+
+            core->remove_sink(sDebugSink);
+            sDebugSink.reset();
+
+            sMinLevel = Log_DX;
+            sLogInitizalized = false;
+        }
+
+        void SetRendererType(const ERenderer type)
+        {
+            sRendererType.store(type, std::memory_order_relaxed);
+        }
+
         void StartIndent()
         {
             ++sLogContext.count;
@@ -204,22 +257,21 @@ namespace ninniku
             --sLogContext.count;
         }
 
-        std::string GetIndent()
+        std::string_view GetIndent()
         {
-            std::string res;
+            // returned as views over a fixed buffer so nothing is allocated per record
+            static constexpr std::string_view Spaces = "                                                                - ";
+            static constexpr uint32_t MAX_SPACES = static_cast<uint32_t>(Spaces.size() - 2);
 
             if (sLogContext.isNew > 0) {
-                for (uint32_t i = 1; i < sLogContext.count; ++i)
-                    res += " ";
-
-                res += "- ";
                 --sLogContext.isNew;
-            } else {
-                for (uint32_t i = 0; i < sLogContext.count; ++i)
-                    res += "  ";
+
+                auto numSpaces = std::min(std::max(sLogContext.count, 1u) - 1, MAX_SPACES);
+
+                return Spaces.substr(MAX_SPACES - numSpaces);
             }
 
-            return res;
+            return Spaces.substr(0, std::min(sLogContext.count * 2, MAX_SPACES));
         }
     } // namespace Log
 } // namespace ninniku
\ No newline at end of file
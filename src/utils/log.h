@@ -26,12 +26,17 @@
 
 #include "ninniku/ninniku.h"
 
-#define LOG BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_Core) << ninniku::Log::GetIndent()
-#define LOGD BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_DX) << ninniku::Log::GetIndent()
-#define LOGDF(X) BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_DX) << ninniku::Log::GetIndent() << boost::str(X)
-#define LOGE BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_Error) << ninniku::Log::GetIndent()
-#define LOGEF(X) BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_Error) << ninniku::Log::GetIndent() << boost::str(X)
-#define LOGW BOOST_LOG_SEV(ninniku::Log::boost_log::get(), ninniku::Log::Log_Warning) << ninniku::Log::GetIndent()
+// the level is checked before anything is evaluated, the record is then formatted in boost::log's per thread stream
+#define NINNIKU_LOG_SEV(X) if (!ninniku::Log::IsEnabled(X)) {} else BOOST_LOG_SEV(ninniku::Log::boost_log::get(), X) << ninniku::Log::GetIndent()
+
+#define LOG NINNIKU_LOG_SEV(ninniku::Log::Log_Core)
+#define LOGF(X) LOG << (X)
+#define LOGD NINNIKU_LOG_SEV(ninniku::Log::Log_DX)
+#define LOGDF(X) LOGD << (X)
+#define LOGE NINNIKU_LOG_SEV(ninniku::Log::Log_Error)
+#define LOGEF(X) LOGE << (X)
+#define LOGW NINNIKU_LOG_SEV(ninniku::Log::Log_Warning)
+#define LOGWF(X) LOGW << (X)
 
 #define LOG_INDENT_START ninniku::Log::StartIndent(); ## LOG
 #define LOGD_INDENT_START ninniku::Log::StartIndent(); ## LOGD
@@ -56,9 +61,17 @@ namespace ninniku
 
         BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(boost_log, boost::log::sources::severity_logger_mt<BoostLogLevel>);
 
+        // everything goes through until Initialize sets the level
+        inline BoostLogLevel sMinLevel = Log_DX;
+
+        inline bool IsEnabled(BoostLogLevel level) { return level >= sMinLevel; }
+
         void Initialize(const ELogLevel level);
+        // write the queued records and stop the console thread, Initialize can be called again afterward
+        void Terminate();
+        void SetRendererType(const ERenderer type);
         void StartIndent();
         void EndIndent();
-        std::string GetIndent();
+        std::string_view GetIndent();
     } // namespace Log
 } // namespace ninniku
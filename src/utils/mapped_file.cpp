@@ -0,0 +1,93 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "mapped_file.h"
+
+#include "log.h"
+
+namespace ninniku
+{
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    void MappedFile::Close()
+    {
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+            data_ = nullptr;
+        }
+
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+        }
+
+        size_ = 0;
+    }
+
+    bool MappedFile::Open(const std::filesystem::path& path)
+    {
+        Close();
+
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            LOGEF(boost::format("MappedFile: could not open %1%") % path);
+            return false;
+        }
+
+        LARGE_INTEGER size;
+
+        if (!GetFileSizeEx(file_, &size) || (size.QuadPart == 0)) {
+            LOGEF(boost::format("MappedFile: %1% is empty") % path);
+            Close();
+            return false;
+        }
+
+        // copy on write, the view can be modified without touching the file
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+        if (mapping_ == nullptr) {
+            LOGEF(boost::format("MappedFile: CreateFileMapping failed for %1%") % path);
+            Close();
+            return false;
+        }
+
+        data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_COPY, 0, 0, 0));
+
+        if (data_ == nullptr) {
+            LOGEF(boost::format("MappedFile: MapViewOfFile failed for %1%") % path);
+            Close();
+            return false;
+        }
+
+        size_ = static_cast<size_t>(size.QuadPart);
+
+        return true;
+    }
+} // namespace ninniku
@@ -0,0 +1,52 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/utils.h"
+
+#include <filesystem>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // MappedFile: maps a whole file in memory, written pages are private copies so the file is never modified
+    //////////////////////////////////////////////////////////////////////////
+    class MappedFile : NonCopyable
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() override;
+
+        uint8_t* GetData() const { return data_; }
+        size_t GetSize() const { return size_; }
+
+        bool Open(const std::filesystem::path& path);
+
+    private:
+        void Close();
+
+    private:
+        HANDLE file_ = INVALID_HANDLE_VALUE;
+        HANDLE mapping_ = nullptr;
+        uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+    };
+} // namespace ninniku
@@ -1,42 +1,257 @@
 // Copyright(c) 2018-2020 Kitti Vongsay
 //
-// Permission is hereby granted: free of charge: to any person obtaining a copy
-// of this software and associated documentation files(the "Software"): to deal
-// in the Software without restriction: including without limitation the rights
-// to use: copy: modify: merge: publish: distribute: sublicense: and/or sell
-// copies of the Software: and to permit persons to whom the Software is
-// furnished to do so: subject to the following conditions :
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
 //
 // The above copyright notice and this permission notice shall be included in all
 // copies or substantial portions of the Software.
 //
-// THE SOFTWARE IS PROVIDED "AS IS": WITHOUT WARRANTY OF ANY KIND: EXPRESS OR
-// IMPLIED: INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY:
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 // FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
-// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM: DAMAGES OR OTHER
-// LIABILITY: WHETHER IN AN ACTION OF CONTRACT: TORT OR OTHERWISE: ARISING FROM:
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
 #include "pch.h"
 #include "object_tracker.h"
 
+#include <mutex>
+
 namespace ninniku
 {
-    ObjectTracker::ObjectTracker()
+    //////////////////////////////////////////////////////////////////////////
+    // TrackerRegistry
+    //////////////////////////////////////////////////////////////////////////
+    struct TrackerRegistry
+    {
+        static constexpr uint32_t INVALID_SLOT = std::numeric_limits<uint32_t>::max();
+
+        struct Slot
+        {
+            std::shared_ptr<TrackedObject> obj;
+            uint64_t size;
+
+            // bumped on release so a stale TrackedRef cannot free the next owner of the slot
+            uint32_t generation;
+            uint32_t nextFree;
+        };
+
+        struct Released
+        {
+            std::shared_ptr<TrackedObject> obj;
+            uint64_t size;
+        };
+
+        TrackerRegistry(bool deferRelease) noexcept;
+
+        void Free(std::vector<Released>& objects);
+        void Release(uint32_t index, uint32_t generation);
+
+        mutable std::mutex mutex_;
+        std::vector<Slot> slots_;
+        std::vector<Released> deferred_;
+        uint32_t freeHead_;
+        const bool deferRelease_;
+        ResourceStats stats_;
+    };
+
+    TrackerRegistry::TrackerRegistry(bool deferRelease) noexcept
+        : freeHead_{ INVALID_SLOT }
+        , deferRelease_{ deferRelease }
+        , stats_{}
+    {
+    }
+
+    void TrackerRegistry::Free(std::vector<Released>& objects)
+    {
+        if (objects.empty())
+            return;
+
+        auto count = static_cast<uint32_t>(objects.size());
+        uint64_t size = 0;
+
+        for (auto& released : objects) {
+            size += released.size;
+        }
+
+        // destroy outside of the lock, releasing API objects can take a while
+        objects.clear();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        stats_.numLiveObjects -= count;
+        stats_.liveBytes -= size;
+        stats_.numReleased += count;
+    }
+
+    void TrackerRegistry::Release(uint32_t index, uint32_t generation)
+    {
+        std::vector<TrackerRegistry::Released> released;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if ((index >= slots_.size()) || (slots_[index].generation != generation))
+                return;
+
+            auto& slot = slots_[index];
+
+            ++slot.generation;
+            slot.nextFree = freeHead_;
+            freeHead_ = index;
+
+            if (deferRelease_) {
+                deferred_.push_back({ std::move(slot.obj), slot.size });
+                return;
+            }
+
+            released.push_back({ std::move(slot.obj), slot.size });
+        }
+
+        Free(released);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // TrackedRef
+    //////////////////////////////////////////////////////////////////////////
+    TrackedRef::TrackedRef(const std::shared_ptr<TrackerRegistry>& registry, uint32_t index, uint32_t generation) noexcept
+        : registry_{ registry }
+        , index_{ index }
+        , generation_{ generation }
+    {
+    }
+
+    TrackedRef::TrackedRef(TrackedRef&& other) noexcept
+        : registry_{ std::move(other.registry_) }
+        , index_{ other.index_ }
+        , generation_{ other.generation_ }
+    {
+        other.registry_.reset();
+    }
+
+    TrackedRef::~TrackedRef()
+    {
+        Release();
+    }
+
+    TrackedRef& TrackedRef::operator=(TrackedRef&& other) noexcept
+    {
+        if (this != &other) {
+            Release();
+
+            registry_ = std::move(other.registry_);
+            index_ = other.index_;
+            generation_ = other.generation_;
+
+            other.registry_.reset();
+        }
+
+        return *this;
+    }
+
+    void TrackedRef::Release()
+    {
+        auto registry = registry_.lock();
+
+        if (registry)
+            registry->Release(index_, generation_);
+
+        registry_.reset();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // ObjectTracker
+    //////////////////////////////////////////////////////////////////////////
+    ObjectTracker::ObjectTracker(bool deferRelease)
+        : registry_{ std::make_shared<TrackerRegistry>(deferRelease) }
+    {
+        registry_->slots_.reserve(16);
+    }
+
+    ResourceStats ObjectTracker::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(registry_->mutex_);
+
+        return registry_->stats_;
+    }
+
+    TrackedRef ObjectTracker::RegisterObject(const std::shared_ptr<TrackedObject>& obj, uint64_t size)
     {
-        objects_.reserve(16);
+        auto& registry = *registry_;
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+
+        uint32_t index;
+
+        if (registry.freeHead_ != TrackerRegistry::INVALID_SLOT) {
+            index = registry.freeHead_;
+            registry.freeHead_ = registry.slots_[index].nextFree;
+        } else {
+            index = static_cast<uint32_t>(registry.slots_.size());
+            registry.slots_.push_back({});
+        }
+
+        auto& slot = registry.slots_[index];
+
+        slot.obj = obj;
+        slot.size = size;
+        slot.nextFree = TrackerRegistry::INVALID_SLOT;
+
+        ++registry.stats_.numLiveObjects;
+        registry.stats_.liveBytes += size;
+        ++registry.stats_.numCreated;
+
+        return TrackedRef(registry_, index, slot.generation);
     }
 
-    void ObjectTracker::RegisterObject(const std::shared_ptr<TrackedObject>& obj)
+    void ObjectTracker::ReleaseDeferred(const std::function<void(const TrackedObject&)>& onRelease)
     {
-        objects_.emplace_back(obj);
+        std::vector<TrackerRegistry::Released> released;
+
+        {
+            std::lock_guard<std::mutex> lock(registry_->mutex_);
+
+            released.swap(registry_->deferred_);
+        }
+
+        if (onRelease) {
+            for (auto& iter : released) {
+                onRelease(*iter.obj);
+            }
+        }
+
+        registry_->Free(released);
     }
 
     void ObjectTracker::ReleaseObjects()
     {
-        for (auto& obj : objects_) {
-            obj.reset();
+        std::vector<TrackerRegistry::Released> released;
+
+        {
+            auto& registry = *registry_;
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+
+            released.swap(registry.deferred_);
+
+            for (uint32_t i = 0; i < registry.slots_.size(); ++i) {
+                auto& slot = registry.slots_[i];
+
+                if (!slot.obj)
+                    continue;
+
+                ++slot.generation;
+                slot.nextFree = registry.freeHead_;
+                registry.freeHead_ = i;
+
+                released.push_back({ std::move(slot.obj), slot.size });
+            }
         }
+
+        registry_->Free(released);
     }
-} // namespace ninniku
\ No newline at end of file
+} // namespace ninniku
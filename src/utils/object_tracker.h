@@ -22,12 +22,10 @@
 
 #include "ninniku/core/renderer/types.h"
 
+#include <functional>
+
 namespace ninniku
 {
-    // TODO: we need to address the case were user owned objects like a command
-    // goes are destroyed and never re-used again. At the moment, ObjectTracker will
-    // hold dead references..
-
     //////////////////////////////////////////////////////////////////////////
     // Track objects externally so we can free them when Terminate() is called
     //////////////////////////////////////////////////////////////////////////
@@ -36,18 +34,49 @@ namespace ninniku
         virtual ~TrackedObject() = default;
     };
 
+    struct TrackerRegistry;
+
+    //////////////////////////////////////////////////////////////////////////
+    // TrackedRef: owned by the handle given to the user, frees the object with it
+    //////////////////////////////////////////////////////////////////////////
+    class TrackedRef
+    {
+    public:
+        TrackedRef() = default;
+        TrackedRef(const std::shared_ptr<TrackerRegistry>& registry, uint32_t index, uint32_t generation) noexcept;
+        TrackedRef(TrackedRef&& other) noexcept;
+        ~TrackedRef();
+
+        TrackedRef(const TrackedRef&) = delete;
+        TrackedRef& operator=(const TrackedRef&) = delete;
+        TrackedRef& operator=(TrackedRef&& other) noexcept;
+
+        void Release();
+
+    private:
+        // the device can be finalized before the user drops its handles
+        std::weak_ptr<TrackerRegistry> registry_;
+        uint32_t index_ = 0;
+        uint32_t generation_ = 0;
+    };
+
     //////////////////////////////////////////////////////////////////////////
-    // ObjectTracker
+    // ObjectTracker: slots are recycled, a stale TrackedRef is detected by its generation
     //////////////////////////////////////////////////////////////////////////
     class ObjectTracker : NonCopyable
     {
     public:
-        ObjectTracker();
+        // with deferRelease, objects are only freed by ReleaseDeferred so in flight GPU work can finish first
+        ObjectTracker(bool deferRelease = false);
+
+        ResourceStats GetStats() const;
+        [[nodiscard]] TrackedRef RegisterObject(const std::shared_ptr<TrackedObject>& obj, uint64_t size);
 
-        void RegisterObject(const std::shared_ptr<TrackedObject>& obj);
+        // onRelease sees each object right before it is freed
+        void ReleaseDeferred(const std::function<void(const TrackedObject&)>& onRelease = nullptr);
         void ReleaseObjects();
 
     private:
-        std::vector<std::shared_ptr<TrackedObject>> objects_;
+        std::shared_ptr<TrackerRegistry> registry_;
     };
 } // namespace ninniku
@@ -0,0 +1,222 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "stats.h"
+
+#include "ninniku/core/renderer/renderdevice.h"
+
+#include <cmath>
+#include <mutex>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadStats: only written by its thread, the others can read it at any time
+    //////////////////////////////////////////////////////////////////////////
+    struct ThreadStats
+    {
+        struct Histogram
+        {
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> totalUs;
+            std::atomic<uint64_t> maxUs;
+            std::array<std::atomic<uint64_t>, LatencyHistogram::NUM_BUCKETS> buckets;
+        };
+
+        std::array<std::atomic<uint64_t>, SC_Count> counters;
+        std::array<Histogram, SL_Count> latencies;
+    };
+
+    // a single writer does not need a locked read-modify-write
+    static void AddRelaxed(std::atomic<uint64_t>& value, uint64_t delta)
+    {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    static void Accumulate(Stats& dst, const ThreadStats& src)
+    {
+        for (uint32_t i = 0; i < SC_Count; ++i) {
+            dst.counters[i] += src.counters[i].load(std::memory_order_relaxed);
+        }
+
+        for (uint32_t i = 0; i < SL_Count; ++i) {
+            auto& dstHisto = dst.latencies[i];
+            auto& srcHisto = src.latencies[i];
+
+            dstHisto.count += srcHisto.count.load(std::memory_order_relaxed);
+            dstHisto.totalUs += srcHisto.totalUs.load(std::memory_order_relaxed);
+            dstHisto.maxUs = std::max(dstHisto.maxUs, srcHisto.maxUs.load(std::memory_order_relaxed));
+
+            for (uint32_t j = 0; j < LatencyHistogram::NUM_BUCKETS; ++j) {
+                dstHisto.buckets[j] += srcHisto.buckets[j].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // StatsRegistry
+    //////////////////////////////////////////////////////////////////////////
+    struct StatsRegistry
+    {
+        std::mutex mutex;
+        std::vector<const ThreadStats*> threads;
+
+        // what threads that already exited recorded
+        Stats retired = {};
+    };
+
+    static StatsRegistry& GetRegistry()
+    {
+        // constructed by the first thread registering so it outlives every thread_local
+        static StatsRegistry registry;
+
+        return registry;
+    }
+
+    class ThreadStatsOwner
+    {
+        // no copy of any kind allowed
+        ThreadStatsOwner(const ThreadStatsOwner&) = delete;
+        ThreadStatsOwner& operator=(ThreadStatsOwner&) = delete;
+        ThreadStatsOwner(ThreadStatsOwner&&) = delete;
+        ThreadStatsOwner& operator=(ThreadStatsOwner&&) = delete;
+
+    public:
+        ThreadStatsOwner()
+        {
+            auto& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            registry.threads.push_back(&stats_);
+        }
+
+        ~ThreadStatsOwner()
+        {
+            auto& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            Accumulate(registry.retired, stats_);
+
+            registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &stats_));
+        }
+
+        ThreadStats& Get() { return stats_; }
+
+    private:
+        ThreadStats stats_ = {};
+    };
+
+    static ThreadStats& GetThreadStats()
+    {
+        static thread_local ThreadStatsOwner owner;
+
+        return owner.Get();
+    }
+
+    void AddStat(EStatCounter counter, uint64_t value)
+    {
+        AddRelaxed(GetThreadStats().counters[counter], value);
+    }
+
+    void AddLatency(EStatLatency latency, uint64_t us)
+    {
+        auto& histo = GetThreadStats().latencies[latency];
+
+        AddRelaxed(histo.count, 1);
+        AddRelaxed(histo.totalUs, us);
+        AddRelaxed(histo.buckets[LatencyHistogram::GetBucket(us)], 1);
+
+        if (us > histo.maxUs.load(std::memory_order_relaxed))
+            histo.maxUs.store(us, std::memory_order_relaxed);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // LatencyHistogram
+    //////////////////////////////////////////////////////////////////////////
+    uint32_t LatencyHistogram::GetBucket(uint64_t us)
+    {
+        // the first buckets are one microsecond wide
+        if (us < NUM_SUB_BUCKETS)
+            return static_cast<uint32_t>(us);
+
+        uint32_t msb = SUB_BUCKET_BITS;
+
+        while ((msb < 63) && ((us >> (msb + 1)) != 0))
+            ++msb;
+
+        auto shift = msb - SUB_BUCKET_BITS;
+        auto subBucket = static_cast<uint32_t>(us >> shift) - NUM_SUB_BUCKETS;
+
+        return std::min((shift + 1) * NUM_SUB_BUCKETS + subBucket, NUM_BUCKETS - 1);
+    }
+
+    uint64_t LatencyHistogram::GetBucketLowerBound(uint32_t bucket)
+    {
+        if (bucket < NUM_SUB_BUCKETS)
+            return bucket;
+
+        auto shift = bucket / NUM_SUB_BUCKETS - 1;
+
+        return static_cast<uint64_t>(NUM_SUB_BUCKETS + bucket % NUM_SUB_BUCKETS) << shift;
+    }
+
+    uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const
+    {
+        if (count == 0)
+            return 0;
+
+        auto target = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) * count / 100.0));
+        uint64_t total = 0;
+
+        target = std::max<uint64_t>(target, 1);
+
+        for (uint32_t i = 0; i < NUM_BUCKETS - 1; ++i) {
+            total += buckets[i];
+
+            if (total >= target)
+                return std::min(GetBucketLowerBound(i + 1) - 1, maxUs);
+        }
+
+        return maxUs;
+    }
+
+    Stats GetStats()
+    {
+        Stats res;
+
+        {
+            auto& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            res = registry.retired;
+
+            for (auto threadStats : registry.threads) {
+                Accumulate(res, *threadStats);
+            }
+        }
+
+        auto& dx = GetRenderer();
+
+        res.resources = dx ? dx->GetResourceStats() : ResourceStats{};
+
+        return res;
+    }
+} // namespace ninniku
@@ -0,0 +1,62 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/stats.h"
+
+#include <chrono>
+
+namespace ninniku
+{
+    // only touch the counters of the calling thread so they never contend
+    void AddStat(EStatCounter counter, uint64_t value = 1);
+    void AddLatency(EStatLatency latency, uint64_t us);
+
+    //////////////////////////////////////////////////////////////////////////
+    // ScopedLatency: records how long the scope took when it ends
+    //////////////////////////////////////////////////////////////////////////
+    class ScopedLatency
+    {
+        // no copy of any kind allowed
+        ScopedLatency(const ScopedLatency&) = delete;
+        ScopedLatency& operator=(ScopedLatency&) = delete;
+        ScopedLatency(ScopedLatency&&) = delete;
+        ScopedLatency& operator=(ScopedLatency&&) = delete;
+
+    public:
+        ScopedLatency(EStatLatency latency)
+            : latency_{ latency }
+            , start_{ std::chrono::steady_clock::now() }
+        {
+        }
+
+        ~ScopedLatency()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+
+            AddLatency(latency_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        }
+
+    private:
+        EStatLatency latency_;
+        std::chrono::steady_clock::time_point start_;
+    };
+} // namespace ninniku
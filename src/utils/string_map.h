@@ -20,65 +20,172 @@
 
 #pragma once
 
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace ninniku
 {
+    // Flat hash map keyed by strings which can be looked up with a std::string_view without copying it
+    // Entries are stored densely in insertion order and found through an open addressing index with
+    // linear probing. Each entry keeps its hash so probing only compares strings when hashes match.
+    // Inserting may invalidate iterators and references, erasing is not supported.
     template<typename ValueType>
-    class StringMap : public std::unordered_map<std::string, ValueType>
+    class StringMap
     {
     public:
+        using value_type = std::pair<std::string, ValueType>;
+        using iterator = typename std::vector<value_type>::iterator;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+
+        iterator begin() noexcept { return entries_.begin(); }
+        const_iterator begin() const noexcept { return entries_.begin(); }
+        iterator end() noexcept { return entries_.end(); }
+        const_iterator end() const noexcept { return entries_.end(); }
+
+        bool empty() const noexcept { return entries_.empty(); }
+        size_t size() const noexcept { return entries_.size(); }
 
-        typename std::unordered_map<std::string, ValueType>::iterator find(const std::string_view& str)
+        void clear() noexcept
         {
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
-            return std::unordered_map<std::string, ValueType>::find(tmp_);
+            entries_.clear();
+            hashes_.clear();
+            slots_.clear();
         }
 
-        typename std::unordered_map<std::string, ValueType>::const_iterator find(const std::string_view& str) const
+        iterator find(const std::string_view& str)
         {
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
-            return std::unordered_map<std::string, ValueType>::find(tmp_);
+            auto index = FindIndex(str, Hash(str));
+
+            return (index == NOT_FOUND) ? end() : begin() + index;
         }
 
-        ValueType& operator[](const std::string_view& str)
+        const_iterator find(const std::string_view& str) const
         {
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
+            auto index = FindIndex(str, Hash(str));
 
-            return std::unordered_map<std::string, ValueType>::operator [](tmp_);
+            return (index == NOT_FOUND) ? end() : begin() + index;
         }
 
-        const ValueType& operator[](const std::string_view& str) const
+        ValueType& operator[](const std::string_view& str)
         {
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
+            auto hash = Hash(str);
+            auto index = FindIndex(str, hash);
 
-            return std::unordered_map<std::string, ValueType>::operator [](tmp_);
+            if (index == NOT_FOUND)
+                index = Insert(str, hash, ValueType{});
+
+            return entries_[index].second;
         }
 
         void emplace(const std::string_view& str, const ValueType& value)
         {
-            // discard return value since it is not needed
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
+            auto hash = Hash(str);
 
-            std::unordered_map<std::string, ValueType>::emplace(tmp_, value);
+            // like std::unordered_map, an existing value is left untouched
+            if (FindIndex(str, hash) == NOT_FOUND)
+                Insert(str, hash, value);
         }
 
         void emplace(const std::string_view& str, ValueType&& value)
         {
-            // discard return value since it is not needed
-            tmp_.reserve(str.size());
-            tmp_.assign(str.data(), str.size());
+            auto hash = Hash(str);
+
+            if (FindIndex(str, hash) == NOT_FOUND)
+                Insert(str, hash, std::move(value));
+        }
+
+        void reserve(const size_t count)
+        {
+            entries_.reserve(count);
+            hashes_.reserve(count);
 
-            std::unordered_map<std::string, ValueType>::emplace(tmp_, std::move(value));
+            if (SlotsNeeded(count) > slots_.size())
+                Rehash(SlotsNeeded(count));
         }
 
     private:
-        thread_local static std::string tmp_;
-    };
+        static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t EMPTY_SLOT = 0;
+        static constexpr size_t MIN_SLOTS = 8;
 
-    template<typename ValueType>
-    thread_local std::string StringMap<ValueType>::tmp_;
+        static size_t Hash(const std::string_view& str) noexcept { return std::hash<std::string_view>{}(str); }
+
+        // keep the load factor under 3/4 with a power of 2 so probing can mask instead of modulo
+        static size_t SlotsNeeded(const size_t count) noexcept
+        {
+            auto res = MIN_SLOTS;
+
+            while (res * 3 < count * 4)
+                res *= 2;
+
+            return res;
+        }
+
+        uint32_t FindIndex(const std::string_view& str, const size_t hash) const noexcept
+        {
+            if (slots_.empty())
+                return NOT_FOUND;
+
+            auto mask = slots_.size() - 1;
+
+            for (auto slot = hash & mask;; slot = (slot + 1) & mask) {
+                auto stored = slots_[slot];
+
+                if (stored == EMPTY_SLOT)
+                    return NOT_FOUND;
+
+                // slots store index + 1 so 0 can mean empty
+                auto index = stored - 1;
+
+                if ((hashes_[index] == hash) && (entries_[index].first == str))
+                    return index;
+            }
+        }
+
+        template<typename T>
+        uint32_t Insert(const std::string_view& str, const size_t hash, T&& value)
+        {
+            if (SlotsNeeded(entries_.size() + 1) > slots_.size())
+                Rehash(SlotsNeeded(entries_.size() + 1));
+
+            auto index = static_cast<uint32_t>(entries_.size());
+
+            entries_.emplace_back(std::string{ str }, std::forward<T>(value));
+            hashes_.push_back(hash);
+            Place(index, hash);
+
+            return index;
+        }
+
+        void Place(const uint32_t index, const size_t hash) noexcept
+        {
+            auto mask = slots_.size() - 1;
+            auto slot = hash & mask;
+
+            while (slots_[slot] != EMPTY_SLOT)
+                slot = (slot + 1) & mask;
+
+            slots_[slot] = index + 1;
+        }
+
+        void Rehash(const size_t numSlots)
+        {
+            slots_.assign(numSlots, EMPTY_SLOT);
+
+            for (uint32_t i = 0; i < hashes_.size(); ++i)
+                Place(i, hashes_[i]);
+        }
+
+    private:
+        std::vector<value_type> entries_;
+
+        // same order as entries_
+        std::vector<size_t> hashes_;
+
+        // index + 1 in entries_, EMPTY_SLOT when unused
+        std::vector<uint32_t> slots_;
+    };
 } // namespace ninniku
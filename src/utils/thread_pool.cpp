@@ -0,0 +1,207 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pch.h"
+#include "thread_pool.h"
+
+#include "trace.h"
+
+namespace ninniku
+{
+    // so a worker submitting more work pushes to its own queue
+    static thread_local const ThreadPool* tlsPool = nullptr;
+    static thread_local uint32_t tlsWorkerIndex = 0;
+
+    ThreadPool::ThreadPool(uint32_t numThreads)
+        : pending_{ 0 }
+        , nextQueue_{ 0 }
+        , stop_{ false }
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        queues_.reserve(numThreads);
+        workers_.reserve(numThreads);
+
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            queues_.emplace_back(std::make_unique<WorkQueue>());
+        }
+
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            workers_.emplace_back(&ThreadPool::WorkerMain, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            stop_ = true;
+        }
+
+        wakeCV_.notify_all();
+
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::ParallelFor(uint32_t count, uint32_t grain, const RangeTask& task)
+    {
+        TRACE_SCOPED_UTILS;
+
+        if (count == 0)
+            return;
+
+        grain = std::max(1u, grain);
+
+        auto numChunks = (count + grain - 1) / grain;
+
+        // nothing to gain from going wide
+        if (numChunks == 1) {
+            task(0, count);
+            return;
+        }
+
+        std::atomic<uint32_t> remaining{ numChunks };
+
+        for (uint32_t i = 0; i < numChunks; ++i) {
+            auto begin = i * grain;
+            auto end = std::min(count, begin + grain);
+
+            Submit([&task, &remaining, begin, end]()
+            {
+                task(begin, end);
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+        }
+
+        // help instead of blocking, this also prevents a deadlock when called from a worker
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!RunPendingTask())
+                std::this_thread::yield();
+        }
+    }
+
+    bool ThreadPool::PopTask(uint32_t index, Task& task)
+    {
+        auto numQueues = static_cast<uint32_t>(queues_.size());
+
+        // own queue is LIFO since the most recent task is the most likely to be in cache
+        {
+            auto& queue = *queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+
+            if (!queue.tasks_.empty()) {
+                task = std::move(queue.tasks_.back());
+                queue.tasks_.pop_back();
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // steal the oldest task from the others
+        for (uint32_t i = 1; i < numQueues; ++i) {
+            auto& queue = *queues_[(index + i) % numQueues];
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+
+            if (!queue.tasks_.empty()) {
+                task = std::move(queue.tasks_.front());
+                queue.tasks_.pop_front();
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool ThreadPool::RunPendingTask()
+    {
+        auto index = (tlsPool == this) ? tlsWorkerIndex : nextQueue_.load(std::memory_order_relaxed) % queues_.size();
+        Task task;
+
+        if (!PopTask(static_cast<uint32_t>(index), task))
+            return false;
+
+        task();
+
+        return true;
+    }
+
+    void ThreadPool::Submit(Task&& task)
+    {
+        uint32_t index;
+
+        if (tlsPool == this)
+            index = tlsWorkerIndex;
+        else
+            index = nextQueue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+        {
+            auto& queue = *queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+
+            queue.tasks_.emplace_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            pending_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        wakeCV_.notify_one();
+    }
+
+    void ThreadPool::WorkerMain(uint32_t index)
+    {
+        tlsPool = this;
+        tlsWorkerIndex = index;
+
+        Task task;
+
+        for (;;) {
+            if (PopTask(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+
+            wakeCV_.wait(lock, [this]() { return stop_ || (pending_.load(std::memory_order_relaxed) > 0); });
+
+            if (stop_ && (pending_.load(std::memory_order_relaxed) <= 0))
+                return;
+        }
+    }
+
+    void ParallelFor(ThreadPool* pool, uint32_t count, uint32_t minGrain, const ThreadPool::RangeTask& task)
+    {
+        if (pool == nullptr) {
+            if (count > 0)
+                task(0, count);
+
+            return;
+        }
+
+        pool->ParallelFor(count, std::max(minGrain, count / (pool->GetNumThreads() * 4)), task);
+    }
+} // namespace ninniku
@@ -0,0 +1,102 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include "ninniku/utils.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace ninniku
+{
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadPool: each worker owns a queue and steals from the others when empty
+    //////////////////////////////////////////////////////////////////////////
+    class ThreadPool : NonCopyable
+    {
+    public:
+        using Task = std::function<void()>;
+        using RangeTask = std::function<void(uint32_t begin, uint32_t end)>;
+
+        // numThreads = 0 will use every hardware thread available
+        ThreadPool(uint32_t numThreads = 0);
+        ~ThreadPool() override;
+
+        uint32_t GetNumThreads() const { return static_cast<uint32_t>(workers_.size()); }
+
+        // split [0, count) in chunks of grain elements and block until they are all processed
+        // the calling thread will also execute chunks while it waits
+        void ParallelFor(uint32_t count, uint32_t grain, const RangeTask& task);
+
+        // run one pending task from any queue, returns false if there was nothing to do
+        bool RunPendingTask();
+
+        void Submit(Task&& task);
+
+    private:
+        struct WorkQueue
+        {
+            std::mutex mutex_;
+            std::deque<Task> tasks_;
+        };
+
+        bool PopTask(uint32_t index, Task& task);
+        void WorkerMain(uint32_t index);
+
+    private:
+        std::vector<std::unique_ptr<WorkQueue>> queues_;
+        std::vector<std::thread> workers_;
+
+        std::mutex wakeMutex_;
+        std::condition_variable wakeCV_;
+
+        // can be temporarily negative when a task is stolen before it is accounted for
+        std::atomic<int32_t> pending_;
+        std::atomic<uint32_t> nextQueue_;
+        bool stop_;
+    };
+
+    // a few chunks of at least minGrain elements per worker so stealing can balance the work
+    // runs on the calling thread when there is no pool (eg: ninniku was not initialized)
+    void ParallelFor(ThreadPool* pool, uint32_t count, uint32_t minGrain, const ThreadPool::RangeTask& task);
+
+    // wait for the predicate while running pending tasks so a worker calling this cannot deadlock the pool
+    template<typename Predicate>
+    void HelpUntil(ThreadPool* pool, std::condition_variable& cv, std::unique_lock<std::mutex>& lock, Predicate pred)
+    {
+        while (!pred()) {
+            if (pool != nullptr) {
+                lock.unlock();
+                auto ran = pool->RunPendingTask();
+                lock.lock();
+
+                if (ran)
+                    continue;
+            }
+
+            cv.wait(lock, pred);
+        }
+    }
+} // namespace ninniku
@@ -22,6 +22,9 @@
 
 #ifndef TRACY_ENABLE
 
+#define TRACE_SCOPED_CPU
+#define TRACE_SCOPED_NAMED_CPU
+
 #define TRACE_SCOPED_DX11
 #define TRACE_SCOPED_NAMED_DX11
 
@@ -30,6 +33,13 @@
 
 #define TRACE_SCOPED_UTILS
 
+#define TRACE_SCOPED_IMAGE
+#define TRACE_SCOPED_NAMED_IMAGE(X)
+#define TRACE_ALLOC_IMAGE(P, S)
+#define TRACE_FREE_IMAGE(P)
+#define TRACE_THROUGHPUT_IMAGE(X)
+#define TRACE_THROUGHPUT_ADD_IMAGE(X)
+
 #else
 
 #include <Tracy.hpp>
@@ -38,10 +48,15 @@ enum ETraceCategories
 {
     TC_DX11 = 1 << 0,
     TC_DX12 = 1 << 1,
-    TC_UTILS = 1 << 2
+    TC_UTILS = 1 << 2,
+    TC_CPU = 1 << 3,
+    TC_IMAGE = 1 << 4
 };
 
-#define TRACE_CATEGORIES (TC_DX11 | TC_DX12 | TC_UTILS)
+#define TRACE_CATEGORIES (TC_DX11 | TC_DX12 | TC_UTILS | TC_CPU | TC_IMAGE)
+
+#define TRACE_SCOPED_CPU ZoneNamed(__tracy, TRACE_CATEGORIES & TC_CPU);
+#define TRACE_SCOPED_NAMED_CPU(X) ZoneNamedN(__tracy, X, TRACE_CATEGORIES & TC_CPU);
 
 #define TRACE_SCOPED_DX11 ZoneNamed(__tracy, TRACE_CATEGORIES & TC_DX11);
 #define TRACE_SCOPED_NAMED_DX11(X) ZoneNamedN(__tracy, X, TRACE_CATEGORIES & TC_DX11);
@@ -51,4 +66,53 @@ enum ETraceCategories
 
 #define TRACE_SCOPED_UTILS ZoneNamed(__tracy, TRACE_CATEGORIES & TC_UTILS);
 
+#define TRACE_SCOPED_IMAGE ZoneNamed(__tracy, TRACE_CATEGORIES & TC_IMAGE);
+#define TRACE_SCOPED_NAMED_IMAGE(X) ZoneNamedN(__tracy, X, TRACE_CATEGORIES & TC_IMAGE);
+
+// pixel memory owned by images (ScratchImage, cmft, stb) so it shows up in the memory view
+#define TRACE_ALLOC_IMAGE(P, S) if (((TRACE_CATEGORIES & TC_IMAGE) != 0) && ((P) != nullptr)) { TracyAlloc(P, S); }
+#define TRACE_FREE_IMAGE(P) if (((TRACE_CATEGORIES & TC_IMAGE) != 0) && ((P) != nullptr)) { TracyFree(P); }
+
+#define TRACE_THROUGHPUT_IMAGE(X) ninniku::TraceThroughput __tracyThroughput{ X, (TRACE_CATEGORIES & TC_IMAGE) != 0 }
+#define TRACE_THROUGHPUT_ADD_IMAGE(X) __tracyThroughput.Add(X)
+
+#include <chrono>
+
+namespace ninniku
+{
+    // plots the MB/s processed by the enclosing scope when it ends
+    class TraceThroughput
+    {
+        // no copy of any kind allowed
+        TraceThroughput(const TraceThroughput&) = delete;
+        TraceThroughput& operator=(TraceThroughput&) = delete;
+        TraceThroughput(TraceThroughput&&) = delete;
+        TraceThroughput& operator=(TraceThroughput&&) = delete;
+
+    public:
+        TraceThroughput(const char* plot, bool active)
+            : plot_{ plot }
+            , active_{ active }
+            , start_{ std::chrono::steady_clock::now() }
+        {
+        }
+
+        ~TraceThroughput()
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+
+            if (active_ && (bytes_ > 0) && (elapsed.count() > 0))
+                TracyPlot(plot_, bytes_ / (elapsed.count() * 1024.0 * 1024.0));
+        }
+
+        void Add(uint64_t bytes) { bytes_ += bytes; }
+
+    private:
+        const char* plot_;
+        bool active_;
+        uint64_t bytes_ = 0;
+        std::chrono::steady_clock::time_point start_;
+    };
+} // namespace ninniku
+
 #endif
\ No newline at end of file
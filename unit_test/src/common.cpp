@@ -29,10 +29,8 @@
 
 #include <boost/test/unit_test.hpp>
 
-ninniku::TextureHandle GenerateColoredMips(ninniku::RenderDeviceHandle& dx, const std::string_view& shaderRoot)
+ninniku::TextureHandle DispatchColoredMips(ninniku::RenderDeviceHandle& dx)
 {
-    BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
-
     auto param = ninniku::TextureParam::Create();
     param->format = ninniku::TF_R32G32B32A32_FLOAT;
     param->width = param->height = 512;
@@ -70,6 +68,13 @@ ninniku::TextureHandle GenerateColoredMips(ninniku::RenderDeviceHandle& dx, cons
     return resTex;
 }
 
+ninniku::TextureHandle GenerateColoredMips(ninniku::RenderDeviceHandle& dx, const std::string_view& shaderRoot)
+{
+    BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
+
+    return DispatchColoredMips(dx);
+}
+
 ninniku::TextureHandle GenerateColoredCubeArrayMips(ninniku::RenderDeviceHandle& dx, const std::string_view& shaderRoot)
 {
     BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
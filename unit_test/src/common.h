@@ -22,6 +22,8 @@
 
 #include <ninniku/core/image/image.h>
 
+// colorMips must already be loaded
+ninniku::TextureHandle DispatchColoredMips(ninniku::RenderDeviceHandle& dx);
 ninniku::TextureHandle GenerateColoredMips(ninniku::RenderDeviceHandle& dx, const std::string_view& shaderRoot);
 ninniku::TextureHandle GenerateColoredCubeArrayMips(ninniku::RenderDeviceHandle& dx, const std::string_view& shaderRoot);
 ninniku::TextureHandle Generate2DTexWithMips(ninniku::RenderDeviceHandle& dx, const ninniku::Image* image, const std::string_view& shaderRoot);
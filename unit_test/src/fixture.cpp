@@ -20,6 +20,7 @@
 
 #include "fixture.h"
 
+#include "kernels.h"
 #include "utils.h"
 
 #include <iostream>
@@ -47,6 +48,23 @@ SetupFixtureNull::~SetupFixtureNull()
     ninniku::Terminate();
 }
 
+SetupFixtureCPU::SetupFixtureCPU()
+{
+    auto renderer = ninniku::ERenderer::RENDERER_CPU;
+    uint32_t flags = ninniku::EInitializationFlags::IF_BC7_QUICK_MODE;
+
+    if (!ninniku::Initialize(renderer, flags, ninniku::ELogLevel::LL_FULL)) {
+        std::cout << "Failed to initialize Ninniku." << std::endl;
+    } else if (!RegisterKernels()) {
+        std::cout << "Failed to register kernels." << std::endl;
+    }
+}
+
+SetupFixtureCPU::~SetupFixtureCPU()
+{
+    ninniku::Terminate();
+}
+
 SetupFixtureDX11::SetupFixtureDX11()
     : shaderRoot{ DX11ShadersRoot }
 {
@@ -151,6 +169,38 @@ SetupFixtureDX12WarpSlow::SetupFixtureDX12WarpSlow()
 }
 
 SetupFixtureDX12WarpSlow::~SetupFixtureDX12WarpSlow()
+{
+    ninniku::Terminate();
+}
+
+SetupFixtureDX11WarpLazy::SetupFixtureDX11WarpLazy()
+    : shaderRoot{ DX11ShadersRoot }
+{
+    auto renderer = ninniku::ERenderer::RENDERER_WARP_DX11;
+    uint32_t flags = ninniku::EInitializationFlags::IF_BC7_QUICK_MODE | ninniku::EInitializationFlags::IF_LazyShaderLoading;
+
+    if (!ninniku::Initialize(renderer, flags, ninniku::ELogLevel::LL_FULL)) {
+        std::cout << "Failed to initialize Ninniku." << std::endl;
+    }
+}
+
+SetupFixtureDX11WarpLazy::~SetupFixtureDX11WarpLazy()
+{
+    ninniku::Terminate();
+}
+
+SetupFixtureDX12WarpLazy::SetupFixtureDX12WarpLazy()
+    : shaderRoot{ DX12ShadersRoot }
+{
+    auto renderer = ninniku::ERenderer::RENDERER_WARP_DX12;
+    uint32_t flags = ninniku::EInitializationFlags::IF_BC7_QUICK_MODE | ninniku::EInitializationFlags::IF_LazyShaderLoading;
+
+    if (!ninniku::Initialize(renderer, flags, ninniku::ELogLevel::LL_FULL)) {
+        std::cout << "Failed to initialize Ninniku." << std::endl;
+    }
+}
+
+SetupFixtureDX12WarpLazy::~SetupFixtureDX12WarpLazy()
 {
     ninniku::Terminate();
 }
\ No newline at end of file
@@ -32,6 +32,16 @@ struct SetupFixtureNull
     ~SetupFixtureNull();
 };
 
+struct SetupFixtureCPU
+{
+    SetupFixtureCPU();
+    ~SetupFixtureCPU();
+
+    // kernels are registered natively so there is nothing to load from disk
+    std::string_view shaderRoot;
+    bool isNull = false;
+};
+
 struct SetupFixtureDX11
 {
     SetupFixtureDX11();
@@ -86,6 +96,25 @@ struct SetupFixtureDX12WarpSlow
     bool isNull = false;
 };
 
+// IF_LazyShaderLoading
+struct SetupFixtureDX11WarpLazy
+{
+    SetupFixtureDX11WarpLazy();
+    ~SetupFixtureDX11WarpLazy();
+
+    std::string_view shaderRoot;
+    bool isNull = false;
+};
+
+struct SetupFixtureDX12WarpLazy
+{
+    SetupFixtureDX12WarpLazy();
+    ~SetupFixtureDX12WarpLazy();
+
+    std::string_view shaderRoot;
+    bool isNull = false;
+};
+
 typedef boost::mpl::vector<SetupFixtureDX11Warp, SetupFixtureDX12WarpSlow, SetupFixtureDX12Warp> FixturesWarpAll;
 typedef boost::mpl::vector<SetupFixtureDX11, SetupFixtureDX12Slow, SetupFixtureDX12> FixturesHWAll;
 typedef boost::mpl::joint_view<FixturesHWAll, FixturesWarpAll> FixturesAll;
@@ -95,6 +124,11 @@ typedef boost::mpl::vector<SetupFixtureDX11Warp> FixtureDX11Warp;
 
 typedef boost::mpl::vector<SetupFixtureDX12Slow, SetupFixtureDX12> FixturesDX12;
 typedef boost::mpl::vector<SetupFixtureDX12WarpSlow, SetupFixtureDX12Warp> FixturesDX12Warp;
+typedef boost::mpl::joint_view<FixturesDX12, FixturesDX12Warp> FixturesDX12All;
 
 typedef boost::mpl::vector<SetupFixtureDX12Slow> FixtureDX12Slow;
 typedef boost::mpl::vector<SetupFixtureDX12> FixtureDX12;
+
+typedef boost::mpl::vector<SetupFixtureCPU> FixtureCPU;
+
+typedef boost::mpl::vector<SetupFixtureDX11WarpLazy, SetupFixtureDX12WarpLazy> FixturesWarpLazy;
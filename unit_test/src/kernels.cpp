@@ -0,0 +1,91 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "kernels.h"
+
+#include "shaders/cbuffers.h"
+#include "shaders/dispatch.h"
+
+#include <ninniku/core/renderer/kernel.h>
+
+#include <algorithm>
+#include <array>
+
+using float4 = std::array<float, 4>;
+
+// same as shaders/color20.hlsl
+static constexpr std::array<std::array<float, 3>, 21> color20 = { {
+    { 0, 1, 0 },
+    { 0, 0, 1 },
+    { 1, 0, 0 },
+    { 0.003f, 1, 0.996f },
+    { 1, 0.650f, 0.996f },
+    { 1, 0.858f, 0.4f },
+    { 0, 0.392f, 0.003f },
+    { 0.003f, 0, 0.403f },
+    { 0.584f, 0, 0.227f },
+    { 0, 0.490f, 0.709f },
+    { 1, 0, 0.964f },
+    { 1, 0.933f, 0.909f },
+    { 0.466f, 0.301f, 0 },
+    { 0.564f, 0.984f, 0.572f },
+    { 0, 0.462f, 1 },
+    { 0.835f, 1, 0 },
+    { 1, 0.576f, 0.494f },
+    { 0.415f, 0.509f, 0.423f },
+    { 1, 0.007f, 0.615f },
+    { 0.996f, 0.537f, 0 },
+    { 0.478f, 0.278f, 0.509f }
+} };
+
+static bool RegisterColorMips()
+{
+    ninniku::KernelDesc desc;
+
+    desc.name = "colorMips";
+    desc.numThreads = { COLORMIPS_NUMTHREAD_X, COLORMIPS_NUMTHREAD_Y, COLORMIPS_NUMTHREAD_Z };
+    desc.uavNames = { "dstTex" };
+    desc.cbufferName = "CBGlobal";
+    desc.function = [](const ninniku::KernelContext& ctx)
+    {
+        auto dstTex = ctx.GetUAV(0);
+        auto& color = color20[ctx.GetCBuffer<CBGlobal>()->targetMip];
+        float4 value = { color[0], color[1], color[2], 1 };
+
+        ctx.ForEachRow([&](uint32_t xBegin, uint32_t xEnd, uint32_t y, uint32_t z)
+        {
+            auto& sub = dstTex->GetSubresource(0, z);
+
+            if (y >= sub.height)
+                return;
+
+            auto row = &dstTex->At<float4>(0, y, z);
+
+            std::fill(row + xBegin, row + std::min(xEnd, sub.width), value);
+        });
+    };
+
+    return ninniku::RegisterKernel(desc);
+}
+
+bool RegisterKernels()
+{
+    return RegisterColorMips();
+}
@@ -0,0 +1,162 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../fixture.h"
+
+#include <ninniku/core/image/batch_loader.h>
+#include <ninniku/core/image/cmft.h>
+#include <ninniku/core/image/dds.h>
+#include <ninniku/core/image/generic.h>
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+static const std::vector<std::string> batchPaths = {
+    "data/Cathedral01.dds",
+    "data/banner.png",
+    "data/weave_16.png",
+    "data/park02.exr",
+    "data/weave_8.png"
+};
+
+// images loaded one by one with the same types the loader uses by default
+static void CheckBatchResults(const std::vector<std::string>& paths, std::vector<ninniku::ImageHandle>& results)
+{
+    BOOST_REQUIRE(results.size() == paths.size());
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        ninniku::ImageHandle ref;
+        auto ext = std::filesystem::path{ paths[i] }.extension();
+
+        if (ext == ".dds")
+            ref = std::make_unique<ninniku::ddsImage>();
+        else if (ext == ".exr")
+            ref = std::make_unique<ninniku::cmftImage>();
+        else
+            ref = std::make_unique<ninniku::genericImage>();
+
+        BOOST_REQUIRE(ref->Load(paths[i]));
+        BOOST_REQUIRE(results[i]);
+
+        auto refData = ref->GetData();
+        auto data = results[i]->GetData();
+
+        BOOST_REQUIRE(std::get<1>(data) == std::get<1>(refData));
+        BOOST_REQUIRE(memcmp(std::get<0>(data), std::get<0>(refData), std::get<1>(refData)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(BatchLoader)
+
+BOOST_FIXTURE_TEST_CASE(batch_load, SetupFixtureNull)
+{
+    ninniku::BatchLoader loader;
+    std::mutex mutex;
+    std::vector<ninniku::ImageHandle> results(batchPaths.size());
+    uint32_t numCalls = 0;
+
+    auto res = loader.Load(batchPaths, [&](const uint32_t index, ninniku::ImageHandle image)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        results[index] = std::move(image);
+        ++numCalls;
+    });
+
+    BOOST_REQUIRE(res);
+    BOOST_REQUIRE(numCalls == batchPaths.size());
+
+    CheckBatchResults(batchPaths, results);
+}
+
+BOOST_FIXTURE_TEST_CASE(batch_load_budget, SetupFixtureNull)
+{
+    // every file is bigger than the budget so they must go through one at a time
+    ninniku::BatchLoaderDesc desc;
+
+    desc.maxInFlightBytes = 1;
+
+    ninniku::BatchLoader loader{ desc };
+    std::mutex mutex;
+    std::vector<ninniku::ImageHandle> results(batchPaths.size());
+    uint32_t inCallback = 0;
+    uint32_t maxInCallback = 0;
+
+    auto res = loader.LoadAsync(batchPaths, [&](const uint32_t index, ninniku::ImageHandle image)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            maxInCallback = std::max(maxInCallback, ++inCallback);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        results[index] = std::move(image);
+        --inCallback;
+    });
+
+    BOOST_REQUIRE(res.get());
+    BOOST_REQUIRE(maxInCallback == 1);
+
+    CheckBatchResults(batchPaths, results);
+}
+
+BOOST_FIXTURE_TEST_CASE(batch_load_failures, SetupFixtureNull)
+{
+    std::vector<std::string> paths = { "data/banner.png", "data/missing.png", "data/weave_8.png" };
+    ninniku::BatchLoaderDesc desc;
+
+    // no loader for weave_8
+    desc.factory = [](const std::string_view& path) -> ninniku::ImageHandle
+    {
+        if (path.find("weave") != std::string_view::npos)
+            return nullptr;
+
+        return std::make_unique<ninniku::genericImage>();
+    };
+
+    ninniku::BatchLoader loader{ desc };
+    std::mutex mutex;
+    std::vector<ninniku::ImageHandle> results(paths.size());
+    uint32_t numCalls = 0;
+
+    auto res = loader.Load(paths, [&](const uint32_t index, ninniku::ImageHandle image)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        results[index] = std::move(image);
+        ++numCalls;
+    });
+
+    BOOST_REQUIRE(!res);
+    BOOST_REQUIRE(numCalls == paths.size());
+    BOOST_REQUIRE(results[0]);
+    BOOST_REQUIRE(!results[1]);
+    BOOST_REQUIRE(!results[2]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
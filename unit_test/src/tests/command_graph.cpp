@@ -0,0 +1,186 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../fixture.h"
+
+#include <ninniku/core/renderer/command_graph.h>
+
+BOOST_AUTO_TEST_SUITE(CommandGraph)
+
+using ninniku::EGraphQueue;
+using ninniku::EResourceState;
+using ninniku::GraphAccess;
+using ninniku::GraphBatch;
+using ninniku::GraphPass;
+
+// only used as identifiers
+static int resA = 0;
+static int resB = 0;
+static int resC = 0;
+
+static GraphAccess Access(const int& res, uint32_t numSubresources, uint32_t subresource, EResourceState state)
+{
+    return GraphAccess{ &res, numSubresources, subresource, state };
+}
+
+static GraphAccess Whole(const int& res, EResourceState state)
+{
+    return Access(res, 1, GraphAccess::ALL_SUBRESOURCES, state);
+}
+
+BOOST_FIXTURE_TEST_CASE(graph_merge_dispatches, SetupFixtureNull)
+{
+    // A is only read and B is written by each pass
+    std::vector<GraphPass> passes;
+
+    for (auto i = 0; i < 3; ++i) {
+        passes.push_back(GraphPass{ EGraphQueue::GQ_Compute, { Whole(resA, EResourceState::RS_ShaderResource), Whole(resB, EResourceState::RS_UnorderedAccess) } });
+    }
+
+    ninniku::CompiledGraph compiled;
+
+    BOOST_REQUIRE(ninniku::CompileGraph(passes, compiled));
+
+    // one command list, a transition of B on each side and UAV barriers between the passes
+    BOOST_REQUIRE(compiled.batches.size() == 1);
+    BOOST_REQUIRE(compiled.numWaits == 0);
+    BOOST_REQUIRE(compiled.numBarriers == 4);
+
+    auto& steps = compiled.batches[0].steps;
+
+    BOOST_REQUIRE(steps.size() == 4);
+    BOOST_REQUIRE(steps[0].pass == 0);
+    BOOST_REQUIRE(steps[0].barriers.size() == 1);
+    BOOST_REQUIRE(steps[0].barriers[0].resource == &resB);
+    BOOST_REQUIRE(steps[0].barriers[0].after == EResourceState::RS_UnorderedAccess);
+    BOOST_REQUIRE(steps[1].barriers.size() == 1);
+    BOOST_REQUIRE(steps[1].barriers[0].before == steps[1].barriers[0].after);
+    BOOST_REQUIRE(steps[3].pass == ninniku::GraphStep::NO_PASS);
+    BOOST_REQUIRE(steps[3].barriers[0].after == EResourceState::RS_ShaderResource);
+}
+
+BOOST_FIXTURE_TEST_CASE(graph_subresources, SetupFixtureNull)
+{
+    // mip chain: each pass reads the whole texture and writes the next mip
+    constexpr uint32_t numMips = 3;
+
+    std::vector<GraphPass> passes;
+
+    for (uint32_t i = 1; i < numMips; ++i) {
+        passes.push_back(GraphPass{ EGraphQueue::GQ_Compute, { Access(resA, numMips, GraphAccess::ALL_SUBRESOURCES, EResourceState::RS_ShaderResource), Access(resA, numMips, i, EResourceState::RS_UnorderedAccess) } });
+    }
+
+    ninniku::CompiledGraph compiled;
+
+    BOOST_REQUIRE(ninniku::CompileGraph(passes, compiled));
+    BOOST_REQUIRE(compiled.batches.size() == 1);
+
+    // mip 1 goes to UAV and back, then mip 2 goes to UAV and back
+    BOOST_REQUIRE(compiled.numBarriers == 4);
+
+    auto& steps = compiled.batches[0].steps;
+
+    BOOST_REQUIRE(steps[0].barriers.size() == 1);
+    BOOST_REQUIRE(steps[0].barriers[0].subresource == 1);
+    BOOST_REQUIRE(steps[1].barriers.size() == 2);
+    BOOST_REQUIRE(steps[2].barriers.size() == 1);
+    BOOST_REQUIRE(steps[2].barriers[0].subresource == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(graph_copy_queue, SetupFixtureNull)
+{
+    // B is written on the compute queue then copied to C on the copy queue
+    std::vector<GraphPass> passes = {
+        GraphPass{ EGraphQueue::GQ_Compute, { Whole(resB, EResourceState::RS_UnorderedAccess) } },
+        GraphPass{ EGraphQueue::GQ_Copy, { Whole(resB, EResourceState::RS_CopySource), Whole(resC, EResourceState::RS_CopyDest) } },
+        GraphPass{ EGraphQueue::GQ_Copy, { Whole(resC, EResourceState::RS_CopySource), Whole(resA, EResourceState::RS_CopyDest) } }
+    };
+
+    ninniku::CompiledGraph compiled;
+
+    BOOST_REQUIRE(ninniku::CompileGraph(passes, compiled));
+
+    // compute, both copies, compute to restore the states
+    BOOST_REQUIRE(compiled.batches.size() == 3);
+    BOOST_REQUIRE(compiled.numWaits == 2);
+
+    auto& compute = compiled.batches[0];
+    auto& copy = compiled.batches[1];
+    auto& restore = compiled.batches[2];
+
+    BOOST_REQUIRE(compute.queue == EGraphQueue::GQ_Compute);
+    BOOST_REQUIRE(copy.queue == EGraphQueue::GQ_Copy);
+    BOOST_REQUIRE(restore.queue == EGraphQueue::GQ_Compute);
+
+    // the copy queue cannot leave the shader states so those transitions are done by the compute queue
+    BOOST_REQUIRE(compute.steps.size() == 2);
+    BOOST_REQUIRE(compute.steps[1].pass == ninniku::GraphStep::NO_PASS);
+    BOOST_REQUIRE(compute.steps[1].barriers.size() == 3);
+
+    BOOST_REQUIRE(copy.waits[static_cast<uint32_t>(EGraphQueue::GQ_Compute)] == 0);
+    BOOST_REQUIRE(copy.steps.size() == 2);
+    BOOST_REQUIRE(copy.steps[0].barriers.empty());
+
+    // C from copy dest to copy source stays on the copy queue
+    BOOST_REQUIRE(copy.steps[1].barriers.size() == 1);
+    BOOST_REQUIRE(copy.steps[1].barriers[0].resource == &resC);
+
+    BOOST_REQUIRE(restore.waits[static_cast<uint32_t>(EGraphQueue::GQ_Copy)] == 1);
+    BOOST_REQUIRE(restore.steps[0].barriers.size() == 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(graph_read_only, SetupFixtureNull)
+{
+    // nothing changes so nothing to synchronize
+    std::vector<GraphPass> passes = {
+        GraphPass{ EGraphQueue::GQ_Compute, { Whole(resA, EResourceState::RS_ShaderResource) } },
+        GraphPass{ EGraphQueue::GQ_Compute, { Whole(resA, EResourceState::RS_ShaderResource), Whole(resB, EResourceState::RS_ShaderResource) } }
+    };
+
+    ninniku::CompiledGraph compiled;
+
+    BOOST_REQUIRE(ninniku::CompileGraph(passes, compiled));
+    BOOST_REQUIRE(compiled.batches.size() == 1);
+    BOOST_REQUIRE(compiled.numBarriers == 0);
+    BOOST_REQUIRE(compiled.numWaits == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(graph_invalid, SetupFixtureNull)
+{
+    ninniku::CompiledGraph compiled;
+
+    // same subresource in two states
+    std::vector<GraphPass> passes = {
+        GraphPass{ EGraphQueue::GQ_Compute, { Whole(resA, EResourceState::RS_ShaderResource), Whole(resA, EResourceState::RS_UnorderedAccess) } }
+    };
+
+    BOOST_REQUIRE(!ninniku::CompileGraph(passes, compiled));
+
+    // out of range
+    passes = {
+        GraphPass{ EGraphQueue::GQ_Compute, { Access(resA, 2, 2, EResourceState::RS_ShaderResource) } }
+    };
+
+    BOOST_REQUIRE(!ninniku::CompileGraph(passes, compiled));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,121 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../fixture.h"
+
+#include <ninniku/core/image/convert.h>
+
+#include <DirectXPackedVector.h>
+#include <chrono>
+#include <random>
+
+template<typename T>
+std::vector<uint32_t> PackR11G11B10Reference(const std::vector<T>& rgb)
+{
+    auto numPixels = rgb.size() / 3;
+    std::vector<uint32_t> res(numPixels);
+
+    for (size_t i = 0; i < numPixels; ++i) {
+        float r = static_cast<float>(rgb[i * 3 + 0]);
+        float g = static_cast<float>(rgb[i * 3 + 1]);
+        float b = static_cast<float>(rgb[i * 3 + 2]);
+
+        if constexpr (sizeof(T) == 1) {
+            r /= 255.f;
+            g /= 255.f;
+            b /= 255.f;
+        }
+
+        res[i] = DirectX::PackedVector::XMFLOAT3PK(r, g, b);
+    }
+
+    return res;
+}
+
+BOOST_AUTO_TEST_SUITE(Convert)
+
+BOOST_FIXTURE_TEST_CASE(convert_r11g11b10_8bit, SetupFixtureNull)
+{
+    // every value on every channel, with a size that leaves a scalar tail
+    std::vector<uint8_t> rgb((256 * 3 + 5) * 3);
+
+    for (size_t i = 0; i < rgb.size(); ++i)
+        rgb[i] = static_cast<uint8_t>((i / 3) + (i % 3) * 85);
+
+    std::vector<uint32_t> res(rgb.size() / 3);
+
+    ninniku::PackR11G11B10(rgb.data(), static_cast<uint32_t>(res.size()), res.data());
+
+    BOOST_REQUIRE(res == PackR11G11B10Reference(rgb));
+}
+
+BOOST_FIXTURE_TEST_CASE(convert_r11g11b10_16bit, SetupFixtureNull)
+{
+    // every value on every channel, including those above the largest 11 and 10 bits floats
+    std::vector<uint16_t> rgb((65536 + 7) * 3);
+
+    for (size_t i = 0; i < rgb.size(); ++i)
+        rgb[i] = static_cast<uint16_t>((i / 3) * ((i % 3) * 2 + 1));
+
+    std::vector<uint32_t> res(rgb.size() / 3);
+
+    ninniku::PackR11G11B10(rgb.data(), static_cast<uint32_t>(res.size()), res.data());
+
+    BOOST_REQUIRE(res == PackR11G11B10Reference(rgb));
+}
+
+// run with --run_test=Convert/convert_r11g11b10_benchmark
+BOOST_FIXTURE_TEST_CASE(convert_r11g11b10_benchmark, SetupFixtureNull, *boost::unit_test::disabled())
+{
+    constexpr uint32_t numPixels = 4096 * 4096;
+    constexpr uint32_t numRuns = 10;
+
+    std::vector<uint8_t> rgb(numPixels * 3);
+    std::mt19937 rng(1234);
+
+    for (auto& channel : rgb)
+        channel = static_cast<uint8_t>(rng());
+
+    std::vector<uint32_t> res(numPixels);
+    std::vector<uint32_t> ref;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < numRuns; ++i)
+        ref = PackR11G11B10Reference(rgb);
+
+    auto scalar = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / numRuns;
+
+    start = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < numRuns; ++i)
+        ninniku::PackR11G11B10(rgb.data(), numPixels, res.data());
+
+    auto packed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / numRuns;
+
+    BOOST_REQUIRE(res == ref);
+
+    BOOST_TEST_MESSAGE("XMFLOAT3PK: " << (numPixels / scalar) * 1e-6 << " MPixels/s");
+    BOOST_TEST_MESSAGE("PackR11G11B10: " << (numPixels / packed) * 1e-6 << " MPixels/s");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,584 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../common.h"
+#include "../fixture.h"
+#include "../shaders/cbuffers.h"
+#include "../shaders/dispatch.h"
+#include "../utils.h"
+
+#include <ninniku/core/renderer/command_graph.h>
+#include <ninniku/core/renderer/renderdevice.h>
+#include <ninniku/ninniku.h>
+#include <ninniku/stats.h>
+#include <ninniku/types.h>
+
+#include <cstring>
+#include <numeric>
+
+BOOST_AUTO_TEST_SUITE(CPU)
+
+BOOST_FIXTURE_TEST_CASE(cpu_copy_texture_subresource, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    BOOST_REQUIRE(dx->GetType() == ninniku::ERenderer::RENDERER_CPU);
+
+    constexpr uint32_t size = 64;
+
+    // initial data has a larger pitch than the texture to check that rows are repacked
+    constexpr uint32_t srcRowPitch = (size + 16) * sizeof(uint32_t);
+    std::vector<uint32_t> pixels(srcRowPitch / sizeof(uint32_t) * size);
+
+    std::iota(pixels.begin(), pixels.end(), 0);
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R8G8B8A8_UNORM;
+    param->width = param->height = size;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = 1;
+    param->viewflags = ninniku::RV_SRV;
+    param->imageDatas.push_back({ pixels.data(), srcRowPitch, srcRowPitch * size });
+
+    auto src = dx->CreateTexture(param);
+
+    BOOST_REQUIRE(src);
+
+    auto dstParam = param->Duplicate();
+    dstParam->viewflags = ninniku::RV_CPU_READ;
+    dstParam->imageDatas.clear();
+
+    auto dst = dx->CreateTexture(dstParam);
+
+    ninniku::CopyTextureSubresourceParam copyParams = {};
+
+    copyParams.src = src.get();
+    copyParams.dst = dst.get();
+
+    auto indexes = dx->CopyTextureSubresource(copyParams);
+    auto mapped = dx->Map(dst, std::get<1>(indexes));
+
+    BOOST_REQUIRE(mapped);
+
+    auto data = static_cast<const uint32_t*>(mapped->GetData());
+
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            BOOST_REQUIRE(data[y * size + x] == pixels[y * (srcRowPitch / sizeof(uint32_t)) + x]);
+        }
+    }
+
+    // out of range mip/face are rejected instead of indexing past the subresources
+    copyParams.srcMip = 1;
+    BOOST_REQUIRE(dx->CopyTextureSubresource(copyParams) == std::make_tuple(0u, 0u));
+
+    copyParams.srcMip = 0;
+    copyParams.dstFace = 1;
+    BOOST_REQUIRE(dx->CopyTextureSubresource(copyParams) == std::make_tuple(0u, 0u));
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_copy_buffer, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    auto param = ninniku::BufferParam::Create();
+    param->numElements = 256;
+    param->elementSize = sizeof(uint32_t);
+    param->viewflags = ninniku::RV_SRV | ninniku::RV_UAV;
+
+    auto src = dx->CreateBuffer(param);
+
+    BOOST_REQUIRE(src);
+
+    // buffers live in host memory so they can be written through Map
+    {
+        auto mapped = dx->Map(src);
+        auto data = static_cast<uint32_t*>(mapped->GetData());
+
+        std::iota(data, data + param->numElements, 0);
+    }
+
+    auto dst = dx->CreateBuffer(src);
+    auto data = dst->GetData();
+
+    BOOST_REQUIRE(std::get<1>(data) == param->numElements * param->elementSize);
+
+    auto values = reinterpret_cast<const uint32_t*>(std::get<0>(data));
+
+    for (uint32_t i = 0; i < param->numElements; ++i) {
+        BOOST_REQUIRE(values[i] == i);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_readback_texture, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    constexpr uint32_t size = 16;
+    constexpr uint32_t numMips = 5;
+    constexpr uint32_t arraySize = ninniku::CUBEMAP_NUM_FACES * 2;
+
+    // every texel tells where it comes from
+    std::vector<std::vector<uint32_t>> pixels(arraySize * numMips);
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R8G8B8A8_UNORM;
+    param->width = param->height = size;
+    param->depth = 1;
+    param->numMips = numMips;
+    param->arraySize = arraySize;
+    param->viewflags = ninniku::RV_SRV;
+
+    for (uint32_t face = 0; face < arraySize; ++face) {
+        for (uint32_t mip = 0; mip < numMips; ++mip) {
+            auto index = mip + face * numMips;
+            auto mipSize = size >> mip;
+            auto& sub = pixels[index];
+
+            sub.resize(mipSize * mipSize);
+            std::iota(sub.begin(), sub.end(), index << 16);
+
+            param->imageDatas.push_back({ sub.data(), mipSize * static_cast<uint32_t>(sizeof(uint32_t)), 0 });
+        }
+    }
+
+    auto tex = dx->CreateTexture(param);
+
+    BOOST_REQUIRE(tex);
+
+    // second cube only
+    ninniku::ReadbackTextureParam readbackParams = {};
+
+    readbackParams.src = tex.get();
+    readbackParams.firstFace = ninniku::CUBEMAP_NUM_FACES;
+    readbackParams.numFaces = ninniku::CUBEMAP_NUM_FACES;
+
+    auto readback = dx->ReadbackTexture(readbackParams);
+
+    BOOST_REQUIRE(readback);
+    BOOST_REQUIRE(readback->subresources.size() == ninniku::CUBEMAP_NUM_FACES * numMips);
+
+    for (auto& sub : readback->subresources) {
+        BOOST_REQUIRE(sub.face >= ninniku::CUBEMAP_NUM_FACES);
+        BOOST_REQUIRE(sub.face < arraySize);
+
+        auto mipSize = size >> sub.mip;
+        auto& ref = pixels[sub.mip + sub.face * numMips];
+
+        for (uint32_t y = 0; y < mipSize; ++y) {
+            auto row = reinterpret_cast<const uint32_t*>(sub.data + y * sub.rowPitch);
+
+            BOOST_REQUIRE(memcmp(row, &ref[y * mipSize], mipSize * sizeof(uint32_t)) == 0);
+        }
+    }
+
+    // out of range
+    readbackParams.firstFace = arraySize - 1;
+    readbackParams.numFaces = 2;
+
+    BOOST_REQUIRE(!dx->ReadbackTexture(readbackParams));
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_resource_stats, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    auto before = dx->GetResourceStats();
+
+    auto bufParam = ninniku::BufferParam::Create();
+    bufParam->numElements = 64;
+    bufParam->elementSize = sizeof(uint32_t);
+    bufParam->viewflags = ninniku::RV_SRV;
+
+    auto texParam = ninniku::TextureParam::Create();
+    texParam->format = ninniku::TF_R8G8B8A8_UNORM;
+    texParam->width = texParam->height = 16;
+    texParam->depth = 1;
+    texParam->numMips = 1;
+    texParam->arraySize = 1;
+    texParam->viewflags = ninniku::RV_SRV;
+
+    constexpr uint64_t bufSize = 64 * sizeof(uint32_t);
+    constexpr uint64_t texSize = 16 * 16 * 4;
+
+    {
+        auto buffer = dx->CreateBuffer(bufParam);
+        auto tex = dx->CreateTexture(texParam);
+
+        BOOST_REQUIRE(buffer && tex);
+
+        auto stats = dx->GetResourceStats();
+
+        BOOST_REQUIRE(stats.numLiveObjects == before.numLiveObjects + 2);
+        BOOST_REQUIRE(stats.liveBytes == before.liveBytes + bufSize + texSize);
+
+        // dropping a handle frees its object right away
+        buffer.reset();
+        stats = dx->GetResourceStats();
+
+        BOOST_REQUIRE(stats.numLiveObjects == before.numLiveObjects + 1);
+        BOOST_REQUIRE(stats.liveBytes == before.liveBytes + texSize);
+    }
+
+    auto after = dx->GetResourceStats();
+
+    BOOST_REQUIRE(after.numLiveObjects == before.numLiveObjects);
+    BOOST_REQUIRE(after.liveBytes == before.liveBytes);
+    BOOST_REQUIRE(after.numCreated == before.numCreated + 2);
+    BOOST_REQUIRE(after.numReleased == before.numReleased + 2);
+
+    // short lived textures do not pile up until Terminate
+    for (uint32_t i = 0; i < 64; ++i) {
+        auto tex = dx->CreateTexture(texParam);
+
+        BOOST_REQUIRE(tex);
+    }
+
+    BOOST_REQUIRE(dx->GetResourceStats().numLiveObjects == before.numLiveObjects);
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_kernel_dispatch, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    // same command building code as the DX renderers
+    auto res = GenerateColoredMips(dx, shaderRoot);
+    auto desc = res->GetDesc();
+
+    // first color of shaders/color20.hlsl for each mip
+    constexpr std::array<float, 4> mip0 = { 0, 1, 0, 1 };
+    constexpr std::array<float, 4> mip1 = { 0, 0, 1, 1 };
+
+    for (uint32_t face = 0; face < ninniku::CUBEMAP_NUM_FACES; ++face) {
+        for (uint32_t mip = 0; mip < 2; ++mip) {
+            auto mapped = dx->Map(res, mip + face * desc->numMips);
+            auto data = static_cast<const std::array<float, 4>*>(mapped->GetData());
+            auto numTexels = (desc->width >> mip) * (desc->height >> mip);
+            auto& expected = (mip == 0) ? mip0 : mip1;
+
+            BOOST_REQUIRE(data[0] == expected);
+            BOOST_REQUIRE(data[numTexels - 1] == expected);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_stats, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    auto before = ninniku::GetStats();
+
+    auto res = GenerateColoredMips(dx, shaderRoot);
+
+    BOOST_REQUIRE(dx->Map(res, 0));
+
+    auto after = ninniku::GetStats();
+    auto& dispatches = after.latencies[ninniku::SL_Dispatch];
+
+    BOOST_REQUIRE(after.counters[ninniku::SC_Dispatches] > before.counters[ninniku::SC_Dispatches]);
+    BOOST_REQUIRE(dispatches.count > before.latencies[ninniku::SL_Dispatch].count);
+    BOOST_REQUIRE(after.latencies[ninniku::SL_Map].count == before.latencies[ninniku::SL_Map].count + 1);
+    BOOST_REQUIRE(after.resources.numLiveObjects == dx->GetResourceStats().numLiveObjects);
+    BOOST_REQUIRE(dispatches.GetValueAtPercentile(50) <= dispatches.GetValueAtPercentile(99));
+    BOOST_REQUIRE(dispatches.GetValueAtPercentile(100) == dispatches.maxUs);
+
+    // every value falls between the lower bounds of its bucket and the next one
+    using Histogram = ninniku::LatencyHistogram;
+
+    for (uint64_t us = 0; us < 100000; us = us * 5 / 4 + 1) {
+        auto bucket = Histogram::GetBucket(us);
+
+        BOOST_REQUIRE(Histogram::GetBucketLowerBound(bucket) <= us);
+        BOOST_REQUIRE(Histogram::GetBucketLowerBound(bucket + 1) > us);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_dispatch_async, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R32G32B32A32_FLOAT;
+    param->width = param->height = 64;
+    param->depth = 1;
+    param->numMips = 2;
+    param->arraySize = ninniku::CUBEMAP_NUM_FACES;
+    param->viewflags = ninniku::RV_SRV | ninniku::RV_UAV;
+
+    auto tex = dx->CreateTexture(param);
+
+    // the same command and constant buffer are changed between submissions
+    auto cmd = dx->CreateCommand();
+    cmd->shader = "colorMips";
+    cmd->cbufferStr = "CBGlobal";
+
+    ninniku::FenceHandle fence;
+
+    for (uint32_t i = 0; i < param->numMips; ++i) {
+        cmd->dispatch = { (param->width >> i) / COLORMIPS_NUMTHREAD_X, (param->height >> i) / COLORMIPS_NUMTHREAD_Y, ninniku::CUBEMAP_NUM_FACES / COLORMIPS_NUMTHREAD_Z };
+        cmd->uavBindings.clear();
+        cmd->uavBindings.insert(std::make_pair("dstTex", tex->GetUAV(i)));
+
+        CBGlobal cb = {};
+
+        cb.targetMip = i;
+
+        BOOST_REQUIRE(dx->UpdateConstantBuffer(cmd->cbufferStr, &cb, sizeof(CBGlobal)));
+
+        fence = dx->DispatchAsync(cmd, fence);
+
+        BOOST_REQUIRE(fence);
+    }
+
+    BOOST_REQUIRE(fence->Wait());
+    BOOST_REQUIRE(fence->IsComplete());
+
+    // first color of shaders/color20.hlsl for each mip
+    constexpr std::array<float, 4> mip0 = { 0, 1, 0, 1 };
+    constexpr std::array<float, 4> mip1 = { 0, 0, 1, 1 };
+
+    for (uint32_t face = 0; face < ninniku::CUBEMAP_NUM_FACES; ++face) {
+        for (uint32_t mip = 0; mip < param->numMips; ++mip) {
+            auto mapped = dx->Map(tex, mip + face * param->numMips);
+            auto data = static_cast<const std::array<float, 4>*>(mapped->GetData());
+            auto numTexels = (param->width >> mip) * (param->height >> mip);
+            auto& expected = (mip == 0) ? mip0 : mip1;
+
+            BOOST_REQUIRE(data[0] == expected);
+            BOOST_REQUIRE(data[numTexels - 1] == expected);
+        }
+    }
+
+    // errors are reported when submitting
+    cmd->shader = "notRegistered";
+
+    BOOST_REQUIRE(!dx->DispatchAsync(cmd, nullptr));
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_dispatch_async_released, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R32G32B32A32_FLOAT;
+    param->width = param->height = 64;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = ninniku::CUBEMAP_NUM_FACES;
+    param->viewflags = ninniku::RV_SRV | ninniku::RV_UAV;
+
+    CBGlobal cb = {};
+
+    BOOST_REQUIRE(dx->UpdateConstantBuffer("CBGlobal", &cb, sizeof(CBGlobal)));
+
+    auto before = dx->GetResourceStats();
+    ninniku::FenceHandle fence;
+
+    // the handles are dropped before the queue gets to the dispatches so they must keep the textures alive
+    for (uint32_t i = 0; i < 16; ++i) {
+        auto tex = dx->CreateTexture(param);
+
+        auto cmd = dx->CreateCommand();
+        cmd->shader = "colorMips";
+        cmd->cbufferStr = "CBGlobal";
+        cmd->dispatch = { param->width / COLORMIPS_NUMTHREAD_X, param->height / COLORMIPS_NUMTHREAD_Y, ninniku::CUBEMAP_NUM_FACES / COLORMIPS_NUMTHREAD_Z };
+        cmd->uavBindings.insert(std::make_pair("dstTex", tex->GetUAV(0)));
+
+        fence = dx->DispatchAsync(cmd, fence);
+
+        BOOST_REQUIRE(fence);
+    }
+
+    BOOST_REQUIRE(fence->Wait());
+
+    // the tracker let go of them with the handles, the dispatches held the last references
+    BOOST_REQUIRE(dx->GetResourceStats().numLiveObjects == before.numLiveObjects);
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_copy_buffer_async, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    auto param = ninniku::BufferParam::Create();
+    param->numElements = 1024;
+    param->elementSize = sizeof(uint32_t);
+    param->viewflags = ninniku::RV_SRV;
+
+    std::array<ninniku::BufferHandle, 3> buffers;
+
+    for (auto& buffer : buffers) {
+        buffer = dx->CreateBuffer(param);
+
+        BOOST_REQUIRE(buffer);
+    }
+
+    {
+        auto mapped = dx->Map(buffers[0]);
+        auto data = static_cast<uint32_t*>(mapped->GetData());
+
+        std::iota(data, data + param->numElements, 0);
+    }
+
+    // the second copy reads what the first one wrote
+    ninniku::CopyBufferSubresourceParam first = {};
+
+    first.src = buffers[0].get();
+    first.dst = buffers[1].get();
+
+    auto fence = dx->CopyBufferResourceAsync(first, nullptr);
+
+    BOOST_REQUIRE(fence);
+
+    ninniku::CopyBufferSubresourceParam second = {};
+
+    second.src = buffers[1].get();
+    second.dst = buffers[2].get();
+
+    fence = dx->CopyBufferResourceAsync(second, fence);
+
+    BOOST_REQUIRE(fence);
+    BOOST_REQUIRE(fence->Wait());
+
+    auto values = reinterpret_cast<const uint32_t*>(std::get<0>(buffers[2]->GetData()));
+
+    for (uint32_t i = 0; i < param->numElements; ++i) {
+        BOOST_REQUIRE(values[i] == i);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_command_graph, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    BOOST_REQUIRE(LoadShader(dx, "colorMips", shaderRoot));
+
+    auto texParam = ninniku::TextureParam::Create();
+    texParam->format = ninniku::TF_R32G32B32A32_FLOAT;
+    texParam->width = texParam->height = 16;
+    texParam->depth = 1;
+    texParam->numMips = 1;
+    texParam->arraySize = ninniku::CUBEMAP_NUM_FACES;
+    texParam->viewflags = ninniku::RV_SRV | ninniku::RV_UAV;
+
+    std::array<ninniku::TextureHandle, 2> textures;
+
+    for (auto& tex : textures) {
+        tex = dx->CreateTexture(texParam);
+
+        BOOST_REQUIRE(tex);
+    }
+
+    auto bufParam = ninniku::BufferParam::Create();
+    bufParam->numElements = 256;
+    bufParam->elementSize = sizeof(uint32_t);
+    bufParam->viewflags = ninniku::RV_SRV;
+
+    auto src = dx->CreateBuffer(bufParam);
+    auto dst = dx->CreateBuffer(bufParam);
+
+    {
+        auto mapped = dx->Map(src);
+        auto data = static_cast<uint32_t*>(mapped->GetData());
+
+        std::iota(data, data + bufParam->numElements, 0);
+    }
+
+    CBGlobal cb = {};
+
+    BOOST_REQUIRE(dx->UpdateConstantBuffer("CBGlobal", &cb, sizeof(CBGlobal)));
+
+    ninniku::CommandGraph graph;
+
+    for (auto& tex : textures) {
+        auto cmd = dx->CreateCommand();
+        cmd->shader = "colorMips";
+        cmd->cbufferStr = "CBGlobal";
+        cmd->dispatch = { texParam->width / COLORMIPS_NUMTHREAD_X, texParam->height / COLORMIPS_NUMTHREAD_Y, ninniku::CUBEMAP_NUM_FACES / COLORMIPS_NUMTHREAD_Z };
+        cmd->uavBindings.insert(std::make_pair("dstTex", tex->GetUAV(0)));
+
+        graph.AddDispatch(std::move(cmd));
+    }
+
+    ninniku::CopyBufferSubresourceParam copyParams = {};
+
+    copyParams.src = src.get();
+    copyParams.dst = dst.get();
+
+    graph.AddCopy(copyParams);
+
+    auto fence = dx->Submit(graph, nullptr);
+
+    BOOST_REQUIRE(fence);
+    BOOST_REQUIRE(fence->Wait());
+
+    // first color of shaders/color20.hlsl for mip 0
+    constexpr std::array<float, 4> expected = { 0, 1, 0, 1 };
+
+    for (auto& tex : textures) {
+        for (uint32_t face = 0; face < ninniku::CUBEMAP_NUM_FACES; ++face) {
+            auto mapped = dx->Map(tex, face);
+            auto data = static_cast<const std::array<float, 4>*>(mapped->GetData());
+
+            BOOST_REQUIRE(data[0] == expected);
+            BOOST_REQUIRE(data[texParam->width * texParam->height - 1] == expected);
+        }
+    }
+
+    auto values = reinterpret_cast<const uint32_t*>(std::get<0>(dst->GetData()));
+
+    for (uint32_t i = 0; i < bufParam->numElements; ++i) {
+        BOOST_REQUIRE(values[i] == i);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cpu_kernel_unknown_binding, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R32G32B32A32_FLOAT;
+    param->width = param->height = 16;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = 1;
+    param->viewflags = ninniku::RV_UAV;
+
+    auto tex = dx->CreateTexture(param);
+    auto cmd = dx->CreateCommand();
+
+    cmd->shader = "colorMips";
+    cmd->dispatch = { 1, 1, 1 };
+    cmd->uavBindings.insert(std::make_pair("notDeclared", tex->GetUAV(0)));
+
+    BOOST_REQUIRE(!dx->Dispatch(cmd));
+
+    // unknown kernel
+    cmd->shader = "notRegistered";
+    cmd->uavBindings.clear();
+
+    BOOST_REQUIRE(!dx->Dispatch(cmd));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -31,9 +31,13 @@
 #include <ninniku/core/image/dds.h>
 #include <ninniku/core/image/generic.h>
 #include <ninniku/ninniku.h>
+#include <ninniku/stats.h>
 #include <ninniku/types.h>
 #include <ninniku/utils.h>
+#include <array>
+#include <cmath>
 #include <filesystem>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(Image)
 
@@ -170,6 +174,411 @@ BOOST_FIXTURE_TEST_CASE(cmft_texture_param, SetupFixtureNull)
     BOOST_REQUIRE(param->width == 512);
 }
 
+// horizontal strip of 6 faces filled with a single color
+static std::unique_ptr<ninniku::cmftImage> CreateConstantCubemap(const uint32_t faceSize, const std::array<float, 4>& color)
+{
+    auto image = std::make_unique<ninniku::cmftImage>();
+    std::vector<float> strip(faceSize * 6 * faceSize * 4);
+
+    for (size_t i = 0; i < strip.size(); i += 4)
+        memcpy(&strip[i], color.data(), sizeof(float) * 4);
+
+    BOOST_REQUIRE(image->LoadRaw(strip.data(), strip.size() * sizeof(float), faceSize * 6, faceSize, DXGI_FORMAT_R32G32B32A32_FLOAT));
+
+    return image;
+}
+
+static void CheckConstantCubemap(const ninniku::TextureParamHandle& param, const std::array<float, 4>& color, const float epsilon)
+{
+    for (uint32_t face = 0; face < param->arraySize; ++face) {
+        for (uint32_t mip = 0; mip < param->numMips; ++mip) {
+            auto& sub = param->imageDatas[mip + face * param->numMips];
+            auto size = std::max(1u, param->width >> mip);
+
+            BOOST_REQUIRE(sub.rowPitch == size * sizeof(float) * 4);
+
+            auto texels = static_cast<const float*>(sub.data);
+
+            for (uint32_t i = 0; i < size * size; ++i) {
+                for (uint32_t c = 0; c < 3; ++c)
+                    BOOST_REQUIRE(std::abs(texels[i * 4 + c] - color[c]) <= epsilon);
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_radiance_filter, SetupFixtureNull)
+{
+    const std::array<float, 4> color = { 0.25f, 0.5f, 1.f, 1.f };
+    auto image = CreateConstantCubemap(32, color);
+
+    ninniku::cmftImage::RadianceFilterParams params;
+
+    params.faceSize = 16;
+    params.numThreads = 3;
+
+    BOOST_REQUIRE(image->RadianceFilter(params));
+
+    auto param = image->CreateTextureParam(ninniku::RV_SRV);
+
+    BOOST_REQUIRE(param->arraySize == 6);
+    BOOST_REQUIRE(param->width == 16);
+    BOOST_REQUIRE(param->numMips == 5);
+    BOOST_REQUIRE(param->imageDatas.size() == 6 * 5);
+
+    // every lobe integrates to 1 so a constant environment must stay constant
+    CheckConstantCubemap(param, color, 1e-3f);
+
+    // faces are split between threads so the count must not change the result
+    auto ref = CreateConstantCubemap(32, color);
+
+    params.numThreads = 1;
+
+    BOOST_REQUIRE(ref->RadianceFilter(params));
+
+    auto data = image->GetData();
+    auto refData = ref->GetData();
+
+    BOOST_REQUIRE(std::get<1>(data) == std::get<1>(refData));
+    BOOST_REQUIRE(memcmp(std::get<0>(data), std::get<0>(refData), std::get<1>(refData)) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_irradiance_filter, SetupFixtureNull)
+{
+    const std::array<float, 4> color = { 0.25f, 0.5f, 1.f, 1.f };
+    auto image = CreateConstantCubemap(32, color);
+
+    BOOST_REQUIRE(image->IrradianceFilter(8));
+
+    auto param = image->CreateTextureParam(ninniku::RV_SRV);
+
+    BOOST_REQUIRE(param->width == 8);
+    BOOST_REQUIRE(param->numMips == 1);
+
+    CheckConstantCubemap(param, color, 1e-3f);
+}
+
+static void CheckReadbackCubeArray(ninniku::RenderDeviceHandle& dx)
+{
+    std::array<std::unique_ptr<ninniku::cmftImage>, 2> cubes = {
+        CreateConstantCubemap(16, { 0.25f, 0.5f, 1.f, 1.f }),
+        CreateConstantCubemap(16, { 1.f, 0.5f, 0.25f, 1.f })
+    };
+
+    // both cubes in the same array
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R32G32B32A32_FLOAT;
+    param->width = param->height = 16;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = ninniku::CUBEMAP_NUM_FACES * 2;
+    param->viewflags = ninniku::RV_SRV;
+
+    for (auto& cube : cubes) {
+        auto cubeParam = cube->CreateTextureParam(ninniku::RV_SRV);
+
+        param->imageDatas.insert(param->imageDatas.end(), cubeParam->imageDatas.begin(), cubeParam->imageDatas.end());
+    }
+
+    auto tex = dx->CreateTexture(param);
+
+    BOOST_REQUIRE(tex);
+
+    for (uint32_t cubeIndex = 0; cubeIndex < cubes.size(); ++cubeIndex) {
+        ninniku::cmftImage image;
+
+        BOOST_REQUIRE(image.InitializeFromTextureObject(dx, tex, cubeIndex));
+
+        auto data = image.GetData();
+        auto refData = cubes[cubeIndex]->GetData();
+
+        BOOST_REQUIRE(std::get<1>(data) == std::get<1>(refData));
+        BOOST_REQUIRE(memcmp(std::get<0>(data), std::get<0>(refData), std::get<1>(refData)) == 0);
+    }
+}
+
+// every texel stores (face, mip, x, y) so a wrong subresource offset or row pitch shows up,
+// the small mips are narrower than the 256 bytes D3D12 aligns readback rows to
+static void CheckReadbackCubeArrayMips(ninniku::RenderDeviceHandle& dx)
+{
+    constexpr uint32_t size = 16;
+    constexpr uint32_t numMips = 5;
+    constexpr uint32_t firstFace = ninniku::CUBEMAP_NUM_FACES;
+
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R32G32B32A32_FLOAT;
+    param->width = param->height = size;
+    param->depth = 1;
+    param->numMips = numMips;
+    param->arraySize = ninniku::CUBEMAP_NUM_FACES * 2;
+    param->viewflags = ninniku::RV_SRV;
+
+    std::vector<std::vector<float>> texels(param->arraySize * numMips);
+
+    for (uint32_t face = 0; face < param->arraySize; ++face) {
+        for (uint32_t mip = 0; mip < numMips; ++mip) {
+            auto mipSize = std::max(1u, size >> mip);
+            auto& sub = texels[mip + face * numMips];
+
+            sub.reserve(mipSize * mipSize * 4);
+
+            for (uint32_t y = 0; y < mipSize; ++y) {
+                for (uint32_t x = 0; x < mipSize; ++x)
+                    sub.insert(sub.end(), { static_cast<float>(face), static_cast<float>(mip), static_cast<float>(x), static_cast<float>(y) });
+            }
+
+            param->imageDatas.push_back({ sub.data(), mipSize * static_cast<uint32_t>(sizeof(float)) * 4, 0 });
+        }
+    }
+
+    auto tex = dx->CreateTexture(param);
+
+    BOOST_REQUIRE(tex);
+
+    ninniku::ReadbackTextureParam params;
+    params.src = tex.get();
+    params.firstFace = firstFace;
+    params.numFaces = ninniku::CUBEMAP_NUM_FACES;
+
+    auto readback = dx->ReadbackTexture(params);
+
+    BOOST_REQUIRE(readback);
+    BOOST_REQUIRE(readback->subresources.size() == params.numFaces * numMips);
+
+    // DX12 copies every subresource into a single readback buffer
+    if ((dx->GetType() & ninniku::ERenderer::RENDERER_DX12) != 0)
+        BOOST_REQUIRE(readback->mappings.size() == 1);
+
+    for (auto& sub : readback->subresources) {
+        BOOST_REQUIRE(sub.face >= firstFace);
+        BOOST_REQUIRE(sub.face < firstFace + params.numFaces);
+        BOOST_REQUIRE(sub.mip < numMips);
+
+        auto mipSize = std::max(1u, size >> sub.mip);
+
+        BOOST_REQUIRE(sub.rowPitch >= mipSize * sizeof(float) * 4);
+
+        for (uint32_t y = 0; y < mipSize; ++y) {
+            auto row = reinterpret_cast<const float*>(sub.data + y * sub.rowPitch);
+
+            for (uint32_t x = 0; x < mipSize; ++x) {
+                auto texel = row + x * 4;
+
+                BOOST_REQUIRE(texel[0] == static_cast<float>(sub.face));
+                BOOST_REQUIRE(texel[1] == static_cast<float>(sub.mip));
+                BOOST_REQUIRE(texel[2] == static_cast<float>(x));
+                BOOST_REQUIRE(texel[3] == static_cast<float>(y));
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_readback_cube_array, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    CheckReadbackCubeArray(dx);
+    CheckReadbackCubeArrayMips(dx);
+}
+
+// same as above through the single buffer GetCopyableFootprints layout, WARP runs it on CI
+BOOST_FIXTURE_TEST_CASE_TEMPLATE(cmft_readback_cube_array_dx12, T, FixturesDX12All, T)
+{
+    // Disable HW GPU support when running on CI
+    if (T::isNull)
+        return;
+
+    auto& dx = ninniku::GetRenderer();
+
+    CheckReadbackCubeArray(dx);
+    CheckReadbackCubeArrayMips(dx);
+}
+
+// uncompressed RGB float EXR, tileSize = 0 writes scanlines
+static std::vector<uint8_t> CreateEXR(const uint32_t width, const uint32_t height, const uint32_t tileSize, const std::vector<float>& rgba)
+{
+    std::vector<uint8_t> res;
+
+    auto write = [&](const void* data, const size_t size)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        res.insert(res.end(), bytes, bytes + size);
+    };
+
+    auto writeInt = [&](const int32_t value) { write(&value, sizeof(value)); };
+
+    auto writeAttribute = [&](const char* name, const char* type, const int32_t size)
+    {
+        write(name, strlen(name) + 1);
+        write(type, strlen(type) + 1);
+        writeInt(size);
+    };
+
+    // channels are sorted by name in the file
+    const std::array<const char*, 3> channels = { "B", "G", "R" };
+    const std::array<uint32_t, 3> components = { 2, 1, 0 };
+    const uint8_t zero[4] = {};
+    const float one = 1.f;
+
+    writeInt(20000630);
+    writeInt((tileSize > 0) ? 0x202 : 2);
+
+    writeAttribute("channels", "chlist", 18 * 3 + 1);
+
+    for (auto name : channels) {
+        write(name, 2);
+        writeInt(2);
+        write(zero, 4);
+        writeInt(1);
+        writeInt(1);
+    }
+
+    write(zero, 1);
+
+    writeAttribute("compression", "compression", 1);
+    write(zero, 1);
+
+    for (auto name : { "dataWindow", "displayWindow" }) {
+        writeAttribute(name, "box2i", 16);
+        writeInt(0);
+        writeInt(0);
+        writeInt(width - 1);
+        writeInt(height - 1);
+    }
+
+    writeAttribute("lineOrder", "lineOrder", 1);
+    write(zero, 1);
+    writeAttribute("pixelAspectRatio", "float", 4);
+    write(&one, 4);
+    writeAttribute("screenWindowCenter", "v2f", 8);
+    write(zero, 4);
+    write(zero, 4);
+    writeAttribute("screenWindowWidth", "float", 4);
+    write(&one, 4);
+
+    if (tileSize > 0) {
+        writeAttribute("tiles", "tiledesc", 9);
+        writeInt(tileSize);
+        writeInt(tileSize);
+        write(zero, 1);
+    }
+
+    write(zero, 1);
+
+    const uint32_t blockWidth = (tileSize > 0) ? tileSize : width;
+    const uint32_t blockHeight = (tileSize > 0) ? tileSize : 1;
+    const uint32_t numBlocksX = (width + blockWidth - 1) / blockWidth;
+    const uint32_t numBlocksY = (height + blockHeight - 1) / blockHeight;
+
+    auto tableOffset = res.size();
+
+    res.resize(res.size() + numBlocksX * numBlocksY * sizeof(uint64_t));
+
+    for (uint32_t by = 0; by < numBlocksY; ++by) {
+        for (uint32_t bx = 0; bx < numBlocksX; ++bx) {
+            uint64_t offset = res.size();
+
+            memcpy(&res[tableOffset + (bx + by * numBlocksX) * sizeof(uint64_t)], &offset, sizeof(uint64_t));
+
+            auto x0 = bx * blockWidth;
+            auto y0 = by * blockHeight;
+            auto w = std::min(blockWidth, width - x0);
+            auto h = std::min(blockHeight, height - y0);
+
+            if (tileSize > 0) {
+                writeInt(bx);
+                writeInt(by);
+                writeInt(0);
+                writeInt(0);
+            } else {
+                writeInt(y0);
+            }
+
+            writeInt(w * h * 3 * sizeof(float));
+
+            for (uint32_t y = y0; y < y0 + h; ++y) {
+                for (auto c : components) {
+                    for (uint32_t x = x0; x < x0 + w; ++x)
+                        write(&rgba[(x + y * width) * 4 + c], sizeof(float));
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+// smooth gradient so every bilinear tap matters
+static std::vector<float> CreateGradient(const uint32_t width, const uint32_t height)
+{
+    std::vector<float> res(width * height * 4);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            auto texel = &res[(x + y * width) * 4];
+
+            texel[0] = static_cast<float>(x) / width;
+            texel[1] = static_cast<float>(y) / height;
+            texel[2] = std::sin(x * 0.1f) * std::cos(y * 0.2f) + 1.f;
+            texel[3] = 1.f;
+        }
+    }
+
+    return res;
+}
+
+static void CheckSameImage(const ninniku::cmftImage& image, const ninniku::cmftImage& ref, const float epsilon)
+{
+    auto data = image.GetData();
+    auto refData = ref.GetData();
+
+    BOOST_REQUIRE(std::get<1>(data) == std::get<1>(refData));
+
+    auto texels = reinterpret_cast<const float*>(std::get<0>(data));
+    auto refTexels = reinterpret_cast<const float*>(std::get<0>(refData));
+
+    for (uint32_t i = 0; i < std::get<1>(refData) / sizeof(float); ++i)
+        BOOST_REQUIRE(std::abs(texels[i] - refTexels[i]) <= epsilon);
+}
+
+static void CheckStreamedEXR(const uint32_t width, const uint32_t height, const uint32_t tileSize)
+{
+    auto rgba = CreateGradient(width, height);
+    auto exr = CreateEXR(width, height, tileSize, rgba);
+
+    ninniku::cmftImage image;
+    ninniku::cmftImage ref;
+
+    BOOST_REQUIRE(image.LoadRaw(exr.data(), exr.size()));
+    BOOST_REQUIRE(ref.LoadRaw(rgba.data(), rgba.size() * sizeof(float), width, height, DXGI_FORMAT_R32G32B32A32_FLOAT));
+
+    auto param = image.CreateTextureParam(ninniku::RV_SRV);
+    auto refParam = ref.CreateTextureParam(ninniku::RV_SRV);
+
+    BOOST_REQUIRE(param->arraySize == 6);
+    BOOST_REQUIRE(param->width == refParam->width);
+
+    CheckSameImage(image, ref, 1e-5f);
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_load_exr_stream, SetupFixtureNull)
+{
+    // more rows than a single band
+    CheckStreamedEXR(512, 256, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_load_exr_stream_tiled, SetupFixtureNull)
+{
+    // partial tiles on both axis
+    CheckStreamedEXR(200, 100, 32);
+}
+
+BOOST_FIXTURE_TEST_CASE(cmft_load_exr_stream_fallback, SetupFixtureNull)
+{
+    // not a lat-long so the whole image is decoded then converted by cmft
+    CheckStreamedEXR(6 * 16, 16, 0);
+}
+
 BOOST_FIXTURE_TEST_CASE(cmft_saveImage_cubemap, SetupFixtureNull)
 {
     auto image = std::make_unique<ninniku::cmftImage>();
@@ -260,6 +669,49 @@ BOOST_FIXTURE_TEST_CASE(dds_load, SetupFixtureNull)
     CheckCRC(std::get<0>(data), std::get<1>(data), 2638212697);
 }
 
+BOOST_FIXTURE_TEST_CASE(dds_load_mapped, SetupFixtureNull)
+{
+    auto ref = std::make_unique<ninniku::ddsImage>();
+
+    BOOST_REQUIRE(ref->Load("data/Cathedral01.dds"));
+
+    // only DX10 headers can be mapped and SaveImage always writes one
+    std::string filename = "dds_load_mapped.dds";
+
+    BOOST_REQUIRE(ref->SaveImage(filename));
+
+    auto image = std::make_unique<ninniku::ddsImage>();
+    auto mappedBefore = ninniku::GetStats().counters[ninniku::SC_ImagesMapped];
+
+    BOOST_REQUIRE(image->LoadMapped(filename));
+
+    // a copying fallback would load the same data so check that the mapped path was taken
+    BOOST_REQUIRE(ninniku::GetStats().counters[ninniku::SC_ImagesMapped] == mappedBefore + 1);
+
+    auto& data = image->GetData();
+
+    CheckCRC(std::get<0>(data), std::get<1>(data), 2638212697);
+
+    // subresources must stay valid after the image is gone
+    auto param = image->CreateTextureParam(ninniku::RV_SRV);
+
+    BOOST_REQUIRE(param->imageDatasOwner != nullptr);
+
+    image.reset();
+
+    auto refParam = ref->CreateTextureParam(ninniku::RV_SRV);
+
+    BOOST_REQUIRE(param->imageDatas.size() == refParam->imageDatas.size());
+
+    for (size_t i = 0; i < param->imageDatas.size(); ++i) {
+        auto& sub = param->imageDatas[i];
+        auto& refSub = refParam->imageDatas[i];
+
+        BOOST_REQUIRE(sub.rowPitch == refSub.rowPitch);
+        BOOST_REQUIRE(memcmp(sub.data, refSub.data, refSub.depthPitch) == 0);
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(dds_need_resize, SetupFixtureNull)
 {
     auto image = std::make_unique<ninniku::ddsImage>();
@@ -843,6 +1295,323 @@ BOOST_FIXTURE_TEST_CASE_TEMPLATE(dds_saveImage_bc7, T, FixturesAll, T)
     }
 }
 
+// generated sources give the built-in encoder tests a known content whatever the data set
+static std::unique_ptr<ninniku::ddsImage> CreateGeneratedImage(ninniku::RenderDeviceHandle& dx, const ninniku::ETextureFormat format, const uint32_t size, void* pixels, const uint32_t texelSize)
+{
+    auto param = ninniku::TextureParam::Create();
+
+    param->format = format;
+    param->width = param->height = size;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = 1;
+    param->viewflags = ninniku::RV_SRV;
+    param->imageDatas.push_back({ pixels, size * texelSize, size * size * texelSize });
+
+    auto srcTex = dx->CreateTexture(param);
+    auto res = std::make_unique<ninniku::ddsImage>();
+
+    BOOST_REQUIRE(srcTex);
+    BOOST_REQUIRE(res->InitializeFromTextureObject(dx, srcTex));
+
+    return res;
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc3_quality, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    auto image = std::make_unique<ninniku::genericImage>();
+
+    BOOST_REQUIRE(image->Load("data/banner.png"));
+
+    auto srcTex = dx->CreateTexture(image->CreateTextureParam(ninniku::RV_SRV));
+    auto res = std::make_unique<ninniku::ddsImage>();
+
+    BOOST_REQUIRE(res->InitializeFromTextureObject(dx, srcTex));
+
+    const std::array<ninniku::EBCQuality, 3> qualities = { ninniku::EBCQuality::BCQ_Fast, ninniku::EBCQuality::BCQ_Normal, ninniku::EBCQuality::BCQ_High };
+    std::array<float, 3> rmse;
+
+    for (uint32_t i = 0; i < qualities.size(); ++i) {
+        ninniku::CompressDesc desc;
+        ninniku::CompressResult result;
+
+        desc.quality = qualities[i];
+
+        auto filename = "dds_saveImage_bc3_quality" + std::to_string(i) + ".dds";
+
+        BOOST_REQUIRE(res->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC3_UNORM, desc, &result));
+        BOOST_REQUIRE(std::filesystem::exists(filename));
+        BOOST_REQUIRE((result.rmse > 0.f) && (result.rmse < 0.1f));
+
+        rmse[i] = result.rmse;
+    }
+
+    // the principal axis should not do meaningfully worse than the bounding box
+    BOOST_REQUIRE(rmse[1] <= rmse[0] * 1.05f);
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc1_alpha, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    constexpr uint32_t size = 64;
+    std::vector<uint8_t> pixels(size * size * 4);
+
+    // alpha above the threshold everywhere, then 8x8 checker cells of black texels below it
+    for (uint32_t belowThreshold = 0; belowThreshold < 2; ++belowThreshold) {
+        auto isTransparent = [belowThreshold](uint32_t x, uint32_t y) { return (belowThreshold != 0) && ((((x / 8) + (y / 8)) & 1) != 0); };
+
+        for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) {
+                auto texel = &pixels[(y * size + x) * 4];
+                auto transparent = isTransparent(x, y);
+
+                texel[0] = transparent ? 0 : static_cast<uint8_t>(x * 4);
+                texel[1] = transparent ? 0 : static_cast<uint8_t>(y * 4);
+                texel[2] = transparent ? 0 : static_cast<uint8_t>((x + y) * 2);
+                texel[3] = transparent ? 40 : 200;
+            }
+        }
+
+        auto res = CreateGeneratedImage(dx, ninniku::TF_R8G8B8A8_UNORM, size, pixels.data(), 4);
+
+        for (auto quality : { ninniku::EBCQuality::BCQ_Fast, ninniku::EBCQuality::BCQ_Normal }) {
+            ninniku::CompressDesc desc;
+            ninniku::CompressResult result;
+
+            desc.quality = quality;
+
+            auto filename = "dds_saveImage_bc1_alpha" + std::to_string(belowThreshold) + "_" + std::to_string(static_cast<uint32_t>(quality)) + ".dds";
+
+            BOOST_REQUIRE(res->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC1_UNORM, desc, &result));
+            BOOST_REQUIRE(result.rmse < 0.03f);
+
+            // magic, DDS_HEADER and DDS_HEADER_DXT10 come before the blocks
+            constexpr size_t headerSize = 4 + 124 + 20;
+            constexpr uint32_t numBlocks = size / 4;
+            auto file = LoadFile(filename);
+
+            BOOST_REQUIRE(file.size() == headerSize + numBlocks * numBlocks * 8);
+
+            // a texel decodes as transparent only in the 3 colors mode with index 3
+            for (uint32_t by = 0; by < numBlocks; ++by) {
+                for (uint32_t bx = 0; bx < numBlocks; ++bx) {
+                    auto block = &file[headerSize + (by * numBlocks + bx) * 8];
+                    auto c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+                    auto c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+                    auto indices = static_cast<uint32_t>(block[4] | (block[5] << 8) | (block[6] << 16) | (block[7] << 24));
+
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        auto decodedTransparent = (c0 <= c1) && (((indices >> (2 * i)) & 3) == 3);
+
+                        BOOST_REQUIRE(decodedTransparent == isTransparent(bx * 4 + i % 4, by * 4 + i / 4));
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc4_bc5_quality, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    constexpr uint32_t size = 64;
+    std::vector<uint8_t> pixels(size * size * 4);
+
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            auto texel = &pixels[(y * size + x) * 4];
+
+            texel[0] = static_cast<uint8_t>(x * 4);
+            texel[1] = static_cast<uint8_t>(y * 4);
+            texel[2] = static_cast<uint8_t>((x + y) * 2);
+            texel[3] = 255;
+        }
+    }
+
+    auto res = CreateGeneratedImage(dx, ninniku::TF_R8G8B8A8_UNORM, size, pixels.data(), 4);
+
+    // the error only covers the 1 or 2 channels the format stores, blue and alpha are dropped
+    for (auto format : { DXGI_FORMAT_BC4_UNORM, DXGI_FORMAT_BC5_UNORM }) {
+        for (auto quality : { ninniku::EBCQuality::BCQ_Fast, ninniku::EBCQuality::BCQ_Normal }) {
+            ninniku::CompressDesc desc;
+            ninniku::CompressResult result;
+
+            desc.quality = quality;
+
+            auto filename = "dds_saveImage_bc4_bc5_quality" + std::to_string(static_cast<uint32_t>(format)) + "_" + std::to_string(static_cast<uint32_t>(quality)) + ".dds";
+
+            BOOST_REQUIRE(res->SaveCompressedImage(filename, dx, format, desc, &result));
+            BOOST_REQUIRE(std::filesystem::exists(filename));
+            BOOST_REQUIRE(result.rmse < 0.01f);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc6h_quality, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    // gradient up to 4 so the error has a known scale
+    constexpr uint32_t size = 64;
+    std::vector<float> pixels(size * size * 4);
+
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            auto value = (x + y) / 32.f;
+            auto texel = &pixels[(y * size + x) * 4];
+
+            texel[0] = value;
+            texel[1] = value * 0.5f;
+            texel[2] = value * 0.25f;
+            texel[3] = 1.f;
+        }
+    }
+
+    auto gradient = CreateGeneratedImage(dx, ninniku::TF_R32G32B32A32_FLOAT, size, pixels.data(), 4 * sizeof(float));
+
+    auto image = std::make_unique<ninniku::cmftImage>();
+
+    BOOST_REQUIRE(image->Load("data/whipple_creek_regional_park_01_2k.hdr"));
+
+    auto srcTex = dx->CreateTexture(image->CreateTextureParam(ninniku::RV_SRV));
+    auto panorama = std::make_unique<ninniku::ddsImage>();
+
+    BOOST_REQUIRE(panorama->InitializeFromTextureObject(dx, srcTex));
+
+    const std::array<ninniku::EBCQuality, 2> qualities = { ninniku::EBCQuality::BCQ_Fast, ninniku::EBCQuality::BCQ_Normal };
+    std::array<float, 2> rmse;
+
+    for (uint32_t i = 0; i < qualities.size(); ++i) {
+        ninniku::CompressDesc desc;
+        ninniku::CompressResult result;
+
+        desc.quality = qualities[i];
+
+        auto filename = "dds_saveImage_bc6h_quality_gradient" + std::to_string(i) + ".dds";
+
+        BOOST_REQUIRE(gradient->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC6H_UF16, desc, &result));
+        BOOST_REQUIRE(std::filesystem::exists(filename));
+        BOOST_REQUIRE((result.rmse > 0.f) && (result.rmse < 0.02f));
+
+        filename = "dds_saveImage_bc6h_quality" + std::to_string(i) + ".dds";
+
+        BOOST_REQUIRE(panorama->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC6H_UF16, desc, &result));
+        BOOST_REQUIRE(std::filesystem::exists(filename));
+        BOOST_REQUIRE((result.rmse > 0.f) && std::isfinite(result.rmse));
+
+        rmse[i] = result.rmse;
+    }
+
+    // the least squares refinement should not do meaningfully worse than the bounding box
+    BOOST_REQUIRE(rmse[1] <= rmse[0] * 1.05f);
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc7_modes, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    auto image = std::make_unique<ninniku::genericImage>();
+
+    BOOST_REQUIRE(image->Load("data/banner.png"));
+
+    auto srcTex = dx->CreateTexture(image->CreateTextureParam(ninniku::RV_SRV));
+    auto res = std::make_unique<ninniku::ddsImage>();
+
+    BOOST_REQUIRE(res->InitializeFromTextureObject(dx, srcTex));
+
+    struct Profile
+    {
+        uint8_t modeMask;
+        uint8_t partitionSearch;
+        float earlyOutError;
+    };
+
+    // every modes, mode 6 alone, the partitions search stopping as soon as a block is good enough, then the shallowest and deepest searches
+    const std::array<Profile, 5> profiles = { {
+        { ninniku::BC7_ALL_MODES, 16, 0.f },
+        { 1 << 6, 16, 0.f },
+        { ninniku::BC7_ALL_MODES, 16, 4.f },
+        { ninniku::BC7_ALL_MODES, 1, 0.f },
+        { ninniku::BC7_ALL_MODES, 64, 0.f }
+    } };
+    std::array<float, 5> rmse;
+
+    for (uint32_t i = 0; i < profiles.size(); ++i) {
+        ninniku::CompressDesc desc;
+        ninniku::CompressResult result;
+
+        desc.quality = ninniku::EBCQuality::BCQ_Normal;
+        desc.bc7ModeMask = profiles[i].modeMask;
+        desc.bc7PartitionSearch = profiles[i].partitionSearch;
+        desc.bc7EarlyOutError = profiles[i].earlyOutError;
+
+        auto filename = "dds_saveImage_bc7_modes" + std::to_string(i) + ".dds";
+
+        BOOST_REQUIRE(res->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC7_UNORM, desc, &result));
+        BOOST_REQUIRE(std::filesystem::exists(filename));
+        BOOST_REQUIRE((result.rmse > 0.f) && (result.rmse < 0.1f));
+
+        rmse[i] = result.rmse;
+    }
+
+    // mode 6 is always tried and a deeper search covers the partitions of a shallower one so neither can make things worse
+    BOOST_REQUIRE(rmse[0] <= rmse[1]);
+    BOOST_REQUIRE(rmse[0] <= rmse[2]);
+    BOOST_REQUIRE(rmse[0] <= rmse[3]);
+    BOOST_REQUIRE(rmse[4] <= rmse[0]);
+}
+
+BOOST_FIXTURE_TEST_CASE(dds_saveImage_bc7_mode1_only, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    constexpr uint32_t size = 64;
+    std::vector<uint8_t> pixels(size * size * 4);
+
+    // opaque, then with the same alpha everywhere
+    for (uint32_t hasAlpha = 0; hasAlpha < 2; ++hasAlpha) {
+        for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) {
+                auto texel = &pixels[(y * size + x) * 4];
+
+                texel[0] = static_cast<uint8_t>(x * 4);
+                texel[1] = static_cast<uint8_t>(y * 4);
+                texel[2] = static_cast<uint8_t>((x + y) * 2);
+                texel[3] = (hasAlpha != 0) ? 128 : 255;
+            }
+        }
+
+        auto res = CreateGeneratedImage(dx, ninniku::TF_R8G8B8A8_UNORM, size, pixels.data(), 4);
+
+        ninniku::CompressDesc desc;
+        ninniku::CompressResult result;
+
+        desc.quality = ninniku::EBCQuality::BCQ_Normal;
+        desc.bc7ModeMask = 1 << 1;
+
+        auto filename = "dds_saveImage_bc7_mode1_only" + std::to_string(hasAlpha) + ".dds";
+
+        BOOST_REQUIRE(res->SaveCompressedImage(filename, dx, DXGI_FORMAT_BC7_UNORM, desc, &result));
+
+        // mode 1 would lose the alpha so those blocks go to DirectXTex instead
+        BOOST_REQUIRE(result.rmse < 0.05f);
+
+        if (hasAlpha != 0)
+            continue;
+
+        // magic, DDS_HEADER and DDS_HEADER_DXT10 come before the blocks
+        constexpr size_t headerSize = 4 + 124 + 20;
+        constexpr uint32_t numBlocks = size / 4;
+        auto file = LoadFile(filename);
+
+        BOOST_REQUIRE(file.size() == headerSize + numBlocks * numBlocks * 16);
+
+        // the mode is the position of the lowest bit set, 0b10 for mode 1
+        for (uint32_t i = 0; i < numBlocks * numBlocks; ++i) {
+            BOOST_REQUIRE((file[headerSize + i * 16] & 0x3) == 0x2);
+        }
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(generic_load, SetupFixtureNull)
 {
     auto image = std::make_unique<ninniku::genericImage>();
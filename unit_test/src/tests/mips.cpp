@@ -0,0 +1,303 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../fixture.h"
+
+#include <ninniku/core/image/mips.h>
+
+#include <DirectXPackedVector.h>
+#include <cmath>
+#include <cstring>
+
+// a slice by slice copy of the whole mip chain, mip 0 is filled with a pattern
+template<typename T>
+struct MipChain
+{
+    MipChain(uint32_t format, uint32_t width, uint32_t height, uint32_t arraySize, uint32_t numChannels)
+    {
+        param = ninniku::TextureParam::Create();
+        param->format = format;
+        param->width = width;
+        param->height = height;
+        param->depth = 1;
+        param->arraySize = arraySize;
+        param->numMips = 1;
+
+        while ((std::max(width, height) >> param->numMips) > 0)
+            ++param->numMips;
+
+        channels = numChannels;
+        levels.resize(arraySize * param->numMips);
+        param->imageDatas.resize(levels.size());
+
+        for (uint32_t slice = 0; slice < arraySize; ++slice) {
+            for (uint32_t mip = 0; mip < param->numMips; ++mip) {
+                auto index = mip + slice * param->numMips;
+                auto w = std::max(1u, width >> mip);
+                auto h = std::max(1u, height >> mip);
+
+                levels[index].resize(w * h * channels);
+
+                if (mip == 0) {
+                    // integers use their whole range to catch overflows in the sums
+                    for (uint32_t i = 0; i < levels[index].size(); ++i) {
+                        auto hash = (i + slice * 131) * 2654435761u;
+
+                        if constexpr (std::is_floating_point_v<T>)
+                            levels[index][i] = static_cast<T>(hash >> 8) / static_cast<T>(1 << 24);
+                        else
+                            levels[index][i] = static_cast<T>(hash >> 16);
+                    }
+                }
+
+                param->imageDatas[index].data = levels[index].data();
+                param->imageDatas[index].rowPitch = static_cast<uint32_t>(w * channels * sizeof(T));
+                param->imageDatas[index].depthPitch = 0;
+            }
+        }
+    }
+
+    // straightforward 2x2 box filter, rows and columns past the edge are clamped
+    void CheckAgainstReference() const
+    {
+        auto isFloat = std::is_floating_point_v<T>;
+
+        for (uint32_t slice = 0; slice < param->arraySize; ++slice) {
+            std::vector<T> src = levels[slice * param->numMips];
+
+            for (uint32_t mip = 1; mip < param->numMips; ++mip) {
+                auto srcW = std::max(1u, param->width >> (mip - 1));
+                auto srcH = std::max(1u, param->height >> (mip - 1));
+                auto w = std::max(1u, param->width >> mip);
+                auto h = std::max(1u, param->height >> mip);
+                std::vector<T> ref(w * h * channels);
+
+                for (uint32_t y = 0; y < h; ++y) {
+                    for (uint32_t x = 0; x < w; ++x) {
+                        for (uint32_t c = 0; c < channels; ++c) {
+                            auto x0 = x * 2;
+                            auto x1 = std::min(x * 2 + 1, srcW - 1);
+                            auto y0 = y * 2;
+                            auto y1 = std::min(y * 2 + 1, srcH - 1);
+                            double sum = static_cast<double>(src[(y0 * srcW + x0) * channels + c]) + src[(y0 * srcW + x1) * channels + c] + src[(y1 * srcW + x0) * channels + c] + src[(y1 * srcW + x1) * channels + c];
+
+                            ref[(y * w + x) * channels + c] = isFloat ? static_cast<T>(sum * 0.25) : static_cast<T>((static_cast<uint32_t>(sum) + 2) >> 2);
+                        }
+                    }
+                }
+
+                auto& res = levels[mip + slice * param->numMips];
+
+                for (uint32_t i = 0; i < ref.size(); ++i) {
+                    if (isFloat)
+                        BOOST_REQUIRE_SMALL(std::abs(static_cast<double>(res[i]) - ref[i]), 1e-4);
+                    else
+                        BOOST_REQUIRE_EQUAL(res[i], ref[i]);
+                }
+
+                src = std::move(ref);
+            }
+        }
+    }
+
+    // packed formats are filtered as floats, decode(value, float*) unpacks ValueChannels floats and encode(const float*) packs them back
+    template<uint32_t ValueChannels, typename Decode, typename Encode>
+    void CheckPackedAgainstReference(Decode decode, Encode encode, double tolerance) const
+    {
+        auto unpack = [&decode](const std::vector<T>& values)
+        {
+            std::vector<float> res(values.size() * ValueChannels);
+
+            for (size_t i = 0; i < values.size(); ++i)
+                decode(values[i], &res[i * ValueChannels]);
+
+            return res;
+        };
+
+        for (uint32_t slice = 0; slice < param->arraySize; ++slice) {
+            std::vector<T> src = levels[slice * param->numMips];
+
+            for (uint32_t mip = 1; mip < param->numMips; ++mip) {
+                auto srcW = std::max(1u, param->width >> (mip - 1));
+                auto srcH = std::max(1u, param->height >> (mip - 1));
+                auto w = std::max(1u, param->width >> mip);
+                auto h = std::max(1u, param->height >> mip);
+                auto srcFloats = unpack(src);
+                std::vector<T> ref(w * h * channels);
+
+                for (uint32_t y = 0; y < h; ++y) {
+                    for (uint32_t x = 0; x < w; ++x) {
+                        for (uint32_t c = 0; c < channels; ++c) {
+                            auto x0 = x * 2;
+                            auto x1 = std::min(x * 2 + 1, srcW - 1);
+                            auto y0 = y * 2;
+                            auto y1 = std::min(y * 2 + 1, srcH - 1);
+                            float values[ValueChannels];
+
+                            for (uint32_t k = 0; k < ValueChannels; ++k) {
+                                auto at = [&](uint32_t sx, uint32_t sy) { return static_cast<double>(srcFloats[((sy * srcW + sx) * channels + c) * ValueChannels + k]); };
+
+                                values[k] = static_cast<float>((at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1)) * 0.25);
+                            }
+
+                            ref[(y * w + x) * channels + c] = encode(values);
+                        }
+                    }
+                }
+
+                // conversions may round the last bit differently
+                auto resFloats = unpack(levels[mip + slice * param->numMips]);
+                auto refFloats = unpack(ref);
+
+                for (uint32_t i = 0; i < refFloats.size(); ++i)
+                    BOOST_REQUIRE_SMALL(std::abs(static_cast<double>(resFloats[i]) - refFloats[i]), tolerance * std::max(1.0, std::abs(static_cast<double>(refFloats[i]))));
+
+                src = std::move(ref);
+            }
+        }
+    }
+
+    std::shared_ptr<ninniku::TextureParam> param;
+    std::vector<std::vector<T>> levels;
+    uint32_t channels;
+};
+
+BOOST_AUTO_TEST_SUITE(Mips)
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_unorm8, SetupFixtureNull)
+{
+    MipChain<uint8_t> rgba(ninniku::TF_R8G8B8A8_UNORM, 256, 256, ninniku::CUBEMAP_NUM_FACES, 4);
+    BOOST_REQUIRE(ninniku::GenerateMips(*rgba.param));
+    rgba.CheckAgainstReference();
+
+    // non power of 2 sizes go through the clamped edges and the scalar tails
+    MipChain<uint8_t> rg(ninniku::TF_R8G8_UNORM, 45, 19, 2, 2);
+    BOOST_REQUIRE(ninniku::GenerateMips(*rg.param));
+    rg.CheckAgainstReference();
+
+    MipChain<uint8_t> r(ninniku::TF_R8_UNORM, 7, 130, 1, 1);
+    BOOST_REQUIRE(ninniku::GenerateMips(*r.param));
+    r.CheckAgainstReference();
+}
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_unorm16, SetupFixtureNull)
+{
+    MipChain<uint16_t> rgba(ninniku::TF_R16G16B16A16_UNORM, 33, 64, 3, 4);
+    BOOST_REQUIRE(ninniku::GenerateMips(*rgba.param));
+    rgba.CheckAgainstReference();
+
+    MipChain<uint16_t> rg(ninniku::TF_R16G16_UNORM, 128, 5, 1, 2);
+    BOOST_REQUIRE(ninniku::GenerateMips(*rg.param));
+    rg.CheckAgainstReference();
+
+    MipChain<uint16_t> r(ninniku::TF_R16_UNORM, 100, 100, 1, 1);
+    BOOST_REQUIRE(ninniku::GenerateMips(*r.param));
+    r.CheckAgainstReference();
+}
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_float, SetupFixtureNull)
+{
+    MipChain<float> rgba(ninniku::TF_R32G32B32A32_FLOAT, 512, 512, ninniku::CUBEMAP_NUM_FACES, 4);
+    BOOST_REQUIRE(ninniku::GenerateMips(*rgba.param));
+    rgba.CheckAgainstReference();
+
+    MipChain<float> r(ninniku::TF_R32_FLOAT, 77, 31, 2, 1);
+    BOOST_REQUIRE(ninniku::GenerateMips(*r.param));
+    r.CheckAgainstReference();
+}
+
+// finite positive values up to 4, the raw bits of the integer pattern could be NaN or infinity
+static float GetPackedPattern(uint32_t i)
+{
+    return static_cast<float>((i * 2654435761u) >> 8) / static_cast<float>(1 << 22);
+}
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_half4, SetupFixtureNull)
+{
+    using namespace DirectX::PackedVector;
+
+    MipChain<HALF> rgba(ninniku::TF_R16G16B16A16_FLOAT, 67, 40, 2, 4);
+
+    for (uint32_t slice = 0; slice < rgba.param->arraySize; ++slice) {
+        auto& level = rgba.levels[slice * rgba.param->numMips];
+
+        for (uint32_t i = 0; i < level.size(); ++i)
+            level[i] = XMConvertFloatToHalf(GetPackedPattern(i + slice * 131));
+    }
+
+    BOOST_REQUIRE(ninniku::GenerateMips(*rgba.param));
+
+    // half has 11 bits of precision
+    rgba.CheckPackedAgainstReference<1>([](HALF value, float* res) { *res = XMConvertHalfToFloat(value); }, [](const float* values) { return XMConvertFloatToHalf(values[0]); }, 1.0 / 1024);
+}
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_r11g11b10, SetupFixtureNull)
+{
+    using namespace DirectX;
+    using namespace DirectX::PackedVector;
+
+    MipChain<uint32_t> rgb(ninniku::TF_R11G11B10_FLOAT, 129, 33, 1, 1);
+    auto& level = rgb.levels.front();
+
+    for (uint32_t i = 0; i < level.size(); ++i)
+        level[i] = XMFLOAT3PK(GetPackedPattern(i * 3), GetPackedPattern(i * 3 + 1), GetPackedPattern(i * 3 + 2));
+
+    BOOST_REQUIRE(ninniku::GenerateMips(*rgb.param));
+
+    auto decode = [](uint32_t value, float* res)
+    {
+        XMFLOAT3PK packed{ value };
+        XMFLOAT3 unpacked;
+
+        XMStoreFloat3(&unpacked, XMLoadFloat3PK(&packed));
+
+        res[0] = unpacked.x;
+        res[1] = unpacked.y;
+        res[2] = unpacked.z;
+    };
+
+    // blue only has 6 bits of precision
+    rgb.CheckPackedAgainstReference<3>(decode, [](const float* values) { return static_cast<uint32_t>(XMFLOAT3PK(values[0], values[1], values[2])); }, 1.0 / 32);
+}
+
+BOOST_FIXTURE_TEST_CASE(mips_generate_invalid, SetupFixtureNull)
+{
+    MipChain<uint8_t> chain(ninniku::TF_R8G8B8A8_UNORM, 16, 16, 1, 4);
+
+    // missing subresources
+    auto param = chain.param->Duplicate();
+    param->imageDatas.pop_back();
+    BOOST_REQUIRE(!ninniku::GenerateMips(*param));
+
+    // too many mips for the size
+    param = chain.param->Duplicate();
+    param->numMips = 6;
+    param->imageDatas.resize(6, param->imageDatas.back());
+    BOOST_REQUIRE(!ninniku::GenerateMips(*param));
+
+    // Texture3D
+    param = chain.param->Duplicate();
+    param->depth = 4;
+    BOOST_REQUIRE(!ninniku::GenerateMips(*param));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
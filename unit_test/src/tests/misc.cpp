@@ -23,9 +23,15 @@
 #include "../fixture.h"
 
 #include <ninniku/core/renderer/renderdevice.h>
+#include <ninniku/core/renderer/types.h>
 
 #include <ninniku/ninniku.h>
 
+#include <utils/string_map.h>
+
+#include <algorithm>
+#include <string>
+
 BOOST_AUTO_TEST_SUITE(Misc)
 
 BOOST_FIXTURE_TEST_CASE_TEMPLATE(misc_dx12_check_feature, T, FixturesDX12, T)
@@ -40,4 +46,129 @@ BOOST_FIXTURE_TEST_CASE_TEMPLATE(misc_dx12_check_feature, T, FixturesDX12, T)
     BOOST_REQUIRE(dx->CheckFeatureSupport(ninniku::EDeviceFeature::DF_SM6_WAVE_INTRINSICS));
 }
 
+BOOST_AUTO_TEST_CASE(misc_binding_table)
+{
+    // only the addresses are used
+    ninniku::ShaderResourceView srvA;
+    ninniku::ShaderResourceView srvB;
+
+    ninniku::BindingTable<ninniku::ShaderResourceView> forward;
+    ninniku::BindingTable<ninniku::ShaderResourceView> backward;
+
+    BOOST_REQUIRE(forward.insert({ "srcTex", &srvA }).second);
+    BOOST_REQUIRE(forward.insert({ "srcMip", &srvB }).second);
+    BOOST_REQUIRE(backward.insert({ "srcMip", &srvB }).second);
+    BOOST_REQUIRE(backward.insert({ "srcTex", &srvA }).second);
+
+    // sorted by name whatever the insertion order
+    BOOST_REQUIRE(forward.size() == 2);
+    BOOST_REQUIRE(forward.begin()->first == "srcMip");
+    BOOST_REQUIRE(forward.GetHash() == backward.GetHash());
+
+    // an existing binding is left untouched by insert but not by operator[]
+    BOOST_REQUIRE(!forward.insert({ "srcTex", &srvB }).second);
+    BOOST_REQUIRE(forward.find("srcTex")->second == &srvA);
+
+    forward["srcTex"] = &srvB;
+
+    BOOST_REQUIRE(forward.find("srcTex")->second == &srvB);
+    BOOST_REQUIRE(forward.GetHash() != backward.GetHash());
+    BOOST_REQUIRE(forward.find("dstTex") == forward.end());
+
+    forward.clear();
+
+    BOOST_REQUIRE(forward.empty());
+
+    // past the inline capacity the bindings move to the heap and stay sorted
+    backward.clear();
+
+    constexpr std::string_view names = "zyxwvutsrqponmlkjihgfedcba";
+
+    for (uint32_t i = 0; i < names.size(); ++i) {
+        BOOST_REQUIRE(forward.insert({ names.substr(i, 1), &srvA }).second);
+        BOOST_REQUIRE(backward.insert({ names.substr(names.size() - 1 - i, 1), &srvA }).second);
+    }
+
+    BOOST_REQUIRE(names.size() > ninniku::BindingTable<ninniku::ShaderResourceView>::CAPACITY);
+    BOOST_REQUIRE(forward.size() == names.size());
+    BOOST_REQUIRE(std::is_sorted(forward.begin(), forward.end()));
+    BOOST_REQUIRE(forward.find("a")->second == &srvA);
+    BOOST_REQUIRE(forward.GetHash() == backward.GetHash());
+
+    forward["a"] = &srvB;
+
+    BOOST_REQUIRE(forward.find("a")->second == &srvB);
+
+    forward.clear();
+
+    BOOST_REQUIRE(forward.empty());
+    BOOST_REQUIRE(forward.insert({ "srcTex", &srvA }).second);
+    BOOST_REQUIRE(forward.begin()->first == "srcTex");
+}
+
+BOOST_AUTO_TEST_CASE(misc_string_map)
+{
+    ninniku::StringMap<uint32_t> map;
+
+    BOOST_REQUIRE(map.empty());
+    BOOST_REQUIRE(map.find("missing") == map.end());
+
+    // enough keys to rehash several times and collide in the probing
+    constexpr uint32_t count = 1000;
+
+    for (uint32_t i = 0; i < count; ++i)
+        map.emplace("key" + std::to_string(i), i);
+
+    BOOST_REQUIRE(map.size() == count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        auto found = map.find("key" + std::to_string(i));
+
+        BOOST_REQUIRE(found != map.end());
+        BOOST_REQUIRE(found->second == i);
+    }
+
+    BOOST_REQUIRE(map.find("key") == map.end());
+    BOOST_REQUIRE(map.find("key1000") == map.end());
+
+    // an existing value is left untouched by emplace but not by operator[]
+    map.emplace("key0", 42u);
+    map.emplace(std::string_view{ "key1" }, 42u);
+
+    BOOST_REQUIRE(map.size() == count);
+    BOOST_REQUIRE(map.find("key0")->second == 0);
+    BOOST_REQUIRE(map.find("key1")->second == 1);
+
+    map["key0"] = 42;
+
+    BOOST_REQUIRE(map.size() == count);
+    BOOST_REQUIRE(map.find("key0")->second == 42);
+
+    // operator[] inserts a default value and iteration follows insertion order
+    map.clear();
+
+    BOOST_REQUIRE(map.empty());
+    BOOST_REQUIRE(map.find("key0") == map.end());
+
+    constexpr std::string_view names = "zyxwvutsrqponmlkjihgfedcba";
+
+    for (uint32_t i = 0; i < names.size(); ++i) {
+        BOOST_REQUIRE(map[names.substr(i, 1)] == 0);
+
+        map[names.substr(i, 1)] = i + 1;
+    }
+
+    BOOST_REQUIRE(map.size() == names.size());
+
+    uint32_t index = 0;
+
+    for (auto& entry : map) {
+        BOOST_REQUIRE(entry.first == names.substr(index, 1));
+        BOOST_REQUIRE(entry.second == index + 1);
+        ++index;
+    }
+
+    BOOST_REQUIRE(index == names.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,137 @@
+// Copyright(c) 2018-2020 Kitti Vongsay
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "../fixture.h"
+
+#include <ninniku/core/renderer/renderdevice.h>
+#include <ninniku/core/renderer/resource_pool.h>
+#include <ninniku/types.h>
+
+BOOST_AUTO_TEST_SUITE(ResourcePool)
+
+static ninniku::TextureParamHandle CreatePoolTextureParam(uint32_t size)
+{
+    auto param = ninniku::TextureParam::Create();
+    param->format = ninniku::TF_R8G8B8A8_UNORM;
+    param->width = param->height = size;
+    param->depth = 1;
+    param->numMips = 1;
+    param->arraySize = 1;
+    param->viewflags = ninniku::RV_SRV | ninniku::RV_UAV;
+
+    return param;
+}
+
+BOOST_FIXTURE_TEST_CASE(resource_pool_reuse, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+    ninniku::ResourcePool pool{ dx };
+
+    auto param = CreatePoolTextureParam(16);
+    auto tex = pool.AcquireTexture(param);
+
+    BOOST_REQUIRE(tex);
+
+    auto recycled = tex.get();
+
+    pool.Release(std::move(tex));
+
+    BOOST_REQUIRE(pool.GetStats().numPooled == 1);
+
+    // a different size cannot use it
+    auto other = pool.AcquireTexture(CreatePoolTextureParam(32));
+
+    BOOST_REQUIRE(other);
+    BOOST_REQUIRE(other.get() != recycled);
+
+    // same description gets the released texture back
+    auto same = pool.AcquireTexture(CreatePoolTextureParam(16));
+
+    BOOST_REQUIRE(same.get() == recycled);
+
+    auto stats = pool.GetStats();
+
+    BOOST_REQUIRE(stats.hits == 1);
+    BOOST_REQUIRE(stats.misses == 2);
+    BOOST_REQUIRE(stats.numPooled == 0);
+    BOOST_REQUIRE(stats.pooledBytes == 0);
+
+    // buffers are pooled too
+    auto bufParam = ninniku::BufferParam::Create();
+    bufParam->numElements = 64;
+    bufParam->elementSize = sizeof(uint32_t);
+    bufParam->viewflags = ninniku::RV_SRV;
+
+    auto buffer = pool.AcquireBuffer(bufParam);
+    auto recycledBuffer = buffer.get();
+
+    pool.Release(std::move(buffer));
+
+    BOOST_REQUIRE(pool.AcquireBuffer(bufParam).get() == recycledBuffer);
+}
+
+BOOST_FIXTURE_TEST_CASE(resource_pool_budget, SetupFixtureCPU)
+{
+    auto& dx = ninniku::GetRenderer();
+
+    constexpr uint64_t texSize = 16 * 16 * 4;
+
+    ninniku::ResourcePoolDesc desc;
+    desc.budget = texSize * 2;
+
+    ninniku::ResourcePool pool{ dx, desc };
+
+    auto numLiveObjects = dx->GetResourceStats().numLiveObjects;
+    auto param = CreatePoolTextureParam(16);
+    std::vector<ninniku::TextureHandle> textures;
+    std::vector<const ninniku::TextureObject*> released;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        textures.emplace_back(pool.AcquireTexture(param));
+        released.push_back(textures.back().get());
+    }
+
+    for (auto& tex : textures) {
+        pool.Release(std::move(tex));
+    }
+
+    // the least recently released one was freed
+    auto stats = pool.GetStats();
+
+    BOOST_REQUIRE(stats.evictions == 1);
+    BOOST_REQUIRE(stats.numPooled == 2);
+    BOOST_REQUIRE(stats.pooledBytes == texSize * 2);
+    BOOST_REQUIRE(dx->GetResourceStats().numLiveObjects == numLiveObjects + 2);
+
+    auto first = pool.AcquireTexture(param);
+    auto second = pool.AcquireTexture(param);
+
+    BOOST_REQUIRE((first.get() == released[1]) || (first.get() == released[2]));
+    BOOST_REQUIRE((second.get() == released[1]) || (second.get() == released[2]));
+    BOOST_REQUIRE(pool.GetStats().hits == 2);
+
+    pool.Clear();
+
+    BOOST_REQUIRE(pool.GetStats().numPooled == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()